@@ -138,7 +138,7 @@ Mat loadPFM(const string filePath)
  * @brief savePFM
  * @param image
  * @param filePath
- * @return
+ * @return false if the file could not be written.
  */
 bool savePFM(const cv::Mat image, const std::string filePath)
 {
@@ -211,12 +211,10 @@ bool savePFM(const cv::Mat image, const std::string filePath)
         delete[] buffer;
 
         imageFile.close();
-    }
-    else
-    {
-        cerr << "Could not open the file : " << filePath << endl;
-        return false;
+
+        //The errors are reported by the caller (output writer)
+        return !imageFile.fail();
     }
 
-    return true;
+    return false;
 }
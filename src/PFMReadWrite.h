@@ -59,7 +59,7 @@ cv::Mat loadPFM(const std::string filePath);
  * @brief savePFM
  * @param image
  * @param filePath
- * @return
+ * @return false if the file could not be written.
  */
 bool savePFM(const cv::Mat image, const std::string filePath);
 
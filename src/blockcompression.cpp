@@ -0,0 +1,842 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file blockcompression.cpp
+ * \brief Implementation of the block compression of the reflectance maps for the GPUs.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the block compression of the reflectance maps for the GPUs.
+ */
+
+#include "blockcompression.h"
+#include "outputwriter.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cfloat>
+#include <mutex>
+
+using namespace std;
+using namespace cv;
+
+//DDS file
+#define DDS_MAGIC 0x20534444
+#define DDS_HEADER_SIZE 124
+#define DDS_PIXEL_FORMAT_SIZE 32
+#define DDS_FLAGS 0xA1007           //CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+#define DDS_FOURCC 0x4
+#define DDS_FOURCC_DX10 0x30315844  //"DX10"
+#define DDS_CAPS 0x401008           //COMPLEX | TEXTURE | MIPMAP
+#define DDS_TEXTURE_2D 3
+
+//DXGI formats
+#define DXGI_FORMAT_BC1_UNORM_SRGB 72
+#define DXGI_FORMAT_BC4_UNORM 80
+#define DXGI_FORMAT_BC5_UNORM 83
+
+//Size of the sRGB encoding table
+#define SRGB_TABLE_SIZE 4096
+
+static CompressionQuality currentCompressionQuality = FAST_COMPRESSION;
+
+/**
+ * Sets the quality of the compressed textures saved with the maps (NO_COMPRESSION to only save the PFM and BMP files).
+ * @brief setCompressionQuality
+ * @param quality
+ */
+void setCompressionQuality(CompressionQuality quality)
+{
+    currentCompressionQuality = quality;
+}
+
+/**
+ * Returns the quality of the compressed textures saved with the maps (FAST_COMPRESSION by default).
+ * @brief compressionQuality
+ * @return
+ */
+CompressionQuality compressionQuality()
+{
+    return currentCompressionQuality;
+}
+
+/**
+ * Parses a quality : none, fast or high.
+ * @brief parseCompressionQuality
+ * @param text
+ * @param quality
+ * @return false if the text is not a quality.
+ */
+bool parseCompressionQuality(string text, CompressionQuality &quality)
+{
+    if(text == "none")
+    {
+        quality = NO_COMPRESSION;
+    }
+    else if(text == "fast")
+    {
+        quality = FAST_COMPRESSION;
+    }
+    else if(text == "high")
+    {
+        quality = HIGH_QUALITY_COMPRESSION;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*-------------------------------- BC4 --------------------------------*/
+
+/**
+ * Builds the palette of a BC4 block : 8 values if e0 > e1, otherwise 6 values, 0 and 255.
+ * @brief bc4Palette
+ * @param e0
+ * @param e1
+ * @param palette
+ */
+static void bc4Palette(int e0, int e1, float palette[8])
+{
+    palette[0] = e0;
+    palette[1] = e1;
+
+    if(e0 > e1)
+    {
+        for(int i = 2 ; i<8 ; i++)
+        {
+            palette[i] = ((8-i)*e0+(i-1)*e1)/7.0f;
+        }
+    }
+    else
+    {
+        for(int i = 2 ; i<6 ; i++)
+        {
+            palette[i] = ((6-i)*e0+(i-1)*e1)/5.0f;
+        }
+
+        palette[6] = 0.0f;
+        palette[7] = 255.0f;
+    }
+}
+
+/**
+ * Chooses the closest value of the palette for each pixel.
+ * @brief bc4Indices
+ * @param values
+ * @param e0
+ * @param e1
+ * @param indices
+ * @return the squared error of the block.
+ */
+static float bc4Indices(const float values[16], int e0, int e1, unsigned char indices[16])
+{
+    float palette[8];
+    bc4Palette(e0, e1, palette);
+
+    float error = 0.0f;
+
+    for(int k = 0 ; k<16 ; k++)
+    {
+        float bestError = FLT_MAX;
+
+        for(int i = 0 ; i<8 ; i++)
+        {
+            float difference = values[k]-palette[i];
+
+            if(difference*difference < bestError)
+            {
+                bestError = difference*difference;
+                indices[k] = i;
+            }
+        }
+
+        error += bestError;
+    }
+
+    return error;
+}
+
+/**
+ * Compresses 16 values in the 0;255 range to a BC4 block.
+ * @brief encodeBC4Block
+ * @param values
+ * @param quality
+ * @param block
+ */
+void encodeBC4Block(const float values[16], CompressionQuality quality, unsigned char block[BLOCK_SIZE])
+{
+    float minimum = values[0], maximum = values[0];
+
+    for(int k = 1 ; k<16 ; k++)
+    {
+        minimum = min(minimum, values[k]);
+        maximum = max(maximum, values[k]);
+    }
+
+    int e0 = saturate_cast<uchar>(maximum);
+    int e1 = saturate_cast<uchar>(minimum);
+
+    unsigned char indices[16];
+    float error = bc4Indices(values, e0, e1, indices);
+
+    //Endpoints moved inside the range of the values : the extrema are often isolated pixels
+    if(quality == HIGH_QUALITY_COMPRESSION)
+    {
+        int maximumEndpoint = e0, minimumEndpoint = e1;
+        unsigned char candidateIndices[16];
+
+        for(int d0 = 0 ; d0<=BC4_ENDPOINT_SEARCH_RANGE ; d0++)
+        {
+            for(int d1 = 0 ; d1<=BC4_ENDPOINT_SEARCH_RANGE ; d1++)
+            {
+                int candidate0 = maximumEndpoint-d0;
+                int candidate1 = minimumEndpoint+d1;
+
+                if(candidate0 <= candidate1 || (d0 == 0 && d1 == 0))
+                {
+                    continue;
+                }
+
+                float candidateError = bc4Indices(values, candidate0, candidate1, candidateIndices);
+
+                if(candidateError < error)
+                {
+                    error = candidateError;
+                    e0 = candidate0;
+                    e1 = candidate1;
+
+                    for(int k = 0 ; k<16 ; k++)
+                    {
+                        indices[k] = candidateIndices[k];
+                    }
+                }
+            }
+        }
+    }
+
+    block[0] = e0;
+    block[1] = e1;
+
+    //16 indices of 3 bits, little endian
+    unsigned long long bits = 0;
+
+    for(int k = 0 ; k<16 ; k++)
+    {
+        bits |= ((unsigned long long) indices[k]) << (3*k);
+    }
+
+    for(int b = 0 ; b<6 ; b++)
+    {
+        block[2+b] = (bits >> (8*b)) & 0xFF;
+    }
+}
+
+/*-------------------------------- BC1 --------------------------------*/
+
+/**
+ * Quantizes a colour in the 0;255 range to RGB 565.
+ * @brief packRGB565
+ * @param color
+ * @return
+ */
+static int packRGB565(const float color[3])
+{
+    int r = saturate_cast<int>(min(max(color[0], 0.0f), 255.0f)*31.0f/255.0f);
+    int g = saturate_cast<int>(min(max(color[1], 0.0f), 255.0f)*63.0f/255.0f);
+    int b = saturate_cast<int>(min(max(color[2], 0.0f), 255.0f)*31.0f/255.0f);
+
+    return (r << 11) | (g << 5) | b;
+}
+
+/**
+ * Expands a RGB 565 colour to the 0;255 range as the GPUs.
+ * @brief unpackRGB565
+ * @param packed
+ * @param color
+ */
+static void unpackRGB565(int packed, float color[3])
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+/**
+ * Chooses the closest colour of the 4 colours palette (c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1) for each pixel.
+ * @brief bc1Indices
+ * @param colors
+ * @param c0
+ * @param c1
+ * @param indices
+ * @return the squared error of the block.
+ */
+static float bc1Indices(const float colors[16][3], int c0, int c1, unsigned char indices[16])
+{
+    float palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+
+    for(int c = 0 ; c<3 ; c++)
+    {
+        palette[2][c] = (2.0f*palette[0][c]+palette[1][c])/3.0f;
+        palette[3][c] = (palette[0][c]+2.0f*palette[1][c])/3.0f;
+    }
+
+    float error = 0.0f;
+
+    for(int k = 0 ; k<16 ; k++)
+    {
+        float bestError = FLT_MAX;
+
+        for(int i = 0 ; i<4 ; i++)
+        {
+            float dr = colors[k][0]-palette[i][0];
+            float dg = colors[k][1]-palette[i][1];
+            float db = colors[k][2]-palette[i][2];
+            float difference = dr*dr+dg*dg+db*db;
+
+            if(difference < bestError)
+            {
+                bestError = difference;
+                indices[k] = i;
+            }
+        }
+
+        error += bestError;
+    }
+
+    return error;
+}
+
+/**
+ * Orders the endpoints for the 4 colours mode (c0 > c1) and computes the indices.
+ * @brief bc1Endpoints
+ * @param colors
+ * @param endpoint0
+ * @param endpoint1
+ * @param c0
+ * @param c1
+ * @param indices
+ * @return the squared error of the block.
+ */
+static float bc1Endpoints(const float colors[16][3], const float endpoint0[3], const float endpoint1[3], int &c0, int &c1, unsigned char indices[16])
+{
+    c0 = packRGB565(endpoint0);
+    c1 = packRGB565(endpoint1);
+
+    if(c0 < c1)
+    {
+        swap(c0, c1);
+    }
+
+    //c0 == c1 is the 3 colours mode : all the pixels use c0
+    if(c0 == c1)
+    {
+        for(int k = 0 ; k<16 ; k++)
+        {
+            indices[k] = 0;
+        }
+
+        float color[3];
+        unpackRGB565(c0, color);
+
+        float error = 0.0f;
+
+        for(int k = 0 ; k<16 ; k++)
+        {
+            for(int c = 0 ; c<3 ; c++)
+            {
+                error += (colors[k][c]-color[c])*(colors[k][c]-color[c]);
+            }
+        }
+
+        return error;
+    }
+
+    return bc1Indices(colors, c0, c1, indices);
+}
+
+/**
+ * Compresses 16 RGB colours in the 0;255 range to a BC1 block (4 colours mode).
+ * @brief encodeBC1Block
+ * @param colors
+ * @param quality
+ * @param block
+ */
+void encodeBC1Block(const float colors[16][3], CompressionQuality quality, unsigned char block[BLOCK_SIZE])
+{
+    /*---Principal axis of the colours (power iterations on the covariance)---*/
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+
+    for(int k = 0 ; k<16 ; k++)
+    {
+        for(int c = 0 ; c<3 ; c++)
+        {
+            mean[c] += colors[k][c]/16.0f;
+        }
+    }
+
+    float covariance[3][3] = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+
+    for(int k = 0 ; k<16 ; k++)
+    {
+        for(int a = 0 ; a<3 ; a++)
+        {
+            for(int b = 0 ; b<3 ; b++)
+            {
+                covariance[a][b] += (colors[k][a]-mean[a])*(colors[k][b]-mean[b]);
+            }
+        }
+    }
+
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+
+    for(int iteration = 0 ; iteration<8 ; iteration++)
+    {
+        float next[3];
+
+        for(int a = 0 ; a<3 ; a++)
+        {
+            next[a] = covariance[a][0]*axis[0]+covariance[a][1]*axis[1]+covariance[a][2]*axis[2];
+        }
+
+        float length = sqrt(next[0]*next[0]+next[1]*next[1]+next[2]*next[2]);
+
+        if(length < FLT_EPSILON)
+        {
+            break;
+        }
+
+        for(int a = 0 ; a<3 ; a++)
+        {
+            axis[a] = next[a]/length;
+        }
+    }
+
+    /*---Endpoints : extrema of the projections on the axis---*/
+    float minimum = FLT_MAX, maximum = -FLT_MAX;
+
+    for(int k = 0 ; k<16 ; k++)
+    {
+        float t = (colors[k][0]-mean[0])*axis[0]+(colors[k][1]-mean[1])*axis[1]+(colors[k][2]-mean[2])*axis[2];
+
+        minimum = min(minimum, t);
+        maximum = max(maximum, t);
+    }
+
+    float endpoint0[3], endpoint1[3];
+
+    for(int c = 0 ; c<3 ; c++)
+    {
+        endpoint0[c] = mean[c]+maximum*axis[c];
+        endpoint1[c] = mean[c]+minimum*axis[c];
+    }
+
+    int c0 = 0, c1 = 0;
+    unsigned char indices[16];
+    float error = bc1Endpoints(colors, endpoint0, endpoint1, c0, c1, indices);
+
+    /*---Least squares endpoints for the chosen indices---*/
+    if(quality == HIGH_QUALITY_COMPRESSION)
+    {
+        //Weight of c0 for each index
+        const float weights[4] = {1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f};
+
+        for(int iteration = 0 ; iteration<BC1_REFINEMENT_ITERATIONS && c0 != c1 ; iteration++)
+        {
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            float ax[3] = {0.0f, 0.0f, 0.0f}, bx[3] = {0.0f, 0.0f, 0.0f};
+
+            for(int k = 0 ; k<16 ; k++)
+            {
+                float alpha = weights[indices[k]];
+                float beta = 1.0f-alpha;
+
+                aa += alpha*alpha;
+                ab += alpha*beta;
+                bb += beta*beta;
+
+                for(int c = 0 ; c<3 ; c++)
+                {
+                    ax[c] += alpha*colors[k][c];
+                    bx[c] += beta*colors[k][c];
+                }
+            }
+
+            float determinant = aa*bb-ab*ab;
+
+            if(fabs(determinant) < FLT_EPSILON)
+            {
+                break;
+            }
+
+            for(int c = 0 ; c<3 ; c++)
+            {
+                endpoint0[c] = (bb*ax[c]-ab*bx[c])/determinant;
+                endpoint1[c] = (aa*bx[c]-ab*ax[c])/determinant;
+            }
+
+            int candidate0 = 0, candidate1 = 0;
+            unsigned char candidateIndices[16];
+            float candidateError = bc1Endpoints(colors, endpoint0, endpoint1, candidate0, candidate1, candidateIndices);
+
+            if(candidateError >= error)
+            {
+                break;
+            }
+
+            error = candidateError;
+            c0 = candidate0;
+            c1 = candidate1;
+
+            for(int k = 0 ; k<16 ; k++)
+            {
+                indices[k] = candidateIndices[k];
+            }
+        }
+    }
+
+    /*---Endpoints and 16 indices of 2 bits, little endian---*/
+    block[0] = c0 & 0xFF;
+    block[1] = (c0 >> 8) & 0xFF;
+    block[2] = c1 & 0xFF;
+    block[3] = (c1 >> 8) & 0xFF;
+
+    unsigned int bits = 0;
+
+    for(int k = 0 ; k<16 ; k++)
+    {
+        bits |= ((unsigned int) indices[k]) << (2*k);
+    }
+
+    for(int b = 0 ; b<4 ; b++)
+    {
+        block[4+b] = (bits >> (8*b)) & 0xFF;
+    }
+}
+
+/*-------------------------------- Images --------------------------------*/
+
+/**
+ * Returns a table that maps a linear value in the 0;1 range (SRGB_TABLE_SIZE steps) to its sRGB encoding in the 0;255 range.
+ * @brief srgbTable
+ * @return
+ */
+static const float* srgbTable()
+{
+    static mutex tableMutex;
+    static vector<float> table;
+
+    lock_guard<mutex> lock(tableMutex);
+
+    if(table.empty())
+    {
+        table.resize(SRGB_TABLE_SIZE+1);
+
+        for(int i = 0 ; i<=SRGB_TABLE_SIZE ; i++)
+        {
+            double linear = (double) i/SRGB_TABLE_SIZE;
+            double encoded = linear <= 0.0031308 ? 12.92*linear : 1.055*pow(linear, 1.0/2.4)-0.055;
+
+            table[i] = 255.0*encoded;
+        }
+    }
+
+    return &table[0];
+}
+
+/**
+ * Maps a value of the 0;1 range to the 0;255 range. NaN gives defaultValue.
+ * @brief toByteRange
+ * @param value
+ * @param defaultValue
+ * @return
+ */
+static inline float toByteRange(float value, float defaultValue)
+{
+    if(value != value)
+    {
+        return defaultValue;
+    }
+
+    return min(max(value, 0.0f), 1.0f)*255.0f;
+}
+
+/**
+ * Compresses the rows of blocks of an image.
+ */
+class CompressBlocksBody : public ParallelLoopBody
+{
+public:
+    CompressBlocksBody(const Mat &image, BlockFormat format, CompressionQuality quality, unsigned char *data)
+        : m_image(image), m_format(format), m_quality(quality), m_data(data), m_srgb(srgbTable()) {}
+
+    void operator()(const Range &blockRows) const
+    {
+        int blocksPerRow = (m_image.cols+3)/4;
+        int blockBytes = m_format == BC5 ? 2*BLOCK_SIZE : BLOCK_SIZE;
+
+        float colors[16][3];
+        float values[16], secondValues[16];
+
+        for(int blockY = blockRows.start ; blockY<blockRows.end ; blockY++)
+        {
+            for(int blockX = 0 ; blockX<blocksPerRow ; blockX++)
+            {
+                /*---Pixels of the block, the border is repeated outside the image---*/
+                for(int k = 0 ; k<16 ; k++)
+                {
+                    int i = min(4*blockY+k/4, m_image.rows-1);
+                    int j = min(4*blockX+k%4, m_image.cols-1);
+                    const Vec3f &pixel = m_image.at<Vec3f>(i,j);
+
+                    if(m_format == BC1_SRGB)
+                    {
+                        //BGR to RGB
+                        for(int c = 0 ; c<3 ; c++)
+                        {
+                            colors[k][c] = m_srgb[(int) (toByteRange(pixel.val[2-c], 0.0f)/255.0f*SRGB_TABLE_SIZE+0.5f)];
+                        }
+                    }
+                    else if(m_format == BC4)
+                    {
+                        values[k] = toByteRange(pixel.val[1], 0.0f);
+                    }
+                    else
+                    {
+                        //X and Y of the normals, flat normal for NaN
+                        values[k] = toByteRange((pixel.val[2]+1.0f)/2.0f, 127.5f);
+                        secondValues[k] = toByteRange((pixel.val[1]+1.0f)/2.0f, 127.5f);
+                    }
+                }
+
+                unsigned char *block = m_data+((size_t) blockY*blocksPerRow+blockX)*blockBytes;
+
+                if(m_format == BC1_SRGB)
+                {
+                    encodeBC1Block(colors, m_quality, block);
+                }
+                else
+                {
+                    encodeBC4Block(values, m_quality, block);
+
+                    if(m_format == BC5)
+                    {
+                        encodeBC4Block(secondValues, m_quality, block+BLOCK_SIZE);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    Mat m_image;
+    BlockFormat m_format;
+    CompressionQuality m_quality;
+    unsigned char *m_data;
+    const float *m_srgb;
+};
+
+/**
+ * Compresses an image (CV_32FC3) in blocks. The pixels of the last blocks that are outside the image repeat the border.
+ * BC1_SRGB : BGR colours in the 0;1 range, converted to sRGB. BC4 : green channel in the 0;1 range.
+ * BC5 : normals (BGR = ZYX), X and Y mapped to the 0;1 range.
+ * @brief compressImage
+ * @param image
+ * @param format
+ * @param quality
+ * @param data
+ */
+void compressImage(const Mat &image, BlockFormat format, CompressionQuality quality, vector<unsigned char> &data)
+{
+    int blocksPerRow = (image.cols+3)/4;
+    int blocksPerColumn = (image.rows+3)/4;
+    int blockBytes = format == BC5 ? 2*BLOCK_SIZE : BLOCK_SIZE;
+
+    data.resize((size_t) blocksPerRow*blocksPerColumn*blockBytes);
+
+    parallel_for_(Range(0, blocksPerColumn), CompressBlocksBody(image, format, quality, &data[0]));
+}
+
+/**
+ * Writes an unsigned 32 bits integer in little endian.
+ * @brief writeUInt32
+ * @param file
+ * @param value
+ */
+static void writeUInt32(ofstream &file, unsigned int value)
+{
+    char bytes[4];
+
+    for(int b = 0 ; b<4 ; b++)
+    {
+        bytes[b] = (value >> (8*b)) & 0xFF;
+    }
+
+    file.write(bytes, 4);
+}
+
+/**
+ * Compresses all the levels of a mip chain and saves them in a DDS file.
+ * @brief saveDDS
+ * @param levels
+ * @param format
+ * @param quality
+ * @param filePath
+ * @return false if the file could not be written.
+ */
+bool saveDDS(const vector<Mat> &levels, BlockFormat format, CompressionQuality quality, string filePath)
+{
+    if(levels.empty())
+    {
+        return false;
+    }
+
+    vector< vector<unsigned char> > data(levels.size());
+
+    for(unsigned int level = 0 ; level<levels.size() ; level++)
+    {
+        compressImage(levels[level], format, quality, data[level]);
+    }
+
+    ofstream file(filePath.c_str(), ios::out | ios::binary);
+
+    if(!file)
+    {
+        return false;
+    }
+
+    unsigned int dxgiFormat = DXGI_FORMAT_BC5_UNORM;
+
+    if(format == BC1_SRGB)
+    {
+        dxgiFormat = DXGI_FORMAT_BC1_UNORM_SRGB;
+    }
+    else if(format == BC4)
+    {
+        dxgiFormat = DXGI_FORMAT_BC4_UNORM;
+    }
+
+    /*---Header---*/
+    writeUInt32(file, DDS_MAGIC);
+    writeUInt32(file, DDS_HEADER_SIZE);
+    writeUInt32(file, DDS_FLAGS);
+    writeUInt32(file, levels[0].rows);
+    writeUInt32(file, levels[0].cols);
+    writeUInt32(file, data[0].size());
+    writeUInt32(file, 0);                   //Depth
+    writeUInt32(file, levels.size());
+
+    for(int i = 0 ; i<11 ; i++)
+    {
+        writeUInt32(file, 0);
+    }
+
+    //Pixel format
+    writeUInt32(file, DDS_PIXEL_FORMAT_SIZE);
+    writeUInt32(file, DDS_FOURCC);
+    writeUInt32(file, DDS_FOURCC_DX10);
+
+    for(int i = 0 ; i<5 ; i++)
+    {
+        writeUInt32(file, 0);
+    }
+
+    writeUInt32(file, DDS_CAPS);
+
+    for(int i = 0 ; i<4 ; i++)
+    {
+        writeUInt32(file, 0);
+    }
+
+    //DX10 header : format, dimension, flags, array size, alpha mode
+    writeUInt32(file, dxgiFormat);
+    writeUInt32(file, DDS_TEXTURE_2D);
+    writeUInt32(file, 0);
+    writeUInt32(file, 1);
+    writeUInt32(file, 0);
+
+    /*---Levels---*/
+    for(unsigned int level = 0 ; level<data.size() ; level++)
+    {
+        file.write((const char*) &data[level][0], data[level].size());
+    }
+
+    return file.good();
+}
+
+/**
+ * Queues the compression of a mip chain and its DDS file to the output writer.
+ * @brief saveDDSAsync
+ * @param group
+ * @param levels
+ * @param format
+ * @param quality
+ * @param filePath
+ */
+static void saveDDSAsync(string group, const vector<Mat> &levels, BlockFormat format, CompressionQuality quality, string filePath)
+{
+    //The headers of the levels keep their buffers alive until the file is written
+    vector<Mat> levelsToSave = levels;
+
+    writeOutputAsync(group, filePath, [levelsToSave, format, quality, filePath]() { return saveDDS(levelsToSave, format, quality, filePath); });
+}
+
+/**
+ * Queues the mip chains to the output writer (group pathToFolder), compressed in the textures folder as diffuse.dds (with cross polarised data only), specular.dds,
+ * normalMap.dds and roughness.dds.
+ * @brief saveCompressedTextures
+ * @param chain
+ * @param pathToFolder
+ * @param quality
+ */
+void saveCompressedTextures(const MipChain &chain, string pathToFolder, CompressionQuality quality)
+{
+    if(!chain.diffuse.empty())
+    {
+        saveDDSAsync(pathToFolder, chain.diffuse, BC1_SRGB, quality, pathToFolder + "/textures/diffuse.dds");
+    }
+
+    saveDDSAsync(pathToFolder, chain.specular, BC1_SRGB, quality, pathToFolder + "/textures/specular.dds");
+
+    saveDDSAsync(pathToFolder, chain.normals, BC5, quality, pathToFolder + "/textures/normalMap.dds");
+
+    saveDDSAsync(pathToFolder, chain.roughness, BC4, quality, pathToFolder + "/textures/roughness.dds");
+}
@@ -0,0 +1,148 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file blockcompression.h
+ * \brief Implementation of the block compression of the reflectance maps for the GPUs.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The mip chains of the maps are compressed in blocks of 4x4 pixels and saved in DDS files (DX10 header) :
+ *   - normalMap.dds : BC5, X and Y in the 0;1 range as the normal map (Z = sqrt(1-X^2-Y^2) is rebuilt by the shader),
+ *   - roughness.dds : BC4,
+ *   - diffuse.dds and specular.dds : BC1 in sRGB.
+ * The rows of blocks are compressed in parallel. The computations on the 16 pixels of a block are done on arrays of floats
+ * that the compiler vectorises.
+ *
+ * The quality sets the search of the endpoints of the blocks :
+ *   - FAST_COMPRESSION : extrema of the values (BC4) or of the projections on the principal axis of the colours (BC1),
+ *   - HIGH_QUALITY_COMPRESSION : endpoints searched around the extrema (BC4) or refined by least squares (BC1).
+ */
+
+#ifndef BLOCKCOMPRESSION
+#define BLOCKCOMPRESSION
+
+#include "mipchain.h"
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+
+//Size of a compressed block of 4x4 pixels in bytes (BC1 and BC4, BC5 is two BC4 blocks)
+#define BLOCK_SIZE 8
+
+//High quality : the BC4 endpoints are searched in [max-RANGE;max]x[min;min+RANGE]
+#define BC4_ENDPOINT_SEARCH_RANGE 4
+
+//High quality : number of least squares refinements of the BC1 endpoints
+#define BC1_REFINEMENT_ITERATIONS 2
+
+enum CompressionQuality {NO_COMPRESSION, FAST_COMPRESSION, HIGH_QUALITY_COMPRESSION};
+
+enum BlockFormat {BC1_SRGB, BC4, BC5};
+
+/**
+ * Sets the quality of the compressed textures saved with the maps (NO_COMPRESSION to only save the PFM and BMP files).
+ * @brief setCompressionQuality
+ * @param quality
+ */
+void setCompressionQuality(CompressionQuality quality);
+
+/**
+ * Returns the quality of the compressed textures saved with the maps (FAST_COMPRESSION by default).
+ * @brief compressionQuality
+ * @return
+ */
+CompressionQuality compressionQuality();
+
+/**
+ * Parses a quality : none, fast or high.
+ * @brief parseCompressionQuality
+ * @param text
+ * @param quality
+ * @return false if the text is not a quality.
+ */
+bool parseCompressionQuality(std::string text, CompressionQuality &quality);
+
+/**
+ * Compresses 16 values in the 0;255 range to a BC4 block.
+ * @brief encodeBC4Block
+ * @param values
+ * @param quality
+ * @param block
+ */
+void encodeBC4Block(const float values[16], CompressionQuality quality, unsigned char block[BLOCK_SIZE]);
+
+/**
+ * Compresses 16 RGB colours in the 0;255 range to a BC1 block (4 colours mode).
+ * @brief encodeBC1Block
+ * @param colors
+ * @param quality
+ * @param block
+ */
+void encodeBC1Block(const float colors[16][3], CompressionQuality quality, unsigned char block[BLOCK_SIZE]);
+
+/**
+ * Compresses an image (CV_32FC3) in blocks. The pixels of the last blocks that are outside the image repeat the border.
+ * BC1_SRGB : BGR colours in the 0;1 range, converted to sRGB. BC4 : green channel in the 0;1 range.
+ * BC5 : normals (BGR = ZYX), X and Y mapped to the 0;1 range.
+ * @brief compressImage
+ * @param image
+ * @param format
+ * @param quality
+ * @param data
+ */
+void compressImage(const cv::Mat &image, BlockFormat format, CompressionQuality quality, std::vector<unsigned char> &data);
+
+/**
+ * Compresses all the levels of a mip chain and saves them in a DDS file.
+ * @brief saveDDS
+ * @param levels
+ * @param format
+ * @param quality
+ * @param filePath
+ * @return false if the file could not be written.
+ */
+bool saveDDS(const std::vector<cv::Mat> &levels, BlockFormat format, CompressionQuality quality, std::string filePath);
+
+/**
+ * Queues the mip chains to the output writer (group pathToFolder), compressed in the textures folder as diffuse.dds (with cross polarised data only), specular.dds,
+ * normalMap.dds and roughness.dds.
+ * @brief saveCompressedTextures
+ * @param chain
+ * @param pathToFolder
+ * @param quality
+ */
+void saveCompressedTextures(const MipChain &chain, std::string pathToFolder, CompressionQuality quality);
+
+#endif // BLOCKCOMPRESSION
@@ -0,0 +1,298 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file bufferpool.cpp
+ * \brief Implementation of a pool of image buffers.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of a pool of image buffers.
+ */
+
+#include "bufferpool.h"
+
+/*---- Standard library ----*/
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+//Buffers of at least HUGE_PAGE_SIZE bytes are aligned on huge pages and their size is a multiple of HUGE_PAGE_SIZE
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+//Smaller buffers are aligned on cache lines (and AVX registers)
+#define BUFFER_ALIGNMENT 64
+
+//A free buffer is reused for a request at most MAXIMUM_SIZE_RATIO times smaller
+#define MAXIMUM_SIZE_RATIO 1.25
+
+/**
+ * Returns the size class of a buffer : multiple of a huge page for large buffers, power of 2 otherwise.
+ * @brief bufferSizeClass
+ * @param size
+ * @return
+ */
+size_t bufferSizeClass(size_t size)
+{
+    if(size >= HUGE_PAGE_SIZE)
+    {
+        return (size+HUGE_PAGE_SIZE-1)/HUGE_PAGE_SIZE*HUGE_PAGE_SIZE;
+    }
+
+    size_t classSize = BUFFER_ALIGNMENT;
+
+    while(classSize < size)
+    {
+        classSize *= 2;
+    }
+
+    return classSize;
+}
+
+BufferPool::BufferPool()
+{
+    m_statistics.systemAllocations = 0;
+    m_statistics.reuses = 0;
+    m_statistics.bytesInUse = 0;
+    m_statistics.bytesReserved = 0;
+}
+
+BufferPool::~BufferPool()
+{
+    //Buffers still used by images when the program exits are left to the system
+    trim();
+}
+
+/**
+ * Allocates an aligned buffer from the system, backed by huge pages if possible.
+ * @brief BufferPool::systemAllocate
+ * @param size
+ * @return NULL if the allocation failed.
+ */
+uchar* BufferPool::systemAllocate(size_t size)
+{
+    size_t alignment = size >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : BUFFER_ALIGNMENT;
+    void *buffer = NULL;
+
+#ifdef _WIN32
+    buffer = _aligned_malloc(size, alignment);
+#else
+    if(posix_memalign(&buffer, alignment, size) != 0)
+    {
+        buffer = NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    else if(size >= HUGE_PAGE_SIZE)
+    {
+        //Transparent huge pages : fewer page faults and TLB misses on the full resolution images
+        madvise(buffer, size, MADV_HUGEPAGE);
+    }
+#endif
+#endif
+
+    return (uchar*) buffer;
+}
+
+/**
+ * Gives a buffer back to the system.
+ * @brief BufferPool::systemFree
+ * @param buffer
+ */
+void BufferPool::systemFree(uchar* buffer)
+{
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+/**
+ * Allocates the data of a Mat (called by Mat::create). As in OpenCV, the reference counter is stored after the pixels.
+ * @brief BufferPool::allocate
+ */
+void BufferPool::allocate(int dims, const int* sizes, int type, int*& refcount, uchar*& datastart, uchar*& data, size_t* step)
+{
+    //Continuous image : compute the steps from the last dimension
+    size_t total = CV_ELEM_SIZE(type);
+
+    for(int i = dims-1 ; i>=0 ; i--)
+    {
+        step[i] = total;
+        total *= sizes[i];
+    }
+
+    //The reference counter is aligned as an int after the pixels (odd sizes of 8 bits images)
+    total = alignSize(total, (int) sizeof(*refcount));
+
+    size_t classSize = bufferSizeClass(total+sizeof(int));
+    uchar *buffer = NULL;
+
+    {
+        lock_guard<mutex> lock(m_poolMutex);
+
+        multimap<size_t, uchar*>::iterator freeBuffer = m_freeBuffers.lower_bound(classSize);
+
+        if(freeBuffer != m_freeBuffers.end() && freeBuffer->first <= classSize*MAXIMUM_SIZE_RATIO)
+        {
+            classSize = freeBuffer->first;
+            buffer = freeBuffer->second;
+            m_freeBuffers.erase(freeBuffer);
+            m_statistics.reuses++;
+        }
+    }
+
+    if(buffer == NULL)
+    {
+        buffer = systemAllocate(classSize);
+
+        if(buffer == NULL)
+        {
+            //Last chance : the unused buffers of other size classes
+            trim();
+            buffer = systemAllocate(classSize);
+        }
+
+        if(buffer == NULL)
+        {
+            cerr << "Out of memory : could not allocate " << classSize << " bytes" << endl;
+            throw bad_alloc();
+        }
+
+        lock_guard<mutex> lock(m_poolMutex);
+        m_bufferSizes[buffer] = classSize;
+        m_statistics.systemAllocations++;
+        m_statistics.bytesReserved += classSize;
+    }
+
+    {
+        lock_guard<mutex> lock(m_poolMutex);
+        m_statistics.bytesInUse += classSize;
+    }
+
+    datastart = data = buffer;
+    refcount = (int*) (buffer+total);
+    *refcount = 1;
+}
+
+/**
+ * Gives the data of a Mat back to the pool (called when the last Mat referencing it is released).
+ * @brief BufferPool::deallocate
+ */
+void BufferPool::deallocate(int* refcount, uchar* datastart, uchar* data)
+{
+    (void) refcount;
+    (void) data;
+
+    lock_guard<mutex> lock(m_poolMutex);
+
+    map<uchar*, size_t>::iterator buffer = m_bufferSizes.find(datastart);
+
+    if(buffer != m_bufferSizes.end())
+    {
+        m_freeBuffers.insert(make_pair(buffer->second, datastart));
+        m_statistics.bytesInUse -= buffer->second;
+    }
+}
+
+/**
+ * Returns the statistics of the pool.
+ * @brief BufferPool::statistics
+ * @return
+ */
+BufferPoolStatistics BufferPool::statistics()
+{
+    lock_guard<mutex> lock(m_poolMutex);
+
+    return m_statistics;
+}
+
+/**
+ * Gives the unused buffers back to the system.
+ * @brief BufferPool::trim
+ */
+void BufferPool::trim()
+{
+    lock_guard<mutex> lock(m_poolMutex);
+
+    for(multimap<size_t, uchar*>::iterator buffer = m_freeBuffers.begin() ; buffer != m_freeBuffers.end() ; ++buffer)
+    {
+        systemFree(buffer->second);
+        m_bufferSizes.erase(buffer->second);
+        m_statistics.bytesReserved -= buffer->first;
+    }
+
+    m_freeBuffers.clear();
+}
+
+/**
+ * Returns the buffer pool shared by all the stages of the computation.
+ * @brief globalBufferPool
+ * @return
+ */
+BufferPool& globalBufferPool()
+{
+    //Never destroyed : images may still be released after the end of main
+    static BufferPool *pool = new BufferPool();
+
+    return *pool;
+}
+
+/**
+ * Allocates an image from the global buffer pool.
+ * Does nothing if the image already has the right size and type, so that its buffer is reused,
+ * unless the buffer is shared with another image (e.g. queued to the output writer) : a new buffer is then taken.
+ * @brief createPooledImage
+ * @param image
+ * @param rows
+ * @param cols
+ * @param type
+ */
+void createPooledImage(Mat &image, int rows, int cols, int type)
+{
+    bool isShared = image.refcount != NULL && *image.refcount > 1;
+
+    if(image.data && image.rows == rows && image.cols == cols && image.type() == type && !isShared)
+    {
+        return;
+    }
+
+    image.release();
+    image.allocator = &globalBufferPool();
+    image.create(rows, cols, type);
+}
@@ -0,0 +1,131 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file bufferpool.h
+ * \brief Implementation of a pool of image buffers.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The buffer pool is an OpenCV MatAllocator : a Mat created with the pool as allocator takes a buffer from the pool
+ * and gives it back when it is released. The buffers are grouped by size classes and never returned to the system,
+ * so that processing successive captures of the same size does not allocate new large buffers after the first one.
+ * Large buffers are aligned on 2 MB and backed by huge pages when the system allows it.
+ */
+
+#ifndef BUFFERPOOL
+#define BUFFERPOOL
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <cstddef>
+#include <map>
+#include <vector>
+#include <mutex>
+
+/**
+ * Statistics of the buffer pool.
+ * @brief The BufferPoolStatistics struct
+ */
+struct BufferPoolStatistics
+{
+    size_t systemAllocations;   //Number of buffers allocated from the system
+    size_t reuses;              //Number of buffers taken from the pool
+    size_t bytesInUse;          //Size of the buffers currently used by images
+    size_t bytesReserved;       //Size of all the buffers owned by the pool
+};
+
+/**
+ * Pool of aligned buffers grouped by size classes, used as an OpenCV allocator.
+ * @brief The BufferPool class
+ */
+class BufferPool : public cv::MatAllocator
+{
+public:
+    BufferPool();
+    ~BufferPool();
+
+    void allocate(int dims, const int* sizes, int type, int*& refcount, uchar*& datastart, uchar*& data, size_t* step);
+    void deallocate(int* refcount, uchar* datastart, uchar* data);
+
+    /**
+     * Returns the statistics of the pool.
+     * @brief statistics
+     * @return
+     */
+    BufferPoolStatistics statistics();
+
+    /**
+     * Gives the unused buffers back to the system.
+     * @brief trim
+     */
+    void trim();
+
+private:
+    uchar* systemAllocate(size_t size);
+    void systemFree(uchar* buffer);
+
+    std::mutex m_poolMutex;
+    std::multimap<size_t, uchar*> m_freeBuffers;    //Unused buffers by size class
+    std::map<uchar*, size_t> m_bufferSizes;         //Size class of every buffer owned by the pool
+    BufferPoolStatistics m_statistics;
+};
+
+/**
+ * Returns the size class of a buffer : multiple of a huge page for large buffers, power of 2 otherwise.
+ * This is the memory actually taken from the system for a buffer of this size.
+ * @brief bufferSizeClass
+ * @param size
+ * @return
+ */
+size_t bufferSizeClass(size_t size);
+
+/**
+ * Returns the buffer pool shared by all the stages of the computation.
+ * @brief globalBufferPool
+ * @return
+ */
+BufferPool& globalBufferPool();
+
+/**
+ * Allocates an image from the global buffer pool.
+ * Does nothing if the image already has the right size and type, so that its buffer is reused,
+ * unless the buffer is shared with another image (e.g. queued to the output writer) : a new buffer is then taken.
+ * @brief createPooledImage
+ * @param image
+ * @param rows
+ * @param cols
+ * @param type
+ */
+void createPooledImage(cv::Mat &image, int rows, int cols, int type);
+
+#endif // BUFFERPOOL
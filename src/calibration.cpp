@@ -0,0 +1,551 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file calibration.cpp
+ * \brief Implementation of the flat field calibration of the rig and of the cache of the ambient illumination.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the flat field calibration of the rig and of the cache of the ambient illumination.
+ */
+
+#include "calibration.h"
+#include "imageprocessing.h"
+#include "multishot.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <list>
+#include <mutex>
+
+using namespace std;
+using namespace cv;
+
+//Identifies the calibration files
+#define FLAT_FIELD_FILE_MAGIC "RMFLAT02"
+
+/**
+ * Header of a calibration file, followed by the gains of the parallel polarised gradients
+ * and of the cross polarised gradients (if isCrossData) in row order.
+ * @brief The FlatFieldHeader struct
+ */
+struct FlatFieldHeader
+{
+    char magic[8];
+    int width;
+    int height;
+    int cellSize;
+    int isCrossData;
+    int numberOfGradients;
+};
+
+static mutex flatFieldMutex;
+static string calibrationFilePath;
+static string loadedCalibrationFile;
+static FlatField loadedFlatField;
+
+/**
+ * Decoded ambient image and the identity of its file.
+ * @brief The CachedAmbient struct
+ */
+struct CachedAmbient
+{
+    string key;
+    Mat image8U;
+};
+
+//Most recently used first
+static mutex ambientMutex;
+static list<CachedAmbient> ambientCache;
+
+/**
+ * Computes the gains of a gradient : average of the gradient over the image divided by the average of each cell,
+ * for each colour channel.
+ * @brief computeGradientGains
+ * @param image
+ * @param cellSize
+ * @param gains
+ */
+static void computeGradientGains(const Mat &image, int cellSize, Mat &gains)
+{
+    int rows = (image.rows+cellSize-1)/cellSize;
+    int cols = (image.cols+cellSize-1)/cellSize;
+
+    vector<double> sums(3*rows*cols, 0.0);
+    vector<double> counts(rows*cols, 0.0);
+    double imageSum[3] = {0.0, 0.0, 0.0};
+
+    for(int i = 0 ; i<image.rows ; i++)
+    {
+        const float *pixel = image.ptr<float>(i);
+        int row = i/cellSize;
+
+        for(int j = 0 ; j<image.cols ; j++)
+        {
+            int cell = row*cols + j/cellSize;
+
+            for(int c = 0 ; c<3 ; c++)
+            {
+                sums[3*cell+c] += pixel[3*j+c];
+                imageSum[c] += pixel[3*j+c];
+            }
+
+            counts[cell] += 1.0;
+        }
+    }
+
+    gains.create(rows, cols, CV_32FC3);
+
+    for(int i = 0 ; i<rows ; i++)
+    {
+        float *gain = gains.ptr<float>(i);
+
+        for(int j = 0 ; j<cols ; j++)
+        {
+            int cell = i*cols + j;
+
+            for(int c = 0 ; c<3 ; c++)
+            {
+                double average = imageSum[c]/((double) image.rows*image.cols);
+                double cellAverage = sums[3*cell+c]/counts[cell];
+
+                //A channel without light is not corrected
+                if(average <= 0.0)
+                {
+                    gain[3*j+c] = 1.0f;
+                }
+                else
+                {
+                    float value = cellAverage > 0.0 ? (float) (average/cellAverage) : FLAT_FIELD_MAXIMUM_GAIN;
+                    gain[3*j+c] = min(max(value, FLAT_FIELD_MINIMUM_GAIN), FLAT_FIELD_MAXIMUM_GAIN);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Computes the gain maps of a rig from a reference capture of a flat matte target (same folders as a capture,
+ * the mask and the checkerchart are not used) and saves them in a calibration file.
+ * @brief calibrateFlatField
+ * @param referenceFolder
+ * @param isCrossData set to true to also calibrate the cross polarised gradients.
+ * @param calibrationFile
+ * @return false if the reference capture could not be loaded or the file could not be written.
+ */
+bool calibrateFlatField(string referenceFolder, bool isCrossData, string calibrationFile)
+{
+    FlatField flatField;
+    flatField.cellSize = FLAT_FIELD_CELL_SIZE;
+    flatField.isCrossData = isCrossData;
+    flatField.numberOfGradients = numberOfGradients();
+
+    //The gradients are loaded one polarisation at a time
+    Mat images[MAXIMUM_NUMBER_OF_GRADIENTS];
+
+    if(!loadGradientImages(referenceFolder, "par", PARALLEL_FIRST_IMAGE_NUMBER, images, Rect(), NULL, NULL))
+    {
+        return false;
+    }
+
+    flatField.imageSize = Size(images[0].cols, images[0].rows);
+
+    for(int k = 0 ; k<flatField.numberOfGradients ; k++)
+    {
+        computeGradientGains(images[k], flatField.cellSize, flatField.parallelGains[k]);
+    }
+
+    if(isCrossData)
+    {
+        if(!loadGradientImages(referenceFolder, "cross", CROSS_FIRST_IMAGE_NUMBER, images, Rect(), NULL, NULL))
+        {
+            return false;
+        }
+
+        for(int k = 0 ; k<flatField.numberOfGradients ; k++)
+        {
+            computeGradientGains(images[k], flatField.cellSize, flatField.crossGains[k]);
+        }
+    }
+
+    if(!saveFlatField(flatField, calibrationFile))
+    {
+        cerr << "Could not write the flat field calibration : " << calibrationFile << endl;
+        return false;
+    }
+
+    cout << "Flat field calibration saved in " << calibrationFile << " (" << flatField.parallelGains[0].cols << "x"
+         << flatField.parallelGains[0].rows << " cells)" << endl;
+
+    return true;
+}
+
+/**
+ * Saves gain maps in a calibration file.
+ * @brief saveFlatField
+ * @param flatField
+ * @param calibrationFile
+ * @return false if the file could not be written.
+ */
+bool saveFlatField(const FlatField &flatField, string calibrationFile)
+{
+    ofstream file(calibrationFile.c_str(), ios::out | ios::trunc | ios::binary);
+
+    if(!file)
+    {
+        return false;
+    }
+
+    FlatFieldHeader header;
+    memcpy(header.magic, FLAT_FIELD_FILE_MAGIC, sizeof(header.magic));
+    header.width = flatField.imageSize.width;
+    header.height = flatField.imageSize.height;
+    header.cellSize = flatField.cellSize;
+    header.isCrossData = flatField.isCrossData ? 1 : 0;
+    header.numberOfGradients = flatField.numberOfGradients;
+
+    file.write((const char*) &header, sizeof(FlatFieldHeader));
+
+    for(int k = 0 ; k<flatField.numberOfGradients*(flatField.isCrossData ? 2 : 1) ; k++)
+    {
+        const Mat &gains = k < flatField.numberOfGradients ? flatField.parallelGains[k]
+                                                           : flatField.crossGains[k-flatField.numberOfGradients];
+
+        for(int i = 0 ; i<gains.rows ; i++)
+        {
+            file.write((const char*) gains.ptr<float>(i), 3*gains.cols*sizeof(float));
+        }
+    }
+
+    return file.good();
+}
+
+/**
+ * Loads the gain maps of a calibration file.
+ * @brief loadFlatField
+ * @param calibrationFile
+ * @param flatField
+ * @return false if the file could not be read or is not a calibration file.
+ */
+bool loadFlatField(string calibrationFile, FlatField &flatField)
+{
+    ifstream file(calibrationFile.c_str(), ios::in | ios::binary);
+    FlatFieldHeader header;
+
+    if(!file || !file.read((char*) &header, sizeof(FlatFieldHeader)) ||
+       memcmp(header.magic, FLAT_FIELD_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+       header.width <= 0 || header.height <= 0 || header.cellSize <= 0 ||
+       header.numberOfGradients <= 0 || header.numberOfGradients > MAXIMUM_NUMBER_OF_GRADIENTS)
+    {
+        return false;
+    }
+
+    flatField.imageSize = Size(header.width, header.height);
+    flatField.cellSize = header.cellSize;
+    flatField.isCrossData = header.isCrossData != 0;
+    flatField.numberOfGradients = header.numberOfGradients;
+
+    int rows = (header.height+header.cellSize-1)/header.cellSize;
+    int cols = (header.width+header.cellSize-1)/header.cellSize;
+
+    for(int k = 0 ; k<MAXIMUM_NUMBER_OF_GRADIENTS ; k++)
+    {
+        flatField.parallelGains[k].release();
+        flatField.crossGains[k].release();
+    }
+
+    for(int k = 0 ; k<flatField.numberOfGradients*(flatField.isCrossData ? 2 : 1) ; k++)
+    {
+        Mat &gains = k < flatField.numberOfGradients ? flatField.parallelGains[k]
+                                                     : flatField.crossGains[k-flatField.numberOfGradients];
+        gains.create(rows, cols, CV_32FC3);
+
+        for(int i = 0 ; i<rows ; i++)
+        {
+            if(!file.read((char*) gains.ptr<float>(i), 3*cols*sizeof(float)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Sets the calibration file applied to the captures (none by default, an empty path disables the correction).
+ * The file is loaded once, at the first capture.
+ * @brief setFlatFieldFile
+ * @param calibrationFile
+ */
+void setFlatFieldFile(string calibrationFile)
+{
+    lock_guard<mutex> lock(flatFieldMutex);
+    calibrationFilePath = calibrationFile;
+}
+
+/**
+ * Returns the calibration file applied to the captures, empty if none.
+ * @brief flatFieldFile
+ * @return
+ */
+string flatFieldFile()
+{
+    lock_guard<mutex> lock(flatFieldMutex);
+    return calibrationFilePath;
+}
+
+/**
+ * Returns the gain maps of flatFieldFile(), loaded at the first call.
+ * @brief currentFlatField
+ * @param flatField set to NULL if there is no calibration file.
+ * @return false if the calibration file could not be loaded.
+ */
+bool currentFlatField(const FlatField *&flatField)
+{
+    lock_guard<mutex> lock(flatFieldMutex);
+    flatField = NULL;
+
+    if(calibrationFilePath.empty())
+    {
+        return true;
+    }
+
+    if(loadedCalibrationFile != calibrationFilePath)
+    {
+        FlatField calibration;
+
+        if(!loadFlatField(calibrationFilePath, calibration))
+        {
+            cerr << "Could not load the flat field calibration : " << calibrationFilePath << endl;
+            return false;
+        }
+
+        loadedFlatField = calibration;
+        loadedCalibrationFile = calibrationFilePath;
+    }
+
+    flatField = &loadedFlatField;
+
+    return true;
+}
+
+/**
+ * Returns true if gain maps can be applied to a region of a capture : the region is inside the calibrated images,
+ * the cross polarised gradients are calibrated if they are used and the rig has the same gradients.
+ * @brief flatFieldCovers
+ * @param flatField
+ * @param isCrossData
+ * @param region
+ * @return
+ */
+bool flatFieldCovers(const FlatField &flatField, bool isCrossData, Rect region)
+{
+    return region.x >= 0 && region.y >= 0 &&
+           region.x+region.width <= flatField.imageSize.width && region.y+region.height <= flatField.imageSize.height &&
+           (flatField.isCrossData || !isCrossData) && flatField.numberOfGradients == numberOfGradients();
+}
+
+/**
+ * Returns the cell on the left (or above) of a pixel and the weight of the next cell for the interpolation
+ * between the centres of the cells. The gains are constant beyond the first and the last centres.
+ * @brief interpolationCell
+ * @param pixel
+ * @param cellSize
+ * @param numberOfCells
+ * @param cell
+ * @param weight
+ */
+static inline void interpolationCell(int pixel, int cellSize, int numberOfCells, int &cell, float &weight)
+{
+    float position = (pixel+0.5f)/cellSize - 0.5f;
+
+    if(position <= 0.0f)
+    {
+        cell = 0;
+        weight = 0.0f;
+    }
+    else if(position >= numberOfCells-1)
+    {
+        cell = numberOfCells-1;
+        weight = 0.0f;
+    }
+    else
+    {
+        cell = (int) position;
+        weight = position - cell;
+    }
+}
+
+/**
+ * Multiplies the rows of a gradient by its gains, interpolated between the rows of cells.
+ * The gains of each row of cells are already interpolated between the columns of cells (one value per pixel)
+ * so that each pixel only costs an interpolation between two contiguous rows.
+ */
+class FlatFieldBody : public ParallelLoopBody
+{
+public:
+    FlatFieldBody(Mat &image, const Mat &cellRows, int cellSize, int top)
+        : m_image(image), m_cellRows(cellRows), m_cellSize(cellSize), m_top(top) {}
+
+    void operator()(const Range &rows) const
+    {
+        int width = m_image.cols*m_image.channels();
+
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            int cell = 0;
+            float weight = 0.0f;
+            interpolationCell(m_top+i, m_cellSize, m_cellRows.rows, cell, weight);
+
+            const float *above = m_cellRows.ptr<float>(cell);
+            const float *below = m_cellRows.ptr<float>(min(cell+1, m_cellRows.rows-1));
+            float *pixel = m_image.ptr<float>(i);
+
+            for(int j = 0 ; j<width ; j++)
+            {
+                pixel[j] *= above[j] + weight*(below[j]-above[j]);
+            }
+        }
+    }
+
+private:
+    Mat &m_image;
+    const Mat &m_cellRows;
+    int m_cellSize;
+    int m_top;
+};
+
+/**
+ * Multiplies the gradients of a region of a capture by the checkerchart ratio and by their gains, interpolated
+ * between the centres of the cells, in a single parallel pass per gradient.
+ * @brief applyFlatFieldGains
+ * @param images numberOfGradients() gradients (CV_32FC3) of the region.
+ * @param gains gain maps of the gradients (parallelGains or crossGains).
+ * @param cellSize
+ * @param ratio BGR ratio returned by readCheckerchartRatios.
+ * @param region position of the images in the capture.
+ */
+void applyFlatFieldGains(Mat images[], const Mat gains[], int cellSize, Vec3f ratio, Rect region)
+{
+    int width = images[0].cols;
+    Mat cellRows;
+
+    for(int k = 0 ; k<numberOfGradients() ; k++)
+    {
+        //Gains of each row of cells interpolated at the columns of the region, times the ratio
+        cellRows.create(gains[k].rows, width, CV_32FC3);
+
+        for(int i = 0 ; i<gains[k].rows ; i++)
+        {
+            const float *cellGains = gains[k].ptr<float>(i);
+            float *rowGains = cellRows.ptr<float>(i);
+
+            for(int j = 0 ; j<width ; j++)
+            {
+                int cell = 0;
+                float weight = 0.0f;
+                interpolationCell(region.x+j, cellSize, gains[k].cols, cell, weight);
+
+                const float *left = cellGains + 3*cell;
+                const float *right = cellGains + 3*min(cell+1, gains[k].cols-1);
+
+                for(int c = 0 ; c<3 ; c++)
+                {
+                    rowGains[3*j+c] = ratio.val[c]*(left[c] + weight*(right[c]-left[c]));
+                }
+            }
+        }
+
+        parallel_for_(Range(0, images[k].rows), FlatFieldBody(images[k], cellRows, cellSize, region.y));
+    }
+}
+
+/**
+ * Reads and decodes an image file of the ambient illumination (CV_8UC3) through the cache of the decoded ambient images.
+ * The image is shared with the cache and must not be modified.
+ * The cache keeps the ambient shots of the parallel and cross polarised folders of one session (2*numberOfShots() images).
+ * @brief readAmbientFile
+ * @param filePath
+ * @param image8U
+ * @return false if the file could not be read or decoded.
+ */
+bool readAmbientFile(string filePath, Mat &image8U)
+{
+    string key;
+
+    if(!fileIdentity(filePath, key))
+    {
+        return false;
+    }
+
+    {
+        lock_guard<mutex> lock(ambientMutex);
+
+        for(list<CachedAmbient>::iterator ambient = ambientCache.begin() ; ambient != ambientCache.end() ; ambient++)
+        {
+            if(ambient->key == key)
+            {
+                image8U = ambient->image8U;
+                ambientCache.splice(ambientCache.begin(), ambientCache, ambient);
+                return true;
+            }
+        }
+    }
+
+    //Decoded in a new image : the buffer of image8U may be shared with the cache
+    Mat decoded;
+
+    if(!readImageFile(filePath, decoded))
+    {
+        return false;
+    }
+
+    {
+        lock_guard<mutex> lock(ambientMutex);
+
+        CachedAmbient ambient;
+        ambient.key = key;
+        ambient.image8U = decoded;
+        ambientCache.push_front(ambient);
+
+        while((int) ambientCache.size() > 2*numberOfShots())
+        {
+            ambientCache.pop_back();
+        }
+    }
+
+    image8U = decoded;
+
+    return true;
+}
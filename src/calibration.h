@@ -0,0 +1,172 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file calibration.h
+ * \brief Implementation of the flat field calibration of the rig and of the cache of the ambient illumination.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The LCD screen is not a uniform light source : its brightness falls off towards the edges and its polarisation
+ * varies over the screen, so the gradients of a flat sample are not uniform over the image. The flat field calibration
+ * measures this non uniformity once per rig on a reference capture of a flat matte target that fills the image :
+ * the gain of each gradient, colour channel and polarisation is the average of the gradient over the image divided by
+ * its local value. The gains vary slowly and are kept at the centre of square cells of FLAT_FIELD_CELL_SIZE pixels
+ * (about 1 MB for a 24 MP camera). They are interpolated during the ingestion of the captures and applied in the same
+ * pass as the checkerchart ratios.
+ *
+ * The ambient illumination is often shared by all the captures of a session (same file, or links to the same file).
+ * The decoded ambient images are cached by file (device, inode, size, modification time) so that they are decoded once.
+ */
+
+#ifndef CALIBRATION
+#define CALIBRATION
+
+#include "reflectance.h"
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+
+//Size in pixels of the cells of the gain maps
+#define FLAT_FIELD_CELL_SIZE 64
+
+//Range of the gains : the cells darker than 1/4 of the average are not corrected more
+#define FLAT_FIELD_MINIMUM_GAIN 0.25f
+#define FLAT_FIELD_MAXIMUM_GAIN 4.0f
+
+/**
+ * Gain maps of a rig, one per gradient and polarisation.
+ * @brief The FlatField struct
+ */
+struct FlatField
+{
+    //Size of the captures of the rig
+    cv::Size imageSize;
+    int cellSize;
+    bool isCrossData;
+
+    //Number of gradients of the rig (numberOfGradients() at the calibration)
+    int numberOfGradients;
+
+    //Gains at the centre of the cells (CV_32FC3, BGR), the cross polarised gains are empty without cross polarised data
+    cv::Mat parallelGains[MAXIMUM_NUMBER_OF_GRADIENTS];
+    cv::Mat crossGains[MAXIMUM_NUMBER_OF_GRADIENTS];
+};
+
+/**
+ * Computes the gain maps of a rig from a reference capture of a flat matte target (same folders as a capture,
+ * the mask and the checkerchart are not used) and saves them in a calibration file.
+ * @brief calibrateFlatField
+ * @param referenceFolder
+ * @param isCrossData set to true to also calibrate the cross polarised gradients.
+ * @param calibrationFile
+ * @return false if the reference capture could not be loaded or the file could not be written.
+ */
+bool calibrateFlatField(std::string referenceFolder, bool isCrossData, std::string calibrationFile);
+
+/**
+ * Saves gain maps in a calibration file.
+ * @brief saveFlatField
+ * @param flatField
+ * @param calibrationFile
+ * @return false if the file could not be written.
+ */
+bool saveFlatField(const FlatField &flatField, std::string calibrationFile);
+
+/**
+ * Loads the gain maps of a calibration file.
+ * @brief loadFlatField
+ * @param calibrationFile
+ * @param flatField
+ * @return false if the file could not be read or is not a calibration file.
+ */
+bool loadFlatField(std::string calibrationFile, FlatField &flatField);
+
+/**
+ * Sets the calibration file applied to the captures (none by default, an empty path disables the correction).
+ * The file is loaded once, at the first capture.
+ * @brief setFlatFieldFile
+ * @param calibrationFile
+ */
+void setFlatFieldFile(std::string calibrationFile);
+
+/**
+ * Returns the calibration file applied to the captures, empty if none.
+ * @brief flatFieldFile
+ * @return
+ */
+std::string flatFieldFile();
+
+/**
+ * Returns the gain maps of flatFieldFile(), loaded at the first call.
+ * @brief currentFlatField
+ * @param flatField set to NULL if there is no calibration file.
+ * @return false if the calibration file could not be loaded.
+ */
+bool currentFlatField(const FlatField *&flatField);
+
+/**
+ * Returns true if gain maps can be applied to a region of a capture : the region is inside the calibrated images,
+ * the cross polarised gradients are calibrated if they are used and the rig has the same gradients.
+ * @brief flatFieldCovers
+ * @param flatField
+ * @param isCrossData
+ * @param region
+ * @return
+ */
+bool flatFieldCovers(const FlatField &flatField, bool isCrossData, cv::Rect region);
+
+/**
+ * Multiplies the gradients of a region of a capture by the checkerchart ratio and by their gains, interpolated
+ * between the centres of the cells, in a single parallel pass per gradient.
+ * @brief applyFlatFieldGains
+ * @param images numberOfGradients() gradients (CV_32FC3) of the region.
+ * @param gains gain maps of the gradients (parallelGains or crossGains).
+ * @param cellSize
+ * @param ratio BGR ratio returned by readCheckerchartRatios.
+ * @param region position of the images in the capture.
+ */
+void applyFlatFieldGains(cv::Mat images[], const cv::Mat gains[], int cellSize, cv::Vec3f ratio, cv::Rect region);
+
+/**
+ * Reads and decodes an image file of the ambient illumination (CV_8UC3) through the cache of the decoded ambient images.
+ * The image is shared with the cache and must not be modified.
+ * The cache keeps the ambient shots of the parallel and cross polarised folders of one session (2*numberOfShots() images).
+ * @brief readAmbientFile
+ * @param filePath
+ * @param image8U
+ * @return false if the file could not be read or decoded.
+ */
+bool readAmbientFile(std::string filePath, cv::Mat &image8U);
+
+#endif // CALIBRATION
@@ -0,0 +1,1009 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file capturetile.cpp
+ * \brief Implementation of the tile based computation of the reflectance maps.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the tile based computation of the reflectance maps.
+ */
+
+#include "capturetile.h"
+#include "regionofinterest.h"
+#include "calibration.h"
+#include "microfacet.h"
+#include "taskgraph.h"
+
+using namespace std;
+using namespace cv;
+
+CaptureStatistics::CaptureStatistics()
+{
+    for(int k = 0 ; k<MAXIMUM_NUMBER_OF_GRADIENTS ; k++)
+    {
+        parallelMaxima[k] = 0.0;
+        crossMaxima[k] = 0.0;
+    }
+
+    diffuseMaximum = 0.0;
+    specularMaximum = 0.0;
+
+    normalSum[0] = 0.0;
+    normalSum[1] = 0.0;
+    normalSum[2] = 0.0;
+    numberOfNormals = 0.0;
+}
+
+/**
+ * Merges the statistics of a tile into the statistics of the capture.
+ * Maxima are merged with a maximum, the normals and the invalid pixels are summed.
+ * @brief mergeCaptureStatistics
+ * @param statistics
+ * @param tileStatistics
+ */
+void mergeCaptureStatistics(CaptureStatistics &statistics, const CaptureStatistics &tileStatistics)
+{
+    for(int k = 0 ; k<MAXIMUM_NUMBER_OF_GRADIENTS ; k++)
+    {
+        statistics.parallelMaxima[k] = max(statistics.parallelMaxima[k], tileStatistics.parallelMaxima[k]);
+        statistics.crossMaxima[k] = max(statistics.crossMaxima[k], tileStatistics.crossMaxima[k]);
+    }
+
+    statistics.diffuseMaximum = max(statistics.diffuseMaximum, tileStatistics.diffuseMaximum);
+    statistics.specularMaximum = max(statistics.specularMaximum, tileStatistics.specularMaximum);
+
+    statistics.normalSum[0] += tileStatistics.normalSum[0];
+    statistics.normalSum[1] += tileStatistics.normalSum[1];
+    statistics.normalSum[2] += tileStatistics.normalSum[2];
+    statistics.numberOfNormals += tileStatistics.numberOfNormals;
+
+    mergePixelDiagnostics(statistics.diagnostics, tileStatistics.diagnostics);
+}
+
+/**
+ * Reads the size of the capture (size of the mask).
+ * @brief readCaptureSize
+ * @param pathToFolder
+ * @param size
+ * @return false if the mask could not be loaded.
+ */
+bool readCaptureSize(string pathToFolder, Size &size)
+{
+    Mat mask;
+
+    if(!readImageFile(pathToFolder + "/mask.JPG", mask))
+    {
+        cerr << "Could not load image : " << pathToFolder + "/mask.JPG" << endl;
+        return false;
+    }
+
+    size = Size(mask.cols, mask.rows);
+
+    return true;
+}
+
+/**
+ * Splits an image into tiles of at most tileWidth x tileHeight pixels, row by row.
+ * @brief splitIntoTiles
+ * @param imageSize
+ * @param tileWidth
+ * @param tileHeight
+ * @return
+ */
+vector<Rect> splitIntoTiles(Size imageSize, int tileWidth, int tileHeight)
+{
+    vector<Rect> tiles;
+
+    tileWidth = max(1, tileWidth);
+    tileHeight = max(1, tileHeight);
+
+    for(int y = 0 ; y<imageSize.height ; y += tileHeight)
+    {
+        for(int x = 0 ; x<imageSize.width ; x += tileWidth)
+        {
+            tiles.push_back(Rect(x, y, min(tileWidth, imageSize.width-x), min(tileHeight, imageSize.height-y)));
+        }
+    }
+
+    return tiles;
+}
+
+/**
+ * Returns the flat field calibration to apply to a region of a capture (see calibration.h).
+ * @brief regionFlatField
+ * @param isCrossData
+ * @param region
+ * @param imageSize size of the capture, empty if unknown.
+ * @param flatField set to NULL if there is no calibration.
+ * @return false if the calibration could not be loaded or does not cover the region.
+ */
+static bool regionFlatField(bool isCrossData, Rect region, Size imageSize, const FlatField *&flatField)
+{
+    if(!currentFlatField(flatField))
+    {
+        return false;
+    }
+
+    if(flatField && (!flatFieldCovers(*flatField, isCrossData, region) || (imageSize.area() > 0 && imageSize != flatField->imageSize)))
+    {
+        cerr << "The flat field calibration " << flatFieldFile() << " was not made for this capture" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * White balancing with the checkerchart : multiplies the gradients of a tile by the checkerchart ratios,
+ * and by the gains of the flat field calibration in the same pass if there is one.
+ * @brief applyTileRatios
+ * @param tile
+ * @param flatField
+ * @param ratioPar
+ * @param ratioCross
+ */
+static void applyTileRatios(CaptureTile &tile, const FlatField *flatField, Vec3f ratioPar, Vec3f ratioCross)
+{
+    if(flatField)
+    {
+        applyFlatFieldGains(tile.parallelData, flatField->parallelGains, flatField->cellSize, ratioPar, tile.region);
+    }
+    else
+    {
+        applyCheckerchartRatios(tile.parallelData, numberOfGradients(), ratioPar);
+    }
+
+    if(tile.isCrossData && flatField)
+    {
+        applyFlatFieldGains(tile.crossData, flatField->crossGains, flatField->cellSize, ratioCross, tile.region);
+    }
+    else if(tile.isCrossData)
+    {
+        applyCheckerchartRatios(tile.crossData, numberOfGradients(), ratioCross);
+    }
+}
+
+/**
+ * Loads the region of the capture corresponding to the tile : mask, gradients without ambient illumination
+ * and applies the checkerchart ratios and the gains of the flat field calibration, if any (see calibration.h).
+ * With several shots per image, the shots are averaged and the noise map
+ * of the tile is computed if noiseMapEnabled(). The saturated pixels of the tile are recorded.
+ * @brief loadCaptureTile
+ * @param pathToFolder
+ * @param isCrossData
+ * @param region
+ * @param tile
+ * @return false if one of the files could not be loaded.
+ */
+bool loadCaptureTile(string pathToFolder, bool isCrossData, Rect region, CaptureTile &tile)
+{
+    tile.isCrossData = isCrossData;
+
+    if(!loadLinearImage(pathToFolder + "/mask.JPG", tile.mask, false, region))
+    {
+        return false;
+    }
+
+    //An empty region is the whole capture
+    tile.region = region.area() > 0 ? region : Rect(0, 0, tile.mask.cols, tile.mask.rows);
+
+    const FlatField *flatField = NULL;
+
+    if(!regionFlatField(isCrossData, tile.region, region.area() > 0 ? Size() : tile.region.size(), flatField))
+    {
+        return false;
+    }
+
+    tile.saturatedPixels.clear();
+
+    //The variances of the shots are summed in the noise map of the tile
+    tile.maps.noise.release();
+    Mat *noise = noiseMapEnabled() ? &tile.maps.noise : NULL;
+
+    if(!loadGradientImages(pathToFolder, "par", PARALLEL_FIRST_IMAGE_NUMBER, tile.parallelData, region, noise, &tile.saturatedPixels))
+    {
+        return false;
+    }
+
+    if(isCrossData && !loadGradientImages(pathToFolder, "cross", CROSS_FIRST_IMAGE_NUMBER, tile.crossData, region, noise, &tile.saturatedPixels))
+    {
+        return false;
+    }
+
+    if(noise)
+    {
+        finalizeNoiseMap(tile.maps.noise, numberOfGradients()*(isCrossData ? 2 : 1));
+    }
+
+    Vec3f ratioPar, ratioCross;
+
+    if(!readCheckerchartRatios(pathToFolder, isCrossData, ratioPar, ratioCross))
+    {
+        return false;
+    }
+
+    applyTileRatios(tile, flatField, ratioPar, ratioCross);
+
+    return true;
+}
+
+/**
+ * Decodes the gradient images and the ambient illumination of a folder (par or cross) as 8 bits images.
+ * With several shots per image, the shots are averaged in float one image at a time and the averages are kept
+ * as 16 bits images with the gamma of the image (see linearizeGradientFrames).
+ * @brief loadGradientFrames
+ * @param pathToFolder
+ * @param subFolder
+ * @param firstImageNumber
+ * @param frames array of numberOfGradients()+1 images, the last one is the ambient illumination.
+ * @param noise if not NULL, the variances of the shots of the gradients are added to it.
+ * @return false if one of the images could not be loaded.
+ */
+static bool loadGradientFrames(string pathToFolder, string subFolder, unsigned int firstImageNumber, Mat frames[], Mat *noise)
+{
+    Mat mean;
+
+    for(int i = 0 ; i<=numberOfGradients() ; i++)
+    {
+        if(numberOfShots() > 1)
+        {
+            double gamma = i < numberOfGradients() ? 2.2 : 1.0;
+
+            if(!loadAveragedImage(pathToFolder, subFolder, firstImageNumber, i, gamma, Rect(), mean,
+                                  i < numberOfGradients() ? noise : NULL))
+            {
+                return false;
+            }
+
+            encodeAveragedImage(mean, gamma, frames[i]);
+            continue;
+        }
+
+        string filePath = shotFilePath(pathToFolder, subFolder, firstImageNumber, i, 0);
+        bool isRead = i == numberOfGradients() ? readAmbientFile(filePath, frames[i]) : readImageFile(filePath, frames[i]);
+
+        if(!isRead)
+        {
+            cerr << "Could not load image : " << filePath << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Decodes all the images of a capture as 8 bits images and reads the checkerchart ratios.
+ * With several shots per image, the averages of the shots are kept as 16 bits images
+ * and the noise map is computed if noiseMapEnabled().
+ * @brief loadCaptureFrames
+ * @param pathToFolder
+ * @param isCrossData
+ * @param frames
+ * @return false if one of the files could not be loaded or if the flat field calibration was not made for the capture.
+ */
+bool loadCaptureFrames(string pathToFolder, bool isCrossData, CaptureFrames &frames)
+{
+    frames.isCrossData = isCrossData;
+
+    if(!readImageFile(pathToFolder + "/mask.JPG", frames.mask))
+    {
+        cerr << "Could not load image : " << pathToFolder + "/mask.JPG" << endl;
+        return false;
+    }
+
+    const FlatField *flatField = NULL;
+    Rect capture(0, 0, frames.mask.cols, frames.mask.rows);
+
+    if(!regionFlatField(isCrossData, capture, capture.size(), flatField))
+    {
+        return false;
+    }
+
+    frames.noise.release();
+    Mat *noise = noiseMapEnabled() ? &frames.noise : NULL;
+
+    if(!loadGradientFrames(pathToFolder, "par", PARALLEL_FIRST_IMAGE_NUMBER, frames.parallelFrames, noise))
+    {
+        return false;
+    }
+
+    if(isCrossData && !loadGradientFrames(pathToFolder, "cross", CROSS_FIRST_IMAGE_NUMBER, frames.crossFrames, noise))
+    {
+        return false;
+    }
+
+    if(noise)
+    {
+        finalizeNoiseMap(frames.noise, numberOfGradients()*(isCrossData ? 2 : 1));
+    }
+
+    return readCheckerchartRatios(pathToFolder, isCrossData, frames.ratioPar, frames.ratioCross);
+}
+
+/**
+ * Converts a region of the gradient frames (8 bits, or 16 bits averages) to float and removes the gamma
+ * and the ambient illumination.
+ * @brief linearizeGradientFrames
+ * @param frames array of numberOfGradients()+1 images, the last one is the ambient illumination.
+ * @param region
+ * @param images
+ * @param saturatedPixels the saturated pixels of the gradients are added to it.
+ */
+static void linearizeGradientFrames(const Mat frames[], Rect region, Mat images[], vector<int> &saturatedPixels)
+{
+    for(int i = 0 ; i<numberOfGradients() ; i++)
+    {
+        linearizeImage(frames[i](region), images[i], 2.2);
+        markSaturatedPixels(images[i], saturatedPixels);
+    }
+
+    //Same as loadGradientImages : the gamma of the ambient illumination is not removed
+    Mat ambient;
+    linearizeImage(frames[numberOfGradients()](region), ambient, 1.0);
+
+    removeAmbientIllumination(images, numberOfGradients(), ambient);
+}
+
+/**
+ * Converts a region of the decoded frames to a tile, with the same computations as loadCaptureTile :
+ * linear mask, gradients without gamma and ambient illumination, checkerchart ratios and flat field gains, saturated pixels.
+ * The buffers of the tile are reused between the regions of the same size.
+ * @brief linearizeCaptureTile
+ * @param frames
+ * @param region
+ * @param tile
+ */
+void linearizeCaptureTile(const CaptureFrames &frames, Rect region, CaptureTile &tile)
+{
+    tile.isCrossData = frames.isCrossData;
+    tile.region = region;
+
+    linearizeImage(frames.mask(region), tile.mask, 1.0);
+
+    tile.saturatedPixels.clear();
+
+    linearizeGradientFrames(frames.parallelFrames, region, tile.parallelData, tile.saturatedPixels);
+
+    if(frames.isCrossData)
+    {
+        linearizeGradientFrames(frames.crossFrames, region, tile.crossData, tile.saturatedPixels);
+    }
+
+    //The calibration has been checked when the frames were loaded
+    const FlatField *flatField = NULL;
+    currentFlatField(flatField);
+
+    applyTileRatios(tile, flatField, frames.ratioPar, frames.ratioCross);
+}
+
+/**
+ * First reduction : maximum of each gradient image of the tile inside the mask.
+ * @brief accumulateGradientMaxima
+ * @param tile
+ * @param statistics
+ */
+void accumulateGradientMaxima(const CaptureTile &tile, CaptureStatistics &statistics)
+{
+    for(int k = 0 ; k<numberOfGradients() ; k++)
+    {
+        statistics.parallelMaxima[k] = max(statistics.parallelMaxima[k], maximumInMask(tile.parallelData[k], tile.mask));
+
+        if(tile.isCrossData)
+        {
+            statistics.crossMaxima[k] = max(statistics.crossMaxima[k], maximumInMask(tile.crossData[k], tile.mask));
+        }
+    }
+}
+
+/**
+ * Returns the maximum a gradient is divided by : its own maximum for the LCD screen, the maximum of the full illumination
+ * for the patterns of a description, whose relative intensities are used by the least squares solver (see illumination.h).
+ * @brief gradientMaximum
+ * @param maxima maxima of the gradients of the capture.
+ * @param k index of the gradient.
+ * @return
+ */
+static float gradientMaximum(const float maxima[], int k)
+{
+    return currentIlluminationPatterns() == NULL ? maxima[k] : maxima[0];
+}
+
+/**
+ * Stages of the computation of the maps of a tile in a task graph (see addTileMapTasks).
+ * @brief The TileMapTasks struct
+ */
+struct TileMapTasks
+{
+    //Diffuse and specular albedos (divided by the directional albedo with fresnelAlbedoEnabled())
+    int albedos;
+    //Normals and roughness
+    int normals;
+    //Counters of the invalid pixels of the tile (and their flags with invalidMaskEnabled())
+    int invalidPixels;
+};
+
+/**
+ * Adds the stages of computeTileMaps to a task graph : the scaling of each gradient, then the separation and
+ * the solvers of the normals and the roughness at the same time, then the Fresnel adjustment and the invalid pixels,
+ * that read the results of both. The solvers do not flag anything : the invalid pixels are counted afterwards in a single
+ * pass over the normals, the scaled order 0 gradients and the saturated pixels of the tile.
+ * @brief addTileMapTasks
+ * @param stages
+ * @param tile
+ * @param statistics global statistics containing the gradient maxima.
+ * @return the stages whose results are read by the second reduction.
+ */
+static TileMapTasks addTileMapTasks(TaskGraph &stages, CaptureTile &tile, const CaptureStatistics &statistics)
+{
+    bool diffuse = diffuseNormalsEnabled() && tile.isCrossData;
+    bool interleaved = interleavedGradients() && !perChannelMaps() && !diffuse;
+
+    //The gradients are scaled while they are packed : the gradients 1 to 6 are only read by the solvers
+    vector<int> packing;
+
+    if(interleaved)
+    {
+        packing.push_back(stages.addTask("gradient packing", [&tile, &statistics]()
+        {
+            interleaveGradients(tile.parallelData, statistics.parallelMaxima, tile.interleavedData);
+            return true;
+        }));
+    }
+
+    //Checkerchart scaling with the maxima of the whole capture, one stage per gradient
+    vector<int> parallelScaling, crossScaling;
+
+    for(int k = 0 ; k<numberOfGradients() ; k++)
+    {
+        //The order 0 gradient is packed before it is scaled in place
+        if(!interleaved || k == 0)
+        {
+            parallelScaling.push_back(stages.addTask("parallel polarised scaling", [&tile, &statistics, k]()
+            {
+                divideByMaximum(tile.parallelData[k], gradientMaximum(statistics.parallelMaxima, k));
+                return true;
+            }, packing));
+        }
+
+        if(tile.isCrossData)
+        {
+            crossScaling.push_back(stages.addTask("cross polarised scaling", [&tile, &statistics, k]()
+            {
+                divideByMaximum(tile.crossData[k], gradientMaximum(statistics.crossMaxima, k));
+                return true;
+            }));
+        }
+    }
+
+    vector<int> orderZeroScaling(1, parallelScaling[0]);
+
+    if(tile.isCrossData)
+    {
+        orderZeroScaling.push_back(crossScaling[0]);
+    }
+
+    //The maps are written in the buffers of the previous capture when they have the same size,
+    //otherwise they are taken from the buffer pool
+    int separation = stages.addTask("diffuse specular separation", [&tile]()
+    {
+        separateDiffuseSpecular(tile.parallelData[0], tile.isCrossData ? tile.crossData[0] : Mat(), tile.maps.diffuse, tile.maps.specular);
+        return true;
+    }, orderZeroScaling);
+
+    //The solvers read the packed gradients or the parallel polarised gradients, and the cross polarised gradients
+    //for the diffuse normals
+    vector<int> solverInputs = interleaved ? packing : parallelScaling;
+
+    if(diffuse)
+    {
+        solverInputs.insert(solverInputs.end(), crossScaling.begin(), crossScaling.end());
+    }
+
+    TileMapTasks tasks;
+    tasks.albedos = separation;
+
+    tasks.normals = stages.addTask("normals and roughness", [&tile, diffuse, interleaved]()
+    {
+        if(perChannelMaps())
+        {
+            computeChannelNormalsAndRoughness(tile.parallelData, tile.maps.blueNormals, tile.maps.normals, tile.maps.redNormals,
+                                              tile.maps.roughness, diffuse ? tile.crossData : NULL,
+                                              diffuse ? &tile.maps.diffuseNormals : NULL);
+        }
+        else if(interleaved)
+        {
+            tile.maps.redNormals.release();
+            tile.maps.blueNormals.release();
+
+            computeInterleavedNormalsAndRoughness(tile.interleavedData, tile.maps.normals, tile.maps.roughness);
+        }
+        else
+        {
+            tile.maps.redNormals.release();
+            tile.maps.blueNormals.release();
+
+            computeSpecularNormalsAndRoughness(tile.parallelData, diffuse ? tile.crossData : NULL, tile.maps.normals,
+                                               tile.maps.roughness, diffuse ? &tile.maps.diffuseNormals : NULL);
+        }
+
+        if(!diffuse)
+        {
+            tile.maps.diffuseNormals.release();
+        }
+
+        return true;
+    }, solverInputs);
+
+    //Normals not aligned yet (n.v) and alphas of the model, before the maximum of the specular albedo
+    const MicrofacetTable *microfacet = currentMicrofacetTable();
+
+    if(microfacet && fresnelAlbedoEnabled())
+    {
+        tasks.albedos = stages.addTask("Fresnel albedo", [&tile, microfacet]()
+        {
+            adjustSpecularAlbedo(tile.maps.specular, tile.maps.normals, tile.maps.roughness, *microfacet);
+            return true;
+        }, {separation, tasks.normals});
+    }
+
+    tasks.invalidPixels = stages.addTask("invalid pixels", [&tile]()
+    {
+        //The flag map is only allocated when it is saved
+        if(!invalidMaskEnabled())
+        {
+            tile.maps.invalid.release();
+        }
+
+        tile.diagnostics = PixelDiagnostics();
+
+        flagInvalidPixels(tile.mask, tile.parallelData[0], tile.isCrossData ? tile.crossData[0] : Mat(), tile.maps.blueNormals,
+                          tile.maps.normals, tile.maps.redNormals, tile.saturatedPixels,
+                          invalidMaskEnabled() ? &tile.maps.invalid : NULL, tile.diagnostics);
+        return true;
+    }, {separation, tasks.normals});
+
+    return tasks;
+}
+
+/**
+ * Scales the gradients of the tile with the global maxima and computes the diffuse and specular albedos,
+ * the specular normals (not aligned) and the roughness of the tile, of each colour channel if perChannelMaps().
+ * With interleavedGradients() (green channel only), the parallel gradients are packed in the gradient-major layout
+ * for the solvers and only the order 0 parallel gradient is scaled in place.
+ * With diffuseNormalsEnabled() and cross polarised data, the diffuse normals are computed in the same pass
+ * as the specular normals (the gradient-major layout, that has no cross polarised gradients, is then not used).
+ * With a microfacet model the roughness is its alpha and, with fresnelAlbedoEnabled(), the specular albedo is divided
+ * by the directional albedo of the model (see microfacet.h).
+ * The invalid pixels inside the mask are counted in the diagnostics of the tile, and flagged in its invalid map
+ * if invalidMaskEnabled() only.
+ * The stages are run as a task graph (see addTileMapTasks) : the separation and the solvers run at the same time.
+ * @brief computeTileMaps
+ * @param tile
+ * @param statistics global statistics containing the gradient maxima.
+ */
+void computeTileMaps(CaptureTile &tile, const CaptureStatistics &statistics)
+{
+    TaskGraph stages;
+    addTileMapTasks(stages, tile, statistics);
+
+    //The stages cannot fail
+    stages.run();
+}
+
+/**
+ * Releases the gradient images of a tile once its maps have been computed.
+ * @brief releaseTileGradients
+ * @param tile
+ */
+void releaseTileGradients(CaptureTile &tile)
+{
+    for(int k = 0 ; k<MAXIMUM_NUMBER_OF_GRADIENTS ; k++)
+    {
+        tile.parallelData[k].release();
+        tile.crossData[k].release();
+    }
+
+    tile.interleavedData.release();
+}
+
+/**
+ * Maximum of the albedos of the tile inside the mask.
+ * @brief accumulateAlbedoMaxima
+ * @param tile
+ * @param statistics
+ */
+static void accumulateAlbedoMaxima(const CaptureTile &tile, CaptureStatistics &statistics)
+{
+    if(!tile.maps.diffuse.empty())
+    {
+        statistics.diffuseMaximum = max(statistics.diffuseMaximum, maximumInMask(tile.maps.diffuse, tile.mask));
+    }
+
+    statistics.specularMaximum = max(statistics.specularMaximum, maximumInMask(tile.maps.specular, tile.mask));
+}
+
+/**
+ * Second reduction : maximum of the albedos, sum of the normals and number of invalid pixels of the tile inside the mask.
+ * @brief accumulateMapStatistics
+ * @param tile
+ * @param statistics
+ */
+void accumulateMapStatistics(const CaptureTile &tile, CaptureStatistics &statistics)
+{
+    accumulateAlbedoMaxima(tile, statistics);
+
+    accumulateSurfaceNormals(tile.maps.normals, tile.mask, statistics.normalSum, statistics.numberOfNormals);
+
+    mergePixelDiagnostics(statistics.diagnostics, tile.diagnostics);
+}
+
+/**
+ * Scales the albedos of the tile to the 0;1 range.
+ * @brief scaleTileAlbedos
+ * @param tile
+ * @param statistics global statistics containing the albedo maxima.
+ */
+static void scaleTileAlbedos(CaptureTile &tile, const CaptureStatistics &statistics)
+{
+    if(!tile.maps.diffuse.empty())
+    {
+        divideByMaximum(tile.maps.diffuse, statistics.diffuseMaximum);
+    }
+
+    divideByMaximum(tile.maps.specular, statistics.specularMaximum);
+}
+
+/**
+ * Aligns the normals of the tile (of each channel and the diffuse normals, if computed) with the global average surface normal.
+ * @brief alignTileNormals
+ * @param tile
+ * @param statistics global statistics containing the sum of the normals.
+ */
+static void alignTileNormals(CaptureTile &tile, const CaptureStatistics &statistics)
+{
+    Mat averageNormal = averageSurfaceNormal(statistics.normalSum, statistics.numberOfNormals);
+
+    rotateNormals(tile.maps.normals, averageNormal);
+
+    //Same rotation for all the channels
+    if(!tile.maps.redNormals.empty())
+    {
+        rotateNormals(tile.maps.redNormals, averageNormal);
+        rotateNormals(tile.maps.blueNormals, averageNormal);
+    }
+
+    if(!tile.maps.diffuseNormals.empty())
+    {
+        rotateNormals(tile.maps.diffuseNormals, averageNormal);
+    }
+}
+
+/**
+ * Scales the albedos of the tile to the 0;1 range and aligns its normals with the global average surface normal.
+ * @brief finalizeTileMaps
+ * @param tile
+ * @param statistics global statistics containing the albedo maxima and the sum of the normals.
+ */
+void finalizeTileMaps(CaptureTile &tile, const CaptureStatistics &statistics)
+{
+    scaleTileAlbedos(tile, statistics);
+
+    alignTileNormals(tile, statistics);
+}
+
+/**
+ * Copies the map of a tile at its place in the map of the whole capture.
+ * @brief pasteTileMap
+ * @param tileMap
+ * @param region
+ * @param imageSize
+ * @param map
+ */
+static void pasteTileMap(const Mat &tileMap, Rect region, Size imageSize, Mat &map)
+{
+    if(tileMap.empty())
+    {
+        return;
+    }
+
+    if(map.empty())
+    {
+        createPooledImage(map, imageSize.height, imageSize.width, tileMap.type());
+        map.setTo(Scalar::all(0));
+    }
+
+    Mat destination = map(region);
+    tileMap.copyTo(destination);
+}
+
+/**
+ * Copies the maps of a tile at their place in the maps of the whole capture.
+ * The maps of the capture are allocated at the first call.
+ * @brief pasteTileMaps
+ * @param tileMaps
+ * @param region
+ * @param imageSize
+ * @param maps
+ */
+void pasteTileMaps(const ReflectanceMaps &tileMaps, Rect region, Size imageSize, ReflectanceMaps &maps)
+{
+    pasteTileMap(tileMaps.diffuse, region, imageSize, maps.diffuse);
+    pasteTileMap(tileMaps.specular, region, imageSize, maps.specular);
+    pasteTileMap(tileMaps.normals, region, imageSize, maps.normals);
+    pasteTileMap(tileMaps.roughness, region, imageSize, maps.roughness);
+    pasteTileMap(tileMaps.redNormals, region, imageSize, maps.redNormals);
+    pasteTileMap(tileMaps.blueNormals, region, imageSize, maps.blueNormals);
+    pasteTileMap(tileMaps.diffuseNormals, region, imageSize, maps.diffuseNormals);
+    pasteTileMap(tileMaps.noise, region, imageSize, maps.noise);
+
+    if(invalidMaskEnabled())
+    {
+        pasteTileMap(tileMaps.invalid, region, imageSize, maps.invalid);
+    }
+}
+
+/**
+ * Integrates the aligned normals of a whole capture into its height map.
+ * The height map cannot be computed per tile : the integration is global.
+ * @brief computeCaptureHeightMap
+ * @param maps
+ * @param mask mask of the capture, linear (CV_32FC3) or decoded (CV_8UC3).
+ */
+void computeCaptureHeightMap(ReflectanceMaps &maps, const Mat &mask)
+{
+    Mat binaryMask;
+    makeBinaryMask(mask, binaryMask);
+
+    computeHeightMap(maps.normals, binaryMask, maps.height);
+}
+
+/**
+ * Builds the mip chains of the diffuse, specular, normal and roughness maps of a whole capture.
+ * @brief computeCaptureMipChain
+ * @param maps
+ * @param mask mask of the capture, linear (CV_32FC3) or decoded (CV_8UC3).
+ */
+void computeCaptureMipChain(ReflectanceMaps &maps, const Mat &mask)
+{
+    Mat binaryMask;
+    makeBinaryMask(mask, binaryMask);
+
+    buildMipChain(maps.diffuse, maps.specular, maps.normals, maps.roughness, binaryMask, maps.mipmaps);
+}
+
+/**
+ * Queues diffuse.pfm (with cross polarised data only) and specular.pfm to the output writer.
+ * @brief saveAlbedoMaps
+ * @param maps
+ * @param pathToFolder
+ */
+static void saveAlbedoMaps(const ReflectanceMaps &maps, string pathToFolder)
+{
+    if(!maps.diffuse.empty())
+    {
+        savePFMAsync(pathToFolder, maps.diffuse, pathToFolder + "/textures/diffuse.pfm");
+    }
+
+    savePFMAsync(pathToFolder, maps.specular, pathToFolder + "/textures/specular.pfm");
+}
+
+/**
+ * Queues normalMap.bmp (and normalMap_red.bmp, normalMap_blue.bmp, diffuseNormalMap.bmp if computed) to the output writer.
+ * @brief saveNormalMaps
+ * @param maps
+ * @param pathToFolder
+ */
+static void saveNormalMaps(const ReflectanceMaps &maps, string pathToFolder)
+{
+    saveNormalMapAsync(pathToFolder, maps.normals, pathToFolder + "/textures/normalMap.bmp");
+
+    if(!maps.redNormals.empty())
+    {
+        saveNormalMapAsync(pathToFolder, maps.redNormals, pathToFolder + "/textures/normalMap_red.bmp");
+        saveNormalMapAsync(pathToFolder, maps.blueNormals, pathToFolder + "/textures/normalMap_blue.bmp");
+    }
+
+    if(!maps.diffuseNormals.empty())
+    {
+        saveNormalMapAsync(pathToFolder, maps.diffuseNormals, pathToFolder + "/textures/diffuseNormalMap.bmp");
+    }
+}
+
+/**
+ * Queues invalid.pbm to the output writer if invalidMaskEnabled().
+ * @brief saveInvalidMap
+ * @param maps
+ * @param pathToFolder
+ */
+static void saveInvalidMap(const ReflectanceMaps &maps, string pathToFolder)
+{
+    if(!maps.invalid.empty() && invalidMaskEnabled())
+    {
+        //The header of the map keeps its buffer alive until the file is written
+        Mat invalid = maps.invalid;
+        string filePath = pathToFolder + "/textures/invalid.pbm";
+
+        writeOutputAsync(pathToFolder, filePath, [invalid, filePath]() { return saveInvalidMask(invalid, filePath); });
+    }
+}
+
+/**
+ * Queues the mip chains (if computed), compressed in DDS files with the quality given by compressionQuality(), to the output writer.
+ * @brief saveMipChains
+ * @param maps
+ * @param pathToFolder
+ */
+static void saveMipChains(const ReflectanceMaps &maps, string pathToFolder)
+{
+    saveMipChain(maps.mipmaps, pathToFolder);
+
+    if(!maps.mipmaps.normals.empty() && compressionQuality() != NO_COMPRESSION)
+    {
+        saveCompressedTextures(maps.mipmaps, pathToFolder, compressionQuality());
+    }
+}
+
+/**
+ * Queues the reflectance maps to the output writer (group pathToFolder, see waitForOutputs) : diffuse.pfm
+ * (with cross polarised data only), specular.pfm, normalMap.bmp (and normalMap_red.bmp, normalMap_blue.bmp,
+ * diffuseNormalMap.bmp if computed), roughness.pfm, height.pfm and the mip chains
+ * (if computed), compressed in DDS files with the quality given by compressionQuality(), noise.pfm (if computed)
+ * and invalid.pbm (if invalidMaskEnabled()) in the textures folder.
+ * The maps must not be modified until they are written.
+ * @brief saveReflectanceMaps
+ * @param maps
+ * @param pathToFolder
+ */
+void saveReflectanceMaps(const ReflectanceMaps &maps, string pathToFolder)
+{
+    saveAlbedoMaps(maps, pathToFolder);
+
+    saveNormalMaps(maps, pathToFolder);
+
+    savePFMAsync(pathToFolder, maps.roughness, pathToFolder + "/textures/roughness.pfm");
+
+    if(!maps.height.empty())
+    {
+        savePFMAsync(pathToFolder, maps.height, pathToFolder + "/textures/height.pfm");
+    }
+
+    if(!maps.noise.empty())
+    {
+        savePFMAsync(pathToFolder, maps.noise, pathToFolder + "/textures/noise.pfm");
+    }
+
+    saveInvalidMap(maps, pathToFolder);
+
+    saveMipChains(maps, pathToFolder);
+}
+
+/**
+ * Computes and saves the reflectance maps of a whole capture processed as a single tile.
+ * The images of the tile are kept between the calls : successive captures of the same size reuse the same buffers.
+ * After the first reduction, the computation is a task graph : the stages of computeTileMaps, then each statistic
+ * of the second reduction as soon as the maps it reads are computed, then the scaling of the albedos, the alignment
+ * of the normals, the height map and the mip chains. Each map is queued to the output writer as soon as it is final,
+ * so that the files are written while the next stages run.
+ * The files are written in the background : waitForOutputs(pathToFolder) waits for them.
+ * @brief computeCaptureMaps
+ * @param pathToFolder
+ * @param isCrossData
+ * @param capture
+ * @return false if one of the files could not be loaded.
+ */
+bool computeCaptureMaps(string pathToFolder, bool isCrossData, CaptureTile &capture)
+{
+    CaptureStatistics statistics;
+
+    if(!loadCaptureTile(pathToFolder, isCrossData, Rect(), capture))
+    {
+        return false;
+    }
+
+    accumulateGradientMaxima(capture, statistics);
+
+    ReflectanceMaps &maps = capture.maps;
+
+    if(!maps.noise.empty())
+    {
+        savePFMAsync(pathToFolder, maps.noise, pathToFolder + "/textures/noise.pfm");
+    }
+
+    TaskGraph stages;
+    TileMapTasks tasks = addTileMapTasks(stages, capture, statistics);
+
+    //Second reduction : each statistic is written by a single stage
+    int albedoMaxima = stages.addTask("albedo maxima", [&]()
+    {
+        accumulateAlbedoMaxima(capture, statistics);
+        return true;
+    }, {tasks.albedos});
+
+    int normalSum = stages.addTask("sum of the normals", [&]()
+    {
+        accumulateSurfaceNormals(maps.normals, capture.mask, statistics.normalSum, statistics.numberOfNormals);
+        return true;
+    }, {tasks.normals});
+
+    int invalidCount = stages.addTask("invalid pixel count", [&]()
+    {
+        mergePixelDiagnostics(statistics.diagnostics, capture.diagnostics);
+        saveInvalidMap(maps, pathToFolder);
+        return true;
+    }, {tasks.invalidPixels});
+
+    stages.addTask("capture statistics", [&]()
+    {
+        printPixelDiagnostics(statistics.diagnostics, pathToFolder);
+        storeCaptureStatistics(pathToFolder, isCrossData, Size(capture.mask.cols, capture.mask.rows), statistics);
+        return true;
+    }, {albedoMaxima, normalSum, invalidCount});
+
+    //The roughness is final once computed
+    stages.addTask("roughness output", [&]()
+    {
+        savePFMAsync(pathToFolder, maps.roughness, pathToFolder + "/textures/roughness.pfm");
+        return true;
+    }, {tasks.normals});
+
+    int albedoScaling = stages.addTask("albedo scaling", [&]()
+    {
+        scaleTileAlbedos(capture, statistics);
+        saveAlbedoMaps(maps, pathToFolder);
+        return true;
+    }, {albedoMaxima});
+
+    //The Fresnel adjustment and the invalid pixels read the normals before they are aligned
+    int alignment = stages.addTask("normal alignment", [&]()
+    {
+        alignTileNormals(capture, statistics);
+        saveNormalMaps(maps, pathToFolder);
+        return true;
+    }, {normalSum, tasks.albedos, tasks.invalidPixels});
+
+    stages.addTask("height map", [&]()
+    {
+        computeCaptureHeightMap(maps, capture.mask);
+        savePFMAsync(pathToFolder, maps.height, pathToFolder + "/textures/height.pfm");
+        return true;
+    }, {alignment});
+
+    stages.addTask("mip chains", [&]()
+    {
+        computeCaptureMipChain(maps, capture.mask);
+        saveMipChains(maps, pathToFolder);
+        return true;
+    }, {albedoScaling, alignment});
+
+    return stages.run();
+}
@@ -0,0 +1,333 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file capturetile.h
+ * \brief Implementation of the tile based computation of the reflectance maps.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * A capture is split into tiles that are processed independently.
+ * The only operations that need the whole image are the two global reductions :
+ * the maximum used by scaleTo01Range and the average surface normal used by rotateNormals.
+ * They are stored in a CaptureStatistics that is merged over all the tiles between the steps of the computation.
+ */
+
+#ifndef CAPTURETILE
+#define CAPTURETILE
+
+#include "reflectance.h"
+#include "mipchain.h"
+#include "blockcompression.h"
+#include "outputwriter.h"
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+
+/**
+ * Global statistics of a capture, obtained by merging the statistics of all its tiles.
+ * @brief The CaptureStatistics struct
+ */
+struct CaptureStatistics
+{
+    CaptureStatistics();
+
+    //Maximum of each gradient image after the checkerchart scaling (scaleTo01Range)
+    float parallelMaxima[MAXIMUM_NUMBER_OF_GRADIENTS];
+    float crossMaxima[MAXIMUM_NUMBER_OF_GRADIENTS];
+
+    //Maximum of the diffuse and specular albedos (scaleTo01Range)
+    float diffuseMaximum;
+    float specularMaximum;
+
+    //Sum of the normals inside the mask, XYZ (accumulateSurfaceNormals)
+    double normalSum[3];
+    double numberOfNormals;
+
+    //Number of invalid pixels inside the mask (see diagnostics.h)
+    PixelDiagnostics diagnostics;
+};
+
+/**
+ * Reflectance maps of a tile or of a whole capture. The diffuse map is empty without cross polarised data.
+ * @brief The ReflectanceMaps struct
+ */
+struct ReflectanceMaps
+{
+    cv::Mat diffuse;
+    cv::Mat specular;
+    cv::Mat normals;
+    cv::Mat roughness;
+
+    //Normals of the red and blue channels (perChannelMaps() only, the normals are those of the green channel)
+    cv::Mat redNormals;
+    cv::Mat blueNormals;
+
+    //Diffuse normals of the green channel of the cross polarised data (diffuseNormalsEnabled() only)
+    cv::Mat diffuseNormals;
+
+    //Integrated from the normals of the whole capture (computeCaptureHeightMap)
+    cv::Mat height;
+
+    //Mip chains of the maps of the whole capture (computeCaptureMipChain)
+    MipChain mipmaps;
+
+    //Variance of the shots (see multishot.h), empty unless noiseMapEnabled()
+    cv::Mat noise;
+
+    //Flags of the invalid pixels (see diagnostics.h), kept for the whole capture if invalidMaskEnabled() only
+    cv::Mat invalid;
+};
+
+/**
+ * Data of one tile of a capture.
+ * @brief The CaptureTile struct
+ */
+struct CaptureTile
+{
+    cv::Rect region;
+    bool isCrossData;
+
+    cv::Mat mask;
+    //numberOfGradients() gradients
+    cv::Mat parallelData[MAXIMUM_NUMBER_OF_GRADIENTS];
+    cv::Mat crossData[MAXIMUM_NUMBER_OF_GRADIENTS];
+
+    //Green channel of the parallel gradients in the gradient-major layout, interleavedGradients() only
+    cv::Mat interleavedData;
+
+    //Pixels saturated in at least one gradient, sorted row-major indices (see markSaturatedPixels)
+    std::vector<int> saturatedPixels;
+
+    ReflectanceMaps maps;
+
+    //Invalid pixels of the tile inside the mask, counted by computeTileMaps
+    PixelDiagnostics diagnostics;
+};
+
+/**
+ * Decoded 8 bits images of a whole capture. They are kept in memory (3 bytes per pixel instead of 12)
+ * so that the capture can be converted to float one strip at a time.
+ * @brief The CaptureFrames struct
+ */
+struct CaptureFrames
+{
+    bool isCrossData;
+
+    cv::Mat mask;
+
+    //numberOfGradients() gradients followed by the ambient illumination (CV_16UC3 averages with several shots per image)
+    cv::Mat parallelFrames[MAXIMUM_NUMBER_OF_GRADIENTS+1];
+    cv::Mat crossFrames[MAXIMUM_NUMBER_OF_GRADIENTS+1];
+
+    //Variance of the shots of the whole capture, empty unless noiseMapEnabled()
+    cv::Mat noise;
+
+    //Checkerchart ratios (BGR)
+    cv::Vec3f ratioPar;
+    cv::Vec3f ratioCross;
+};
+
+/**
+ * Merges the statistics of a tile into the statistics of the capture.
+ * Maxima are merged with a maximum, the normals and the invalid pixels are summed.
+ * @brief mergeCaptureStatistics
+ * @param statistics
+ * @param tileStatistics
+ */
+void mergeCaptureStatistics(CaptureStatistics &statistics, const CaptureStatistics &tileStatistics);
+
+/**
+ * Reads the size of the capture (size of the mask).
+ * @brief readCaptureSize
+ * @param pathToFolder
+ * @param size
+ * @return false if the mask could not be loaded.
+ */
+bool readCaptureSize(std::string pathToFolder, cv::Size &size);
+
+/**
+ * Splits an image into tiles of at most tileWidth x tileHeight pixels, row by row.
+ * @brief splitIntoTiles
+ * @param imageSize
+ * @param tileWidth
+ * @param tileHeight
+ * @return
+ */
+std::vector<cv::Rect> splitIntoTiles(cv::Size imageSize, int tileWidth, int tileHeight);
+
+/**
+ * Loads the region of the capture corresponding to the tile : mask, gradients without ambient illumination
+ * and applies the checkerchart ratios and the gains of the flat field calibration, if any (see calibration.h).
+ * With several shots per image, the shots are averaged and the noise map
+ * of the tile is computed if noiseMapEnabled(). The saturated pixels of the tile are recorded.
+ * @brief loadCaptureTile
+ * @param pathToFolder
+ * @param isCrossData
+ * @param region
+ * @param tile
+ * @return false if one of the files could not be loaded.
+ */
+bool loadCaptureTile(std::string pathToFolder, bool isCrossData, cv::Rect region, CaptureTile &tile);
+
+/**
+ * Decodes all the images of a capture as 8 bits images and reads the checkerchart ratios.
+ * With several shots per image, the averages of the shots are kept as 16 bits images
+ * and the noise map is computed if noiseMapEnabled().
+ * @brief loadCaptureFrames
+ * @param pathToFolder
+ * @param isCrossData
+ * @param frames
+ * @return false if one of the files could not be loaded or if the flat field calibration was not made for the capture.
+ */
+bool loadCaptureFrames(std::string pathToFolder, bool isCrossData, CaptureFrames &frames);
+
+/**
+ * Converts a region of the decoded frames to a tile, with the same computations as loadCaptureTile :
+ * linear mask, gradients without gamma and ambient illumination, checkerchart ratios and flat field gains, saturated pixels.
+ * The buffers of the tile are reused between the regions of the same size.
+ * @brief linearizeCaptureTile
+ * @param frames
+ * @param region
+ * @param tile
+ */
+void linearizeCaptureTile(const CaptureFrames &frames, cv::Rect region, CaptureTile &tile);
+
+/**
+ * First reduction : maximum of each gradient image of the tile inside the mask.
+ * @brief accumulateGradientMaxima
+ * @param tile
+ * @param statistics
+ */
+void accumulateGradientMaxima(const CaptureTile &tile, CaptureStatistics &statistics);
+
+/**
+ * Scales the gradients of the tile with the global maxima and computes the diffuse and specular albedos,
+ * the specular normals (not aligned) and the roughness of the tile, of each colour channel if perChannelMaps(),
+ * and the diffuse normals with diffuseNormalsEnabled() and cross polarised data.
+ * With a microfacet model the roughness is its alpha and, with fresnelAlbedoEnabled(), the specular albedo is divided
+ * by the directional albedo of the model (see microfacet.h).
+ * With interleavedGradients() (green channel only), the parallel gradients are packed in the gradient-major layout
+ * for the solvers and only the order 0 parallel gradient is scaled in place.
+ * The invalid pixels inside the mask are counted in the diagnostics of the tile, in a last pass over its results,
+ * and flagged in the invalid map of the tile if invalidMaskEnabled() only.
+ * The stages are run as a task graph (see taskgraph.h) : the gradients are scaled by one stage each,
+ * then the separation and the solvers of the normals and the roughness run at the same time.
+ * @brief computeTileMaps
+ * @param tile
+ * @param statistics global statistics containing the gradient maxima.
+ */
+void computeTileMaps(CaptureTile &tile, const CaptureStatistics &statistics);
+
+/**
+ * Releases the gradient images of a tile once its maps have been computed.
+ * @brief releaseTileGradients
+ * @param tile
+ */
+void releaseTileGradients(CaptureTile &tile);
+
+/**
+ * Second reduction : maximum of the albedos, sum of the normals and number of invalid pixels of the tile inside the mask.
+ * @brief accumulateMapStatistics
+ * @param tile
+ * @param statistics
+ */
+void accumulateMapStatistics(const CaptureTile &tile, CaptureStatistics &statistics);
+
+/**
+ * Scales the albedos of the tile to the 0;1 range and aligns its normals with the global average surface normal.
+ * @brief finalizeTileMaps
+ * @param tile
+ * @param statistics global statistics containing the albedo maxima and the sum of the normals.
+ */
+void finalizeTileMaps(CaptureTile &tile, const CaptureStatistics &statistics);
+
+/**
+ * Copies the maps of a tile at their place in the maps of the whole capture.
+ * The maps of the capture are allocated at the first call.
+ * @brief pasteTileMaps
+ * @param tileMaps
+ * @param region
+ * @param imageSize
+ * @param maps
+ */
+void pasteTileMaps(const ReflectanceMaps &tileMaps, cv::Rect region, cv::Size imageSize, ReflectanceMaps &maps);
+
+/**
+ * Integrates the aligned normals of a whole capture into its height map.
+ * The height map cannot be computed per tile : the integration is global.
+ * @brief computeCaptureHeightMap
+ * @param maps
+ * @param mask mask of the capture, linear (CV_32FC3) or decoded (CV_8UC3).
+ */
+void computeCaptureHeightMap(ReflectanceMaps &maps, const cv::Mat &mask);
+
+/**
+ * Builds the mip chains of the diffuse, specular, normal and roughness maps of a whole capture.
+ * @brief computeCaptureMipChain
+ * @param maps
+ * @param mask mask of the capture, linear (CV_32FC3) or decoded (CV_8UC3).
+ */
+void computeCaptureMipChain(ReflectanceMaps &maps, const cv::Mat &mask);
+
+/**
+ * Queues the reflectance maps to the output writer (group pathToFolder, see waitForOutputs) : diffuse.pfm
+ * (with cross polarised data only), specular.pfm, normalMap.bmp (and normalMap_red.bmp, normalMap_blue.bmp,
+ * diffuseNormalMap.bmp if computed), roughness.pfm, height.pfm and the mip chains
+ * (if computed), compressed in DDS files with the quality given by compressionQuality(), noise.pfm (if computed)
+ * and invalid.pbm (if invalidMaskEnabled()) in the textures folder.
+ * The maps must not be modified until they are written.
+ * @brief saveReflectanceMaps
+ * @param maps
+ * @param pathToFolder
+ */
+void saveReflectanceMaps(const ReflectanceMaps &maps, std::string pathToFolder);
+
+/**
+ * Computes and saves the reflectance maps of a whole capture processed as a single tile.
+ * The images of the tile are kept between the calls : successive captures of the same size reuse the same buffers.
+ * After the first reduction, the computation is a task graph : the stages of computeTileMaps, then each statistic
+ * of the second reduction as soon as the maps it reads are computed, then the scaling of the albedos, the alignment
+ * of the normals, the height map and the mip chains. Each map is queued to the output writer as soon as it is final,
+ * so that the files are written while the next stages run.
+ * The files are written in the background : waitForOutputs(pathToFolder) waits for them.
+ * @brief computeCaptureMaps
+ * @param pathToFolder
+ * @param isCrossData
+ * @param capture
+ * @return false if one of the files could not be loaded.
+ */
+bool computeCaptureMaps(std::string pathToFolder, bool isCrossData, CaptureTile &capture);
+
+#endif // CAPTURETILE
@@ -0,0 +1,854 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file daemon.cpp
+ * \brief Implementation of the daemon mode.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the daemon mode.
+ */
+
+#include "daemon.h"
+#include "bufferpool.h"
+#include "memoryplanner.h"
+#include "regionofinterest.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <sstream>
+#include <deque>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+
+/*---- POSIX ----*/
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+using namespace cv;
+
+//Number of finished jobs whose state can still be queried with STATUS <job_id>
+#define NUMBER_OF_JOB_RECORDS 1000
+
+//A client that disconnects must fail the send instead of raising SIGPIPE. MSG_NOSIGNAL does not exist on macOS and
+//the BSDs : their sockets are configured with SO_NOSIGPIPE instead (see disableBrokenPipeSignal)
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+/**
+ * A capture submitted to the daemon.
+ */
+struct DaemonJob
+{
+    int id;
+    string pathToFolder;
+    bool isCrossData;
+    string spoolFile;
+    chrono::steady_clock::time_point submitTime;
+
+    //ROI command : region to compute and connection of the client, answered by the job thread (-1 for a capture)
+    Rect region;
+    int clientSocket;
+};
+
+/**
+ * State of a job that can be queried with STATUS <job_id>.
+ */
+struct JobRecord
+{
+    string state;
+    double latency;
+
+    //Output files that could not be written
+    vector<string> failedFiles;
+};
+
+/**
+ * State shared by the main loop and the job threads.
+ */
+struct DaemonState
+{
+    mutex stateMutex;
+    condition_variable jobAvailable;
+    condition_variable memoryReleased;
+
+    deque<DaemonJob> queue;
+    map<int, JobRecord> records;
+
+    //ROI commands, computed by the job threads before the queued captures
+    deque<DaemonJob> regionQueue;
+    bool stopping;
+
+    int nextJobId;
+    int runningJobs;
+    int completedJobs;
+    int failedJobs;
+
+    double lastLatency;
+    double maximumLatency;
+    double totalLatency;
+    double totalProcessingTime;
+
+    //Memory that the jobs can use (0 without memory budget) and memory reserved by the running jobs
+    size_t availableMemory;
+    size_t reservedMemory;
+};
+
+/**
+ * Disables SIGPIPE on a socket where send has no MSG_NOSIGNAL flag (SO_NOSIGPIPE, macOS and the BSDs).
+ * @brief disableBrokenPipeSignal
+ * @param socketDescriptor
+ */
+static void disableBrokenPipeSignal(int socketDescriptor)
+{
+#ifdef SO_NOSIGPIPE
+    int noSignal = 1;
+    setsockopt(socketDescriptor, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#else
+    (void) socketDescriptor;
+#endif
+}
+
+/**
+ * Returns the number of milliseconds between two instants.
+ * @brief millisecondsBetween
+ * @param start
+ * @param end
+ * @return
+ */
+static double millisecondsBetween(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+{
+    return chrono::duration<double, milli>(end-start).count();
+}
+
+/**
+ * Parses "cross|nocross <path_to_folder>" and adds the job to the queue.
+ * @brief submitJob
+ * @param state
+ * @param description
+ * @param spoolFile
+ * @return the id of the job or -1 if the description is not valid.
+ */
+static int submitJob(DaemonState *state, string description, string spoolFile)
+{
+    istringstream stream(description);
+    string mode, pathToFolder;
+
+    stream >> mode;
+    getline(stream >> ws, pathToFolder);
+
+    //Remove the end of line of files written on Windows
+    while(!pathToFolder.empty() && (pathToFolder[pathToFolder.size()-1] == '\r' || pathToFolder[pathToFolder.size()-1] == '\n'))
+    {
+        pathToFolder.erase(pathToFolder.size()-1);
+    }
+
+    if((mode != "cross" && mode != "nocross") || pathToFolder.empty())
+    {
+        return -1;
+    }
+
+    DaemonJob job;
+    job.pathToFolder = pathToFolder;
+    job.isCrossData = mode == "cross";
+    job.spoolFile = spoolFile;
+    job.submitTime = chrono::steady_clock::now();
+    job.clientSocket = -1;
+
+    {
+        lock_guard<mutex> lock(state->stateMutex);
+
+        job.id = state->nextJobId++;
+        state->queue.push_back(job);
+
+        JobRecord record = {"QUEUED", 0.0, vector<string>()};
+        state->records[job.id] = record;
+
+        //Only the oldest finished job is forgotten : the queued and running jobs keep their state
+        if(state->records.size() > NUMBER_OF_JOB_RECORDS)
+        {
+            for(map<int, JobRecord>::iterator record = state->records.begin() ; record != state->records.end() ; record++)
+            {
+                if(record->second.state == "DONE" || record->second.state == "FAILED")
+                {
+                    state->records.erase(record);
+                    break;
+                }
+            }
+        }
+    }
+
+    state->jobAvailable.notify_one();
+
+    return job.id;
+}
+
+/**
+ * Processes a job within the memory budget of the daemon : the job waits until the running jobs leave enough memory
+ * for its predicted peak, so the number of concurrent captures depends on their size.
+ * @brief processJobWithinBudget
+ * @param state
+ * The reservation is kept until the files of the job are written, as the writer holds the maps.
+ * @param job
+ * @param failedFiles output files that could not be written.
+ * @return false if the capture could not be loaded or does not fit in the budget.
+ */
+static bool processJobWithinBudget(DaemonState *state, const DaemonJob &job, vector<string> &failedFiles)
+{
+    Size imageSize;
+
+    if(!readCaptureSize(job.pathToFolder, imageSize))
+    {
+        return false;
+    }
+
+    ExecutionPlan plan;
+
+    if(!planExecution(imageSize, job.isCrossData, state->availableMemory, plan))
+    {
+        cerr << "Job " << job.id << " does not fit in the memory budget : it needs at least "
+             << plan.predictedPeak/(1024*1024) << " MB" << endl;
+        return false;
+    }
+
+    {
+        unique_lock<mutex> lock(state->stateMutex);
+
+        while(state->reservedMemory > 0 && state->reservedMemory+plan.predictedPeak > state->availableMemory)
+        {
+            state->memoryReleased.wait(lock);
+        }
+
+        //The unused buffers of the pool are part of the resident memory : give them back if they do not fit
+        BufferPoolStatistics poolStatistics = globalBufferPool().statistics();
+
+        if(state->reservedMemory+plan.predictedPeak+poolStatistics.bytesReserved-poolStatistics.bytesInUse > state->availableMemory)
+        {
+            globalBufferPool().trim();
+        }
+
+        state->reservedMemory += plan.predictedPeak;
+    }
+
+    bool success = runExecutionPlan(job.pathToFolder, job.isCrossData, plan);
+
+    success = waitForOutputs(job.pathToFolder, failedFiles) && success;
+
+    {
+        lock_guard<mutex> lock(state->stateMutex);
+        state->reservedMemory -= plan.predictedPeak;
+    }
+
+    state->memoryReleased.notify_all();
+
+    cout << "Job " << job.id << " predicted peak " << plan.predictedPeak/(1024*1024) << " MB ("
+         << (plan.precision == FLOAT_FRAMES ? "float images" : "8 bits images") << ", strips of " << plan.stripHeight
+         << " rows), process peak " << peakResidentMemory()/(1024*1024) << " MB" << endl;
+
+    return success;
+}
+
+/**
+ * Records the end of a job : statistics, state of the job and spool file (.done or .failed).
+ * @brief finishJob
+ * @param state
+ * @param job
+ * @param success
+ * @param startTime start of the computation.
+ * @param failedFiles output files that could not be written.
+ */
+static void finishJob(DaemonState *state, const DaemonJob &job, bool success, chrono::steady_clock::time_point startTime,
+                      const vector<string> &failedFiles)
+{
+    chrono::steady_clock::time_point endTime = chrono::steady_clock::now();
+    double latency = millisecondsBetween(job.submitTime, endTime);
+
+    success = success && failedFiles.empty();
+
+    {
+        lock_guard<mutex> lock(state->stateMutex);
+
+        state->runningJobs--;
+
+        if(success)
+        {
+            state->completedJobs++;
+            state->lastLatency = latency;
+            state->maximumLatency = max(state->maximumLatency, latency);
+            state->totalLatency += latency;
+            state->totalProcessingTime += millisecondsBetween(startTime, endTime);
+        }
+        else
+        {
+            state->failedJobs++;
+        }
+
+        JobRecord record = {success ? "DONE" : "FAILED", latency, failedFiles};
+        state->records[job.id] = record;
+    }
+
+    if(!job.spoolFile.empty())
+    {
+        string baseName = job.spoolFile.substr(0, job.spoolFile.size()-string(".queued").size());
+        rename(job.spoolFile.c_str(), (baseName + (success ? ".done" : ".failed")).c_str());
+    }
+
+    for(unsigned int f = 0 ; f<failedFiles.size() ; f++)
+    {
+        cerr << "Job " << job.id << " could not write : " << failedFiles[f] << endl;
+    }
+
+    cout << "Job " << job.id << " " << job.pathToFolder << (success ? " done in " : " failed after ") << latency << " ms" << endl;
+}
+
+/**
+ * Computes the maps of a region (ROI command) with the statistics of the last computation of the capture,
+ * waits for their files and answers the client : OK <ms> or ERROR.
+ * @brief processRegionJob
+ * @param job
+ */
+static void processRegionJob(const DaemonJob &job)
+{
+    CaptureTile tile;
+    vector<string> failedFiles;
+    string answer;
+
+    if(!computeRegionMaps(job.pathToFolder, job.isCrossData, job.region, tile, true))
+    {
+        answer = "ERROR region not computed";
+    }
+    else
+    {
+        saveRegionMaps(tile.maps, job.pathToFolder);
+
+        if(!waitForOutputs(job.pathToFolder, failedFiles))
+        {
+            answer = "ERROR region not written";
+        }
+        else
+        {
+            ostringstream stream;
+            stream << "OK " << millisecondsBetween(job.submitTime, chrono::steady_clock::now());
+            answer = stream.str();
+        }
+    }
+
+    answer += "\n";
+    send(job.clientSocket, answer.c_str(), answer.size(), SEND_FLAGS);
+
+    close(job.clientSocket);
+}
+
+/**
+ * Job thread : processes the queued jobs until the daemon stops and the queue is empty.
+ * The regions (ROI command) are computed before the queued captures.
+ * Without memory budget, each thread keeps its own capture buffers between the jobs and starts the next job
+ * while the files of the previous one are written : the job is finished by the output writer.
+ * @brief processJobs
+ * @param state
+ */
+static void processJobs(DaemonState *state)
+{
+    CaptureTile capture;
+
+    while(true)
+    {
+        DaemonJob job;
+
+        {
+            unique_lock<mutex> lock(state->stateMutex);
+
+            while(state->queue.empty() && state->regionQueue.empty() && !state->stopping)
+            {
+                state->jobAvailable.wait(lock);
+            }
+
+            if(state->queue.empty() && state->regionQueue.empty())
+            {
+                return;
+            }
+
+            if(!state->regionQueue.empty())
+            {
+                job = state->regionQueue.front();
+                state->regionQueue.pop_front();
+            }
+            else
+            {
+                job = state->queue.front();
+                state->queue.pop_front();
+                state->runningJobs++;
+                state->records[job.id].state = "RUNNING";
+            }
+        }
+
+        if(job.clientSocket >= 0)
+        {
+            processRegionJob(job);
+            continue;
+        }
+
+        chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+        if(state->availableMemory > 0)
+        {
+            vector<string> failedFiles;
+            bool success = processJobWithinBudget(state, job, failedFiles);
+
+            finishJob(state, job, success, startTime, failedFiles);
+        }
+        else if(!computeCaptureMaps(job.pathToFolder, job.isCrossData, capture))
+        {
+            finishJob(state, job, false, startTime, vector<string>());
+        }
+        else
+        {
+            {
+                lock_guard<mutex> lock(state->stateMutex);
+                state->records[job.id].state = "WRITING";
+            }
+
+            whenOutputsWritten(job.pathToFolder, [state, job, startTime](const vector<string> &failedFiles) {
+                finishJob(state, job, true, startTime, failedFiles);
+            });
+        }
+    }
+}
+
+/**
+ * Accepts the .job files of the spool directory : they are renamed .queued and added to the queue.
+ * @brief scanSpoolDirectory
+ * @param state
+ * @param spoolDirectory
+ */
+static void scanSpoolDirectory(DaemonState *state, string spoolDirectory)
+{
+    DIR *directory = opendir(spoolDirectory.c_str());
+
+    if(directory == NULL)
+    {
+        return;
+    }
+
+    vector<string> jobFiles;
+    struct dirent *entry = NULL;
+
+    while((entry = readdir(directory)) != NULL)
+    {
+        string fileName = entry->d_name;
+
+        if(fileName.size() > 4 && fileName.compare(fileName.size()-4, 4, ".job") == 0)
+        {
+            jobFiles.push_back(fileName.substr(0, fileName.size()-4));
+        }
+    }
+
+    closedir(directory);
+
+    for(unsigned int i = 0 ; i<jobFiles.size() ; i++)
+    {
+        string jobFile = spoolDirectory + "/" + jobFiles[i] + ".job";
+        string queuedFile = spoolDirectory + "/" + jobFiles[i] + ".queued";
+
+        ifstream file(jobFile.c_str(), ios::in);
+        string description;
+        getline(file, description);
+        file.close();
+
+        if(rename(jobFile.c_str(), queuedFile.c_str()) != 0)
+        {
+            continue;
+        }
+
+        if(submitJob(state, description, queuedFile) < 0)
+        {
+            cerr << "Invalid job file : " << jobFile << endl;
+            rename(queuedFile.c_str(), (spoolDirectory + "/" + jobFiles[i] + ".failed").c_str());
+        }
+    }
+}
+
+/**
+ * Answers a command received on the socket. A ROI command is queued for the job threads, that answer the client.
+ * @brief answerCommand
+ * @param state
+ * @param command
+ * @param clientSocket connection of the client, kept open by a queued ROI command.
+ * @return the answer, without end of line, or an empty string if the command is answered by a job thread.
+ */
+static string answerCommand(DaemonState *state, string command, int clientSocket)
+{
+    istringstream stream(command);
+    string verb;
+    stream >> verb;
+
+    ostringstream answer;
+
+    if(verb == "SUBMIT")
+    {
+        string description;
+        getline(stream >> ws, description);
+
+        int jobId = submitJob(state, description, "");
+
+        if(jobId < 0)
+        {
+            answer << "ERROR usage : SUBMIT cross|nocross <path_to_folder>";
+        }
+        else
+        {
+            answer << "OK " << jobId;
+        }
+    }
+    else if(verb == "STATUS")
+    {
+        int jobId = -1;
+        lock_guard<mutex> lock(state->stateMutex);
+
+        if(stream >> jobId)
+        {
+            map<int, JobRecord>::iterator record = state->records.find(jobId);
+
+            if(record == state->records.end())
+            {
+                answer << "ERROR unknown job " << jobId;
+            }
+            else
+            {
+                answer << "JOB " << jobId << " " << record->second.state << " " << record->second.latency;
+
+                for(unsigned int f = 0 ; f<record->second.failedFiles.size() ; f++)
+                {
+                    answer << " NOT_WRITTEN " << record->second.failedFiles[f];
+                }
+            }
+        }
+        else
+        {
+            answer << "QUEUE " << state->queue.size() << " RUNNING " << state->runningJobs
+                   << " DONE " << state->completedJobs << " FAILED " << state->failedJobs
+                   << " LAST_MS " << state->lastLatency << " MAX_MS " << state->maximumLatency
+                   << " MEAN_MS " << (state->completedJobs > 0 ? state->totalLatency/state->completedJobs : 0.0)
+                   << " MEAN_PROCESSING_MS " << (state->completedJobs > 0 ? state->totalProcessingTime/state->completedJobs : 0.0);
+
+            //Successive captures of the same size should only reuse buffers
+            BufferPoolStatistics poolStatistics = globalBufferPool().statistics();
+
+            answer << " POOL_ALLOCATIONS " << poolStatistics.systemAllocations << " POOL_REUSES " << poolStatistics.reuses
+                   << " POOL_IN_USE_MB " << poolStatistics.bytesInUse/(1024*1024)
+                   << " POOL_RESERVED_MB " << poolStatistics.bytesReserved/(1024*1024);
+
+            if(state->availableMemory > 0)
+            {
+                answer << " MEMORY_RESERVED_MB " << state->reservedMemory/(1024*1024)
+                       << " MEMORY_AVAILABLE_MB " << state->availableMemory/(1024*1024)
+                       << " PEAK_RSS_MB " << peakResidentMemory()/(1024*1024);
+            }
+        }
+    }
+    else if(verb == "ROI")
+    {
+        string mode, regionText, pathToFolder;
+        Rect region;
+
+        stream >> mode >> regionText;
+        getline(stream >> ws, pathToFolder);
+
+        if((mode != "cross" && mode != "nocross") || !parseRegion(regionText, region) || pathToFolder.empty())
+        {
+            answer << "ERROR usage : ROI cross|nocross <x,y,w,h> <path_to_folder>";
+        }
+        else
+        {
+            //The images of the region are decoded by a job thread : the socket keeps accepting commands meanwhile
+            DaemonJob job;
+            job.id = -1;
+            job.pathToFolder = pathToFolder;
+            job.isCrossData = mode == "cross";
+            job.submitTime = chrono::steady_clock::now();
+            job.region = region;
+            job.clientSocket = clientSocket;
+
+            {
+                lock_guard<mutex> lock(state->stateMutex);
+                state->regionQueue.push_back(job);
+            }
+
+            state->jobAvailable.notify_one();
+
+            return "";
+        }
+    }
+    else if(verb == "QUIT")
+    {
+        lock_guard<mutex> lock(state->stateMutex);
+        state->stopping = true;
+        answer << "OK";
+    }
+    else
+    {
+        answer << "ERROR unknown command " << verb;
+    }
+
+    return answer.str();
+}
+
+/**
+ * Reads one command from a client, answers it and closes the connection (a ROI command is answered by a job thread).
+ * @brief handleClient
+ * @param state
+ * @param clientSocket
+ */
+static void handleClient(DaemonState *state, int clientSocket)
+{
+    string command;
+    char character = 0;
+
+    //Commands are short : give up on clients that do not send a full line quickly
+    pollfd clientPoll;
+    clientPoll.fd = clientSocket;
+    clientPoll.events = POLLIN;
+
+    while(command.size() < 4096 && poll(&clientPoll, 1, 1000) > 0 && recv(clientSocket, &character, 1, 0) == 1 && character != '\n')
+    {
+        command += character;
+    }
+
+    string answer = answerCommand(state, command, clientSocket);
+
+    //The connection now belongs to the job thread that answers the command
+    if(answer.empty())
+    {
+        return;
+    }
+
+    answer += "\n";
+    send(clientSocket, answer.c_str(), answer.size(), SEND_FLAGS);
+
+    close(clientSocket);
+}
+
+/**
+ * Runs the daemon until it receives the QUIT command.
+ * @brief runDaemon
+ * @param socketPath path of the Unix socket on which the commands are received.
+ * @param spoolDirectory directory scanned for .job files. Not scanned if empty.
+ * @param numberOfJobThreads maximum number of captures processed concurrently.
+ * @param memoryBudget total memory of the process in bytes, 0 for no budget.
+ * @return false if the socket could not be created.
+ */
+bool runDaemon(string socketPath, string spoolDirectory, int numberOfJobThreads, size_t memoryBudget)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if(socketPath.size() >= sizeof(address.sun_path))
+    {
+        cerr << "Socket path too long : " << socketPath << endl;
+        return false;
+    }
+
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path)-1);
+
+    //Remove the socket of a previous daemon
+    unlink(socketPath.c_str());
+
+    int serverSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(serverSocket < 0 || bind(serverSocket, (sockaddr*) &address, sizeof(address)) != 0 || listen(serverSocket, 16) != 0)
+    {
+        cerr << "Could not create the socket : " << socketPath << endl;
+
+        if(serverSocket >= 0)
+        {
+            close(serverSocket);
+        }
+
+        return false;
+    }
+
+    //Build the lookup tables before the first job
+    gammaLookupTable(1.0);
+    gammaLookupTable(2.2);
+
+    DaemonState state;
+    state.stopping = false;
+    state.nextJobId = 1;
+    state.runningJobs = 0;
+    state.completedJobs = 0;
+    state.failedJobs = 0;
+    state.lastLatency = 0.0;
+    state.maximumLatency = 0.0;
+    state.totalLatency = 0.0;
+    state.totalProcessingTime = 0.0;
+    state.availableMemory = 0;
+    state.reservedMemory = 0;
+
+    if(memoryBudget > 0)
+    {
+        size_t baseline = currentResidentMemory();
+
+        if(memoryBudget <= baseline)
+        {
+            cerr << "The memory budget is below the memory already used (" << baseline/(1024*1024) << " MB)" << endl;
+            close(serverSocket);
+            unlink(socketPath.c_str());
+            return false;
+        }
+
+        state.availableMemory = memoryBudget-baseline;
+    }
+
+    vector<thread> jobThreads;
+
+    for(int t = 0 ; t<max(1, numberOfJobThreads) ; t++)
+    {
+        jobThreads.push_back(thread(processJobs, &state));
+    }
+
+    cout << "Daemon listening on " << socketPath;
+    if(!spoolDirectory.empty())
+    {
+        cout << ", spool directory " << spoolDirectory;
+    }
+    if(state.availableMemory > 0)
+    {
+        cout << ", " << state.availableMemory/(1024*1024) << " MB available for the jobs";
+    }
+    cout << endl;
+
+    bool stopping = false;
+
+    while(!stopping)
+    {
+        pollfd serverPoll;
+        serverPoll.fd = serverSocket;
+        serverPoll.events = POLLIN;
+
+        //Wake up every second to scan the spool directory
+        if(poll(&serverPoll, 1, 1000) > 0)
+        {
+            int clientSocket = accept(serverSocket, NULL, NULL);
+
+            if(clientSocket >= 0)
+            {
+                disableBrokenPipeSignal(clientSocket);
+                handleClient(&state, clientSocket);
+            }
+        }
+
+        if(!spoolDirectory.empty())
+        {
+            scanSpoolDirectory(&state, spoolDirectory);
+        }
+
+        lock_guard<mutex> lock(state.stateMutex);
+        stopping = state.stopping;
+    }
+
+    close(serverSocket);
+    unlink(socketPath.c_str());
+
+    //The job threads finish the queued jobs before exiting
+    state.jobAvailable.notify_all();
+
+    for(unsigned int t = 0 ; t<jobThreads.size() ; t++)
+    {
+        jobThreads[t].join();
+    }
+
+    //The last jobs are finished once their files are written
+    vector<string> failedFiles;
+    flushOutputs(failedFiles);
+
+    return true;
+}
+
+/**
+ * Sends a command to a running daemon and returns its answer.
+ * @brief sendDaemonCommand
+ * @param socketPath
+ * @param command
+ * @param reply
+ * @return false if the daemon could not be reached.
+ */
+bool sendDaemonCommand(string socketPath, string command, string &reply)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path)-1);
+
+    int clientSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(clientSocket < 0 || connect(clientSocket, (sockaddr*) &address, sizeof(address)) != 0)
+    {
+        cerr << "Could not connect to the daemon : " << socketPath << endl;
+
+        if(clientSocket >= 0)
+        {
+            close(clientSocket);
+        }
+
+        return false;
+    }
+
+    disableBrokenPipeSignal(clientSocket);
+
+    command += "\n";
+    send(clientSocket, command.c_str(), command.size(), SEND_FLAGS);
+
+    reply.clear();
+    char character = 0;
+
+    while(recv(clientSocket, &character, 1, 0) == 1 && character != '\n')
+    {
+        reply += character;
+    }
+
+    close(clientSocket);
+
+    return true;
+}
@@ -0,0 +1,92 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file daemon.h
+ * \brief Implementation of the daemon mode.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * In daemon mode the program stays alive and processes the captures submitted on a local Unix socket
+ * or dropped in a spool directory. The job threads, the lookup tables and the image buffers are kept
+ * between the captures.
+ *
+ * Commands accepted on the socket (one line per connection, one line answered) :
+ *   SUBMIT cross|nocross <path_to_folder>   ->  OK <job_id>
+ *   STATUS                                  ->  QUEUE <n> RUNNING <n> DONE <n> FAILED <n> LAST_MS <t> MEAN_MS <t> MAX_MS <t> MEAN_PROCESSING_MS <t>
+ *                                               POOL_ALLOCATIONS <n> POOL_REUSES <n> POOL_IN_USE_MB <n> POOL_RESERVED_MB <n>
+ *                                               [MEMORY_RESERVED_MB <n> MEMORY_AVAILABLE_MB <n> PEAK_RSS_MB <n>] (with a memory budget)
+ *   STATUS <job_id>                         ->  JOB <job_id> QUEUED|RUNNING|WRITING|DONE|FAILED <latency_ms> [NOT_WRITTEN <file>]...
+ *   ROI cross|nocross <x,y,w,h> <path_to_folder>  ->  OK <ms> (maps of the region saved as textures/roi_*, see regionofinterest.h)
+ *   QUIT                                    ->  OK (the queued jobs are finished before exiting)
+ *
+ * A spool job is a file name.job containing "cross|nocross <path_to_folder>". It is renamed name.queued
+ * when it is accepted, then name.done or name.failed. A job is finished once its files are written (WRITING
+ * in the meantime) : the job thread starts the next job while the output writer writes them.
+ * The latency of a job is measured from its submission to the end of its computation.
+ * A region is computed by the next free job thread, before the queued captures, with the statistics of the last
+ * computation of the capture : the decoded images of the capture are kept for the next regions. The socket keeps
+ * accepting commands meanwhile, and the client of the ROI command waits for its answer.
+ *
+ * With a memory budget, each job is planned (see memoryplanner.h) and waits until the running jobs leave enough memory
+ * for its predicted peak.
+ */
+
+#ifndef DAEMON
+#define DAEMON
+
+#include "capturetile.h"
+
+/*---- Standard library ----*/
+#include <string>
+#include <cstddef>
+
+/**
+ * Runs the daemon until it receives the QUIT command.
+ * @brief runDaemon
+ * @param socketPath path of the Unix socket on which the commands are received.
+ * @param spoolDirectory directory scanned for .job files. Not scanned if empty.
+ * @param numberOfJobThreads maximum number of captures processed concurrently.
+ * @param memoryBudget total memory of the process in bytes, 0 for no budget.
+ * @return false if the socket could not be created.
+ */
+bool runDaemon(std::string socketPath, std::string spoolDirectory, int numberOfJobThreads, size_t memoryBudget);
+
+/**
+ * Sends a command to a running daemon and returns its answer.
+ * @brief sendDaemonCommand
+ * @param socketPath
+ * @param command
+ * @param reply
+ * @return false if the daemon could not be reached.
+ */
+bool sendDaemonCommand(std::string socketPath, std::string command, std::string &reply);
+
+#endif // DAEMON
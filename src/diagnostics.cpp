@@ -0,0 +1,310 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file diagnostics.cpp
+ * \brief Implementation of the counters of the invalid pixels of a capture.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the counters of the invalid pixels of a capture.
+ */
+
+#include "diagnostics.h"
+#include "bufferpool.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+static bool isInvalidMaskEnabled = false;
+
+/**
+ * Constructor : no invalid pixel.
+ */
+PixelDiagnostics::PixelDiagnostics()
+{
+    nanNormals = 0;
+    clampedPixels = 0;
+    zeroDivisions = 0;
+    saturatedPixels = 0;
+    invalidPixels = 0;
+}
+
+/**
+ * Enables the saving of the invalid pixels as a 1 bit mask (invalid.pbm).
+ * @brief setInvalidMaskEnabled
+ * @param enabled
+ */
+void setInvalidMaskEnabled(bool enabled)
+{
+    isInvalidMaskEnabled = enabled;
+}
+
+/**
+ * Returns true if the invalid pixels are saved as a 1 bit mask (false by default).
+ * @brief invalidMaskEnabled
+ * @return
+ */
+bool invalidMaskEnabled()
+{
+    return isInvalidMaskEnabled;
+}
+
+/**
+ * Adds the pixels of a linear image (CV_32FC3, before the removal of the ambient illumination) with a channel
+ * at the maximum of the camera (1.0) to the saturated pixels of a tile.
+ * @brief markSaturatedPixels
+ * @param image
+ * @param saturatedPixels indices of the pixels (row-major), sorted and without duplicates.
+ */
+void markSaturatedPixels(const Mat &image, vector<int> &saturatedPixels)
+{
+    size_t previousPixels = saturatedPixels.size();
+
+    for(int i = 0 ; i<image.rows ; i++)
+    {
+        const Vec3f *pixels = image.ptr<Vec3f>(i);
+
+        for(int j = 0 ; j<image.cols ; j++)
+        {
+            if(pixels[j].val[0] >= 1.0f || pixels[j].val[1] >= 1.0f || pixels[j].val[2] >= 1.0f)
+            {
+                saturatedPixels.push_back(i*image.cols+j);
+            }
+        }
+    }
+
+    //The pixels of the image are sorted : merged with those of the previous images
+    inplace_merge(saturatedPixels.begin(), saturatedPixels.begin()+previousPixels, saturatedPixels.end());
+    saturatedPixels.erase(unique(saturatedPixels.begin(), saturatedPixels.end()), saturatedPixels.end());
+}
+
+/**
+ * Flags and counts the invalid pixels of a range of rows, with counters per range added to the counters of the tile at the end.
+ */
+class InvalidPixelsBody : public ParallelLoopBody
+{
+public:
+    InvalidPixelsBody(const Mat &mask, const Mat &parallelImage, const Mat &crossImage, const Mat *normals[3],
+                      const vector<int> &saturatedPixels, Mat *invalid, PixelDiagnostics &diagnostics, mutex &diagnosticsMutex)
+        : m_mask(mask), m_parallelImage(parallelImage), m_crossImage(crossImage), m_normals(normals), m_saturatedPixels(saturatedPixels),
+          m_invalid(invalid), m_diagnostics(diagnostics), m_diagnosticsMutex(diagnosticsMutex) {}
+
+    void operator()(const Range &rows) const
+    {
+        int width = m_mask.cols;
+        bool isCrossData = !m_crossImage.empty();
+
+        //Channels of the order 0 gradient divided by the solvers : green only, or BGR with the normals of each channel
+        int firstChannel = m_normals[0]->empty() ? 1 : 0;
+        int lastChannel = m_normals[0]->empty() ? 1 : 2;
+
+        PixelDiagnostics diagnostics;
+        vector<int>::const_iterator saturated = lower_bound(m_saturatedPixels.begin(), m_saturatedPixels.end(), rows.start*width);
+
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            const Vec3f *maskPixels = m_mask.ptr<Vec3f>(i);
+            const Vec3f *parallelPixels = m_parallelImage.ptr<Vec3f>(i);
+            const Vec3f *crossPixels = isCrossData ? m_crossImage.ptr<Vec3f>(i) : NULL;
+            uchar *invalidFlags = m_invalid ? m_invalid->ptr<uchar>(i) : NULL;
+
+            for(int j = 0 ; j<width ; j++)
+            {
+                int flags = 0;
+
+                if(saturated != m_saturatedPixels.end() && *saturated == i*width+j)
+                {
+                    flags |= INVALID_SATURATED;
+                    saturated++;
+                }
+
+                //The background is not part of the sample
+                if(!(maskPixels[j].val[2] > 0.9))
+                {
+                    if(invalidFlags)
+                    {
+                        invalidFlags[j] = 0;
+                    }
+
+                    continue;
+                }
+
+                for(int c = firstChannel ; c<=lastChannel ; c++)
+                {
+                    //BGR = ZYX
+                    flags |= isnan(m_normals[c]->at<Vec3f>(i,j).val[0]) ? INVALID_NAN_NORMAL : 0;
+                    flags |= parallelPixels[j].val[c] == 0.0f ? INVALID_ZERO_DIVISION : 0;
+                }
+
+                //Same test as the sign of the difference in separateDiffuseSpecular
+                if(isCrossData && (parallelPixels[j].val[0] < crossPixels[j].val[0] || parallelPixels[j].val[1] < crossPixels[j].val[1]
+                                   || parallelPixels[j].val[2] < crossPixels[j].val[2]))
+                {
+                    flags |= INVALID_CLAMPED;
+                }
+
+                diagnostics.nanNormals += (flags & INVALID_NAN_NORMAL) ? 1 : 0;
+                diagnostics.clampedPixels += (flags & INVALID_CLAMPED) ? 1 : 0;
+                diagnostics.zeroDivisions += (flags & INVALID_ZERO_DIVISION) ? 1 : 0;
+                diagnostics.saturatedPixels += (flags & INVALID_SATURATED) ? 1 : 0;
+                diagnostics.invalidPixels += flags != 0 ? 1 : 0;
+
+                if(invalidFlags)
+                {
+                    invalidFlags[j] = flags;
+                }
+            }
+        }
+
+        lock_guard<mutex> lock(m_diagnosticsMutex);
+        mergePixelDiagnostics(m_diagnostics, diagnostics);
+    }
+
+private:
+    Mat m_mask;
+    Mat m_parallelImage;
+    Mat m_crossImage;
+    const Mat **m_normals;
+    const vector<int> &m_saturatedPixels;
+    Mat *m_invalid;
+    PixelDiagnostics &m_diagnostics;
+    mutex &m_diagnosticsMutex;
+};
+
+/**
+ * Flags the invalid pixels of a tile from its results and counts them inside the mask : NaN normals, divisions by
+ * a null order 0 gradient in the roughness, specular albedo clamped to 0 and saturated inputs.
+ * The rows are processed in parallel, each range of rows with its own counters : the counters need no map,
+ * the flags are only kept if invalid is not NULL.
+ * @brief flagInvalidPixels
+ * @param mask linear mask (CV_32FC3).
+ * @param parallelImage scaled order 0 parallel polarised gradient.
+ * @param crossImage scaled order 0 cross polarised gradient, empty without cross polarised data.
+ * @param blueNormals normals of the blue channel (not aligned), empty unless the normals are computed for each channel.
+ * @param normals normals of the green channel (not aligned).
+ * @param redNormals normals of the red channel (not aligned), empty unless the normals are computed for each channel.
+ * @param saturatedPixels saturated pixels of the tile (see markSaturatedPixels).
+ * @param invalid if not NULL, invalid map of the tile (CV_8UC1, taken from the buffer pool), 0 outside the mask.
+ * @param diagnostics the counters of the tile are added to it.
+ */
+void flagInvalidPixels(const Mat &mask, const Mat &parallelImage, const Mat &crossImage, const Mat &blueNormals, const Mat &normals,
+                       const Mat &redNormals, const vector<int> &saturatedPixels, Mat *invalid, PixelDiagnostics &diagnostics)
+{
+    if(invalid)
+    {
+        createPooledImage(*invalid, mask.rows, mask.cols, CV_8UC1);
+    }
+
+    const Mat *channelNormals[3] = {&blueNormals, &normals, &redNormals};
+    mutex diagnosticsMutex;
+
+    parallel_for_(Range(0, mask.rows), InvalidPixelsBody(mask, parallelImage, crossImage, channelNormals, saturatedPixels, invalid,
+                                                         diagnostics, diagnosticsMutex));
+}
+
+/**
+ * Adds the counters of a tile to the counters of the capture.
+ * @brief mergePixelDiagnostics
+ * @param diagnostics
+ * @param tileDiagnostics
+ */
+void mergePixelDiagnostics(PixelDiagnostics &diagnostics, const PixelDiagnostics &tileDiagnostics)
+{
+    diagnostics.nanNormals += tileDiagnostics.nanNormals;
+    diagnostics.clampedPixels += tileDiagnostics.clampedPixels;
+    diagnostics.zeroDivisions += tileDiagnostics.zeroDivisions;
+    diagnostics.saturatedPixels += tileDiagnostics.saturatedPixels;
+    diagnostics.invalidPixels += tileDiagnostics.invalidPixels;
+}
+
+/**
+ * Prints the summary of the invalid pixels of a capture.
+ * @brief printPixelDiagnostics
+ * @param diagnostics
+ * @param pathToFolder
+ */
+void printPixelDiagnostics(const PixelDiagnostics &diagnostics, string pathToFolder)
+{
+    cout << "Invalid pixels of " << pathToFolder << " : " << diagnostics.invalidPixels
+         << " (NaN normals : " << diagnostics.nanNormals
+         << ", clamped specular : " << diagnostics.clampedPixels
+         << ", divisions by 0 : " << diagnostics.zeroDivisions
+         << ", saturated : " << diagnostics.saturatedPixels << ")" << endl;
+}
+
+/**
+ * Saves the pixels with at least one flag as a 1 bit binary PBM image (P4, 1 = invalid).
+ * @brief saveInvalidMask
+ * @param invalid
+ * @param filePath
+ * @return false if the file could not be written.
+ */
+bool saveInvalidMask(const Mat &invalid, string filePath)
+{
+    ofstream file(filePath.c_str(), ios::out | ios::trunc | ios::binary);
+
+    if(!file)
+    {
+        return false;
+    }
+
+    file << "P4\n" << invalid.cols << " " << invalid.rows << "\n";
+
+    //Each row starts on a new byte, the first pixel is the most significant bit
+    vector<char> row((invalid.cols+7)/8);
+
+    for(int i = 0 ; i<invalid.rows ; i++)
+    {
+        const uchar *flags = invalid.ptr<uchar>(i);
+
+        fill(row.begin(), row.end(), 0);
+
+        for(int j = 0 ; j<invalid.cols ; j++)
+        {
+            if(flags[j] != 0)
+            {
+                row[j/8] |= (char) (0x80 >> (j%8));
+            }
+        }
+
+        file.write(&row[0], row.size());
+    }
+
+    return file.good();
+}
@@ -0,0 +1,146 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file diagnostics.h
+ * \brief Implementation of the counters of the invalid pixels of a capture.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The pixels whose result is not reliable are counted instead of logged : NaN normals (x^2+y^2 > 1 in sqrt(1-x^2-y^2)),
+ * specular albedo clamped to 0 (cross polarised value above the parallel polarised value), divisions by a null
+ * order 0 gradient in the roughness and saturated inputs. The saturated pixels are recorded while the gradients are loaded
+ * (the ambient illumination is removed afterwards), the other problems are found once the maps of the tile are computed,
+ * in a single parallel pass with counters per range of rows (flagInvalidPixels). The map of 8 bits flags (one per pixel)
+ * is only allocated to save the invalid pixels as a 1 bit mask (invalid.pbm, invalidMaskEnabled()).
+ * The counters of each tile are merged with the other statistics of the capture and printed once in a summary.
+ */
+
+#ifndef DIAGNOSTICS
+#define DIAGNOSTICS
+
+//Flags of the invalid map (CV_8UC1)
+#define INVALID_NAN_NORMAL 1
+#define INVALID_CLAMPED 2
+#define INVALID_ZERO_DIVISION 4
+#define INVALID_SATURATED 8
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+
+/**
+ * Number of invalid pixels of the sample (inside the mask), for each problem and in total (see flagInvalidPixels).
+ * A pixel can be counted for several problems but only once in invalidPixels.
+ * @brief The PixelDiagnostics struct
+ */
+struct PixelDiagnostics
+{
+    PixelDiagnostics();
+
+    long long nanNormals;
+    long long clampedPixels;
+    long long zeroDivisions;
+    long long saturatedPixels;
+    long long invalidPixels;
+};
+
+/**
+ * Enables the saving of the invalid pixels as a 1 bit mask (invalid.pbm).
+ * @brief setInvalidMaskEnabled
+ * @param enabled
+ */
+void setInvalidMaskEnabled(bool enabled);
+
+/**
+ * Returns true if the invalid pixels are saved as a 1 bit mask (false by default).
+ * @brief invalidMaskEnabled
+ * @return
+ */
+bool invalidMaskEnabled();
+
+/**
+ * Adds the pixels of a linear image (CV_32FC3, before the removal of the ambient illumination) with a channel
+ * at the maximum of the camera (1.0) to the saturated pixels of a tile.
+ * @brief markSaturatedPixels
+ * @param image
+ * @param saturatedPixels indices of the pixels (row-major), sorted and without duplicates.
+ */
+void markSaturatedPixels(const cv::Mat &image, std::vector<int> &saturatedPixels);
+
+/**
+ * Flags the invalid pixels of a tile from its results and counts them inside the mask : NaN normals, divisions by
+ * a null order 0 gradient in the roughness, specular albedo clamped to 0 and saturated inputs.
+ * The rows are processed in parallel, each range of rows with its own counters : the counters need no map,
+ * the flags are only kept if invalid is not NULL.
+ * @brief flagInvalidPixels
+ * @param mask linear mask (CV_32FC3).
+ * @param parallelImage scaled order 0 parallel polarised gradient.
+ * @param crossImage scaled order 0 cross polarised gradient, empty without cross polarised data.
+ * @param blueNormals normals of the blue channel (not aligned), empty unless the normals are computed for each channel.
+ * @param normals normals of the green channel (not aligned).
+ * @param redNormals normals of the red channel (not aligned), empty unless the normals are computed for each channel.
+ * @param saturatedPixels saturated pixels of the tile (see markSaturatedPixels).
+ * @param invalid if not NULL, invalid map of the tile (CV_8UC1, taken from the buffer pool), 0 outside the mask.
+ * @param diagnostics the counters of the tile are added to it.
+ */
+void flagInvalidPixels(const cv::Mat &mask, const cv::Mat &parallelImage, const cv::Mat &crossImage, const cv::Mat &blueNormals,
+                       const cv::Mat &normals, const cv::Mat &redNormals, const std::vector<int> &saturatedPixels, cv::Mat *invalid,
+                       PixelDiagnostics &diagnostics);
+
+/**
+ * Adds the counters of a tile to the counters of the capture.
+ * @brief mergePixelDiagnostics
+ * @param diagnostics
+ * @param tileDiagnostics
+ */
+void mergePixelDiagnostics(PixelDiagnostics &diagnostics, const PixelDiagnostics &tileDiagnostics);
+
+/**
+ * Prints the summary of the invalid pixels of a capture.
+ * @brief printPixelDiagnostics
+ * @param diagnostics
+ * @param pathToFolder
+ */
+void printPixelDiagnostics(const PixelDiagnostics &diagnostics, std::string pathToFolder);
+
+/**
+ * Saves the pixels with at least one flag as a 1 bit binary PBM image (P4, 1 = invalid).
+ * @brief saveInvalidMask
+ * @param invalid
+ * @param filePath
+ * @return false if the file could not be written.
+ */
+bool saveInvalidMask(const cv::Mat &invalid, std::string filePath);
+
+#endif // DIAGNOSTICS
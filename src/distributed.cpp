@@ -0,0 +1,851 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file distributed.cpp
+ * \brief Implementation of the distributed computation of the reflectance maps.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the distributed computation of the reflectance maps.
+ */
+
+#include "distributed.h"
+#include "regionofinterest.h"
+#include "calibration.h"
+#include "kernelprecision.h"
+#include "microfacet.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <functional>
+#include <cstring>
+#include <cerrno>
+
+/*---- POSIX ----*/
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+using namespace cv;
+
+//Requests waiting in the socket of a worker : the worker has its next tile while the coordinator reads a reply
+#define MAXIMUM_PENDING_TILES 2
+
+//A closed connection must fail the send instead of raising SIGPIPE. MSG_NOSIGNAL does not exist on macOS and the BSDs :
+//their sockets are configured with SO_NOSIGPIPE instead (see disableBrokenPipeSignal)
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+/**
+ * Type of the messages exchanged between the coordinator and the workers.
+ * Each request of the coordinator is answered by one message of the worker.
+ */
+enum MessageType
+{
+    MESSAGE_LOAD_TILE = 1,      //Coordinator -> worker : path, modes, region and shots of the tile
+    MESSAGE_GRADIENT_MAXIMA,    //Worker -> coordinator : statistics with the gradient maxima of the tile
+    MESSAGE_COMPUTE_MAPS,       //Coordinator -> worker : global statistics with the gradient maxima
+    MESSAGE_MAP_STATISTICS,     //Worker -> coordinator : statistics with the albedo maxima and the normals of the tile
+    MESSAGE_FINALIZE_TILE,      //Coordinator -> worker : global statistics
+    MESSAGE_TILE_MAPS,          //Worker -> coordinator : maps of the tile (ReflectanceMaps without height and mip chains)
+    MESSAGE_QUIT,               //Coordinator -> worker : end of the computation
+    MESSAGE_ERROR               //Worker -> coordinator : the tile could not be processed
+};
+
+/**
+ * Header sent before the payload of every message.
+ */
+struct MessageHeader
+{
+    int type;
+    int tileIndex;
+    unsigned long long payloadSize;
+};
+
+/**
+ * Disables SIGPIPE on a socket where send has no MSG_NOSIGNAL flag (SO_NOSIGPIPE, macOS and the BSDs).
+ * @brief disableBrokenPipeSignal
+ * @param socketDescriptor
+ */
+static void disableBrokenPipeSignal(int socketDescriptor)
+{
+#ifdef SO_NOSIGPIPE
+    int noSignal = 1;
+    setsockopt(socketDescriptor, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#else
+    (void) socketDescriptor;
+#endif
+}
+
+/**
+ * Sends size bytes on the socket.
+ * @brief sendAll
+ * @param socketDescriptor
+ * @param data
+ * @param size
+ * @return false if the connection is closed.
+ */
+static bool sendAll(int socketDescriptor, const char *data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t sentBytes = send(socketDescriptor, data, size, SEND_FLAGS);
+
+        if(sentBytes <= 0)
+        {
+            return false;
+        }
+
+        data += sentBytes;
+        size -= sentBytes;
+    }
+
+    return true;
+}
+
+/**
+ * Receives exactly size bytes from the socket.
+ * @brief receiveAll
+ * @param socketDescriptor
+ * @param data
+ * @param size
+ * @return false if the connection is closed.
+ */
+static bool receiveAll(int socketDescriptor, char *data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t receivedBytes = recv(socketDescriptor, data, size, 0);
+
+        if(receivedBytes <= 0)
+        {
+            return false;
+        }
+
+        data += receivedBytes;
+        size -= receivedBytes;
+    }
+
+    return true;
+}
+
+/**
+ * Sends a message (header and payload) on the socket.
+ * @brief sendMessage
+ * @param socketDescriptor
+ * @param type
+ * @param tileIndex
+ * @param payload
+ * @return false if the connection is closed.
+ */
+static bool sendMessage(int socketDescriptor, int type, int tileIndex, const vector<char> &payload)
+{
+    MessageHeader header;
+    header.type = type;
+    header.tileIndex = tileIndex;
+    header.payloadSize = payload.size();
+
+    if(!sendAll(socketDescriptor, (const char*) &header, sizeof(MessageHeader)))
+    {
+        return false;
+    }
+
+    return payload.empty() || sendAll(socketDescriptor, &payload[0], payload.size());
+}
+
+/**
+ * Receives a message (header and payload) from the socket.
+ * @brief receiveMessage
+ * @param socketDescriptor
+ * @param type
+ * @param tileIndex
+ * @param payload
+ * @return false if the connection is closed.
+ */
+static bool receiveMessage(int socketDescriptor, int &type, int &tileIndex, vector<char> &payload)
+{
+    MessageHeader header;
+
+    if(!receiveAll(socketDescriptor, (char*) &header, sizeof(MessageHeader)))
+    {
+        return false;
+    }
+
+    type = header.type;
+    tileIndex = header.tileIndex;
+    payload.resize(header.payloadSize);
+
+    return payload.empty() || receiveAll(socketDescriptor, &payload[0], payload.size());
+}
+
+/**
+ * Appends raw bytes at the end of a payload.
+ * @brief appendBytes
+ * @param payload
+ * @param data
+ * @param size
+ */
+static void appendBytes(vector<char> &payload, const void *data, size_t size)
+{
+    const char *bytes = (const char*) data;
+    payload.insert(payload.end(), bytes, bytes+size);
+}
+
+/**
+ * Reads raw bytes from a payload and moves the offset after them.
+ * @brief readBytes
+ * @param payload
+ * @param offset
+ * @param data
+ * @param size
+ * @return false if the payload is too short.
+ */
+static bool readBytes(const vector<char> &payload, size_t &offset, void *data, size_t size)
+{
+    if(offset+size > payload.size())
+    {
+        return false;
+    }
+
+    if(size > 0)
+    {
+        memcpy(data, &payload[offset], size);
+    }
+
+    offset += size;
+
+    return true;
+}
+
+/**
+ * Appends an image (rows, cols, type and pixels) at the end of a payload. Empty images are allowed.
+ * @brief appendMat
+ * @param payload
+ * @param image
+ */
+static void appendMat(vector<char> &payload, const Mat &image)
+{
+    int header[3] = {image.rows, image.cols, image.type()};
+    appendBytes(payload, header, sizeof(header));
+
+    if(!image.empty())
+    {
+        Mat continuousImage = image.isContinuous() ? image : image.clone();
+        appendBytes(payload, continuousImage.data, continuousImage.total()*continuousImage.elemSize());
+    }
+}
+
+/**
+ * Reads an image written by appendMat from a payload.
+ * @brief readMat
+ * @param payload
+ * @param offset
+ * @param image
+ * @return false if the payload is too short.
+ */
+static bool readMat(const vector<char> &payload, size_t &offset, Mat &image)
+{
+    int header[3] = {0, 0, 0};
+
+    if(!readBytes(payload, offset, header, sizeof(header)))
+    {
+        return false;
+    }
+
+    if(header[0] <= 0 || header[1] <= 0)
+    {
+        image.release();
+        return true;
+    }
+
+    image.create(header[0], header[1], header[2]);
+
+    return readBytes(payload, offset, image.data, image.total()*image.elemSize());
+}
+
+/**
+ * Receives the answer of a worker for a given tile and checks that it has the expected type.
+ * @brief receiveReply
+ * @param socketDescriptor
+ * @param expectedType
+ * @param tileIndex
+ * @param payload
+ * @return false if the worker failed or the connection is closed.
+ */
+static bool receiveReply(int socketDescriptor, int expectedType, int tileIndex, vector<char> &payload)
+{
+    int type = 0, replyTileIndex = -1;
+
+    if(!receiveMessage(socketDescriptor, type, replyTileIndex, payload))
+    {
+        cerr << "Lost the connection with the worker of tile " << tileIndex << endl;
+        return false;
+    }
+
+    if(type != expectedType || replyTileIndex != tileIndex)
+    {
+        cerr << "The worker could not process tile " << tileIndex << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Sends a request for every tile and reads the replies of the workers. At most MAXIMUM_PENDING_TILES requests wait
+ * per worker : a worker blocked while it sends a large reply never has unread requests filling the buffers of its socket,
+ * and it has its next tile to process while the coordinator reads the reply. The tiles of worker w are w, w+numberOfWorkers...
+ * and are answered in the order of their requests. The replies of the workers are read as soon as they arrive (poll).
+ * @brief exchangeTileMessages
+ * @param workerSockets
+ * @param numberOfTiles
+ * @param requestType
+ * @param replyType
+ * @param makeRequest fills the payload of the request of a tile.
+ * @param readReply reads the payload of the reply of a tile, returns false if it is not valid.
+ * @return false if one of the tiles failed.
+ */
+static bool exchangeTileMessages(const vector<int> &workerSockets, int numberOfTiles, int requestType, int replyType,
+                                 function<void(int, vector<char>&)> makeRequest, function<bool(int, const vector<char>&)> readReply)
+{
+    int numberOfWorkers = workerSockets.size();
+
+    //Next tile whose request is sent and next tile whose reply is read, for each worker
+    vector<int> nextRequest(numberOfWorkers), nextReply(numberOfWorkers);
+
+    for(int w = 0 ; w<numberOfWorkers ; w++)
+    {
+        nextRequest[w] = w;
+        nextReply[w] = w;
+    }
+
+    int numberOfReplies = 0;
+    vector<char> request, reply;
+
+    while(numberOfReplies < numberOfTiles)
+    {
+        vector<pollfd> workerPolls;
+        vector<int> pollWorkers;
+
+        for(int w = 0 ; w<numberOfWorkers ; w++)
+        {
+            while(nextRequest[w] < numberOfTiles && nextRequest[w]-nextReply[w] < MAXIMUM_PENDING_TILES*numberOfWorkers)
+            {
+                request.clear();
+                makeRequest(nextRequest[w], request);
+
+                if(!sendMessage(workerSockets[w], requestType, nextRequest[w], request))
+                {
+                    cerr << "Lost the connection with the worker of tile " << nextRequest[w] << endl;
+                    return false;
+                }
+
+                nextRequest[w] += numberOfWorkers;
+            }
+
+            if(nextReply[w] < nextRequest[w])
+            {
+                pollfd workerPoll;
+                workerPoll.fd = workerSockets[w];
+                workerPoll.events = POLLIN;
+                workerPoll.revents = 0;
+
+                workerPolls.push_back(workerPoll);
+                pollWorkers.push_back(w);
+            }
+        }
+
+        if(poll(&workerPolls[0], workerPolls.size(), -1) < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            cerr << "Lost the connection with the workers" << endl;
+            return false;
+        }
+
+        for(unsigned int p = 0 ; p<workerPolls.size() ; p++)
+        {
+            int w = pollWorkers[p];
+
+            if(workerPolls[p].revents == 0)
+            {
+                continue;
+            }
+
+            if(!receiveReply(workerSockets[w], replyType, nextReply[w], reply) || !readReply(nextReply[w], reply))
+            {
+                return false;
+            }
+
+            nextReply[w] += numberOfWorkers;
+            numberOfReplies++;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Sends the same request with the global statistics for every tile, then merges the statistics answered by the workers
+ * in the order of the tiles, so that the sums do not depend on the order of the replies.
+ * @brief exchangeStatistics
+ * @param workerSockets
+ * @param numberOfTiles
+ * @param requestType
+ * @param replyType
+ * @param statistics
+ * @return false if one of the tiles failed.
+ */
+static bool exchangeStatistics(const vector<int> &workerSockets, int numberOfTiles, int requestType, int replyType, CaptureStatistics &statistics)
+{
+    vector<CaptureStatistics> tileStatistics(numberOfTiles);
+
+    bool success = exchangeTileMessages(workerSockets, numberOfTiles, requestType, replyType,
+    [&](int, vector<char> &request)
+    {
+        appendBytes(request, &statistics, sizeof(CaptureStatistics));
+    },
+    [&](int t, const vector<char> &reply)
+    {
+        size_t offset = 0;
+        return readBytes(reply, offset, &tileStatistics[t], sizeof(CaptureStatistics));
+    });
+
+    if(!success)
+    {
+        return false;
+    }
+
+    CaptureStatistics globalStatistics = statistics;
+
+    for(int t = 0 ; t<numberOfTiles ; t++)
+    {
+        mergeCaptureStatistics(globalStatistics, tileStatistics[t]);
+    }
+
+    statistics = globalStatistics;
+
+    return true;
+}
+
+/**
+ * Runs the three steps of the computation on the workers and stitches the maps of the tiles.
+ * @brief distributeTiles
+ * @param pathToFolder
+ * @param isCrossData
+ * @param tiles
+ * @param imageSize
+ * @param workerSockets
+ * @param maps
+ * @return false if one of the tiles failed.
+ */
+static bool distributeTiles(string pathToFolder, bool isCrossData, const vector<Rect> &tiles, Size imageSize,
+                            const vector<int> &workerSockets, ReflectanceMaps &maps)
+{
+    int numberOfTiles = tiles.size();
+    CaptureStatistics statistics;
+
+    /*---Step 1 : load the tiles and find the maximum of each gradient---*/
+    string calibrationFile = flatFieldFile();
+    string patternsFile = illuminationPatternsFile();
+
+    bool success = exchangeTileMessages(workerSockets, numberOfTiles, MESSAGE_LOAD_TILE, MESSAGE_GRADIENT_MAXIMA,
+    [&](int t, vector<char> &request)
+    {
+        int tileDescription[16] = {tiles[t].x, tiles[t].y, tiles[t].width, tiles[t].height, isCrossData ? 1 : 0,
+                                   numberOfShots(), noiseMapEnabled() ? 1 : 0, perChannelMaps() ? 1 : 0, invalidMaskEnabled() ? 1 : 0,
+                                   interleavedGradients() ? 1 : 0, (int) calibrationFile.size(), (int) patternsFile.size(),
+                                   diffuseNormalsEnabled() ? 1 : 0, (int) kernelPrecision(), (int) microfacetModel(),
+                                   fresnelAlbedoEnabled() ? 1 : 0};
+
+        //The paths of the calibration file and of the description of the illumination patterns are followed by the path of the capture
+        appendBytes(request, tileDescription, sizeof(tileDescription));
+        appendBytes(request, calibrationFile.c_str(), calibrationFile.size());
+        appendBytes(request, patternsFile.c_str(), patternsFile.size());
+        appendBytes(request, pathToFolder.c_str(), pathToFolder.size());
+    },
+    [&](int, const vector<char> &reply)
+    {
+        //The gradient maxima are merged with a maximum : the order of the replies does not matter
+        CaptureStatistics tileStatistics;
+        size_t offset = 0;
+
+        if(!readBytes(reply, offset, &tileStatistics, sizeof(CaptureStatistics)))
+        {
+            return false;
+        }
+
+        mergeCaptureStatistics(statistics, tileStatistics);
+
+        return true;
+    });
+
+    /*---Step 2 : compute the maps, find the maximum of the albedos and the average surface normal---*/
+    if(!success || !exchangeStatistics(workerSockets, numberOfTiles, MESSAGE_COMPUTE_MAPS, MESSAGE_MAP_STATISTICS, statistics))
+    {
+        return false;
+    }
+
+    cout << "Average surface normal : " << averageSurfaceNormal(statistics.normalSum, statistics.numberOfNormals) << endl;
+
+    printPixelDiagnostics(statistics.diagnostics, pathToFolder);
+
+    storeCaptureStatistics(pathToFolder, isCrossData, imageSize, statistics);
+
+    /*---Step 3 : scale the albedos, align the normals and stitch the tiles---*/
+    return exchangeTileMessages(workerSockets, numberOfTiles, MESSAGE_FINALIZE_TILE, MESSAGE_TILE_MAPS,
+    [&](int, vector<char> &request)
+    {
+        appendBytes(request, &statistics, sizeof(CaptureStatistics));
+    },
+    [&](int t, const vector<char> &reply)
+    {
+        ReflectanceMaps tileMaps;
+        size_t offset = 0;
+
+        if(!readMat(reply, offset, tileMaps.diffuse) || !readMat(reply, offset, tileMaps.specular) ||
+           !readMat(reply, offset, tileMaps.normals) || !readMat(reply, offset, tileMaps.roughness) ||
+           !readMat(reply, offset, tileMaps.noise) || !readMat(reply, offset, tileMaps.redNormals) ||
+           !readMat(reply, offset, tileMaps.blueNormals) || !readMat(reply, offset, tileMaps.diffuseNormals) ||
+           !readMat(reply, offset, tileMaps.invalid))
+        {
+            return false;
+        }
+
+        pasteTileMaps(tileMaps, tiles[t], imageSize, maps);
+
+        return true;
+    });
+}
+
+/**
+ * Computes the reflectance maps of a capture with several worker processes.
+ * If workerExecutable is not empty, numberOfWorkers local workers are started with "workerExecutable --worker 127.0.0.1 port".
+ * Otherwise the coordinator waits for numberOfWorkers workers started by hand (possibly on other nodes).
+ * @brief runCoordinator
+ * @param pathToFolder
+ * @param isCrossData
+ * @param numberOfWorkers
+ * @param tileHeight height of the tiles in pixels. If 0 the image is split into one tile per worker.
+ * @param port TCP port on which the coordinator listens. If 0 a free port is chosen.
+ * @param workerExecutable path to the reflectance_maps executable used to spawn local workers.
+ * @return false if the computation failed.
+ */
+bool runCoordinator(string pathToFolder, bool isCrossData, int numberOfWorkers, int tileHeight, int port, string workerExecutable)
+{
+    Size imageSize;
+
+    if(!readCaptureSize(pathToFolder, imageSize))
+    {
+        return false;
+    }
+
+    numberOfWorkers = max(1, numberOfWorkers);
+
+    if(tileHeight <= 0)
+    {
+        tileHeight = (imageSize.height+numberOfWorkers-1)/numberOfWorkers;
+    }
+
+    vector<Rect> tiles = splitIntoTiles(imageSize, imageSize.width, tileHeight);
+
+    /*---Open the server socket---*/
+    int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    int reuseAddress = 1;
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    socklen_t addressLength = sizeof(address);
+
+    if(serverSocket < 0 || bind(serverSocket, (sockaddr*) &address, sizeof(address)) != 0 ||
+       listen(serverSocket, numberOfWorkers) != 0 || getsockname(serverSocket, (sockaddr*) &address, &addressLength) != 0)
+    {
+        cerr << "Could not listen on port " << port << endl;
+
+        if(serverSocket >= 0)
+        {
+            close(serverSocket);
+        }
+
+        return false;
+    }
+
+    port = ntohs(address.sin_port);
+
+    cout << "Coordinator : " << tiles.size() << " tiles, waiting for " << numberOfWorkers << " workers on port " << port << endl;
+
+    /*---Start the local workers---*/
+    vector<pid_t> localWorkers;
+
+    if(!workerExecutable.empty())
+    {
+        ostringstream portString;
+        portString << port;
+
+        for(int w = 0 ; w<numberOfWorkers ; w++)
+        {
+            pid_t pid = fork();
+
+            if(pid == 0)
+            {
+                close(serverSocket);
+                execlp(workerExecutable.c_str(), workerExecutable.c_str(), "--worker", "127.0.0.1", portString.str().c_str(), (char*) 0);
+                _exit(-1);
+            }
+            else if(pid > 0)
+            {
+                localWorkers.push_back(pid);
+            }
+        }
+    }
+
+    /*---Wait for the workers---*/
+    vector<int> workerSockets;
+
+    while((int) workerSockets.size() < numberOfWorkers)
+    {
+        pollfd serverPoll;
+        serverPoll.fd = serverSocket;
+        serverPoll.events = POLLIN;
+
+        //Local workers that do not connect within a minute have failed to start
+        if(poll(&serverPoll, 1, localWorkers.empty() ? -1 : 60000) <= 0)
+        {
+            cerr << "Timeout while waiting for the workers" << endl;
+            break;
+        }
+
+        int workerSocket = accept(serverSocket, NULL, NULL);
+
+        if(workerSocket >= 0)
+        {
+            int noDelay = 1;
+            setsockopt(workerSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            disableBrokenPipeSignal(workerSocket);
+            workerSockets.push_back(workerSocket);
+        }
+    }
+
+    close(serverSocket);
+
+    ReflectanceMaps maps;
+    bool success = (int) workerSockets.size() == numberOfWorkers &&
+                   distributeTiles(pathToFolder, isCrossData, tiles, imageSize, workerSockets, maps);
+
+    /*---Stop the workers---*/
+    for(unsigned int w = 0 ; w<workerSockets.size() ; w++)
+    {
+        sendMessage(workerSockets[w], MESSAGE_QUIT, -1, vector<char>());
+        close(workerSockets[w]);
+    }
+
+    for(unsigned int w = 0 ; w<localWorkers.size() ; w++)
+    {
+        //Local workers that never connected are killed
+        if(!success)
+        {
+            kill(localWorkers[w], SIGTERM);
+        }
+
+        waitpid(localWorkers[w], NULL, 0);
+    }
+
+    //The height map is integrated by the coordinator : the integration needs the normals of the whole capture
+    Mat mask;
+
+    if(success && !readImageFile(pathToFolder + "/mask.JPG", mask))
+    {
+        cerr << "Could not load image : " << pathToFolder + "/mask.JPG" << endl;
+        success = false;
+    }
+
+    if(success)
+    {
+        computeCaptureHeightMap(maps, mask);
+        computeCaptureMipChain(maps, mask);
+        saveReflectanceMaps(maps, pathToFolder);
+    }
+
+    return success;
+}
+
+/**
+ * Connects to a coordinator and processes the tiles it sends until the coordinator closes the connection.
+ * @brief runWorker
+ * @param host IPv4 address of the coordinator.
+ * @param port
+ * @return false if the connection failed or a tile could not be processed.
+ */
+bool runWorker(string host, int port)
+{
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+
+    int socketDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+
+    if(socketDescriptor < 0 || inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 ||
+       connect(socketDescriptor, (sockaddr*) &address, sizeof(address)) != 0)
+    {
+        cerr << "Could not connect to the coordinator " << host << ":" << port << endl;
+
+        if(socketDescriptor >= 0)
+        {
+            close(socketDescriptor);
+        }
+
+        return false;
+    }
+
+    int noDelay = 1;
+    setsockopt(socketDescriptor, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    disableBrokenPipeSignal(socketDescriptor);
+
+    //Tiles processed by this worker, kept between the steps of the computation
+    map<int, CaptureTile> tiles;
+
+    bool success = true;
+    int type = 0, tileIndex = 0;
+    vector<char> request;
+
+    while(success && receiveMessage(socketDescriptor, type, tileIndex, request) && type != MESSAGE_QUIT)
+    {
+        vector<char> reply;
+        size_t offset = 0;
+        int replyType = MESSAGE_ERROR;
+
+        if(type == MESSAGE_LOAD_TILE)
+        {
+            int tileDescription[16] = {0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, EXACT_PRECISION, NO_MICROFACET_MODEL, 0};
+
+            if(readBytes(request, offset, tileDescription, sizeof(tileDescription)) &&
+               tileDescription[10] >= 0 && tileDescription[11] >= 0 &&
+               offset+tileDescription[10]+tileDescription[11] <= request.size())
+            {
+                size_t patternsOffset = offset+tileDescription[10];
+                string calibrationFile(request.begin()+offset, request.begin()+patternsOffset);
+                string patternsFile(request.begin()+patternsOffset, request.begin()+patternsOffset+tileDescription[11]);
+                string pathToFolder(request.begin()+patternsOffset+tileDescription[11], request.end());
+                Rect region(tileDescription[0], tileDescription[1], tileDescription[2], tileDescription[3]);
+                CaptureTile &tile = tiles[tileIndex];
+
+                //Shots, channels, flat field calibration and illumination patterns of the capture of the coordinator
+                setNumberOfShots(tileDescription[5]);
+                setNoiseMapEnabled(tileDescription[6] != 0);
+                setPerChannelMaps(tileDescription[7] != 0);
+                setInvalidMaskEnabled(tileDescription[8] != 0);
+                setInterleavedGradients(tileDescription[9] != 0);
+                setDiffuseNormalsEnabled(tileDescription[12] != 0);
+                setKernelPrecision((KernelPrecision) tileDescription[13]);
+                setMicrofacetModel((MicrofacetModel) tileDescription[14]);
+                setFresnelAlbedoEnabled(tileDescription[15] != 0);
+                setFlatFieldFile(calibrationFile);
+
+                bool hasPatterns = patternsFile == illuminationPatternsFile() || setIlluminationPatternsFile(patternsFile);
+
+                if(hasPatterns && loadCaptureTile(pathToFolder, tileDescription[4] != 0, region, tile))
+                {
+                    CaptureStatistics tileStatistics;
+                    accumulateGradientMaxima(tile, tileStatistics);
+
+                    appendBytes(reply, &tileStatistics, sizeof(CaptureStatistics));
+                    replyType = MESSAGE_GRADIENT_MAXIMA;
+                }
+            }
+        }
+        else if(type == MESSAGE_COMPUTE_MAPS || type == MESSAGE_FINALIZE_TILE)
+        {
+            CaptureStatistics statistics;
+            map<int, CaptureTile>::iterator tile = tiles.find(tileIndex);
+
+            if(tile != tiles.end() && readBytes(request, offset, &statistics, sizeof(CaptureStatistics)))
+            {
+                if(type == MESSAGE_COMPUTE_MAPS)
+                {
+                    CaptureStatistics tileStatistics;
+
+                    computeTileMaps(tile->second, statistics);
+                    releaseTileGradients(tile->second);
+                    accumulateMapStatistics(tile->second, tileStatistics);
+
+                    appendBytes(reply, &tileStatistics, sizeof(CaptureStatistics));
+                    replyType = MESSAGE_MAP_STATISTICS;
+                }
+                else
+                {
+                    finalizeTileMaps(tile->second, statistics);
+
+                    appendMat(reply, tile->second.maps.diffuse);
+                    appendMat(reply, tile->second.maps.specular);
+                    appendMat(reply, tile->second.maps.normals);
+                    appendMat(reply, tile->second.maps.roughness);
+                    appendMat(reply, tile->second.maps.noise);
+                    appendMat(reply, tile->second.maps.redNormals);
+                    appendMat(reply, tile->second.maps.blueNormals);
+                    appendMat(reply, tile->second.maps.diffuseNormals);
+                    appendMat(reply, invalidMaskEnabled() ? tile->second.maps.invalid : Mat());
+                    replyType = MESSAGE_TILE_MAPS;
+
+                    tiles.erase(tile);
+                }
+            }
+        }
+
+        success = replyType != MESSAGE_ERROR;
+        sendMessage(socketDescriptor, replyType, tileIndex, reply);
+    }
+
+    close(socketDescriptor);
+
+    return success;
+}
@@ -0,0 +1,76 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file distributed.h
+ * \brief Implementation of the distributed computation of the reflectance maps.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * A coordinator splits the capture into tiles and sends them to worker processes over TCP sockets.
+ * The workers load and process their tiles (see capturetile.h) while the coordinator performs the global
+ * reductions between the steps of the computation and stitches the resulting maps.
+ * Workers can run on the same machine (spawned by the coordinator) or on other nodes.
+ * The messages are exchanged in the native byte order : all the nodes must have the same architecture.
+ */
+
+#ifndef DISTRIBUTED
+#define DISTRIBUTED
+
+#include "capturetile.h"
+
+/*---- Standard library ----*/
+#include <string>
+
+/**
+ * Computes the reflectance maps of a capture with several worker processes.
+ * If workerExecutable is not empty, numberOfWorkers local workers are started with "workerExecutable --worker 127.0.0.1 port".
+ * Otherwise the coordinator waits for numberOfWorkers workers started by hand (possibly on other nodes).
+ * @brief runCoordinator
+ * @param pathToFolder
+ * @param isCrossData
+ * @param numberOfWorkers
+ * @param tileHeight height of the tiles in pixels. If 0 the image is split into one tile per worker.
+ * @param port TCP port on which the coordinator listens. If 0 a free port is chosen.
+ * @param workerExecutable path to the reflectance_maps executable used to spawn local workers.
+ * @return false if the computation failed.
+ */
+bool runCoordinator(std::string pathToFolder, bool isCrossData, int numberOfWorkers, int tileHeight, int port, std::string workerExecutable);
+
+/**
+ * Connects to a coordinator and processes the tiles it sends until the coordinator closes the connection.
+ * @brief runWorker
+ * @param host IPv4 address of the coordinator.
+ * @param port
+ * @return false if the connection failed or a tile could not be processed.
+ */
+bool runWorker(std::string host, int port);
+
+#endif // DISTRIBUTED
@@ -0,0 +1,702 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file heightmap.cpp
+ * \brief Implementation of the integration of the normals into a height map.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the integration of the normals into a height map.
+ */
+
+#include "heightmap.h"
+#include "bufferpool.h"
+#include "mathfunctions.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Computes the 1D DFTs of a range of rows.
+ */
+class DFTRowsBody : public ParallelLoopBody
+{
+public:
+    DFTRowsBody(const Mat &image, int flags) : m_image(image), m_flags(flags) {}
+
+    void operator()(const Range &rows) const
+    {
+        Mat block = m_image.rowRange(rows.start, rows.end);
+        dft(block, block, m_flags | DFT_ROWS);
+    }
+
+private:
+    Mat m_image;
+    int m_flags;
+};
+
+/**
+ * Computes the 2D DFT of a CV_32FC2 image in place. The rows of each pass are computed in parallel.
+ * @brief parallelDFT
+ * @param image
+ * @param flags DFT_INVERSE, DFT_SCALE.
+ */
+void parallelDFT(Mat &image, int flags)
+{
+    //Rows, then columns as the rows of the transposed image
+    parallel_for_(Range(0, image.rows), DFTRowsBody(image, flags));
+
+    Mat transposed;
+    createPooledImage(transposed, image.cols, image.rows, image.type());
+    transpose(image, transposed);
+
+    parallel_for_(Range(0, transposed.rows), DFTRowsBody(transposed, flags));
+
+    transpose(transposed, image);
+}
+
+/**
+ * Converts a mask to a binary CV_8UC1 mask (255 inside the object).
+ * Accepts the linear masks of the computation (CV_32FC3, inside if the red channel is above 0.9) and the decoded masks (CV_8UC3).
+ * @brief makeBinaryMask
+ * @param mask
+ * @param binaryMask
+ */
+void makeBinaryMask(const Mat &mask, Mat &binaryMask)
+{
+    createPooledImage(binaryMask, mask.rows, mask.cols, CV_8UC1);
+
+    for(int i = 0 ; i<mask.rows ; i++)
+    {
+        uchar *binary = binaryMask.ptr<uchar>(i);
+
+        for(int j = 0 ; j<mask.cols ; j++)
+        {
+            //Same threshold as maximumInMask
+            if(mask.type() == CV_32FC3)
+            {
+                binary[j] = mask.at<Vec3f>(i,j).val[2] > 0.9 ? 255 : 0;
+            }
+            else
+            {
+                binary[j] = mask.at<Vec3b>(i,j).val[2] > 0.9*255 ? 255 : 0;
+            }
+        }
+    }
+}
+
+/**
+ * Computes the slopes p = -nx/nz and q = -ny/nz of the normals. The slopes are 0 outside the mask and for invalid normals.
+ * @brief computeSlopes
+ * @param normals
+ * @param binaryMask
+ * @param p
+ * @param q
+ */
+void computeSlopes(const Mat &normals, const Mat &binaryMask, Mat &p, Mat &q)
+{
+    createPooledImage(p, normals.rows, normals.cols, CV_32FC1);
+    createPooledImage(q, normals.rows, normals.cols, CV_32FC1);
+
+    for(int i = 0 ; i<normals.rows ; i++)
+    {
+        const Vec3f *normal = normals.ptr<Vec3f>(i);
+        const uchar *mask = binaryMask.ptr<uchar>(i);
+        float *slopeX = p.ptr<float>(i);
+        float *slopeY = q.ptr<float>(i);
+
+        for(int j = 0 ; j<normals.cols ; j++)
+        {
+            //BGR = ZYX
+            float z = max(normal[j].val[0], (float) MINIMUM_NORMAL_Z);
+
+            slopeX[j] = -normal[j].val[2]/z;
+            slopeY[j] = -normal[j].val[1]/z;
+
+            //Outside the mask and NaN normals
+            if(mask[j] == 0 || slopeX[j] != slopeX[j] || slopeY[j] != slopeY[j])
+            {
+                slopeX[j] = 0.0;
+                slopeY[j] = 0.0;
+            }
+        }
+    }
+}
+
+/**
+ * Least squares integration of the slopes in the Fourier domain (Frankot-Chellappa).
+ * The DFT size is padded to a fast size. p and q are transformed together as the real and imaginary parts of a complex image.
+ * @brief integrateSlopesFFT
+ * @param p
+ * @param q
+ * @param height
+ */
+void integrateSlopesFFT(const Mat &p, const Mat &q, Mat &height)
+{
+    int rows = p.rows;
+    int cols = p.cols;
+    int fftRows = getOptimalDFTSize(rows);
+    int fftCols = getOptimalDFTSize(cols);
+
+    //c = p + iq
+    Mat slopes;
+    createPooledImage(slopes, fftRows, fftCols, CV_32FC2);
+    slopes.setTo(Scalar::all(0));
+
+    for(int i = 0 ; i<rows ; i++)
+    {
+        for(int j = 0 ; j<cols ; j++)
+        {
+            slopes.at<Vec2f>(i,j) = Vec2f(p.at<float>(i,j), q.at<float>(i,j));
+        }
+    }
+
+    parallelDFT(slopes, 0);
+
+    Mat heightSpectrum;
+    createPooledImage(heightSpectrum, fftRows, fftCols, CV_32FC2);
+
+    for(int i = 0 ; i<fftRows ; i++)
+    {
+        //Frequencies in -pi;pi
+        float wy = 2.0*M_PI*(i <= fftRows/2 ? i : i-fftRows)/fftRows;
+
+        for(int j = 0 ; j<fftCols ; j++)
+        {
+            float wx = 2.0*M_PI*(j <= fftCols/2 ? j : j-fftCols)/fftCols;
+            float w2 = wx*wx+wy*wy;
+
+            if(w2 == 0.0)
+            {
+                //The mean height is free
+                heightSpectrum.at<Vec2f>(i,j) = Vec2f(0.0, 0.0);
+                continue;
+            }
+
+            //P = (C(k)+conj(C(-k)))/2 and Q = (C(k)-conj(C(-k)))/2i
+            Vec2f c = slopes.at<Vec2f>(i,j);
+            Vec2f cMinus = slopes.at<Vec2f>((fftRows-i)%fftRows, (fftCols-j)%fftCols);
+
+            float PReal = (c.val[0]+cMinus.val[0])/2.0;
+            float PImaginary = (c.val[1]-cMinus.val[1])/2.0;
+            float QReal = (c.val[1]+cMinus.val[1])/2.0;
+            float QImaginary = (cMinus.val[0]-c.val[0])/2.0;
+
+            //Z = -j(wx P + wy Q)/(wx^2 + wy^2)
+            float AReal = wx*PReal+wy*QReal;
+            float AImaginary = wx*PImaginary+wy*QImaginary;
+
+            heightSpectrum.at<Vec2f>(i,j) = Vec2f(AImaginary/w2, -AReal/w2);
+        }
+    }
+
+    parallelDFT(heightSpectrum, DFT_INVERSE | DFT_SCALE);
+
+    createPooledImage(height, rows, cols, CV_32FC1);
+
+    for(int i = 0 ; i<rows ; i++)
+    {
+        for(int j = 0 ; j<cols ; j++)
+        {
+            height.at<float>(i,j) = heightSpectrum.at<Vec2f>(i,j).val[0];
+        }
+    }
+}
+
+/**
+ * One level of the multigrid solver : discrete Poisson equation sum_j (z_j - z_i) = b_i over the neighbours j of i in the mask.
+ */
+struct PoissonLevel
+{
+    Mat mask;               //CV_8UC1
+    Mat rightHandSide;      //CV_32FC1
+    Mat height;             //CV_32FC1
+};
+
+/**
+ * Returns the sum of the heights of the neighbours of a pixel in the mask and their number.
+ * @brief sumOfNeighbours
+ * @param level
+ * @param i
+ * @param j
+ * @param numberOfNeighbours
+ * @return
+ */
+static inline float sumOfNeighbours(const PoissonLevel &level, int i, int j, int &numberOfNeighbours)
+{
+    float sum = 0.0;
+    numberOfNeighbours = 0;
+
+    if(i > 0 && level.mask.at<uchar>(i-1,j))
+    {
+        sum += level.height.at<float>(i-1,j);
+        numberOfNeighbours++;
+    }
+    if(i < level.mask.rows-1 && level.mask.at<uchar>(i+1,j))
+    {
+        sum += level.height.at<float>(i+1,j);
+        numberOfNeighbours++;
+    }
+    if(j > 0 && level.mask.at<uchar>(i,j-1))
+    {
+        sum += level.height.at<float>(i,j-1);
+        numberOfNeighbours++;
+    }
+    if(j < level.mask.cols-1 && level.mask.at<uchar>(i,j+1))
+    {
+        sum += level.height.at<float>(i,j+1);
+        numberOfNeighbours++;
+    }
+
+    return sum;
+}
+
+/**
+ * Gauss-Seidel relaxation of the pixels of one color of a red-black ordering : the pixels of the same color
+ * are independent, so the rows are relaxed in parallel.
+ */
+class RedBlackSweepBody : public ParallelLoopBody
+{
+public:
+    RedBlackSweepBody(PoissonLevel &level, int color) : m_level(level), m_color(color) {}
+
+    void operator()(const Range &rows) const
+    {
+        int numberOfNeighbours = 0;
+
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            for(int j = (i+m_color)%2 ; j<m_level.mask.cols ; j += 2)
+            {
+                if(!m_level.mask.at<uchar>(i,j))
+                {
+                    continue;
+                }
+
+                float sum = sumOfNeighbours(m_level, i, j, numberOfNeighbours);
+
+                if(numberOfNeighbours > 0)
+                {
+                    m_level.height.at<float>(i,j) = (sum-m_level.rightHandSide.at<float>(i,j))/numberOfNeighbours;
+                }
+            }
+        }
+    }
+
+private:
+    PoissonLevel &m_level;
+    int m_color;
+};
+
+/**
+ * Red-black Gauss-Seidel sweeps.
+ * @brief smooth
+ * @param level
+ * @param numberOfSweeps
+ */
+static void smooth(PoissonLevel &level, int numberOfSweeps)
+{
+    for(int s = 0 ; s<numberOfSweeps ; s++)
+    {
+        parallel_for_(Range(0, level.mask.rows), RedBlackSweepBody(level, 0));
+        parallel_for_(Range(0, level.mask.rows), RedBlackSweepBody(level, 1));
+    }
+}
+
+/**
+ * Computes the residual b_i - sum_j (z_j - z_i) of a range of rows and the squared norm of the residual of each row.
+ */
+class ResidualBody : public ParallelLoopBody
+{
+public:
+    ResidualBody(const PoissonLevel &level, Mat &residual, vector<double> &squaredNorms)
+        : m_level(level), m_residual(residual), m_squaredNorms(squaredNorms) {}
+
+    void operator()(const Range &rows) const
+    {
+        int numberOfNeighbours = 0;
+
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            float *residual = m_residual.ptr<float>(i);
+            double squaredNorm = 0.0;
+
+            for(int j = 0 ; j<m_level.mask.cols ; j++)
+            {
+                if(!m_level.mask.at<uchar>(i,j))
+                {
+                    residual[j] = 0.0;
+                    continue;
+                }
+
+                float sum = sumOfNeighbours(m_level, i, j, numberOfNeighbours);
+                float r = m_level.rightHandSide.at<float>(i,j)-(sum-numberOfNeighbours*m_level.height.at<float>(i,j));
+
+                residual[j] = r;
+                squaredNorm += r*r;
+            }
+
+            m_squaredNorms[i] = squaredNorm;
+        }
+    }
+
+private:
+    const PoissonLevel &m_level;
+    Mat &m_residual;
+    vector<double> &m_squaredNorms;
+};
+
+/**
+ * Computes the residual b_i - sum_j (z_j - z_i) of a level. The rows are computed in parallel
+ * and their squared norms are summed in order, so that the result does not depend on the number of threads.
+ * @brief computeResidual
+ * @param level
+ * @param residual
+ * @return the squared norm of the residual.
+ */
+static double computeResidual(const PoissonLevel &level, Mat &residual)
+{
+    createPooledImage(residual, level.mask.rows, level.mask.cols, CV_32FC1);
+
+    vector<double> squaredNorms(level.mask.rows, 0.0);
+    parallel_for_(Range(0, level.mask.rows), ResidualBody(level, residual, squaredNorms));
+
+    double squaredNorm = 0.0;
+
+    for(int i = 0 ; i<level.mask.rows ; i++)
+    {
+        squaredNorm += squaredNorms[i];
+    }
+
+    return squaredNorm;
+}
+
+/**
+ * Restriction of a range of rows of the coarse level : its right hand side is the sum of the residuals of the 4 children.
+ */
+class RestrictionBody : public ParallelLoopBody
+{
+public:
+    RestrictionBody(const Mat &residual, PoissonLevel &coarse) : m_residual(residual), m_coarse(coarse) {}
+
+    void operator()(const Range &rows) const
+    {
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            float *rightHandSide = m_coarse.rightHandSide.ptr<float>(i);
+
+            for(int j = 0 ; j<m_coarse.mask.cols ; j++)
+            {
+                rightHandSide[j] = 0.0;
+            }
+
+            for(int fineI = 2*i ; fineI<min(2*i+2, m_residual.rows) ; fineI++)
+            {
+                const float *residual = m_residual.ptr<float>(fineI);
+
+                for(int fineJ = 0 ; fineJ<m_residual.cols ; fineJ++)
+                {
+                    rightHandSide[fineJ/2] += residual[fineJ];
+                }
+            }
+        }
+    }
+
+private:
+    Mat m_residual;
+    PoissonLevel &m_coarse;
+};
+
+/**
+ * Prolongation of a range of rows of the fine level : the correction of the coarse level is added to its children in the mask.
+ */
+class ProlongationBody : public ParallelLoopBody
+{
+public:
+    ProlongationBody(const PoissonLevel &coarse, PoissonLevel &level) : m_coarse(coarse), m_level(level) {}
+
+    void operator()(const Range &rows) const
+    {
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            const uchar *mask = m_level.mask.ptr<uchar>(i);
+            const float *correction = m_coarse.height.ptr<float>(i/2);
+            float *height = m_level.height.ptr<float>(i);
+
+            for(int j = 0 ; j<m_level.mask.cols ; j++)
+            {
+                if(mask[j])
+                {
+                    height[j] += correction[j/2];
+                }
+            }
+        }
+    }
+
+private:
+    const PoissonLevel &m_coarse;
+    PoissonLevel &m_level;
+};
+
+/**
+ * Solves the coarsest level : a few pixels, relaxed on the calling thread (a parallel loop per sweep would cost more
+ * than the sweep itself) from a zero correction until its residual is below MULTIGRID_COARSEST_TOLERANCE times
+ * its right hand side or decreases by less than MULTIGRID_COARSEST_STAGNATION, with at most MULTIGRID_COARSEST_MAXIMUM_SWEEPS sweeps.
+ * @brief solveCoarsestLevel
+ * @param level
+ */
+static void solveCoarsestLevel(PoissonLevel &level)
+{
+    Range rows(0, level.mask.rows);
+    RedBlackSweepBody red(level, 0);
+    RedBlackSweepBody black(level, 1);
+
+    //The correction starts from 0 : the first residual is the right hand side
+    Mat residual;
+    double squaredNorm = computeResidual(level, residual);
+    double tolerance = MULTIGRID_COARSEST_TOLERANCE*MULTIGRID_COARSEST_TOLERANCE*squaredNorm;
+
+    for(int s = 0 ; s<MULTIGRID_COARSEST_MAXIMUM_SWEEPS ; s++)
+    {
+        //The residual is checked every MULTIGRID_COARSEST_SIZE sweeps. The restricted right hand side is not exactly
+        //in the range of the Neumann Laplacian : the residual stops decreasing once its consistent part is solved
+        if(s > 0 && s%MULTIGRID_COARSEST_SIZE == 0)
+        {
+            double previousSquaredNorm = squaredNorm;
+            squaredNorm = computeResidual(level, residual);
+
+            if(squaredNorm <= tolerance || squaredNorm > MULTIGRID_COARSEST_STAGNATION*MULTIGRID_COARSEST_STAGNATION*previousSquaredNorm)
+            {
+                return;
+            }
+        }
+
+        red(rows);
+        black(rows);
+    }
+}
+
+/**
+ * Multigrid V-cycle : smoothing, correction computed on the coarser level, smoothing.
+ * The coarse level has half the resolution : its right hand side is the sum of the residuals of the 4 children
+ * (the coarse Laplacian has a spacing twice larger) and its correction is copied to the children.
+ * The transfers between the levels are computed in parallel over the rows.
+ * @brief multigridCycle
+ * @param levels
+ * @param l
+ */
+static void multigridCycle(vector<PoissonLevel> &levels, unsigned int l)
+{
+    PoissonLevel &level = levels[l];
+
+    if(l == levels.size()-1)
+    {
+        solveCoarsestLevel(level);
+        return;
+    }
+
+    smooth(level, MULTIGRID_SMOOTHING_SWEEPS);
+
+    Mat residual;
+    computeResidual(level, residual);
+
+    PoissonLevel &coarse = levels[l+1];
+    parallel_for_(Range(0, coarse.mask.rows), RestrictionBody(residual, coarse));
+    coarse.height.setTo(Scalar::all(0));
+
+    multigridCycle(levels, l+1);
+
+    parallel_for_(Range(0, level.mask.rows), ProlongationBody(coarse, level));
+
+    smooth(level, MULTIGRID_SMOOTHING_SWEEPS);
+}
+
+/**
+ * Least squares integration of the slopes restricted to the mask, with a multigrid solver of the Poisson equation.
+ * height is used as the initial guess if it has the right size.
+ * @brief integrateSlopesMultigrid
+ * @param p
+ * @param q
+ * @param binaryMask
+ * @param height
+ * @return the number of multigrid cycles.
+ */
+int integrateSlopesMultigrid(const Mat &p, const Mat &q, const Mat &binaryMask, Mat &height)
+{
+    int rows = p.rows;
+    int cols = p.cols;
+
+    vector<PoissonLevel> levels(1);
+    levels[0].mask = binaryMask;
+
+    if(height.rows == rows && height.cols == cols && height.type() == CV_32FC1)
+    {
+        levels[0].height = height;
+    }
+    else
+    {
+        createPooledImage(levels[0].height, rows, cols, CV_32FC1);
+        levels[0].height.setTo(Scalar::all(0));
+    }
+
+    /*---Right hand side : b_i = sum_j of the slope between i and j, with the average of the slopes of i and j---*/
+    Mat &rightHandSide = levels[0].rightHandSide;
+    createPooledImage(rightHandSide, rows, cols, CV_32FC1);
+    rightHandSide.setTo(Scalar::all(0));
+
+    double squaredNormOfRightHandSide = 0.0;
+
+    for(int i = 0 ; i<rows ; i++)
+    {
+        for(int j = 0 ; j<cols ; j++)
+        {
+            if(!binaryMask.at<uchar>(i,j))
+            {
+                continue;
+            }
+
+            float b = 0.0;
+
+            if(j < cols-1 && binaryMask.at<uchar>(i,j+1))
+            {
+                b += (p.at<float>(i,j)+p.at<float>(i,j+1))/2.0;
+            }
+            if(j > 0 && binaryMask.at<uchar>(i,j-1))
+            {
+                b -= (p.at<float>(i,j)+p.at<float>(i,j-1))/2.0;
+            }
+            if(i < rows-1 && binaryMask.at<uchar>(i+1,j))
+            {
+                b += (q.at<float>(i,j)+q.at<float>(i+1,j))/2.0;
+            }
+            if(i > 0 && binaryMask.at<uchar>(i-1,j))
+            {
+                b -= (q.at<float>(i,j)+q.at<float>(i-1,j))/2.0;
+            }
+
+            rightHandSide.at<float>(i,j) = b;
+            squaredNormOfRightHandSide += b*b;
+        }
+    }
+
+    /*---Coarser levels : a coarse pixel is in the mask if one of its children is---*/
+    while(min(levels.back().mask.rows, levels.back().mask.cols) > MULTIGRID_COARSEST_SIZE)
+    {
+        const Mat &fineMask = levels.back().mask;
+
+        PoissonLevel coarse;
+        createPooledImage(coarse.mask, (fineMask.rows+1)/2, (fineMask.cols+1)/2, CV_8UC1);
+        coarse.mask.setTo(Scalar::all(0));
+        createPooledImage(coarse.rightHandSide, coarse.mask.rows, coarse.mask.cols, CV_32FC1);
+        createPooledImage(coarse.height, coarse.mask.rows, coarse.mask.cols, CV_32FC1);
+
+        for(int i = 0 ; i<fineMask.rows ; i++)
+        {
+            for(int j = 0 ; j<fineMask.cols ; j++)
+            {
+                if(fineMask.at<uchar>(i,j))
+                {
+                    coarse.mask.at<uchar>(i/2,j/2) = 255;
+                }
+            }
+        }
+
+        levels.push_back(coarse);
+    }
+
+    /*---V-cycles until the residual is small enough---*/
+    Mat residual;
+    int cycle = 0;
+
+    while(cycle < MULTIGRID_MAXIMUM_CYCLES
+          && computeResidual(levels[0], residual) > MULTIGRID_TOLERANCE*MULTIGRID_TOLERANCE*squaredNormOfRightHandSide)
+    {
+        multigridCycle(levels, 0);
+        cycle++;
+    }
+
+    height = levels[0].height;
+
+    return cycle;
+}
+
+/**
+ * Integrates the normals into a height map (CV_32FC1, in pixels, 0 outside the mask, mean 0 inside the mask).
+ * @brief computeHeightMap
+ * @param normals CV_32FC3, BGR = ZYX.
+ * @param binaryMask CV_8UC1.
+ * @param height
+ */
+void computeHeightMap(const Mat &normals, const Mat &binaryMask, Mat &height)
+{
+    Mat p, q;
+    computeSlopes(normals, binaryMask, p, q);
+
+    integrateSlopesFFT(p, q, height);
+
+    double coverage = (double) countNonZero(binaryMask)/binaryMask.total();
+
+    //The Fourier solution is the initial guess of the solver restricted to the mask
+    if(coverage < FFT_MASK_COVERAGE)
+    {
+        integrateSlopesMultigrid(p, q, binaryMask, height);
+    }
+
+    /*---0 outside the mask, mean 0 inside---*/
+    double sum = 0.0;
+    double numberOfPixels = 0.0;
+
+    for(int i = 0 ; i<height.rows ; i++)
+    {
+        for(int j = 0 ; j<height.cols ; j++)
+        {
+            if(binaryMask.at<uchar>(i,j))
+            {
+                sum += height.at<float>(i,j);
+                numberOfPixels++;
+            }
+        }
+    }
+
+    float mean = numberOfPixels > 0.0 ? sum/numberOfPixels : 0.0;
+
+    for(int i = 0 ; i<height.rows ; i++)
+    {
+        for(int j = 0 ; j<height.cols ; j++)
+        {
+            height.at<float>(i,j) = binaryMask.at<uchar>(i,j) ? height.at<float>(i,j)-mean : 0.0;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file heightmap.h
+ * \brief Implementation of the integration of the normals into a height map.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The height z is the least squares solution of grad(z) = (p,q) with the slopes p = -nx/nz and q = -ny/nz
+ * (x along the columns, y along the rows, in pixels). It is solved in the Fourier domain (Frankot-Chellappa) :
+ *   Z = -j(wx P + wy Q)/(wx^2 + wy^2)
+ * with 2D DFTs whose rows are computed in parallel. The Fourier solution assumes a periodic rectangular domain :
+ * when the mask does not cover the image, it is used as the initial guess of a multigrid solver of the Poisson
+ * equation restricted to the mask (Neumann boundary conditions).
+ */
+
+#ifndef HEIGHTMAP
+#define HEIGHTMAP
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <vector>
+
+//Mask coverage above which the height map is integrated with the Fourier solution only
+#define FFT_MASK_COVERAGE 0.99
+
+//The slopes are clamped for normals almost perpendicular to the view
+#define MINIMUM_NORMAL_Z 0.05
+
+//Multigrid parameters
+#define MULTIGRID_MAXIMUM_CYCLES 30
+#define MULTIGRID_TOLERANCE 1e-4
+#define MULTIGRID_SMOOTHING_SWEEPS 3
+#define MULTIGRID_COARSEST_SIZE 8
+#define MULTIGRID_COARSEST_TOLERANCE 1e-3
+#define MULTIGRID_COARSEST_STAGNATION 0.95
+#define MULTIGRID_COARSEST_MAXIMUM_SWEEPS (10*MULTIGRID_COARSEST_SIZE*MULTIGRID_COARSEST_SIZE)
+
+/**
+ * Converts a mask to a binary CV_8UC1 mask (255 inside the object).
+ * Accepts the linear masks of the computation (CV_32FC3, inside if the red channel is above 0.9) and the decoded masks (CV_8UC3).
+ * @brief makeBinaryMask
+ * @param mask
+ * @param binaryMask
+ */
+void makeBinaryMask(const cv::Mat &mask, cv::Mat &binaryMask);
+
+/**
+ * Integrates the normals into a height map (CV_32FC1, in pixels, 0 outside the mask, mean 0 inside the mask).
+ * @brief computeHeightMap
+ * @param normals CV_32FC3, BGR = ZYX.
+ * @param binaryMask CV_8UC1.
+ * @param height
+ */
+void computeHeightMap(const cv::Mat &normals, const cv::Mat &binaryMask, cv::Mat &height);
+
+/**
+ * Computes the slopes p = -nx/nz and q = -ny/nz of the normals. The slopes are 0 outside the mask and for invalid normals.
+ * @brief computeSlopes
+ * @param normals
+ * @param binaryMask
+ * @param p
+ * @param q
+ */
+void computeSlopes(const cv::Mat &normals, const cv::Mat &binaryMask, cv::Mat &p, cv::Mat &q);
+
+/**
+ * Least squares integration of the slopes in the Fourier domain (Frankot-Chellappa).
+ * @brief integrateSlopesFFT
+ * @param p
+ * @param q
+ * @param height
+ */
+void integrateSlopesFFT(const cv::Mat &p, const cv::Mat &q, cv::Mat &height);
+
+/**
+ * Least squares integration of the slopes restricted to the mask, with a multigrid solver of the Poisson equation.
+ * height is used as the initial guess if it has the right size.
+ * @brief integrateSlopesMultigrid
+ * @param p
+ * @param q
+ * @param binaryMask
+ * @param height
+ * @return the number of multigrid cycles.
+ */
+int integrateSlopesMultigrid(const cv::Mat &p, const cv::Mat &q, const cv::Mat &binaryMask, cv::Mat &height);
+
+/**
+ * Computes the 2D DFT of a CV_32FC2 image in place. The rows of each pass are computed in parallel.
+ * @brief parallelDFT
+ * @param image
+ * @param flags DFT_INVERSE, DFT_SCALE.
+ */
+void parallelDFT(cv::Mat &image, int flags);
+
+#endif // HEIGHTMAP
@@ -0,0 +1,362 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file illumination.cpp
+ * \brief Implementation of the description of the illumination patterns of a rig and of their least squares solver.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the description of the illumination patterns of a rig and of their least squares solver.
+ */
+
+#include "illumination.h"
+#include "reflectance.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+//Relative size of the smallest pivot of the normal equations : below it the moments are not independent
+#define ILLUMINATION_PIVOT_TOLERANCE 1e-9
+
+static string patternsFilePath;
+static IlluminationPatterns loadedPatterns;
+static bool hasPatterns = false;
+
+/**
+ * Reads a description file and computes the least squares solver of its patterns.
+ * @brief loadIlluminationPatterns
+ * @param descriptionFile
+ * @param patterns
+ * @return false if the file could not be read or does not describe valid patterns (see illumination.h).
+ */
+bool loadIlluminationPatterns(string descriptionFile, IlluminationPatterns &patterns)
+{
+    ifstream file(descriptionFile.c_str());
+
+    if(!file)
+    {
+        cerr << "Cannot read the illumination patterns " << descriptionFile << endl;
+        return false;
+    }
+
+    string line;
+    int lineNumber = 0;
+    patterns.numberOfPatterns = 0;
+
+    while(getline(file, line))
+    {
+        lineNumber++;
+
+        istringstream stream(line);
+        string name;
+
+        if(!(stream >> name) || name[0] == '#')
+        {
+            continue;
+        }
+
+        if(patterns.numberOfPatterns == MAXIMUM_NUMBER_OF_GRADIENTS)
+        {
+            cerr << "More than " << MAXIMUM_NUMBER_OF_GRADIENTS << " illumination patterns in " << descriptionFile << endl;
+            return false;
+        }
+
+        int k = patterns.numberOfPatterns;
+        patterns.names[k] = name;
+
+        for(int m = 0 ; m<NUMBER_OF_MOMENTS ; m++)
+        {
+            if(!(stream >> patterns.coefficients[k][m]))
+            {
+                cerr << "Invalid line " << lineNumber << " in the illumination patterns " << descriptionFile
+                     << " : a name and " << NUMBER_OF_MOMENTS << " coefficients are expected" << endl;
+                return false;
+            }
+        }
+
+        patterns.numberOfPatterns++;
+    }
+
+    if(!solveIlluminationPatterns(patterns))
+    {
+        cerr << "The illumination patterns of " << descriptionFile << " cannot be used" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Inverts a symmetric positive matrix of at most NUMBER_OF_MOMENTS rows (Gauss-Jordan with partial pivoting).
+ * @brief invertNormalMatrix
+ * @param matrix
+ * @param size
+ * @param inverse
+ * @return false if the matrix is singular.
+ */
+static bool invertNormalMatrix(double matrix[NUMBER_OF_MOMENTS][NUMBER_OF_MOMENTS], int size,
+                               double inverse[NUMBER_OF_MOMENTS][NUMBER_OF_MOMENTS])
+{
+    double largestDiagonal = 0.0;
+
+    for(int i = 0 ; i<size ; i++)
+    {
+        largestDiagonal = max(largestDiagonal, fabs(matrix[i][i]));
+
+        for(int j = 0 ; j<size ; j++)
+        {
+            inverse[i][j] = i == j ? 1.0 : 0.0;
+        }
+    }
+
+    for(int column = 0 ; column<size ; column++)
+    {
+        int pivot = column;
+
+        for(int i = column+1 ; i<size ; i++)
+        {
+            if(fabs(matrix[i][column]) > fabs(matrix[pivot][column]))
+            {
+                pivot = i;
+            }
+        }
+
+        if(fabs(matrix[pivot][column]) <= ILLUMINATION_PIVOT_TOLERANCE*largestDiagonal)
+        {
+            return false;
+        }
+
+        for(int j = 0 ; j<size ; j++)
+        {
+            swap(matrix[column][j], matrix[pivot][j]);
+            swap(inverse[column][j], inverse[pivot][j]);
+        }
+
+        double scale = 1.0/matrix[column][column];
+
+        for(int j = 0 ; j<size ; j++)
+        {
+            matrix[column][j] *= scale;
+            inverse[column][j] *= scale;
+        }
+
+        for(int i = 0 ; i<size ; i++)
+        {
+            double factor = matrix[i][column];
+
+            if(i == column || factor == 0.0)
+            {
+                continue;
+            }
+
+            for(int j = 0 ; j<size ; j++)
+            {
+                matrix[i][j] -= factor*matrix[column][j];
+                inverse[i][j] -= factor*inverse[column][j];
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Computes the moments determined by the patterns and the pseudo inverse of the matrix of their coefficients.
+ * @brief solveIlluminationPatterns
+ * @param patterns
+ * @return false if the moments used by the maps are not determined by the patterns.
+ */
+bool solveIlluminationPatterns(IlluminationPatterns &patterns)
+{
+    int numberOfPatterns = patterns.numberOfPatterns;
+
+    if(numberOfPatterns == 0)
+    {
+        cerr << "No illumination pattern" << endl;
+        return false;
+    }
+
+    //The full illumination gives the albedos and the divisor of the moments
+    bool isFullIllumination = patterns.coefficients[0][MOMENT_1] > 0.0;
+
+    for(int m = MOMENT_X ; m<NUMBER_OF_MOMENTS ; m++)
+    {
+        isFullIllumination = isFullIllumination && patterns.coefficients[0][m] == 0.0;
+    }
+
+    if(!isFullIllumination)
+    {
+        cerr << "The first illumination pattern must be the full illumination (1 0 0 0 0 0 0)" << endl;
+        return false;
+    }
+
+    //Moments that appear in the patterns
+    int moments[NUMBER_OF_MOMENTS];
+    int numberOfMoments = 0;
+
+    for(int m = 0 ; m<NUMBER_OF_MOMENTS ; m++)
+    {
+        patterns.isDetermined[m] = false;
+
+        for(int k = 0 ; k<numberOfPatterns ; k++)
+        {
+            patterns.isDetermined[m] = patterns.isDetermined[m] || patterns.coefficients[k][m] != 0.0;
+        }
+
+        if(patterns.isDetermined[m])
+        {
+            moments[numberOfMoments++] = m;
+        }
+    }
+
+    if(!patterns.isDetermined[MOMENT_X] || !patterns.isDetermined[MOMENT_Y]
+       || !patterns.isDetermined[MOMENT_XX] || !patterns.isDetermined[MOMENT_YY])
+    {
+        cerr << "The illumination patterns must determine the x, y, xx and yy moments" << endl;
+        return false;
+    }
+
+    //Normal equations of the least squares problem
+    double normalMatrix[NUMBER_OF_MOMENTS][NUMBER_OF_MOMENTS];
+    double inverse[NUMBER_OF_MOMENTS][NUMBER_OF_MOMENTS];
+
+    for(int i = 0 ; i<numberOfMoments ; i++)
+    {
+        for(int j = 0 ; j<numberOfMoments ; j++)
+        {
+            normalMatrix[i][j] = 0.0;
+
+            for(int k = 0 ; k<numberOfPatterns ; k++)
+            {
+                normalMatrix[i][j] += patterns.coefficients[k][moments[i]]*patterns.coefficients[k][moments[j]];
+            }
+        }
+    }
+
+    if(!invertNormalMatrix(normalMatrix, numberOfMoments, inverse))
+    {
+        cerr << "The illumination patterns do not determine the moments independently ("
+             << numberOfPatterns << " patterns, " << numberOfMoments << " moments)" << endl;
+        return false;
+    }
+
+    for(int m = 0 ; m<NUMBER_OF_MOMENTS ; m++)
+    {
+        for(int k = 0 ; k<MAXIMUM_NUMBER_OF_GRADIENTS ; k++)
+        {
+            patterns.solver[m][k] = 0.0;
+        }
+    }
+
+    for(int i = 0 ; i<numberOfMoments ; i++)
+    {
+        for(int k = 0 ; k<numberOfPatterns ; k++)
+        {
+            double value = 0.0;
+
+            for(int j = 0 ; j<numberOfMoments ; j++)
+            {
+                value += inverse[i][j]*patterns.coefficients[k][moments[j]];
+            }
+
+            patterns.solver[moments[i]][k] = (float) value;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Sets the illumination patterns of the captures (LCD screen by default, an empty path goes back to the LCD screen).
+ * Must not be called while captures are computed.
+ * @brief setIlluminationPatternsFile
+ * @param descriptionFile
+ * @return false if the description could not be loaded : the patterns are not changed.
+ */
+bool setIlluminationPatternsFile(string descriptionFile)
+{
+    if(descriptionFile.empty())
+    {
+        patternsFilePath.clear();
+        hasPatterns = false;
+        return true;
+    }
+
+    IlluminationPatterns patterns;
+
+    if(!loadIlluminationPatterns(descriptionFile, patterns))
+    {
+        return false;
+    }
+
+    loadedPatterns = patterns;
+    patternsFilePath = descriptionFile;
+    hasPatterns = true;
+
+    return true;
+}
+
+/**
+ * Returns the description file of the illumination patterns, empty for the LCD screen.
+ * @brief illuminationPatternsFile
+ * @return
+ */
+string illuminationPatternsFile()
+{
+    return patternsFilePath;
+}
+
+/**
+ * Returns the illumination patterns of the captures, NULL for the LCD screen.
+ * @brief currentIlluminationPatterns
+ * @return
+ */
+const IlluminationPatterns* currentIlluminationPatterns()
+{
+    return hasPatterns ? &loadedPatterns : NULL;
+}
+
+/**
+ * Returns the number of gradient images of a capture : NUMBER_OF_GRADIENT_ILLUMINATION for the LCD screen,
+ * the number of patterns of the description otherwise. The ambient illumination follows the gradients.
+ * @brief numberOfGradients
+ * @return
+ */
+int numberOfGradients()
+{
+    return hasPatterns ? loadedPatterns.numberOfPatterns : NUMBER_OF_GRADIENT_ILLUMINATION;
+}
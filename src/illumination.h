@@ -0,0 +1,141 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file illumination.h
+ * \brief Implementation of the description of the illumination patterns of a rig and of their least squares solver.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * By default the gradients are those of the LCD screen : the 7 patterns (full, -x, +x, +y, -y, x^2, y^2) are fixed
+ * and the normals and the roughness are computed with hardcoded formulas (SpecularMapsBody in reflectance.cpp).
+ * Other rigs (e.g. a spherical light stage with Z gradients) are described by a text file : one pattern per line, in the
+ * order of the pictures (IMG_XXXX.JPG), with the coefficients of its intensity in the direction w = (x,y,z) :
+ *
+ *   # name   1     x     y     z     xx    yy    zz
+ *   full     1     0     0     0     0     0     0
+ *   plusZ    0.5   0     0     0.5   0     0     0
+ *
+ * A pixel measures each pattern as a linear combination of the moments of its reflectance lobe (integrals of 1, x, y, z,
+ * x^2, y^2 and z^2 weighted by the lobe). The moments that the patterns determine are found by least squares :
+ * the pseudo inverse of the matrix of the coefficients is computed once, when the description is loaded, and each pixel
+ * only multiplies its values by it. The first pattern must be the full illumination (albedos, divisor of the moments).
+ * The x, y, xx and yy moments must be determined. The z moment is used for the reflection vector if it is determined,
+ * otherwise z is deduced from x and y as with the LCD screen.
+ */
+
+#ifndef ILLUMINATION
+#define ILLUMINATION
+
+/*---- Standard library ----*/
+#include <string>
+
+//Maximum number of illumination patterns of a rig
+#define MAXIMUM_NUMBER_OF_GRADIENTS 16
+
+/**
+ * Moments of the reflectance lobe of a pixel, in the order of the coefficients of the description file.
+ */
+enum IlluminationMoment
+{
+    MOMENT_1,
+    MOMENT_X,
+    MOMENT_Y,
+    MOMENT_Z,
+    MOMENT_XX,
+    MOMENT_YY,
+    MOMENT_ZZ,
+    NUMBER_OF_MOMENTS
+};
+
+/**
+ * Illumination patterns of a rig and their least squares solver.
+ * @brief The IlluminationPatterns struct
+ */
+struct IlluminationPatterns
+{
+    int numberOfPatterns;
+    std::string names[MAXIMUM_NUMBER_OF_GRADIENTS];
+    double coefficients[MAXIMUM_NUMBER_OF_GRADIENTS][NUMBER_OF_MOMENTS];
+
+    //Moments determined by the patterns and least squares solution : moment = sum of solver[moment][k] * value of pattern k
+    bool isDetermined[NUMBER_OF_MOMENTS];
+    float solver[NUMBER_OF_MOMENTS][MAXIMUM_NUMBER_OF_GRADIENTS];
+};
+
+/**
+ * Reads a description file and computes the least squares solver of its patterns.
+ * @brief loadIlluminationPatterns
+ * @param descriptionFile
+ * @param patterns
+ * @return false if the file could not be read or does not describe valid patterns (see illumination.h).
+ */
+bool loadIlluminationPatterns(std::string descriptionFile, IlluminationPatterns &patterns);
+
+/**
+ * Computes the moments determined by the patterns and the pseudo inverse of the matrix of their coefficients.
+ * @brief solveIlluminationPatterns
+ * @param patterns
+ * @return false if the moments used by the maps are not determined by the patterns.
+ */
+bool solveIlluminationPatterns(IlluminationPatterns &patterns);
+
+/**
+ * Sets the illumination patterns of the captures (LCD screen by default, an empty path goes back to the LCD screen).
+ * Must not be called while captures are computed.
+ * @brief setIlluminationPatternsFile
+ * @param descriptionFile
+ * @return false if the description could not be loaded : the patterns are not changed.
+ */
+bool setIlluminationPatternsFile(std::string descriptionFile);
+
+/**
+ * Returns the description file of the illumination patterns, empty for the LCD screen.
+ * @brief illuminationPatternsFile
+ * @return
+ */
+std::string illuminationPatternsFile();
+
+/**
+ * Returns the illumination patterns of the captures, NULL for the LCD screen.
+ * @brief currentIlluminationPatterns
+ * @return
+ */
+const IlluminationPatterns* currentIlluminationPatterns();
+
+/**
+ * Returns the number of gradient images of a capture : NUMBER_OF_GRADIENT_ILLUMINATION for the LCD screen,
+ * the number of patterns of the description otherwise. The ambient illumination follows the gradients.
+ * @brief numberOfGradients
+ * @return
+ */
+int numberOfGradients();
+
+#endif // ILLUMINATION
@@ -39,9 +39,269 @@
 
 #include "imageprocessing.h"
 
+/*---- Standard library ----*/
+#include <sstream>
+#include <sys/stat.h>
+
 using namespace cv;
 using namespace std;
 
+/**
+ * Returns a lookup table of numberOfValues floats that maps a value v to (v/(numberOfValues-1))^gamma
+ * (256 values for 8 bits images, 65536 for 16 bits images).
+ * The tables are built once per gamma value and kept for the lifetime of the program.
+ * @brief gammaLookupTable
+ * @param gamma
+ * @param numberOfValues
+ * @return
+ */
+const float* gammaLookupTable(double gamma, int numberOfValues)
+{
+    static mutex tablesMutex;
+    static map<pair<double, int>, vector<float> > tables;
+
+    lock_guard<mutex> lock(tablesMutex);
+
+    vector<float> &table = tables[make_pair(gamma, numberOfValues)];
+
+    if(table.empty())
+    {
+        table.resize(numberOfValues);
+
+        for(int v = 0 ; v<numberOfValues ; v++)
+        {
+            table[v] = pow((float) (v/(double) (numberOfValues-1)), (float) gamma);
+        }
+    }
+
+    return &table[0];
+}
+
+/**
+ * Converts an 8 bits image (CV_8UC3) to a linear CV_32FC3 image in the 0;1 range and removes the gamma correction
+ * in the same pass with a lookup table. Use gamma = 1.0 for a simple scaling.
+ * 16 bits images (CV_16UC3, averaged shots) are converted in the same way.
+ * The output buffer is reused if it already has the right size, otherwise it is taken from the buffer pool.
+ * @brief linearizeImage
+ * @param image8U
+ * @param linearImage
+ * @param gamma
+ */
+void linearizeImage(const Mat &image8U, Mat &linearImage, double gamma)
+{
+    bool is16Bits = image8U.depth() == CV_16U;
+    const float *table = gammaLookupTable(gamma, is16Bits ? 65536 : 256);
+
+    int width = image8U.cols;
+    int height = image8U.rows;
+    int numberOfChannels = image8U.channels();
+
+    createPooledImage(linearImage, height, width, CV_32FC(numberOfChannels));
+
+    for(int i = 0 ; i<height ; i++)
+    {
+        float *destination = linearImage.ptr<float>(i);
+
+        if(is16Bits)
+        {
+            const ushort *source = image8U.ptr<ushort>(i);
+
+            for(int j = 0 ; j<width*numberOfChannels ; j++)
+            {
+                destination[j] = table[source[j]];
+            }
+        }
+        else
+        {
+            const uchar *source = image8U.ptr<uchar>(i);
+
+            for(int j = 0 ; j<width*numberOfChannels ; j++)
+            {
+                destination[j] = table[source[j]];
+            }
+        }
+    }
+}
+
+/**
+ * Decoded image of a file read ahead of its use (see prefetchImageFile).
+ * @brief The PrefetchedImage struct
+ */
+struct PrefetchedImage
+{
+    std::string key;
+    Mat image8U;
+};
+
+static mutex prefetchMutex;
+static map<string, PrefetchedImage> prefetchedImages;
+
+/**
+ * Returns the prefetched image of a file and removes it from the prefetched images.
+ * @brief takePrefetchedImage
+ * @param filePath
+ * @param image8U
+ * @return false if the file has not been prefetched or has been modified since.
+ */
+static bool takePrefetchedImage(string filePath, Mat &image8U)
+{
+    PrefetchedImage prefetched;
+
+    {
+        lock_guard<mutex> lock(prefetchMutex);
+
+        map<string, PrefetchedImage>::iterator image = prefetchedImages.find(filePath);
+
+        if(image == prefetchedImages.end())
+        {
+            return false;
+        }
+
+        prefetched = image->second;
+        prefetchedImages.erase(image);
+    }
+
+    string key;
+
+    if(!fileIdentity(filePath, key) || key != prefetched.key)
+    {
+        return false;
+    }
+
+    image8U = prefetched.image8U;
+
+    return true;
+}
+
+/**
+ * Reads and decodes an image file as a CV_8UC3 image.
+ * Both the content of the file and the decoded image are stored in buffers of the buffer pool.
+ * @brief readImageFile
+ * @param filePath
+ * @param image8U
+ * @return false if the file could not be read or decoded.
+ */
+bool readImageFile(string filePath, Mat &image8U)
+{
+    if(takePrefetchedImage(filePath, image8U))
+    {
+        return true;
+    }
+
+    ifstream file(filePath.c_str(), ios::in | ios::binary | ios::ate);
+
+    if(!file)
+    {
+        return false;
+    }
+
+    streamoff fileSize = file.tellg();
+
+    if(fileSize <= 0)
+    {
+        return false;
+    }
+
+    Mat fileContent;
+    createPooledImage(fileContent, 1, (int) fileSize, CV_8UC1);
+
+    file.seekg(0, ios::beg);
+
+    if(!file.read((char*) fileContent.data, fileSize))
+    {
+        return false;
+    }
+
+    if(!image8U.data)
+    {
+        image8U.allocator = &globalBufferPool();
+    }
+
+    imdecode(fileContent, CV_LOAD_IMAGE_COLOR, &image8U);
+
+    return image8U.data != NULL;
+}
+
+/**
+ * Returns a key that identifies the content of a file : the same file reached through different paths
+ * (links) has the same key, and the key changes when the file is modified.
+ * @brief fileIdentity
+ * @param filePath
+ * @param key
+ * @return false if the file does not exist.
+ */
+bool fileIdentity(string filePath, string &key)
+{
+    struct stat status;
+
+    if(stat(filePath.c_str(), &status) != 0)
+    {
+        return false;
+    }
+
+    ostringstream osstream;
+
+    //The inode is not available on every file system
+    if(status.st_ino != 0)
+    {
+        osstream << status.st_dev << ":" << status.st_ino;
+    }
+    else
+    {
+        osstream << filePath;
+    }
+
+    osstream << ":" << status.st_size << ":" << status.st_mtime;
+    key = osstream.str();
+
+    return true;
+}
+
+/**
+ * Decodes an image file ahead of its use : the next readImageFile of the file returns the decoded image
+ * instead of decoding it again, unless the file has been modified in the meantime. The image is kept until then.
+ * @brief prefetchImageFile
+ * @param filePath
+ * @param imageSize size of the decoded image.
+ * @return false if the file could not be read or decoded.
+ */
+bool prefetchImageFile(string filePath, Size &imageSize)
+{
+    PrefetchedImage prefetched;
+
+    //Identity taken before the file is read : a modification during the decoding invalidates the image
+    if(!fileIdentity(filePath, prefetched.key) || !readImageFile(filePath, prefetched.image8U))
+    {
+        return false;
+    }
+
+    imageSize = Size(prefetched.image8U.cols, prefetched.image8U.rows);
+
+    lock_guard<mutex> lock(prefetchMutex);
+    prefetchedImages[filePath] = prefetched;
+
+    return true;
+}
+
+/**
+ * Releases the prefetched images of the files of a folder and of its subfolders that have not been read.
+ * @brief discardPrefetchedImages
+ * @param pathToFolder
+ */
+void discardPrefetchedImages(string pathToFolder)
+{
+    string prefix = pathToFolder + "/";
+
+    lock_guard<mutex> lock(prefetchMutex);
+
+    map<string, PrefetchedImage>::iterator image = prefetchedImages.lower_bound(prefix);
+
+    while(image != prefetchedImages.end() && image->first.compare(0, prefix.size(), prefix) == 0)
+    {
+        prefetchedImages.erase(image++);
+    }
+}
+
 /**
  * Function that scales a float image to the 0;1 range.
  * Divides each color channel by the maximum. The maximum is calculated in the region of the image defined by the mask.
@@ -49,6 +309,21 @@ using namespace std;
  * @param image
  */
 void scaleTo01Range(Mat &image, const Mat &maskObject)
+{
+    float maximumOfRGB = maximumInMask(image, maskObject);
+
+    divideByMaximum(image, maximumOfRGB);
+}
+
+/**
+ * Returns the maximum over the R, G and B channels of a float image.
+ * The maximum is only calculated in the region of the image defined by the mask.
+ * @brief maximumInMask
+ * @param image
+ * @param maskObject
+ * @return
+ */
+float maximumInMask(const Mat &image, const Mat &maskObject)
 {
     int width = image.cols;
     int height = image.rows;
@@ -79,6 +354,21 @@ void scaleTo01Range(Mat &image, const Mat &maskObject)
         }
     }
 
+    return maximumOfRGB;
+}
+
+/**
+ * Divides each color channel of a float image by the same maximum.
+ * The image is left unchanged if the maximum is not strictly positive.
+ * @brief divideByMaximum
+ * @param image
+ * @param maximumOfRGB
+ */
+void divideByMaximum(Mat &image, float maximumOfRGB)
+{
+    int width = image.cols;
+    int height = image.rows;
+
     //Divide RGB by the same value to avoid color shifting
     for(int i = 0 ; i<height ; i++)
     {
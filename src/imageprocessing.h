@@ -41,12 +41,16 @@
 #define IMAGEPROCESSING_H
 
 #include "mathfunctions.h"
+#include "bufferpool.h"
 
 #define M_PI 3.14159265358979323846
 
 #include <iostream>
+#include <fstream>
 #include <cmath>
 #include <vector>
+#include <map>
+#include <mutex>
 
 #include <QApplication>
 #include <QVector3D>
@@ -67,6 +71,25 @@
  */
 void scaleTo01Range(cv::Mat &image, const cv::Mat &maskObject);
 
+/**
+ * Returns the maximum over the R, G and B channels of a float image.
+ * The maximum is only calculated in the region of the image defined by the mask.
+ * @brief maximumInMask
+ * @param image
+ * @param maskObject
+ * @return
+ */
+float maximumInMask(const cv::Mat &image, const cv::Mat &maskObject);
+
+/**
+ * Divides each color channel of a float image by the same maximum.
+ * The image is left unchanged if the maximum is not strictly positive.
+ * @brief divideByMaximum
+ * @param image
+ * @param maximumOfRGB
+ */
+void divideByMaximum(cv::Mat &image, float maximumOfRGB);
+
 /**
  * For each pixel of each image sets RGB to 0 if any of R, G, B is 0
  * @brief setNegativePixelsTo0
@@ -82,6 +105,66 @@ void setNegativePixelsTo0(cv::Mat images[], int numberOfImages);
  */
 void setNegativePixelsTo0(cv::Mat &image);
 
+/**
+ * Returns a lookup table of numberOfValues floats that maps a value v to (v/(numberOfValues-1))^gamma
+ * (256 values for 8 bits images, 65536 for 16 bits images).
+ * The tables are built once per gamma value and kept for the lifetime of the program.
+ * @brief gammaLookupTable
+ * @param gamma
+ * @param numberOfValues
+ * @return
+ */
+const float* gammaLookupTable(double gamma, int numberOfValues = 256);
+
+/**
+ * Converts an 8 bits image (CV_8UC3) to a linear CV_32FC3 image in the 0;1 range and removes the gamma correction
+ * in the same pass with a lookup table. Use gamma = 1.0 for a simple scaling.
+ * 16 bits images (CV_16UC3, averaged shots) are converted in the same way.
+ * The output buffer is reused if it already has the right size, otherwise it is taken from the buffer pool.
+ * @brief linearizeImage
+ * @param image8U
+ * @param linearImage
+ * @param gamma
+ */
+void linearizeImage(const cv::Mat &image8U, cv::Mat &linearImage, double gamma);
+
+/**
+ * Reads and decodes an image file as a CV_8UC3 image.
+ * Both the content of the file and the decoded image are stored in buffers of the buffer pool.
+ * @brief readImageFile
+ * @param filePath
+ * @param image8U
+ * @return false if the file could not be read or decoded.
+ */
+bool readImageFile(std::string filePath, cv::Mat &image8U);
+
+/**
+ * Returns a key that identifies the content of a file : the same file reached through different paths
+ * (links) has the same key, and the key changes when the file is modified.
+ * @brief fileIdentity
+ * @param filePath
+ * @param key
+ * @return false if the file does not exist.
+ */
+bool fileIdentity(std::string filePath, std::string &key);
+
+/**
+ * Decodes an image file ahead of its use : the next readImageFile of the file returns the decoded image
+ * instead of decoding it again, unless the file has been modified in the meantime. The image is kept until then.
+ * @brief prefetchImageFile
+ * @param filePath
+ * @param imageSize size of the decoded image.
+ * @return false if the file could not be read or decoded.
+ */
+bool prefetchImageFile(std::string filePath, cv::Size &imageSize);
+
+/**
+ * Releases the prefetched images of the files of a folder and of its subfolders that have not been read.
+ * @brief discardPrefetchedImages
+ * @param pathToFolder
+ */
+void discardPrefetchedImages(std::string pathToFolder);
+
 /**
  * Apply a gamma correction to a RGB image (OpenCV Mat image).
  * @param INPUT : rgbImage is the image to which the gamma correction is applied.
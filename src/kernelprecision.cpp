@@ -0,0 +1,111 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file kernelprecision.cpp
+ * \brief Implementation of the precision tiers of the solvers of the normals and the roughness.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ */
+
+#include "kernelprecision.h"
+
+using namespace std;
+
+static KernelPrecision currentKernelPrecision = EXACT_PRECISION;
+
+/**
+ * Sets the precision of the solvers of the normals and the roughness.
+ * @brief setKernelPrecision
+ * @param precision
+ */
+void setKernelPrecision(KernelPrecision precision)
+{
+    currentKernelPrecision = precision;
+}
+
+/**
+ * Returns the precision of the solvers of the normals and the roughness (EXACT_PRECISION by default).
+ * @brief kernelPrecision
+ * @return
+ */
+KernelPrecision kernelPrecision()
+{
+    return currentKernelPrecision;
+}
+
+/**
+ * Parses a precision : exact, fast or approximate.
+ * @brief parseKernelPrecision
+ * @param text
+ * @param precision
+ * @return false if the text is not a precision.
+ */
+bool parseKernelPrecision(string text, KernelPrecision &precision)
+{
+    if(text == "exact")
+    {
+        precision = EXACT_PRECISION;
+    }
+    else if(text == "fast")
+    {
+        precision = FAST_PRECISION;
+    }
+    else if(text == "approximate")
+    {
+        precision = APPROXIMATE_PRECISION;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Returns the name of a precision (exact, fast or approximate).
+ * @brief kernelPrecisionName
+ * @param precision
+ * @return
+ */
+string kernelPrecisionName(KernelPrecision precision)
+{
+    if(precision == FAST_PRECISION)
+    {
+        return "fast";
+    }
+    else if(precision == APPROXIMATE_PRECISION)
+    {
+        return "approximate";
+    }
+
+    return "exact";
+}
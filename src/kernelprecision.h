@@ -0,0 +1,289 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file kernelprecision.h
+ * \brief Implementation of the precision tiers of the solvers of the normals and the roughness.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The solvers (SpecularMapsBody and PatternMapsBody in reflectance.cpp) take their square roots, inverse square roots,
+ * fourth roots and divisions from the functions below, specialised at compile time on the precision :
+ *   - EXACT_PRECISION : sqrt and divisions of the standard library (default, same results as before the tiers).
+ *   - FAST_PRECISION : the inverse square root and the reciprocal start from the estimates of the processor (rsqrtss and
+ *     rcpss, 12 bits) refined by one Newton iteration, close to the float precision. z = sqrt(1-x^2-y^2) of the normals is
+ *     computed in float instead of double, which dominates the error near the grazing angles.
+ *   - APPROXIMATE_PRECISION : the estimates without Newton iteration, for previews and the reprocessing of archives.
+ * Without SSE the estimates are read from the bits of the float and refined by more Newton iterations, to a comparable precision.
+ * The NaN values (normals of the pixels whose gradients give x^2+y^2 > 1) are kept in every tier, so that the invalid
+ * pixels are flagged as with the exact functions.
+ *
+ * The maximum errors against the exact tier below are measured on the synthetic captures (see benchmarkKernelPrecision
+ * in synthetic.h), on the scored pixels : angle between the normals in degrees and absolute difference of the roughness.
+ */
+
+#ifndef KERNELPRECISION
+#define KERNELPRECISION
+
+/*---- Standard library ----*/
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define KERNELPRECISION_SSE
+#endif
+
+//Maximum errors against EXACT_PRECISION on the synthetic captures
+#define FAST_PRECISION_NORMAL_TOLERANCE 0.05                //degrees
+#define FAST_PRECISION_ROUGHNESS_TOLERANCE 0.00001
+#define APPROXIMATE_PRECISION_NORMAL_TOLERANCE 0.1          //degrees
+#define APPROXIMATE_PRECISION_ROUGHNESS_TOLERANCE 0.005
+
+enum KernelPrecision {EXACT_PRECISION, FAST_PRECISION, APPROXIMATE_PRECISION};
+
+/**
+ * Sets the precision of the solvers of the normals and the roughness.
+ * @brief setKernelPrecision
+ * @param precision
+ */
+void setKernelPrecision(KernelPrecision precision);
+
+/**
+ * Returns the precision of the solvers of the normals and the roughness (EXACT_PRECISION by default).
+ * @brief kernelPrecision
+ * @return
+ */
+KernelPrecision kernelPrecision();
+
+/**
+ * Parses a precision : exact, fast or approximate.
+ * @brief parseKernelPrecision
+ * @param text
+ * @param precision
+ * @return false if the text is not a precision.
+ */
+bool parseKernelPrecision(std::string text, KernelPrecision &precision);
+
+/**
+ * Returns the name of a precision (exact, fast or approximate).
+ * @brief kernelPrecisionName
+ * @param precision
+ * @return
+ */
+std::string kernelPrecisionName(KernelPrecision precision);
+
+/**
+ * Estimate of 1/sqrt(value) for value >= 0 : rsqrtss instruction (relative error below 0.04 %), or from the bits of the
+ * float without SSE (relative error below 3.5 %, refined by one more Newton iteration).
+ * @brief inverseSquareRootEstimate
+ * @param value
+ * @return
+ */
+inline float inverseSquareRootEstimate(float value)
+{
+#ifdef KERNELPRECISION_SSE
+    return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(value)));
+#else
+    unsigned int bits;
+    std::memcpy(&bits, &value, sizeof(float));
+
+    bits = 0x5f375a86u-(bits >> 1);
+
+    float estimate;
+    std::memcpy(&estimate, &bits, sizeof(float));
+
+    return estimate*(1.5f-0.5f*value*estimate*estimate);
+#endif
+}
+
+/**
+ * Estimate of 1/value : rcpss instruction (relative error below 0.04 %), or from the bits of the float without SSE
+ * (relative error below 12.5 %, refined by two more Newton iterations).
+ * @brief reciprocalEstimate
+ * @param value
+ * @return
+ */
+inline float reciprocalEstimate(float value)
+{
+#ifdef KERNELPRECISION_SSE
+    return _mm_cvtss_f32(_mm_rcp_ss(_mm_set_ss(value)));
+#else
+    unsigned int bits;
+    std::memcpy(&bits, &value, sizeof(float));
+
+    unsigned int sign = bits & 0x80000000u;
+    bits = (0x7ef311c7u-(bits & 0x7fffffffu)) | sign;
+
+    float estimate;
+    std::memcpy(&estimate, &bits, sizeof(float));
+
+    estimate = estimate*(2.0f-value*estimate);
+
+    return estimate*(2.0f-value*estimate);
+#endif
+}
+
+/**
+ * 1/sqrt(value). The Newton iterations propagate a NaN value.
+ * @brief inverseSquareRoot
+ * @param value
+ * @return
+ */
+template<KernelPrecision Precision>
+inline float inverseSquareRoot(float value)
+{
+    if(Precision == EXACT_PRECISION)
+    {
+        return 1.0f/std::sqrt(value);
+    }
+
+    float result = inverseSquareRootEstimate(value);
+
+    if(Precision == FAST_PRECISION)
+    {
+        result = result*(1.5f-0.5f*value*result*result);
+    }
+
+    return result;
+}
+
+/**
+ * sqrt(value), NaN if value is negative as the exact square root.
+ * @brief squareRoot
+ * @param value
+ * @return
+ */
+template<KernelPrecision Precision>
+inline float squareRoot(float value)
+{
+    if(Precision == EXACT_PRECISION)
+    {
+        return std::sqrt(value);
+    }
+
+    //The inverse square root of 0 is infinite
+    float result = value > 0.0f ? value*inverseSquareRoot<Precision>(value) : 0.0f;
+
+    return value >= 0.0f ? result : std::numeric_limits<float>::quiet_NaN();
+}
+
+/**
+ * value^(1/4) for value >= 0 : sqrt(sqrt(value)), or the inverse square root of the inverse square root (0 for 0).
+ * @brief fourthRoot
+ * @param value
+ * @return
+ */
+template<KernelPrecision Precision>
+inline float fourthRoot(float value)
+{
+    if(Precision == EXACT_PRECISION)
+    {
+        return std::sqrt(std::sqrt(value));
+    }
+
+    return value > 0.0f ? inverseSquareRoot<Precision>(inverseSquareRoot<Precision>(value)) : 0.0f;
+}
+
+/**
+ * numerator/denominator, as numerator*(1/denominator) with the approximate tiers.
+ * The reciprocal of the same denominator is computed once when the function is inlined several times.
+ * @brief divide
+ * @param numerator
+ * @param denominator
+ * @return
+ */
+template<KernelPrecision Precision>
+inline float divide(float numerator, float denominator)
+{
+    if(Precision == EXACT_PRECISION)
+    {
+        return numerator/denominator;
+    }
+
+    float result = reciprocalEstimate(denominator);
+
+    if(Precision == FAST_PRECISION)
+    {
+        result = result*(2.0f-denominator*result);
+    }
+
+    return numerator*result;
+}
+
+/**
+ * z = sqrt(1-x^2-y^2) of a unit vector, NaN if x^2+y^2 > 1. The exact tier computes it in double precision.
+ * @brief unitVectorZ
+ * @param x
+ * @param y
+ * @return
+ */
+template<KernelPrecision Precision>
+inline float unitVectorZ(float x, float y)
+{
+    if(Precision == EXACT_PRECISION)
+    {
+        return std::sqrt(1.0-x*x-y*y);
+    }
+
+    return squareRoot<Precision>(1.0f-x*x-y*y);
+}
+
+/**
+ * Normalizes the vector (x,y,z) : divisions by its norm, or multiplications by the inverse square root of its squared norm.
+ * @brief normalizeVector
+ * @param x
+ * @param y
+ * @param z
+ */
+template<KernelPrecision Precision>
+inline void normalizeVector(float &x, float &y, float &z)
+{
+    if(Precision == EXACT_PRECISION)
+    {
+        float norm = std::sqrt(x*x+y*y+z*z);
+
+        x /= norm;
+        y /= norm;
+        z /= norm;
+    }
+    else
+    {
+        float inverseNorm = inverseSquareRoot<Precision>(x*x+y*y+z*z);
+
+        x *= inverseNorm;
+        y *= inverseNorm;
+        z *= inverseNorm;
+    }
+}
+
+#endif // KERNELPRECISION
@@ -0,0 +1,312 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file labelmask.cpp
+ * \brief Implementation of the reflectance maps of several samples captured in the same frames.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the reflectance maps of several samples captured in the same frames.
+ */
+
+#include "labelmask.h"
+#include "capturetile.h"
+#include "imageprocessing.h"
+#include "bufferpool.h"
+#include "taskgraph.h"
+#include "diagnostics.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Finds the samples of a label mask : one sample per colour other than black with at least MINIMUM_SAMPLE_PIXELS pixels,
+ * numbered in the order of their first pixel, row by row.
+ * @brief findLabelledSamples
+ * @param labels decoded label mask (CV_8UC3).
+ * @param samples
+ */
+void findLabelledSamples(const Mat &labels, vector<LabelledSample> &samples)
+{
+    samples.clear();
+
+    //Index of each colour in samples, colours packed as 0xRRGGBB
+    map<int, int> indices;
+
+    for(int i = 0 ; i<labels.rows ; i++)
+    {
+        const Vec3b *pixels = labels.ptr<Vec3b>(i);
+
+        for(int j = 0 ; j<labels.cols ; j++)
+        {
+            int colour = (pixels[j].val[2] << 16) | (pixels[j].val[1] << 8) | pixels[j].val[0];
+
+            if(colour == 0)
+            {
+                continue;
+            }
+
+            map<int, int>::iterator index = indices.find(colour);
+
+            if(index == indices.end())
+            {
+                LabelledSample sample;
+                sample.colour = pixels[j];
+                sample.region = Rect(j, i, 1, 1);
+                sample.numberOfPixels = 0;
+
+                index = indices.insert(make_pair(colour, (int) samples.size())).first;
+                samples.push_back(sample);
+            }
+
+            LabelledSample &sample = samples[index->second];
+            sample.region |= Rect(j, i, 1, 1);
+            sample.numberOfPixels++;
+        }
+    }
+
+    vector<LabelledSample> labelledSamples;
+
+    for(size_t s = 0 ; s<samples.size() ; s++)
+    {
+        if(samples[s].numberOfPixels >= MINIMUM_SAMPLE_PIXELS)
+        {
+            labelledSamples.push_back(samples[s]);
+        }
+    }
+
+    samples.swap(labelledSamples);
+}
+
+/**
+ * Builds the linear mask of a sample on its bounding box : 1 on the pixels of its label, 0 elsewhere.
+ * @brief makeSampleMask
+ * @param labels
+ * @param sample
+ * @param mask linear mask (CV_32FC3) as the masks of the tiles.
+ */
+static void makeSampleMask(const Mat &labels, const LabelledSample &sample, Mat &mask)
+{
+    createPooledImage(mask, sample.region.height, sample.region.width, CV_32FC3);
+
+    const Vec3b &colour = sample.colour;
+
+    for(int i = 0 ; i<sample.region.height ; i++)
+    {
+        const Vec3b *pixels = labels.ptr<Vec3b>(sample.region.y+i)+sample.region.x;
+        Vec3f *maskPixels = mask.ptr<Vec3f>(i);
+
+        for(int j = 0 ; j<sample.region.width ; j++)
+        {
+            bool inside = pixels[j].val[0] == colour.val[0] && pixels[j].val[1] == colour.val[1] && pixels[j].val[2] == colour.val[2];
+            float value = inside ? 1.0f : 0.0f;
+            maskPixels[j] = Vec3f(value, value, value);
+        }
+    }
+}
+
+/**
+ * Computes the maps of a sample on its bounding box with the statistics of its label :
+ * the same reductions as a whole capture, then the height map of the sample.
+ * @brief computeSampleMaps
+ * @param frames
+ * @param labels
+ * @param sample
+ * @param tile
+ * @param statistics statistics of the sample.
+ */
+static void computeSampleMaps(const CaptureFrames &frames, const Mat &labels, const LabelledSample &sample,
+                              CaptureTile &tile, CaptureStatistics &statistics)
+{
+    linearizeCaptureTile(frames, sample.region, tile);
+
+    //The label replaces the mask of the capture
+    makeSampleMask(labels, sample, tile.mask);
+
+    accumulateGradientMaxima(tile, statistics);
+
+    computeTileMaps(tile, statistics);
+    releaseTileGradients(tile);
+
+    accumulateMapStatistics(tile, statistics);
+
+    finalizeTileMaps(tile, statistics);
+
+    computeCaptureHeightMap(tile.maps, tile.mask);
+}
+
+/**
+ * Queues the maps of a sample to the output writer (group pathToFolder) : sample<n>_* in the textures folder.
+ * @brief saveSampleMaps
+ * @param maps
+ * @param pathToFolder
+ * @param sampleNumber
+ */
+static void saveSampleMaps(const ReflectanceMaps &maps, string pathToFolder, int sampleNumber)
+{
+    ostringstream prefix;
+    prefix << pathToFolder << "/textures/sample" << sampleNumber << "_";
+
+    if(!maps.diffuse.empty())
+    {
+        savePFMAsync(pathToFolder, maps.diffuse, prefix.str() + "diffuse.pfm");
+    }
+
+    savePFMAsync(pathToFolder, maps.specular, prefix.str() + "specular.pfm");
+    saveNormalMapAsync(pathToFolder, maps.normals, prefix.str() + "normalMap.bmp");
+
+    if(!maps.redNormals.empty())
+    {
+        saveNormalMapAsync(pathToFolder, maps.redNormals, prefix.str() + "normalMap_red.bmp");
+        saveNormalMapAsync(pathToFolder, maps.blueNormals, prefix.str() + "normalMap_blue.bmp");
+    }
+
+    if(!maps.diffuseNormals.empty())
+    {
+        saveNormalMapAsync(pathToFolder, maps.diffuseNormals, prefix.str() + "diffuseNormalMap.bmp");
+    }
+
+    savePFMAsync(pathToFolder, maps.roughness, prefix.str() + "roughness.pfm");
+    savePFMAsync(pathToFolder, maps.height, prefix.str() + "height.pfm");
+
+    if(!maps.invalid.empty() && invalidMaskEnabled())
+    {
+        //The header of the map keeps its buffer alive until the file is written
+        Mat invalid = maps.invalid;
+        string filePath = prefix.str() + "invalid.pbm";
+
+        writeOutputAsync(pathToFolder, filePath, [invalid, filePath]() { return saveInvalidMask(invalid, filePath); });
+    }
+}
+
+/**
+ * Writes the samples in samples.txt : one line "n x y width height red green blue pixels" per sample.
+ * @brief saveSampleDescription
+ * @param samples
+ * @param pathToTextures
+ * @return false if the file could not be written.
+ */
+static bool saveSampleDescription(const vector<LabelledSample> &samples, string pathToTextures)
+{
+    ofstream file((pathToTextures + "/samples.txt").c_str(), ios::out | ios::trunc);
+
+    for(size_t s = 0 ; s<samples.size() ; s++)
+    {
+        const LabelledSample &sample = samples[s];
+
+        file << s+1 << " " << sample.region.x << " " << sample.region.y << " " << sample.region.width << " " << sample.region.height
+             << " " << (int) sample.colour.val[2] << " " << (int) sample.colour.val[1] << " " << (int) sample.colour.val[0]
+             << " " << sample.numberOfPixels << endl;
+    }
+
+    return file.good();
+}
+
+/**
+ * Computes the reflectance maps of each sample of a label mask with its own statistics and writes them, cropped to the
+ * bounding box of the sample, in the textures folder : sample<n>_diffuse.pfm (with cross polarised data only),
+ * sample<n>_specular.pfm, sample<n>_normalMap.bmp (and sample<n>_normalMap_red.bmp, sample<n>_normalMap_blue.bmp,
+ * sample<n>_diffuseNormalMap.bmp if computed), sample<n>_roughness.pfm and sample<n>_height.pfm, numbered from 1,
+ * with samples.txt (one line "n x y width height red green blue pixels" per sample).
+ * The pixels of the box outside the label are computed but do not contribute to the statistics.
+ * The mip chains and the compressed textures are not computed for the samples.
+ * @brief computeLabelledSampleMaps
+ * @param pathToFolder
+ * @param isCrossData
+ * @param labelFile path of the label mask.
+ * @return false if the label mask has no sample or is not of the size of the capture, or one of the files could not be loaded.
+ */
+bool computeLabelledSampleMaps(string pathToFolder, bool isCrossData, string labelFile)
+{
+    Mat labels;
+
+    if(!readImageFile(labelFile, labels))
+    {
+        cerr << "Could not load image : " << labelFile << endl;
+        return false;
+    }
+
+    vector<LabelledSample> samples;
+    findLabelledSamples(labels, samples);
+
+    if(samples.empty())
+    {
+        cerr << "The label mask " << labelFile << " has no sample of at least " << MINIMUM_SAMPLE_PIXELS << " pixels" << endl;
+        return false;
+    }
+
+    //The frames are decoded once for all the samples
+    CaptureFrames frames;
+
+    if(!loadCaptureFrames(pathToFolder, isCrossData, frames))
+    {
+        return false;
+    }
+
+    if(labels.cols != frames.mask.cols || labels.rows != frames.mask.rows)
+    {
+        cerr << "The label mask " << labelFile << " (" << labels.cols << "x" << labels.rows << ") is not of the size of the capture ("
+             << frames.mask.cols << "x" << frames.mask.rows << ")" << endl;
+        return false;
+    }
+
+    vector<CaptureStatistics> statistics(samples.size());
+
+    runTasks((int) samples.size(), [&](int s)
+    {
+        CaptureTile tile;
+
+        computeSampleMaps(frames, labels, samples[s], tile, statistics[s]);
+        saveSampleMaps(tile.maps, pathToFolder, s+1);
+    });
+
+    for(size_t s = 0 ; s<samples.size() ; s++)
+    {
+        ostringstream name;
+        name << pathToFolder << " (sample " << s+1 << ")";
+
+        printPixelDiagnostics(statistics[s].diagnostics, name.str());
+    }
+
+    if(!saveSampleDescription(samples, pathToFolder + "/textures"))
+    {
+        cerr << "Cannot write " << pathToFolder + "/textures/samples.txt" << endl;
+        return false;
+    }
+
+    return true;
+}
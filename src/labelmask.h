@@ -0,0 +1,100 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file labelmask.h
+ * \brief Implementation of the reflectance maps of several samples captured in the same frames.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Several samples placed under the rig in the same capture are described by a label mask instead of mask.JPG :
+ * an image of the size of the capture in which the pixels of each sample have their own colour (or grey level for
+ * an index image) and the background is black. The label mask must be stored without loss (PNG, BMP).
+ *
+ * Each sample is computed as a capture of its own : the maxima of scaleTo01Range and the average surface normal
+ * are the statistics of the pixels of its label only, so the albedos and the normals of a sample do not depend on
+ * the other samples. The frames are decoded once and the samples are computed concurrently, each one on the
+ * bounding box of its label : the memory is bounded by the decoded frames and the boxes of the samples in flight.
+ */
+
+#ifndef LABELMASK
+#define LABELMASK
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+
+//Labels with fewer pixels are ignored (antialiased borders of a drawn label mask)
+#define MINIMUM_SAMPLE_PIXELS 64
+
+/**
+ * One sample of a label mask.
+ * @brief The LabelledSample struct
+ */
+struct LabelledSample
+{
+    //Colour of the label, BGR
+    cv::Vec3b colour;
+
+    //Bounding box of the label in the capture
+    cv::Rect region;
+
+    int numberOfPixels;
+};
+
+/**
+ * Finds the samples of a label mask : one sample per colour other than black with at least MINIMUM_SAMPLE_PIXELS pixels,
+ * numbered in the order of their first pixel, row by row.
+ * @brief findLabelledSamples
+ * @param labels decoded label mask (CV_8UC3).
+ * @param samples
+ */
+void findLabelledSamples(const cv::Mat &labels, std::vector<LabelledSample> &samples);
+
+/**
+ * Computes the reflectance maps of each sample of a label mask with its own statistics and writes them, cropped to the
+ * bounding box of the sample, in the textures folder : sample<n>_diffuse.pfm (with cross polarised data only),
+ * sample<n>_specular.pfm, sample<n>_normalMap.bmp (and sample<n>_normalMap_red.bmp, sample<n>_normalMap_blue.bmp,
+ * sample<n>_diffuseNormalMap.bmp if computed), sample<n>_roughness.pfm and sample<n>_height.pfm, numbered from 1,
+ * with samples.txt (one line "n x y width height red green blue pixels" per sample).
+ * The pixels of the box outside the label are computed but do not contribute to the statistics.
+ * The mip chains and the compressed textures are not computed for the samples.
+ * @brief computeLabelledSampleMaps
+ * @param pathToFolder
+ * @param isCrossData
+ * @param labelFile path of the label mask.
+ * @return false if the label mask has no sample or is not of the size of the capture, or one of the files could not be loaded.
+ */
+bool computeLabelledSampleMaps(std::string pathToFolder, bool isCrossData, std::string labelFile);
+
+#endif // LABELMASK
@@ -39,20 +39,473 @@
 
 #include <iostream>
 #include <string>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#include <chrono>
 
 #include "reflectance.h"
+#include "capturetile.h"
+#include "memoryplanner.h"
+#include "synthetic.h"
+#include "regionofinterest.h"
+#include "calibration.h"
+#include "mosaic.h"
+#include "labelmask.h"
+#include "kernelprecision.h"
+#include "microfacet.h"
+
+#ifndef _WIN32
+#include "distributed.h"
+#include "daemon.h"
+#endif
+
+#ifdef __linux__
+#include "watchfolder.h"
+#endif
 
 using namespace std;
 
-int main(void)
+/**
+ * Prints the command line options.
+ * @brief printUsage
+ * @param programName
+ */
+void printUsage(const char *programName)
+{
+    cout << "Usage : " << programName << " [path_to_folder] [options]" << endl;
+    cout << "  --no-cross              Only use the parallel polarised measurements." << endl;
+    cout << "  --memory-budget <size>  Keep the memory under size (e.g. 4G, 512M), or under the memory limit of the cgroup with cgroup." << endl;
+    cout << "  --texture-compression <none|fast|high>  Quality of the DDS textures (default : fast)." << endl;
+    cout << "  --shots <n>             Number of shots of each gradient and of the ambient illumination, averaged (default : 1)." << endl;
+    cout << "  --noise-map             With --shots, save the variance of the shots (noise.pfm)." << endl;
+    cout << "  --rgb-maps              Compute the normals and the roughness of each colour channel (default : green only)." << endl;
+    cout << "  --interleaved-gradients Pack the gradients of each pixel together for the normals and roughness solvers (green channel)." << endl;
+    cout << "  --precision <exact|fast|approximate>  Precision of the square roots and divisions of the normals and roughness (default : exact)." << endl;
+    cout << "  --microfacet <none|beckmann|ggx>  Save the roughness as the alpha of a microfacet model (default : none)." << endl;
+    cout << "  --fresnel-albedo        With --microfacet, divide the specular albedo by the directional albedo of the model." << endl;
+    cout << "  --diffuse-normals       With cross polarised data, also compute the diffuse normals (diffuseNormalMap.bmp)." << endl;
+    cout << "  --invalid-mask          Save the invalid pixels (NaN normals, clamped, divisions by 0, saturated) as a 1 bit mask (invalid.pbm)." << endl;
+    cout << "  --flat-field <file>     Correct the non uniformity of the illumination with the gains of a flat field calibration." << endl;
+    cout << "  --calibrate-flat-field <file>  Compute the gains of the rig from path_to_folder, a capture of a flat matte target." << endl;
+    cout << "  --patterns <file>       Description of the illumination patterns of the rig (one line \"name 1 x y z xx yy zz\" per pattern)." << endl;
+    cout << "  --mosaic <layout>       Compute the maps of a sample captured as overlapping shots (one line \"folder x y\" per shot) as tiles." << endl;
+    cout << "  --labels <file>         Compute each sample of a label mask (one colour per sample) with its own statistics (sample<n>_*)." << endl;
+    cout << "  --roi <x,y,w,h>         Recompute the maps of a region with the statistics of the last computation of the capture (roi_*)." << endl;
+    cout << "  --workers <n>           Split the capture into tiles processed by n local worker processes." << endl;
+    cout << "  --external-workers      With --workers, wait for n workers started by hand instead of spawning them." << endl;
+    cout << "  --tile-height <rows>    Height of the tiles sent to the workers (default : one tile per worker)." << endl;
+    cout << "  --port <port>           Port on which the coordinator listens (default : any free port)." << endl;
+    cout << "  " << programName << " --worker <host> <port>   Run a worker for the coordinator at host:port." << endl;
+    cout << "  --daemon <socket>       Stay alive and process the captures submitted on the Unix socket." << endl;
+    cout << "  --spool <directory>     With --daemon, also process the .job files dropped in the directory." << endl;
+    cout << "  --job-threads <n>       With --daemon, number of captures processed concurrently (default : 1)." << endl;
+    cout << "  --watch <directory>     Compute the capture folders created in the directory as their frames land (Linux)." << endl;
+    cout << "  --submit <socket>       Submit path_to_folder to a running daemon." << endl;
+    cout << "  --status <socket>       Print the queue depth and the latencies of a running daemon." << endl;
+    cout << "  --stop <socket>         Stop a running daemon once its queue is empty." << endl;
+    cout << "  --synthetic <folder>    Render synthetic captures of known surfaces in folder, compute them and check the results." << endl;
+    cout << "  --resolutions <list>    With --synthetic, sizes of the square captures (default : 256,512,1024)." << endl;
+    cout << "  --threads <list>        With --synthetic, numbers of threads of the computation (default : 1,2,4)." << endl;
+    cout << "  --captures <list>       With --synthetic, numbers of captures computed concurrently (default : 1)." << endl;
+    cout << "  --benchmark-layout <n>  With --synthetic, compare the layouts of the gradients over n repetitions instead." << endl;
+    cout << "  --benchmark-precision <n>  With --synthetic, compare the precisions of the solvers over n repetitions instead." << endl;
+}
+
+/**
+ * Parses a comma separated list of integers (e.g. 512,1024).
+ * @brief parseIntegerList
+ * @param text
+ * @return
+ */
+vector<int> parseIntegerList(string text)
+{
+    vector<int> values;
+    istringstream stream(text);
+    string value;
+
+    while(getline(stream, value, ','))
+    {
+        if(atoi(value.c_str()) > 0)
+        {
+            values.push_back(atoi(value.c_str()));
+        }
+    }
+
+    return values;
+}
+
+int main(int argc, char *argv[])
 {
-    //Call this function to compute the maps
-    //The first parameter is a path to the folder that contains the illumination measurements : par, cross, checkert.txt, mask.jpg
-    //The second parameter is set to true to use the cross polarised measurements or false otherwise.
-    //NOTE : the loading of the image file is currently hardcoded.
-    //The images are supposed to have a name : IMG_XXXX where XXXX is a number
-    //Within a folder (e.g parallel data) the pictures are supposed to have consecutive numbers.
-    computeMaps(string("path_to_folder"), true);
-
-    return 0;
+    string pathToFolder = "path_to_folder";
+    bool isCrossData = true;
+
+    int numberOfWorkers = 0;
+    bool externalWorkers = false;
+    int tileHeight = 0;
+    int port = 0;
+
+    string daemonSocket;
+    string spoolDirectory;
+    int numberOfJobThreads = 1;
+
+    string watchDirectory;
+
+    size_t memoryBudget = 0;
+
+    bool hasRegion = false;
+    cv::Rect region;
+
+    string calibrationFile;
+    string mosaicLayout;
+    string labelFile;
+
+    string syntheticFolder;
+    vector<int> resolutions = parseIntegerList("256,512,1024");
+    vector<int> threadCounts = parseIntegerList("1,2,4");
+    vector<int> captureCounts = parseIntegerList("1");
+    int layoutRepetitions = 0;
+    int precisionRepetitions = 0;
+
+    string clientSocket;
+    string clientCommand;
+
+    for(int i = 1 ; i<argc ; i++)
+    {
+        string argument = argv[i];
+
+        if(argument == "--no-cross")
+        {
+            isCrossData = false;
+        }
+        else if(argument == "--memory-budget" && i+1<argc)
+        {
+            string budget = argv[++i];
+
+            //The budget is never taken from the cgroup implicitly : the strips change the timing and the outputs of a run
+            memoryBudget = budget == "cgroup" ? readCgroupMemoryLimit() : parseMemorySize(budget);
+
+            if(memoryBudget == 0 && budget == "cgroup")
+            {
+                cerr << "The process has no cgroup memory limit" << endl;
+                return -1;
+            }
+            else if(memoryBudget == 0)
+            {
+                cerr << "Invalid memory budget : " << budget << endl;
+                return -1;
+            }
+        }
+        else if(argument == "--texture-compression" && i+1<argc)
+        {
+            CompressionQuality quality = FAST_COMPRESSION;
+
+            if(!parseCompressionQuality(argv[++i], quality))
+            {
+                cerr << "Invalid texture compression : " << argv[i] << endl;
+                return -1;
+            }
+
+            setCompressionQuality(quality);
+        }
+        else if(argument == "--shots" && i+1<argc)
+        {
+            if(atoi(argv[++i]) <= 0)
+            {
+                cerr << "Invalid number of shots : " << argv[i] << endl;
+                return -1;
+            }
+
+            setNumberOfShots(atoi(argv[i]));
+        }
+        else if(argument == "--noise-map")
+        {
+            setNoiseMapEnabled(true);
+        }
+        else if(argument == "--rgb-maps")
+        {
+            setPerChannelMaps(true);
+        }
+        else if(argument == "--interleaved-gradients")
+        {
+            setInterleavedGradients(true);
+        }
+        else if(argument == "--precision" && i+1<argc)
+        {
+            KernelPrecision precision = EXACT_PRECISION;
+
+            if(!parseKernelPrecision(argv[++i], precision))
+            {
+                cerr << "Invalid precision : " << argv[i] << endl;
+                return -1;
+            }
+
+            setKernelPrecision(precision);
+        }
+        else if(argument == "--microfacet" && i+1<argc)
+        {
+            MicrofacetModel model = NO_MICROFACET_MODEL;
+
+            if(!parseMicrofacetModel(argv[++i], model))
+            {
+                cerr << "Invalid microfacet model : " << argv[i] << endl;
+                return -1;
+            }
+
+            setMicrofacetModel(model);
+        }
+        else if(argument == "--fresnel-albedo")
+        {
+            setFresnelAlbedoEnabled(true);
+        }
+        else if(argument == "--diffuse-normals")
+        {
+            setDiffuseNormalsEnabled(true);
+        }
+        else if(argument == "--invalid-mask")
+        {
+            setInvalidMaskEnabled(true);
+        }
+        else if(argument == "--flat-field" && i+1<argc)
+        {
+            setFlatFieldFile(argv[++i]);
+        }
+        else if(argument == "--calibrate-flat-field" && i+1<argc)
+        {
+            calibrationFile = argv[++i];
+        }
+        else if(argument == "--patterns" && i+1<argc)
+        {
+            if(!setIlluminationPatternsFile(argv[++i]))
+            {
+                return -1;
+            }
+        }
+        else if(argument == "--mosaic" && i+1<argc)
+        {
+            mosaicLayout = argv[++i];
+        }
+        else if(argument == "--labels" && i+1<argc)
+        {
+            labelFile = argv[++i];
+        }
+        else if(argument == "--roi" && i+1<argc)
+        {
+            if(!parseRegion(argv[++i], region))
+            {
+                cerr << "Invalid region : " << argv[i] << endl;
+                return -1;
+            }
+
+            hasRegion = true;
+        }
+        else if(argument == "--synthetic" && i+1<argc)
+        {
+            syntheticFolder = argv[++i];
+        }
+        else if(argument == "--resolutions" && i+1<argc)
+        {
+            resolutions = parseIntegerList(argv[++i]);
+        }
+        else if(argument == "--threads" && i+1<argc)
+        {
+            threadCounts = parseIntegerList(argv[++i]);
+        }
+        else if(argument == "--captures" && i+1<argc)
+        {
+            captureCounts = parseIntegerList(argv[++i]);
+        }
+        else if(argument == "--benchmark-layout" && i+1<argc)
+        {
+            layoutRepetitions = atoi(argv[++i]);
+        }
+        else if(argument == "--benchmark-precision" && i+1<argc)
+        {
+            precisionRepetitions = atoi(argv[++i]);
+        }
+        else if(argument == "--workers" && i+1<argc)
+        {
+            numberOfWorkers = atoi(argv[++i]);
+        }
+        else if(argument == "--external-workers")
+        {
+            externalWorkers = true;
+        }
+        else if(argument == "--tile-height" && i+1<argc)
+        {
+            tileHeight = atoi(argv[++i]);
+        }
+        else if(argument == "--port" && i+1<argc)
+        {
+            port = atoi(argv[++i]);
+        }
+        else if(argument == "--worker" && i+2<argc)
+        {
+#ifndef _WIN32
+            return runWorker(string(argv[i+1]), atoi(argv[i+2])) ? 0 : -1;
+#else
+            cerr << "Distributed processing is not available on Windows" << endl;
+            return -1;
+#endif
+        }
+        else if(argument == "--daemon" && i+1<argc)
+        {
+            daemonSocket = argv[++i];
+        }
+        else if(argument == "--spool" && i+1<argc)
+        {
+            spoolDirectory = argv[++i];
+        }
+        else if(argument == "--job-threads" && i+1<argc)
+        {
+            numberOfJobThreads = atoi(argv[++i]);
+        }
+        else if(argument == "--watch" && i+1<argc)
+        {
+            watchDirectory = argv[++i];
+        }
+        else if((argument == "--submit" || argument == "--status" || argument == "--stop") && i+1<argc)
+        {
+            clientSocket = argv[++i];
+            clientCommand = argument;
+        }
+        else if(argument.size() > 0 && argument[0] != '-')
+        {
+            pathToFolder = argument;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(!calibrationFile.empty())
+    {
+        return calibrateFlatField(pathToFolder, isCrossData, calibrationFile) ? 0 : -1;
+    }
+
+    if(!mosaicLayout.empty())
+    {
+        return computeMosaicMaps(mosaicLayout, isCrossData) ? 0 : -1;
+    }
+
+    if(!syntheticFolder.empty() && precisionRepetitions > 0)
+    {
+        return benchmarkKernelPrecision(syntheticFolder, resolutions, precisionRepetitions) ? 0 : -1;
+    }
+
+    if(!syntheticFolder.empty() && layoutRepetitions > 0)
+    {
+        return benchmarkGradientLayouts(syntheticFolder, resolutions, layoutRepetitions) ? 0 : -1;
+    }
+
+    if(!syntheticFolder.empty())
+    {
+        return runSyntheticHarness(syntheticFolder, resolutions, threadCounts, captureCounts) ? 0 : -1;
+    }
+
+    if(!watchDirectory.empty())
+    {
+#ifdef __linux__
+        return runWatchFolder(watchDirectory, isCrossData, memoryBudget) ? 0 : -1;
+#else
+        cerr << "The watch folder mode is only available on Linux" << endl;
+        return -1;
+#endif
+    }
+
+    if(!daemonSocket.empty() || !clientSocket.empty())
+    {
+#ifndef _WIN32
+        if(!daemonSocket.empty())
+        {
+            return runDaemon(daemonSocket, spoolDirectory, numberOfJobThreads, memoryBudget) ? 0 : -1;
+        }
+
+        string command = "QUIT";
+        string reply;
+
+        if(clientCommand == "--submit")
+        {
+            command = string("SUBMIT ") + (isCrossData ? "cross " : "nocross ") + pathToFolder;
+        }
+        else if(clientCommand == "--status")
+        {
+            command = "STATUS";
+        }
+
+        if(!sendDaemonCommand(clientSocket, command, reply))
+        {
+            return -1;
+        }
+
+        cout << reply << endl;
+
+        return reply.compare(0, 5, "ERROR") == 0 ? -1 : 0;
+#else
+        cerr << "The daemon mode is not available on Windows" << endl;
+        return -1;
+#endif
+    }
+
+    bool success = false;
+
+    if(hasRegion)
+    {
+        //Only the region is converted to float and computed, with the statistics of the whole capture
+        chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+        CaptureTile tile;
+
+        success = computeRegionMaps(pathToFolder, isCrossData, region, tile, false);
+
+        if(success)
+        {
+            cout << "Region computed in " << chrono::duration<double, milli>(chrono::steady_clock::now()-startTime).count() << " ms" << endl;
+            saveRegionMaps(tile.maps, pathToFolder);
+        }
+    }
+    else if(!labelFile.empty())
+    {
+        //The samples are computed concurrently, each one on the bounding box of its label
+        success = computeLabelledSampleMaps(pathToFolder, isCrossData, labelFile);
+    }
+    else if(numberOfWorkers > 0)
+    {
+#ifndef _WIN32
+        success = runCoordinator(pathToFolder, isCrossData, numberOfWorkers, tileHeight, port, externalWorkers ? string() : string(argv[0]));
+#else
+        cerr << "Distributed processing is not available on Windows" << endl;
+        return -1;
+#endif
+    }
+    else if(memoryBudget > 0)
+    {
+        success = computeMapsWithinBudget(pathToFolder, isCrossData, memoryBudget);
+    }
+    else
+    {
+        //Call this function to compute the maps
+        //The first parameter is a path to the folder that contains the illumination measurements : par, cross, checkert.txt, mask.jpg
+        //The second parameter is set to true to use the cross polarised measurements or false otherwise.
+        //NOTE : the loading of the image file is currently hardcoded.
+        //The images are supposed to have a name : IMG_XXXX where XXXX is a number
+        //Within a folder (e.g parallel data) the pictures are supposed to have consecutive numbers.
+        //The capture is processed as a single tile so that the maps are kept
+        //in memory for the height map and the mip chains.
+        CaptureTile capture;
+
+        success = computeCaptureMaps(pathToFolder, isCrossData, capture);
+    }
+
+    //Wait for the files written in the background
+    vector<string> failedFiles;
+
+    if(!flushOutputs(failedFiles))
+    {
+        reportFailedOutputs(failedFiles);
+        return -1;
+    }
+
+    return success ? 0 : -1;
 }
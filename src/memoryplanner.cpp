@@ -0,0 +1,597 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file memoryplanner.cpp
+ * \brief Implementation of the memory budget aware execution of a capture.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the memory budget aware execution of a capture.
+ */
+
+#include "memoryplanner.h"
+#include "bufferpool.h"
+#include "regionofinterest.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+#define MEGABYTE (1024*1024)
+
+//Size of the pixels of the images in memory
+#define FLOAT_BYTES_PER_PIXEL 12
+#define FRAME_BYTES_PER_PIXEL 3
+#define AVERAGED_FRAME_BYTES_PER_PIXEL 6
+#define INTERLEAVED_BYTES_PER_PIXEL (4*INTERLEAVED_GRADIENT_STRIDE)
+
+//Upper bound of the size of a JPEG file read in memory before being decoded
+#define JPEG_BYTES_PER_PIXEL 2
+
+//Size of the pixels of the images of the height map integration
+#define SLOPE_BYTES_PER_PIXEL 4
+#define SPECTRUM_BYTES_PER_PIXEL 8
+
+//Limits above this value mean that the control group has no limit
+#define UNLIMITED_MEMORY (((size_t) 1) << 60)
+
+/**
+ * Parses a memory size : a number of bytes with an optional K, M or G suffix (e.g. 512M, 4G).
+ * @brief parseMemorySize
+ * @param text
+ * @return 0 if the size is not valid.
+ */
+size_t parseMemorySize(string text)
+{
+    char *end = NULL;
+    double value = strtod(text.c_str(), &end);
+
+    if(end == text.c_str() || value <= 0.0)
+    {
+        return 0;
+    }
+
+    switch(*end)
+    {
+        case 'G' : case 'g' :
+            value *= 1024.0;
+            //Fall through
+        case 'M' : case 'm' :
+            value *= 1024.0;
+            //Fall through
+        case 'K' : case 'k' :
+            value *= 1024.0;
+            end++;
+        default :
+            break;
+    }
+
+    if(*end != 0 && *end != 'B' && *end != 'b')
+    {
+        return 0;
+    }
+
+    return (size_t) value;
+}
+
+/**
+ * Reads the first number of a file.
+ * @brief readNumberInFile
+ * @param filePath
+ * @return 0 if the file does not exist or does not start with a number ("max").
+ */
+static size_t readNumberInFile(string filePath)
+{
+    ifstream file(filePath.c_str(), ios::in);
+    unsigned long long value = 0;
+
+    if(!file || !(file >> value))
+    {
+        return 0;
+    }
+
+    return (size_t) value;
+}
+
+/**
+ * Reads the memory limit of the control group of the process (cgroup v2 memory.max or cgroup v1 memory.limit_in_bytes).
+ * @brief readCgroupMemoryLimit
+ * @return 0 if there is no limit.
+ */
+size_t readCgroupMemoryLimit()
+{
+    size_t limit = readNumberInFile("/sys/fs/cgroup/memory.max");
+
+    if(limit == 0)
+    {
+        limit = readNumberInFile("/sys/fs/cgroup/memory/memory.limit_in_bytes");
+    }
+
+    return limit >= UNLIMITED_MEMORY ? 0 : limit;
+}
+
+/**
+ * Reads a field of /proc/self/status given in kB (e.g. VmRSS, VmHWM).
+ * @brief readProcessStatus
+ * @param field
+ * @return the value in bytes, 0 if it is not available.
+ */
+static size_t readProcessStatus(string field)
+{
+    ifstream file("/proc/self/status", ios::in);
+    string line;
+
+    while(getline(file, line))
+    {
+        if(line.compare(0, field.size()+1, field + ":") == 0)
+        {
+            istringstream stream(line.substr(field.size()+1));
+            unsigned long long kilobytes = 0;
+            stream >> kilobytes;
+
+            return (size_t) kilobytes*1024;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Returns the current resident memory of the process in bytes (VmRSS).
+ * @brief currentResidentMemory
+ * @return 0 if it is not available.
+ */
+size_t currentResidentMemory()
+{
+    return readProcessStatus("VmRSS");
+}
+
+/**
+ * Returns the peak resident memory of the process in bytes (VmHWM, or ru_maxrss).
+ * @brief peakResidentMemory
+ * @return 0 if it is not available.
+ */
+size_t peakResidentMemory()
+{
+    size_t peak = readProcessStatus("VmHWM");
+
+#ifndef _WIN32
+    if(peak == 0)
+    {
+        struct rusage usage;
+
+        //ru_maxrss is in kB on Linux
+        if(getrusage(RUSAGE_SELF, &usage) == 0)
+        {
+            peak = (size_t) usage.ru_maxrss*1024;
+        }
+    }
+#endif
+
+    return peak;
+}
+
+/**
+ * Resets the peak resident memory of the process to its current resident memory (Linux only).
+ * @brief resetPeakResidentMemory
+ * @return false if the peak could not be reset.
+ */
+bool resetPeakResidentMemory()
+{
+    ofstream file("/proc/self/clear_refs", ios::out);
+
+    if(!file)
+    {
+        return false;
+    }
+
+    file << "5";
+
+    return (bool) file;
+}
+
+/**
+ * Returns the memory taken from the buffer pool by a number of images of the same size.
+ * @brief pooledMemory
+ * @param numberOfImages
+ * @param pixels
+ * @param bytesPerPixel
+ * @return
+ */
+static size_t pooledMemory(size_t numberOfImages, size_t pixels, size_t bytesPerPixel)
+{
+    if(numberOfImages == 0 || pixels == 0)
+    {
+        return 0;
+    }
+
+    //The reference counter is stored after the pixels
+    return numberOfImages*bufferSizeClass(pixels*bytesPerPixel+sizeof(int));
+}
+
+/**
+ * Memory used by the integration of the height map : binary mask, slopes, spectra (padded to the DFT size),
+ * height, right hand side and residuals of the multigrid solver and its coarser levels (a third of the finest level).
+ * @brief heightMapMemory
+ * @param imageSize
+ * @return
+ */
+static size_t heightMapMemory(Size imageSize)
+{
+    size_t pixels = (size_t) imageSize.width*imageSize.height;
+    size_t spectrumPixels = (size_t) getOptimalDFTSize(imageSize.width)*getOptimalDFTSize(imageSize.height);
+
+    return pooledMemory(1, pixels, 1) + pooledMemory(2, pixels, SLOPE_BYTES_PER_PIXEL)
+           + pooledMemory(3, spectrumPixels, SPECTRUM_BYTES_PER_PIXEL)
+           + pooledMemory(4, pixels, SLOPE_BYTES_PER_PIXEL) + pooledMemory(4, pixels/3, SLOPE_BYTES_PER_PIXEL);
+}
+
+/**
+ * Memory used by the mip chains : levels 1 and above of the maps and their accumulators
+ * (number of pixels, average normal and variance of the lobe).
+ * @brief mipChainMemory
+ * @param imageSize
+ * @param numberOfMaps
+ * @return
+ */
+static size_t mipChainMemory(Size imageSize, size_t numberOfMaps)
+{
+    size_t memory = 0;
+    int rows = imageSize.height;
+    int cols = imageSize.width;
+
+    for(int level = 1 ; level<numberOfMipLevels(imageSize) ; level++)
+    {
+        rows = max(rows/2, 1);
+        cols = max(cols/2, 1);
+
+        size_t pixels = (size_t) rows*cols;
+
+        //Maps, average normal and variance of the lobe of each channel, number of pixels
+        //(the buffers of the accumulators of the previous levels stay in the pool)
+        memory += pooledMemory(numberOfMaps+2, pixels, FLOAT_BYTES_PER_PIXEL) + pooledMemory(1, pixels, SLOPE_BYTES_PER_PIXEL);
+    }
+
+    return memory;
+}
+
+/**
+ * Predicts the memory used by the computation of a capture.
+ * The buffers of the pool are never given back during a computation, so the memory of the loading and of the computation
+ * add up, except for the buffers of the same size that are reused.
+ * @brief predictPeakMemory
+ * @param imageSize
+ * @param isCrossData
+ * @param precision
+ * @param stripHeight height of the strips (RESIDENT_8BIT_FRAMES only).
+ * @return the predicted peak in bytes.
+ */
+size_t predictPeakMemory(Size imageSize, bool isCrossData, FramePrecision precision, int stripHeight)
+{
+    size_t pixels = (size_t) imageSize.width*imageSize.height;
+
+    size_t numberOfGradientImages = numberOfGradients()*(isCrossData ? 2 : 1);
+    size_t numberOfMipMaps = isCrossData ? 4 : 3;
+
+    //Normals of the red and blue channels, diffuse normals
+    bool diffuseNormals = diffuseNormalsEnabled() && isCrossData;
+    size_t numberOfMaps = numberOfMipMaps + (perChannelMaps() ? 2 : 0) + (diffuseNormals ? 1 : 0);
+    bool interleaved = interleavedGradients() && !perChannelMaps() && !diffuseNormals;
+
+    //Content of the JPEG files and 8 bits normal map written at the end
+    size_t peak = pooledMemory(1, pixels, JPEG_BYTES_PER_PIXEL) + pooledMemory(1, pixels, FRAME_BYTES_PER_PIXEL);
+
+    //Sum of the squared deviations of the shots and noise map (multishot.h)
+    if(noiseMapEnabled())
+    {
+        peak += pooledMemory(2, pixels, FLOAT_BYTES_PER_PIXEL);
+    }
+
+    if(precision == FLOAT_FRAMES)
+    {
+        //Gradients and mask in float
+        peak += pooledMemory(numberOfGradientImages+1, pixels, FLOAT_BYTES_PER_PIXEL);
+
+        //The maps reuse the buffer of the ambient illumination, the normal map reuses the buffer of the decoded images
+        peak += pooledMemory(numberOfMaps, pixels, FLOAT_BYTES_PER_PIXEL);
+
+        //Flags of the invalid pixels (diagnostics.h), only allocated when they are saved
+        if(invalidMaskEnabled())
+        {
+            peak += pooledMemory(1, pixels, 1);
+        }
+
+        if(interleaved)
+        {
+            peak += pooledMemory(1, pixels, INTERLEAVED_BYTES_PER_PIXEL);
+        }
+    }
+    else
+    {
+        size_t stripPixels = (size_t) imageSize.width*min(max(stripHeight, 0), imageSize.height);
+        size_t numberOfFrames = (numberOfGradients()+1)*(isCrossData ? 2 : 1)+1;
+
+        //Decoded 8 bits images (or 16 bits averages of the shots, averaged in float one image at a time) and maps of the whole capture
+        if(numberOfShots() > 1)
+        {
+            //The mask stays in 8 bits
+            peak += pooledMemory(numberOfFrames-1, pixels, AVERAGED_FRAME_BYTES_PER_PIXEL) + pooledMemory(1, pixels, FRAME_BYTES_PER_PIXEL);
+            peak += pooledMemory(1, pixels, FLOAT_BYTES_PER_PIXEL);
+        }
+        else
+        {
+            peak += pooledMemory(numberOfFrames, pixels, FRAME_BYTES_PER_PIXEL);
+        }
+
+        peak += pooledMemory(numberOfMaps, pixels, FLOAT_BYTES_PER_PIXEL);
+
+        //Float strip : gradients, mask, ambient illumination and maps
+        peak += pooledMemory(numberOfGradientImages+2+numberOfMaps, stripPixels, FLOAT_BYTES_PER_PIXEL);
+
+        //Flags of the invalid pixels of the strip and of the whole capture, only allocated when they are saved
+        if(invalidMaskEnabled())
+        {
+            peak += pooledMemory(1, stripPixels, 1) + pooledMemory(1, pixels, 1);
+        }
+
+        if(interleaved)
+        {
+            peak += pooledMemory(1, stripPixels, INTERLEAVED_BYTES_PER_PIXEL);
+        }
+    }
+
+    peak += heightMapMemory(imageSize) + mipChainMemory(imageSize, numberOfMipMaps);
+
+    return peak;
+}
+
+/**
+ * Chooses the fastest way to process a capture within the available memory :
+ * float images if they fit, otherwise 8 bits images with the highest strips that fit.
+ * @brief planExecution
+ * @param imageSize
+ * @param isCrossData
+ * @param availableMemory memory available for the computation in bytes.
+ * @param plan
+ * @return false if the capture does not fit, even with the smallest strips. The plan then contains the smallest prediction.
+ */
+bool planExecution(Size imageSize, bool isCrossData, size_t availableMemory, ExecutionPlan &plan)
+{
+    plan.precision = FLOAT_FRAMES;
+    plan.stripHeight = imageSize.height;
+    plan.predictedPeak = predictPeakMemory(imageSize, isCrossData, FLOAT_FRAMES, imageSize.height);
+
+    if(plan.predictedPeak <= availableMemory)
+    {
+        plan.concurrentCaptures = max((size_t) 1, availableMemory/plan.predictedPeak);
+        return true;
+    }
+
+    plan.precision = RESIDENT_8BIT_FRAMES;
+    plan.concurrentCaptures = 1;
+
+    //Highest strips that fit : the prediction increases with the height of the strips
+    int lowestHeight = min(MINIMUM_STRIP_HEIGHT, imageSize.height);
+    int highestHeight = imageSize.height;
+    int stripHeight = 0;
+
+    while(lowestHeight <= highestHeight)
+    {
+        int height = (lowestHeight+highestHeight)/2;
+
+        if(predictPeakMemory(imageSize, isCrossData, RESIDENT_8BIT_FRAMES, height) <= availableMemory)
+        {
+            stripHeight = height;
+            lowestHeight = height+1;
+        }
+        else
+        {
+            highestHeight = height-1;
+        }
+    }
+
+    if(stripHeight == 0)
+    {
+        plan.stripHeight = min(MINIMUM_STRIP_HEIGHT, imageSize.height);
+        plan.predictedPeak = predictPeakMemory(imageSize, isCrossData, RESIDENT_8BIT_FRAMES, plan.stripHeight);
+        return false;
+    }
+
+    //Strips of the same height (up to one row) so that their buffers are reused
+    int numberOfStrips = (imageSize.height+stripHeight-1)/stripHeight;
+    plan.stripHeight = (imageSize.height+numberOfStrips-1)/numberOfStrips;
+    plan.predictedPeak = predictPeakMemory(imageSize, isCrossData, RESIDENT_8BIT_FRAMES, plan.stripHeight);
+    plan.concurrentCaptures = max((size_t) 1, availableMemory/plan.predictedPeak);
+
+    return true;
+}
+
+/**
+ * Prints the plan chosen for a capture.
+ * @brief printExecutionPlan
+ * @param plan
+ * @param availableMemory
+ */
+void printExecutionPlan(const ExecutionPlan &plan, size_t availableMemory)
+{
+    cout << "Memory available : " << availableMemory/MEGABYTE << " MB, plan : "
+         << (plan.precision == FLOAT_FRAMES ? "float images" : "8 bits images")
+         << ", strips of " << plan.stripHeight << " rows, " << plan.concurrentCaptures << " concurrent capture(s), predicted "
+         << plan.predictedPeak/MEGABYTE << " MB" << endl;
+}
+
+/**
+ * Computes the maps of a capture whose 8 bits images stay in memory, one strip of rows at a time.
+ * Same two reductions as the distributed computation : maxima of the gradients, then maxima of the albedos
+ * and average surface normal.
+ * @brief computeCaptureMapsInStrips
+ * @param pathToFolder
+ * @param isCrossData
+ * @param stripHeight
+ * @return false if one of the files could not be loaded.
+ */
+static bool computeCaptureMapsInStrips(string pathToFolder, bool isCrossData, int stripHeight)
+{
+    CaptureFrames frames;
+
+    if(!loadCaptureFrames(pathToFolder, isCrossData, frames))
+    {
+        return false;
+    }
+
+    Size imageSize(frames.mask.cols, frames.mask.rows);
+    vector<Rect> strips = splitIntoTiles(imageSize, imageSize.width, stripHeight);
+
+    CaptureStatistics statistics;
+    CaptureTile strip;
+
+    //First pass : maxima of the gradients
+    for(unsigned int s = 0 ; s<strips.size() ; s++)
+    {
+        linearizeCaptureTile(frames, strips[s], strip);
+        accumulateGradientMaxima(strip, statistics);
+    }
+
+    //Second pass : maps of each strip, pasted in the maps of the capture
+    CaptureTile capture;
+    capture.isCrossData = isCrossData;
+    capture.region = Rect(0, 0, imageSize.width, imageSize.height);
+
+    for(unsigned int s = 0 ; s<strips.size() ; s++)
+    {
+        linearizeCaptureTile(frames, strips[s], strip);
+        computeTileMaps(strip, statistics);
+        accumulateMapStatistics(strip, statistics);
+        pasteTileMaps(strip.maps, strips[s], imageSize, capture.maps);
+    }
+
+    printPixelDiagnostics(statistics.diagnostics, pathToFolder);
+
+    storeCaptureStatistics(pathToFolder, isCrossData, imageSize, statistics);
+
+    finalizeTileMaps(capture, statistics);
+
+    capture.maps.noise = frames.noise;
+
+    computeCaptureHeightMap(capture.maps, frames.mask);
+
+    computeCaptureMipChain(capture.maps, frames.mask);
+
+    saveReflectanceMaps(capture.maps, pathToFolder);
+
+    return true;
+}
+
+/**
+ * Computes and saves the reflectance maps of a capture following a plan.
+ * @brief runExecutionPlan
+ * @param pathToFolder
+ * @param isCrossData
+ * @param plan
+ * @return false if one of the files could not be loaded.
+ */
+bool runExecutionPlan(string pathToFolder, bool isCrossData, const ExecutionPlan &plan)
+{
+    if(plan.precision == FLOAT_FRAMES)
+    {
+        CaptureTile capture;
+
+        return computeCaptureMaps(pathToFolder, isCrossData, capture);
+    }
+
+    return computeCaptureMapsInStrips(pathToFolder, isCrossData, plan.stripHeight);
+}
+
+/**
+ * Plans and runs the computation of a capture within a memory budget, then prints the predicted and the actual peak.
+ * @brief computeMapsWithinBudget
+ * @param pathToFolder
+ * @param isCrossData
+ * @param memoryBudget total memory of the process in bytes.
+ * @return false if the capture does not fit in the budget or could not be loaded.
+ */
+bool computeMapsWithinBudget(string pathToFolder, bool isCrossData, size_t memoryBudget)
+{
+    Size imageSize;
+
+    if(!readCaptureSize(pathToFolder, imageSize))
+    {
+        return false;
+    }
+
+    //Memory already used by the process (libraries, buffer of the mask)
+    size_t baseline = currentResidentMemory();
+
+    if(memoryBudget <= baseline)
+    {
+        cerr << "The memory budget (" << memoryBudget/MEGABYTE << " MB) is below the memory already used ("
+             << baseline/MEGABYTE << " MB)" << endl;
+        return false;
+    }
+
+    ExecutionPlan plan;
+
+    if(!planExecution(imageSize, isCrossData, memoryBudget-baseline, plan))
+    {
+        cerr << "The capture does not fit in the memory budget : it needs at least " << (baseline+plan.predictedPeak)/MEGABYTE
+             << " MB, the budget is " << memoryBudget/MEGABYTE << " MB" << endl;
+        return false;
+    }
+
+    printExecutionPlan(plan, memoryBudget-baseline);
+
+    resetPeakResidentMemory();
+
+    bool success = runExecutionPlan(pathToFolder, isCrossData, plan);
+
+    //The files are encoded and written in the background : wait for them before measuring the peak
+    vector<string> failedFiles;
+
+    if(!waitForOutputs(pathToFolder, failedFiles))
+    {
+        reportFailedOutputs(failedFiles);
+        success = false;
+    }
+
+    cout << "Predicted peak : " << (baseline+plan.predictedPeak)/MEGABYTE << " MB, actual peak : "
+         << peakResidentMemory()/MEGABYTE << " MB, budget : " << memoryBudget/MEGABYTE << " MB" << endl;
+
+    return success;
+}
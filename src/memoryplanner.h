@@ -0,0 +1,169 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file memoryplanner.h
+ * \brief Implementation of the memory budget aware execution of a capture.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The planner predicts the peak memory of the computation of a capture and chooses how to run it so that
+ * the peak stays under a memory budget (given on the command line, or the cgroup limit with --memory-budget cgroup) :
+ *   - FLOAT_FRAMES : all the images are converted to float at once (fastest, about 12 bytes per pixel per image).
+ *   - RESIDENT_8BIT_FRAMES : the decoded 8 bits images stay in memory and are converted to float one strip of rows
+ *     at a time. The height of the strips is the largest one that fits in the budget.
+ * It also gives the number of captures of this size that can be processed concurrently (daemon mode).
+ */
+
+#ifndef MEMORYPLANNER
+#define MEMORYPLANNER
+
+#include "capturetile.h"
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <cstddef>
+#include <string>
+
+//Strips are never smaller than MINIMUM_STRIP_HEIGHT rows
+#define MINIMUM_STRIP_HEIGHT 16
+
+/**
+ * Precision of the images kept in memory during the computation.
+ */
+enum FramePrecision
+{
+    FLOAT_FRAMES,
+    RESIDENT_8BIT_FRAMES
+};
+
+/**
+ * How a capture is processed.
+ * @brief The ExecutionPlan struct
+ */
+struct ExecutionPlan
+{
+    FramePrecision precision;
+    int stripHeight;
+    int concurrentCaptures;
+
+    //Memory used by the computation, in bytes, not counting the memory used by the process before it starts
+    size_t predictedPeak;
+};
+
+/**
+ * Parses a memory size : a number of bytes with an optional K, M or G suffix (e.g. 512M, 4G).
+ * @brief parseMemorySize
+ * @param text
+ * @return 0 if the size is not valid.
+ */
+size_t parseMemorySize(std::string text);
+
+/**
+ * Reads the memory limit of the control group of the process (cgroup v2 memory.max or cgroup v1 memory.limit_in_bytes).
+ * @brief readCgroupMemoryLimit
+ * @return 0 if there is no limit.
+ */
+size_t readCgroupMemoryLimit();
+
+/**
+ * Returns the current resident memory of the process in bytes (VmRSS).
+ * @brief currentResidentMemory
+ * @return 0 if it is not available.
+ */
+size_t currentResidentMemory();
+
+/**
+ * Returns the peak resident memory of the process in bytes (VmHWM, or ru_maxrss).
+ * @brief peakResidentMemory
+ * @return 0 if it is not available.
+ */
+size_t peakResidentMemory();
+
+/**
+ * Resets the peak resident memory of the process to its current resident memory (Linux only).
+ * @brief resetPeakResidentMemory
+ * @return false if the peak could not be reset.
+ */
+bool resetPeakResidentMemory();
+
+/**
+ * Predicts the memory used by the computation of a capture.
+ * @brief predictPeakMemory
+ * @param imageSize
+ * @param isCrossData
+ * @param precision
+ * @param stripHeight height of the strips (RESIDENT_8BIT_FRAMES only).
+ * @return the predicted peak in bytes.
+ */
+size_t predictPeakMemory(cv::Size imageSize, bool isCrossData, FramePrecision precision, int stripHeight);
+
+/**
+ * Chooses the fastest way to process a capture within the available memory.
+ * @brief planExecution
+ * @param imageSize
+ * @param isCrossData
+ * @param availableMemory memory available for the computation in bytes.
+ * @param plan
+ * @return false if the capture does not fit, even with the smallest strips. The plan then contains the smallest prediction.
+ */
+bool planExecution(cv::Size imageSize, bool isCrossData, size_t availableMemory, ExecutionPlan &plan);
+
+/**
+ * Prints the plan chosen for a capture.
+ * @brief printExecutionPlan
+ * @param plan
+ * @param availableMemory
+ */
+void printExecutionPlan(const ExecutionPlan &plan, size_t availableMemory);
+
+/**
+ * Computes and saves the reflectance maps of a capture following a plan.
+ * @brief runExecutionPlan
+ * @param pathToFolder
+ * @param isCrossData
+ * @param plan
+ * @return false if one of the files could not be loaded.
+ */
+bool runExecutionPlan(std::string pathToFolder, bool isCrossData, const ExecutionPlan &plan);
+
+/**
+ * Plans and runs the computation of a capture within a memory budget, then prints the predicted and the actual peak.
+ * @brief computeMapsWithinBudget
+ * @param pathToFolder
+ * @param isCrossData
+ * @param memoryBudget total memory of the process in bytes.
+ * @return false if the capture does not fit in the budget or could not be loaded.
+ */
+bool computeMapsWithinBudget(std::string pathToFolder, bool isCrossData, size_t memoryBudget);
+
+#endif // MEMORYPLANNER
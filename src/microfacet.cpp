@@ -0,0 +1,446 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file microfacet.cpp
+ * \brief Implementation of the conversion of the moments of the specular lobe to the roughness of a microfacet model.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the conversion of the moments of the specular lobe to the roughness of a microfacet model.
+ */
+
+#include "microfacet.h"
+#include "mathfunctions.h"
+
+/*---- Standard library ----*/
+#include <map>
+#include <mutex>
+
+using namespace std;
+using namespace cv;
+
+//Samples of the microfacet normals in the integration of the lobe : inverse of the distribution (tan theta) x azimuth
+#define MICROFACET_ELEVATION_SAMPLES 96
+#define MICROFACET_AZIMUTH_SAMPLES 48
+
+static MicrofacetModel currentMicrofacetModel = NO_MICROFACET_MODEL;
+static bool adjustFresnelAlbedo = false;
+
+static mutex microfacetMutex;
+static map<int, MicrofacetTable> microfacetTables;
+
+/**
+ * Sets the microfacet model of the roughness map (NO_MICROFACET_MODEL : (sigma_x^4+sigma_y^4)^(1/4)/4).
+ * @brief setMicrofacetModel
+ * @param model
+ */
+void setMicrofacetModel(MicrofacetModel model)
+{
+    currentMicrofacetModel = model;
+}
+
+/**
+ * Returns the microfacet model of the roughness map (NO_MICROFACET_MODEL by default).
+ * @brief microfacetModel
+ * @return
+ */
+MicrofacetModel microfacetModel()
+{
+    return currentMicrofacetModel;
+}
+
+/**
+ * Parses a microfacet model : none, beckmann or ggx.
+ * @brief parseMicrofacetModel
+ * @param text
+ * @param model
+ * @return false if the text is not a model.
+ */
+bool parseMicrofacetModel(string text, MicrofacetModel &model)
+{
+    if(text == "none")
+    {
+        model = NO_MICROFACET_MODEL;
+    }
+    else if(text == "beckmann")
+    {
+        model = BECKMANN_MODEL;
+    }
+    else if(text == "ggx")
+    {
+        model = GGX_MODEL;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Returns the name of a microfacet model (none, beckmann or ggx).
+ * @brief microfacetModelName
+ * @param model
+ * @return
+ */
+string microfacetModelName(MicrofacetModel model)
+{
+    if(model == BECKMANN_MODEL)
+    {
+        return "beckmann";
+    }
+    else if(model == GGX_MODEL)
+    {
+        return "ggx";
+    }
+
+    return "none";
+}
+
+/**
+ * Divides the specular albedo by the directional albedo of the microfacet model (false by default).
+ * Only used with a microfacet model.
+ * @brief setFresnelAlbedoEnabled
+ * @param enabled
+ */
+void setFresnelAlbedoEnabled(bool enabled)
+{
+    adjustFresnelAlbedo = enabled;
+}
+
+/**
+ * Returns true if the specular albedo is divided by the directional albedo of the microfacet model.
+ * @brief fresnelAlbedoEnabled
+ * @return
+ */
+bool fresnelAlbedoEnabled()
+{
+    return adjustFresnelAlbedo;
+}
+
+/**
+ * Smith shadowing of one direction.
+ * @brief smithShadowing
+ * @param model
+ * @param alpha
+ * @param cosine cosine between the direction and the normal.
+ * @return
+ */
+static double smithShadowing(MicrofacetModel model, double alpha, double cosine)
+{
+    double tangentSquared = (1.0-cosine*cosine)/(cosine*cosine);
+
+    if(model == GGX_MODEL)
+    {
+        return 2.0/(1.0+sqrt(1.0+alpha*alpha*tangentSquared));
+    }
+
+    //Rational approximation of Walter et al. 2007 for Beckmann
+    double a = 1.0/(alpha*sqrt(tangentSquared));
+
+    return a < 1.6 ? (3.535*a+2.181*a*a)/(1.0+2.276*a+2.577*a*a) : 1.0;
+}
+
+/**
+ * Integrates the lobe reflected towards the camera V = (0,0,1) by a surface of the model whose normal makes an angle
+ * of cosine n.v with the camera, lit from the hemisphere above the sample. The microfacet normals are sampled with the
+ * inverse of the distribution (stratified), weighted by the shadowing and the Jacobian of the reflection.
+ * @brief integrateMicrofacetLobe
+ * @param model
+ * @param alpha
+ * @param cosine
+ * @param variance sigma_x^2+sigma_y^2 of the reflected directions.
+ * @param albedoFactor F0 divided by the directional albedo with the Schlick Fresnel of MICROFACET_DIELECTRIC_F0,
+ *        at most MICROFACET_MAXIMUM_ALBEDO_FACTOR.
+ */
+static void integrateMicrofacetLobe(MicrofacetModel model, double alpha, double cosine, double &variance, double &albedoFactor)
+{
+    double sine = sqrt(1.0-cosine*cosine);
+
+    //Normal in the xz plane and its tangents : the variance sigma_x^2+sigma_y^2 does not depend on the azimuth of the normal
+    double normal[3] = {sine, 0.0, cosine};
+    double tangent[3] = {cosine, 0.0, -sine};
+
+    double weights = 0.0, moments[2] = {0.0, 0.0}, squaredMoments[2] = {0.0, 0.0};
+    double fresnelAlbedo = 0.0, schlickAlbedo = 0.0;
+
+    for(int a = 0 ; a<MICROFACET_ELEVATION_SAMPLES ; a++)
+    {
+        double u = (a+0.5)/MICROFACET_ELEVATION_SAMPLES;
+        double tangentSquared = model == GGX_MODEL ? alpha*alpha*u/(1.0-u) : -alpha*alpha*log(1.0-u);
+        double cosineH = 1.0/sqrt(1.0+tangentSquared);
+        double sineH = sqrt(tangentSquared)*cosineH;
+
+        for(int b = 0 ; b<MICROFACET_AZIMUTH_SAMPLES ; b++)
+        {
+            double phi = 2.0*M_PI*(b+0.5)/MICROFACET_AZIMUTH_SAMPLES;
+            double h[3];
+
+            for(int k = 0 ; k<3 ; k++)
+            {
+                h[k] = sineH*cos(phi)*tangent[k]+cosineH*normal[k];
+            }
+
+            h[1] += sineH*sin(phi);
+
+            //L = 2(V.H)H-V
+            double viewH = h[2];
+            double l[3] = {2.0*viewH*h[0], 2.0*viewH*h[1], 2.0*viewH*h[2]-1.0};
+            double normalL = normal[0]*l[0]+normal[1]*l[1]+normal[2]*l[2];
+
+            //The illumination is above the plane of the sample (z > 0)
+            if(viewH <= 0.0 || normalL <= 0.0 || l[2] <= 0.0)
+            {
+                continue;
+            }
+
+            //BRDF x cosine over the density of the sample D(H)(N.H) with dL = 4(V.H)dH
+            double weight = smithShadowing(model, alpha, cosine)*smithShadowing(model, alpha, normalL)*viewH/(cosineH*cosine);
+            double schlick = pow(1.0-viewH, 5.0);
+
+            weights += weight;
+            moments[0] += weight*l[0];
+            moments[1] += weight*l[1];
+            squaredMoments[0] += weight*l[0]*l[0];
+            squaredMoments[1] += weight*l[1]*l[1];
+
+            fresnelAlbedo += weight*(1.0-schlick);
+            schlickAlbedo += weight*schlick;
+        }
+    }
+
+    variance = 0.0;
+    albedoFactor = 1.0;
+
+    if(weights > 0.0)
+    {
+        for(int k = 0 ; k<2 ; k++)
+        {
+            variance += squaredMoments[k]/weights-(moments[k]/weights)*(moments[k]/weights);
+        }
+
+        //Directional albedo F0*A+B, A and B averaged over the samples
+        double numberOfSamples = MICROFACET_ELEVATION_SAMPLES*MICROFACET_AZIMUTH_SAMPLES;
+        double albedo = (MICROFACET_DIELECTRIC_F0*fresnelAlbedo+schlickAlbedo)/numberOfSamples;
+
+        albedoFactor = albedo > 0.0 ? min(MICROFACET_DIELECTRIC_F0/albedo, MICROFACET_MAXIMUM_ALBEDO_FACTOR) : 1.0;
+    }
+}
+
+/**
+ * Integrates the lobes of the columns of the tables (cosines n.v) in parallel.
+ */
+class MicrofacetLobeBody : public ParallelLoopBody
+{
+public:
+    MicrofacetLobeBody(MicrofacetModel model, vector<double> &deviations, vector<float> &albedoFactors)
+        : m_model(model), m_deviations(deviations), m_albedoFactors(albedoFactors) {}
+
+    void operator()(const Range &columns) const
+    {
+        for(int j = columns.start ; j<columns.end ; j++)
+        {
+            //n.v = 0 has no lobe : the first column is slightly above
+            double cosine = max((double) j/(MICROFACET_TABLE_COLUMNS-1), 0.01);
+
+            for(int i = 0 ; i<MICROFACET_TABLE_ROWS ; i++)
+            {
+                double alpha = MICROFACET_MINIMUM_ROUGHNESS
+                             + (MICROFACET_MAXIMUM_ROUGHNESS-MICROFACET_MINIMUM_ROUGHNESS)*i/(MICROFACET_TABLE_ROWS-1);
+                double variance, albedoFactor;
+
+                integrateMicrofacetLobe(m_model, alpha, cosine, variance, albedoFactor);
+
+                m_deviations[i*MICROFACET_TABLE_COLUMNS+j] = sqrt(max(variance, 0.0));
+                m_albedoFactors[i*MICROFACET_TABLE_COLUMNS+j] = (float) albedoFactor;
+            }
+        }
+    }
+
+private:
+    MicrofacetModel m_model;
+    vector<double> &m_deviations;
+    vector<float> &m_albedoFactors;
+};
+
+/**
+ * Builds the tables of a model : integration of the lobes for the alphas and the cosines of the tables,
+ * then inversion of the standard deviations of each cosine into alphas (the deviation increases with alpha).
+ * @brief buildMicrofacetTable
+ * @param model
+ * @param table
+ */
+static void buildMicrofacetTable(MicrofacetModel model, MicrofacetTable &table)
+{
+    const int size = MICROFACET_TABLE_ROWS*MICROFACET_TABLE_COLUMNS;
+    vector<double> deviations(size);
+
+    table.model = model;
+    table.albedoFactor.assign(size, 1.0f);
+    table.roughness.assign(size, 0.0f);
+
+    parallel_for_(Range(0, MICROFACET_TABLE_COLUMNS), MicrofacetLobeBody(model, deviations, table.albedoFactor));
+
+    //The alphas below the smallest one of the integration reach 0 with the deviation, the albedo of alpha = 0 is
+    //that of the smallest alpha
+    table.maximumDeviation = 0.0f;
+
+    for(int k = 0 ; k<size ; k++)
+    {
+        table.maximumDeviation = max(table.maximumDeviation, (float) deviations[k]);
+    }
+
+    for(int j = 0 ; j<MICROFACET_TABLE_COLUMNS ; j++)
+    {
+        //Alphas and deviations of the column, the deviations made increasing against the noise of the integration
+        vector<double> alphas(1, 0.0), columnDeviations(1, 0.0);
+
+        for(int i = 0 ; i<MICROFACET_TABLE_ROWS ; i++)
+        {
+            alphas.push_back(MICROFACET_MINIMUM_ROUGHNESS
+                             + (MICROFACET_MAXIMUM_ROUGHNESS-MICROFACET_MINIMUM_ROUGHNESS)*i/(MICROFACET_TABLE_ROWS-1));
+            columnDeviations.push_back(max(deviations[i*MICROFACET_TABLE_COLUMNS+j], columnDeviations.back()));
+        }
+
+        size_t k = 1;
+
+        for(int i = 0 ; i<MICROFACET_TABLE_ROWS ; i++)
+        {
+            double deviation = (double) table.maximumDeviation*i/(MICROFACET_TABLE_ROWS-1);
+
+            while(k<columnDeviations.size()-1 && columnDeviations[k] < deviation)
+            {
+                k++;
+            }
+
+            //Deviations above the largest one of the column (grazing angles) give the largest alpha
+            double alpha = alphas.back();
+
+            if(deviation <= columnDeviations[k])
+            {
+                double range = columnDeviations[k]-columnDeviations[k-1];
+                double t = range > 0.0 ? (deviation-columnDeviations[k-1])/range : 1.0;
+
+                alpha = alphas[k-1]+t*(alphas[k]-alphas[k-1]);
+            }
+
+            table.roughness[i*MICROFACET_TABLE_COLUMNS+j] = (float) alpha;
+        }
+    }
+}
+
+/**
+ * Returns the tables of a microfacet model, built at the first call for the model and cached.
+ * @brief microfacetTable
+ * @param model BECKMANN_MODEL or GGX_MODEL.
+ * @return
+ */
+const MicrofacetTable &microfacetTable(MicrofacetModel model)
+{
+    lock_guard<mutex> lock(microfacetMutex);
+
+    map<int, MicrofacetTable>::iterator table = microfacetTables.find(model);
+
+    if(table == microfacetTables.end())
+    {
+        table = microfacetTables.insert(make_pair((int) model, MicrofacetTable())).first;
+        buildMicrofacetTable(model, table->second);
+    }
+
+    return table->second;
+}
+
+/**
+ * Returns the tables of the current model (microfacetModel()), NULL without model.
+ * @brief currentMicrofacetTable
+ * @return
+ */
+const MicrofacetTable *currentMicrofacetTable()
+{
+    return currentMicrofacetModel == NO_MICROFACET_MODEL ? NULL : &microfacetTable(currentMicrofacetModel);
+}
+
+/**
+ * Divides the specular albedo of rows by the directional albedo of the model.
+ */
+class SpecularAlbedoBody : public ParallelLoopBody
+{
+public:
+    SpecularAlbedoBody(Mat &specular, const Mat &normals, const Mat &roughness, const MicrofacetTable &table)
+        : m_specular(specular), m_normals(normals), m_roughness(roughness), m_table(table) {}
+
+    void operator()(const Range &rows) const
+    {
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            Vec3f *specularRow = m_specular.ptr<Vec3f>(i);
+            const Vec3f *normalRow = m_normals.ptr<Vec3f>(i);
+            const Vec3f *roughnessRow = m_roughness.ptr<Vec3f>(i);
+
+            for(int j = 0 ; j<m_specular.cols ; j++)
+            {
+                //BGR = ZYX
+                float cosine = normalRow[j].val[0];
+
+                if(!(cosine > 0.0f))
+                {
+                    continue;
+                }
+
+                for(int c = 0 ; c<3 ; c++)
+                {
+                    specularRow[j].val[c] *= lookupMicrofacetAlbedoFactor(m_table, roughnessRow[j].val[c], cosine);
+                }
+            }
+        }
+    }
+
+private:
+    Mat &m_specular;
+    const Mat &m_normals;
+    const Mat &m_roughness;
+    const MicrofacetTable &m_table;
+};
+
+/**
+ * Divides the specular albedo by the directional albedo of the model (see fresnelAlbedoEnabled), in parallel.
+ * The pixels whose normal is not valid are not changed.
+ * @brief adjustSpecularAlbedo
+ * @param specular specular albedo (CV_32FC3).
+ * @param normals normals of the green channel, not aligned (BGR = ZYX).
+ * @param roughness alphas of the model (CV_32FC3, one per channel).
+ * @param table
+ */
+void adjustSpecularAlbedo(Mat &specular, const Mat &normals, const Mat &roughness, const MicrofacetTable &table)
+{
+    parallel_for_(Range(0, specular.rows), SpecularAlbedoBody(specular, normals, roughness, table));
+}
@@ -0,0 +1,245 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file microfacet.h
+ * \brief Implementation of the conversion of the moments of the specular lobe to the roughness of a microfacet model.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * By default the roughness map holds (sigma_x^4+sigma_y^4)^(1/4)/4, where sigma_x^2 and sigma_y^2 are the variances of
+ * the specular lobe measured by the gradients. With a microfacet model (Beckmann or GGX) the roughness map holds the alpha
+ * of the model instead : the variance of the lobe reflected by a surface of the model seen from the camera (V = (0,0,1))
+ * depends on alpha and on the angle between the normal and the camera (the lobe is stretched by the reflection and
+ * loses its spread along z at grazing angles). It is integrated once per model over the microfacets (Smith shadowing),
+ * for a grid of alphas and of cosines n.v, and inverted into a table of alphas indexed by the standard deviation
+ * sqrt(sigma_x^2+sigma_y^2) and by the cosine : the solvers only read the table, with a bilinear interpolation.
+ *
+ * The tables are built at the first use of a model and cached for the process. With fresnelAlbedoEnabled(), a second
+ * table of the same integration converts the specular albedo : it is divided by the directional albedo of the model
+ * (shadowing and Schlick Fresnel of a dielectric of reflectance MICROFACET_DIELECTRIC_F0) relative to F0, which gives the
+ * reflectance at normal incidence up to the scale of the capture.
+ * The tables assume the ideal moments of the lobe (L1/L0 and L2/L0 of the directions of the illumination).
+ */
+
+#ifndef MICROFACET
+#define MICROFACET
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+//Size of the tables : standard deviations or alphas (rows) and cosines n.v from 0 to 1 (columns)
+#define MICROFACET_TABLE_ROWS 64
+#define MICROFACET_TABLE_COLUMNS 32
+
+//Range of the alphas of the tables
+#define MICROFACET_MINIMUM_ROUGHNESS 0.005
+#define MICROFACET_MAXIMUM_ROUGHNESS 1.0
+
+//Reflectance at normal incidence of the Fresnel term of the specular albedo (dielectric)
+#define MICROFACET_DIELECTRIC_F0 0.04
+
+//The lobes of the normals tilted by more than about 45 degrees are cut by the plane of the sample :
+//their albedo is hardly measured and its factor is limited
+#define MICROFACET_MAXIMUM_ALBEDO_FACTOR 4.0
+
+enum MicrofacetModel {NO_MICROFACET_MODEL, BECKMANN_MODEL, GGX_MODEL};
+
+/**
+ * Tables of a microfacet model.
+ * @brief The MicrofacetTable struct
+ */
+struct MicrofacetTable
+{
+    MicrofacetModel model;
+
+    //Largest standard deviation of the lobe over the alphas and the cosines
+    float maximumDeviation;
+
+    //Alpha for MICROFACET_TABLE_ROWS standard deviations from 0 to maximumDeviation and MICROFACET_TABLE_COLUMNS cosines
+    std::vector<float> roughness;
+
+    //F0 divided by the directional albedo (at most MICROFACET_MAXIMUM_ALBEDO_FACTOR), for MICROFACET_TABLE_ROWS alphas from 0 to MICROFACET_MAXIMUM_ROUGHNESS
+    //and MICROFACET_TABLE_COLUMNS cosines
+    std::vector<float> albedoFactor;
+};
+
+/**
+ * Sets the microfacet model of the roughness map (NO_MICROFACET_MODEL : (sigma_x^4+sigma_y^4)^(1/4)/4).
+ * @brief setMicrofacetModel
+ * @param model
+ */
+void setMicrofacetModel(MicrofacetModel model);
+
+/**
+ * Returns the microfacet model of the roughness map (NO_MICROFACET_MODEL by default).
+ * @brief microfacetModel
+ * @return
+ */
+MicrofacetModel microfacetModel();
+
+/**
+ * Parses a microfacet model : none, beckmann or ggx.
+ * @brief parseMicrofacetModel
+ * @param text
+ * @param model
+ * @return false if the text is not a model.
+ */
+bool parseMicrofacetModel(std::string text, MicrofacetModel &model);
+
+/**
+ * Returns the name of a microfacet model (none, beckmann or ggx).
+ * @brief microfacetModelName
+ * @param model
+ * @return
+ */
+std::string microfacetModelName(MicrofacetModel model);
+
+/**
+ * Divides the specular albedo by the directional albedo of the microfacet model (false by default).
+ * Only used with a microfacet model.
+ * @brief setFresnelAlbedoEnabled
+ * @param enabled
+ */
+void setFresnelAlbedoEnabled(bool enabled);
+
+/**
+ * Returns true if the specular albedo is divided by the directional albedo of the microfacet model.
+ * @brief fresnelAlbedoEnabled
+ * @return
+ */
+bool fresnelAlbedoEnabled();
+
+/**
+ * Returns the tables of a microfacet model, built at the first call for the model and cached.
+ * @brief microfacetTable
+ * @param model BECKMANN_MODEL or GGX_MODEL.
+ * @return
+ */
+const MicrofacetTable &microfacetTable(MicrofacetModel model);
+
+/**
+ * Returns the tables of the current model (microfacetModel()), NULL without model.
+ * @brief currentMicrofacetTable
+ * @return
+ */
+const MicrofacetTable *currentMicrofacetTable();
+
+/**
+ * Bilinear interpolation in a table of MICROFACET_TABLE_ROWS x MICROFACET_TABLE_COLUMNS values,
+ * at a position given in rows and columns. The position is clamped to the table (NaN gives the first row or column).
+ * @brief interpolateMicrofacetTable
+ * @param table
+ * @param row
+ * @param column
+ * @return
+ */
+inline float interpolateMicrofacetTable(const std::vector<float> &table, float row, float column)
+{
+    row = row > 0.0f ? std::min(row, (float) (MICROFACET_TABLE_ROWS-1)) : 0.0f;
+    column = column > 0.0f ? std::min(column, (float) (MICROFACET_TABLE_COLUMNS-1)) : 0.0f;
+
+    int i = std::min((int) row, MICROFACET_TABLE_ROWS-2);
+    int j = std::min((int) column, MICROFACET_TABLE_COLUMNS-2);
+    float a = row-i;
+    float b = column-j;
+
+    const float *values = &table[i*MICROFACET_TABLE_COLUMNS+j];
+
+    return (1.0f-a)*((1.0f-b)*values[0]+b*values[1]) + a*((1.0f-b)*values[MICROFACET_TABLE_COLUMNS]+b*values[MICROFACET_TABLE_COLUMNS+1]);
+}
+
+/**
+ * Alpha of the model for the variance sigma_x^2+sigma_y^2 of the lobe and the cosine n.v of the normal (not aligned).
+ * @brief lookupMicrofacetRoughness
+ * @param table
+ * @param variance negative values (noise) are read as 0.
+ * @param cosine
+ * @return
+ */
+inline float lookupMicrofacetRoughness(const MicrofacetTable &table, float variance, float cosine)
+{
+    float deviation = variance > 0.0f ? std::sqrt(variance) : 0.0f;
+
+    return interpolateMicrofacetTable(table.roughness, deviation/table.maximumDeviation*(MICROFACET_TABLE_ROWS-1),
+                                      cosine*(MICROFACET_TABLE_COLUMNS-1));
+}
+
+/**
+ * F0 divided by the directional albedo of the model for an alpha and the cosine n.v of the normal (not aligned).
+ * @brief lookupMicrofacetAlbedoFactor
+ * @param table
+ * @param alpha
+ * @param cosine
+ * @return
+ */
+inline float lookupMicrofacetAlbedoFactor(const MicrofacetTable &table, float alpha, float cosine)
+{
+    return interpolateMicrofacetTable(table.albedoFactor, alpha/MICROFACET_MAXIMUM_ROUGHNESS*(MICROFACET_TABLE_ROWS-1),
+                                      cosine*(MICROFACET_TABLE_COLUMNS-1));
+}
+
+/**
+ * Replaces the roughness of a row of values by the alpha of the model, except the null values (no spread, or a null
+ * order 0 gradient) that stay 0.
+ * @brief convertMicrofacetRoughness
+ * @param table
+ * @param variance sigma_x^2+sigma_y^2 of each value.
+ * @param cosine z of the normal (not aligned) of each value.
+ * @param roughness
+ * @param numberOfValues
+ */
+inline void convertMicrofacetRoughness(const MicrofacetTable &table, const float *variance, const float *cosine, float *roughness,
+                                       int numberOfValues)
+{
+    for(int n = 0 ; n<numberOfValues ; n++)
+    {
+        roughness[n] = roughness[n] != 0.0f ? lookupMicrofacetRoughness(table, variance[n], cosine[n]) : 0.0f;
+    }
+}
+
+/**
+ * Divides the specular albedo by the directional albedo of the model (see fresnelAlbedoEnabled), in parallel.
+ * The pixels whose normal is not valid are not changed.
+ * @brief adjustSpecularAlbedo
+ * @param specular specular albedo (CV_32FC3).
+ * @param normals normals of the green channel, not aligned (BGR = ZYX).
+ * @param roughness alphas of the model (CV_32FC3, one per channel).
+ * @param table
+ */
+void adjustSpecularAlbedo(cv::Mat &specular, const cv::Mat &normals, const cv::Mat &roughness, const MicrofacetTable &table);
+
+#endif // MICROFACET
@@ -0,0 +1,365 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file mipchain.cpp
+ * \brief Implementation of the mip chains of the reflectance maps.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the mip chains of the reflectance maps.
+ */
+
+#include "mipchain.h"
+#include "bufferpool.h"
+#include "reflectance.h"
+#include "outputwriter.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <sstream>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Averages of the footprints of a level that are not stored in the maps : number of pixels of the footprint
+ * inside the mask, average normal before normalisation and average variance of the specular lobe
+ * (of the slopes of the microfacets with a microfacet model).
+ * @brief The MipAccumulators struct
+ */
+struct MipAccumulators
+{
+    Mat weight;         //CV_32FC1
+    Mat averageNormal;  //CV_32FC3, BGR = ZYX
+    Mat lobeVariance;   //CV_32FC3, one variance per channel of the roughness
+};
+
+/**
+ * Computes the rows of a level from the previous level (2x2 footprints, 3 pixels wide on the last row and column of odd sizes).
+ * The previous level is either the full resolution maps (no accumulators) or a level of the chain.
+ */
+class MipLevelBody : public ParallelLoopBody
+{
+public:
+    MipLevelBody(MipChain &chain, int level, const Mat &binaryMask, const MipAccumulators &source, MipAccumulators &destination,
+                 MicrofacetModel model)
+        : m_chain(chain), m_level(level), m_binaryMask(binaryMask), m_source(source), m_destination(destination), m_model(model) {}
+
+    void operator()(const Range &rows) const
+    {
+        bool isDiffuse = !m_chain.diffuse.empty();
+        const int previous = m_level-1;
+        const Mat &previousNormals = m_chain.normals[previous];
+        const Mat &levelNormals = m_chain.normals[m_level];
+
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            //The last row and column also cover the pixel left by an odd size
+            int lastY = i == levelNormals.rows-1 ? previousNormals.rows : 2*i+2;
+
+            for(int j = 0 ; j<levelNormals.cols ; j++)
+            {
+                int lastX = j == levelNormals.cols-1 ? previousNormals.cols : 2*j+2;
+
+                float weight = 0.0;
+                Vec3f normal(0.0, 0.0, 0.0), diffuse(0.0, 0.0, 0.0), specular(0.0, 0.0, 0.0), lobeVariance(0.0, 0.0, 0.0);
+
+                for(int y = 2*i ; y<lastY ; y++)
+                {
+                    for(int x = 2*j ; x<lastX ; x++)
+                    {
+                        float w = 0.0;
+                        Vec3f n, s;
+
+                        if(previous == 0)
+                        {
+                            //Full resolution : pixels of the mask with a valid normal
+                            const Vec3f &roughness = m_chain.roughness[0].at<Vec3f>(y,x);
+                            n = previousNormals.at<Vec3f>(y,x);
+
+                            for(int c = 0 ; c<3 ; c++)
+                            {
+                                s.val[c] = roughnessToLobeVariance(roughness.val[c], m_model);
+                            }
+
+                            if(m_binaryMask.at<uchar>(y,x) && n.val[0] == n.val[0] && n.val[1] == n.val[1] && n.val[2] == n.val[2])
+                            {
+                                w = 1.0;
+                            }
+                        }
+                        else
+                        {
+                            n = m_source.averageNormal.at<Vec3f>(y,x);
+                            s = m_source.lobeVariance.at<Vec3f>(y,x);
+                            w = m_source.weight.at<float>(y,x);
+                        }
+
+                        if(w == 0.0)
+                        {
+                            continue;
+                        }
+
+                        weight += w;
+                        normal += n*w;
+                        lobeVariance += s*w;
+                        specular += m_chain.specular[previous].at<Vec3f>(y,x)*w;
+
+                        if(isDiffuse)
+                        {
+                            diffuse += m_chain.diffuse[previous].at<Vec3f>(y,x)*w;
+                        }
+                    }
+                }
+
+                if(weight > 0.0)
+                {
+                    normal *= 1.0/weight;
+
+                    for(int c = 0 ; c<3 ; c++)
+                    {
+                        lobeVariance.val[c] /= weight;
+                    }
+
+                    specular *= 1.0/weight;
+                    diffuse *= 1.0/weight;
+                }
+
+                m_destination.weight.at<float>(i,j) = weight;
+                m_destination.averageNormal.at<Vec3f>(i,j) = normal;
+                m_destination.lobeVariance.at<Vec3f>(i,j) = lobeVariance;
+
+                m_chain.specular[m_level].at<Vec3f>(i,j) = specular;
+
+                if(isDiffuse)
+                {
+                    m_chain.diffuse[m_level].at<Vec3f>(i,j) = diffuse;
+                }
+
+                /*---Renormalised normal and Toksvig roughness---*/
+                float length = sqrt(normal.val[0]*normal.val[0]+normal.val[1]*normal.val[1]+normal.val[2]*normal.val[2]);
+                Vec3f roughness(0.0, 0.0, 0.0);
+
+                if(weight > 0.0 && length > 0.0)
+                {
+                    normal *= 1.0/length;
+
+                    //The variance of the normals is added to the lobe of each channel
+                    float normalsVariance = normalsLobeVariance(length, m_model);
+
+                    for(int c = 0 ; c<3 ; c++)
+                    {
+                        roughness.val[c] = lobeVarianceToRoughness(lobeVariance.val[c]+normalsVariance, m_model);
+                    }
+                }
+                else
+                {
+                    //Flat normal outside the mask
+                    normal = Vec3f(1.0, 0.0, 0.0);
+                }
+
+                m_chain.normals[m_level].at<Vec3f>(i,j) = normal;
+                m_chain.roughness[m_level].at<Vec3f>(i,j) = roughness;
+            }
+        }
+    }
+
+private:
+    //The Mat headers of the chain are not modified, only the pixels of the level
+    MipChain &m_chain;
+    int m_level;
+    const Mat &m_binaryMask;
+    const MipAccumulators &m_source;
+    MipAccumulators &m_destination;
+    MicrofacetModel m_model;
+};
+
+/**
+ * Returns the number of levels of a complete mip chain, down to 1x1 (1 + floor(log2(max(width, height)))).
+ * @brief numberOfMipLevels
+ * @param imageSize
+ * @return
+ */
+int numberOfMipLevels(Size imageSize)
+{
+    int numberOfLevels = 1;
+    int size = max(imageSize.width, imageSize.height);
+
+    while(size > 1)
+    {
+        size /= 2;
+        numberOfLevels++;
+    }
+
+    return numberOfLevels;
+}
+
+/**
+ * Returns the variance of the specular lobe corresponding to a roughness, or the variance of the slopes of the microfacets
+ * corresponding to the alpha of a microfacet model.
+ * @brief roughnessToLobeVariance
+ * @param roughness
+ * @param model
+ * @return
+ */
+float roughnessToLobeVariance(float roughness, MicrofacetModel model)
+{
+    if(model != NO_MICROFACET_MODEL)
+    {
+        return roughness*roughness;
+    }
+
+    return 8.0*sqrt(2.0)*roughness*roughness;
+}
+
+/**
+ * Returns the roughness corresponding to a variance of the specular lobe, or the alpha of a microfacet model
+ * corresponding to a variance of the slopes of the microfacets.
+ * @brief lobeVarianceToRoughness
+ * @param lobeVariance
+ * @param model
+ * @return
+ */
+float lobeVarianceToRoughness(float lobeVariance, MicrofacetModel model)
+{
+    if(model != NO_MICROFACET_MODEL)
+    {
+        return sqrt(max(lobeVariance, 0.0f));
+    }
+
+    return sqrt(max(lobeVariance, 0.0f)/(8.0*sqrt(2.0)));
+}
+
+/**
+ * Returns the variance added to the lobe (see roughnessToLobeVariance) by the normals of a footprint,
+ * from the length of their average (Toksvig) : 4 sigma^2 for the reflected lobe, 2 sigma^2 for the slopes of the microfacets.
+ * @brief normalsLobeVariance
+ * @param length length of the average normal, in ]0;1].
+ * @param model
+ * @return
+ */
+float normalsLobeVariance(float length, MicrofacetModel model)
+{
+    float variance = (1.0-length)/length;
+
+    return model != NO_MICROFACET_MODEL ? 2.0*variance : 4.0*variance;
+}
+
+/**
+ * Builds the complete mip chains of the maps. The 4 maps of a level are computed in a single parallel pass over its rows.
+ * The roughness is filtered as the alpha of the current microfacet model, if any (microfacetModel()).
+ * @brief buildMipChain
+ * @param diffuse CV_32FC3 or empty.
+ * @param specular CV_32FC3.
+ * @param normals CV_32FC3, BGR = ZYX.
+ * @param roughness CV_32FC3.
+ * @param binaryMask CV_8UC1.
+ * @param chain
+ */
+void buildMipChain(const Mat &diffuse, const Mat &specular, const Mat &normals, const Mat &roughness,
+                   const Mat &binaryMask, MipChain &chain)
+{
+    int numberOfLevels = numberOfMipLevels(Size(normals.cols, normals.rows));
+    bool isDiffuse = !diffuse.empty();
+
+    chain.diffuse.resize(isDiffuse ? numberOfLevels : 0);
+    chain.specular.resize(numberOfLevels);
+    chain.normals.resize(numberOfLevels);
+    chain.roughness.resize(numberOfLevels);
+
+    //Level 0 shares the buffers of the maps
+    if(isDiffuse)
+    {
+        chain.diffuse[0] = diffuse;
+    }
+
+    chain.specular[0] = specular;
+    chain.normals[0] = normals;
+    chain.roughness[0] = roughness;
+
+    //The roughness of the maps is the alpha of the model they were computed with
+    MicrofacetModel model = microfacetModel();
+
+    //Accumulators of the previous and of the current level
+    MipAccumulators accumulators[2];
+
+    int rows = normals.rows;
+    int cols = normals.cols;
+
+    for(int level = 1 ; level<numberOfLevels ; level++)
+    {
+        rows = max(rows/2, 1);
+        cols = max(cols/2, 1);
+
+        if(isDiffuse)
+        {
+            createPooledImage(chain.diffuse[level], rows, cols, CV_32FC3);
+        }
+
+        createPooledImage(chain.specular[level], rows, cols, CV_32FC3);
+        createPooledImage(chain.normals[level], rows, cols, CV_32FC3);
+        createPooledImage(chain.roughness[level], rows, cols, CV_32FC3);
+
+        MipAccumulators &destination = accumulators[level%2];
+        createPooledImage(destination.weight, rows, cols, CV_32FC1);
+        createPooledImage(destination.averageNormal, rows, cols, CV_32FC3);
+        createPooledImage(destination.lobeVariance, rows, cols, CV_32FC3);
+
+        parallel_for_(Range(0, rows), MipLevelBody(chain, level, binaryMask, accumulators[(level+1)%2], destination, model));
+    }
+}
+
+/**
+ * Queues the levels 1 and above of the chains to the output writer (group pathToFolder) : diffuse_mipN.pfm, specular_mipN.pfm,
+ * normalMap_mipN.bmp and roughness_mipN.pfm in the textures folder (level 0 is saved with the maps).
+ * @brief saveMipChain
+ * @param chain
+ * @param pathToFolder
+ */
+void saveMipChain(const MipChain &chain, string pathToFolder)
+{
+    for(unsigned int level = 1 ; level<chain.normals.size() ; level++)
+    {
+        ostringstream suffix;
+        suffix << "_mip" << level;
+
+        if(!chain.diffuse.empty())
+        {
+            savePFMAsync(pathToFolder, chain.diffuse[level], pathToFolder + "/textures/diffuse" + suffix.str() + ".pfm");
+        }
+
+        savePFMAsync(pathToFolder, chain.specular[level], pathToFolder + "/textures/specular" + suffix.str() + ".pfm");
+
+        saveNormalMapAsync(pathToFolder, chain.normals[level], pathToFolder + "/textures/normalMap" + suffix.str() + ".bmp");
+
+        savePFMAsync(pathToFolder, chain.roughness[level], pathToFolder + "/textures/roughness" + suffix.str() + ".pfm");
+    }
+}
@@ -0,0 +1,139 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file mipchain.h
+ * \brief Implementation of the mip chains of the reflectance maps.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Each level of a mip chain is half the size of the previous one (rounded down, as the GPUs) down to 1x1.
+ * A pixel of a level is the average of the pixels of its footprint in the full resolution maps that are inside the mask.
+ *
+ * The normals are averaged without normalisation, then renormalised. The length |Na| of the average normal
+ * gives the variance of the normals of the footprint (Toksvig) : sigma^2 = (1-|Na|)/|Na|.
+ * The reflection about the normals doubles the angles, so the variance of the specular lobe grows by 4 sigma^2.
+ * The roughness of a level is computed from the average variance of the lobe of its footprint plus this term,
+ * for each channel of the roughness map (see perChannelMaps). The normals of the chain are those of the green channel.
+ * The roughness r of the maps is (2 s^2)^(1/4)/4 with s the variance of the lobe (see computeRoughnessMap) : s = 8 sqrt(2) r^2.
+ *
+ * With a microfacet model (see microfacet.h) the roughness is the alpha of the model, which describes the microfacet
+ * normals and not the reflected lobe : the chain averages the variance of the slopes of the microfacets, alpha^2
+ * (Beckmann, and its Beckmann equivalent for GGX), and the variance of the normals of the footprint is added without
+ * the doubling of the reflection. With the exponent of Toksvig 1/s' = 1/s + sigma^2 and alpha^2 = 2/s, it adds 2 sigma^2.
+ */
+
+#ifndef MIPCHAIN
+#define MIPCHAIN
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+#include "microfacet.h"
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+
+/**
+ * Mip chains of the reflectance maps. Level 0 shares the buffers of the full resolution maps.
+ * The diffuse chain is empty without cross polarised data.
+ * @brief The MipChain struct
+ */
+struct MipChain
+{
+    std::vector<cv::Mat> diffuse;
+    std::vector<cv::Mat> specular;
+    std::vector<cv::Mat> normals;
+    std::vector<cv::Mat> roughness;
+};
+
+/**
+ * Returns the number of levels of a complete mip chain, down to 1x1 (1 + floor(log2(max(width, height)))).
+ * @brief numberOfMipLevels
+ * @param imageSize
+ * @return
+ */
+int numberOfMipLevels(cv::Size imageSize);
+
+/**
+ * Returns the variance of the specular lobe corresponding to a roughness, or the variance of the slopes of the microfacets
+ * corresponding to the alpha of a microfacet model.
+ * @brief roughnessToLobeVariance
+ * @param roughness
+ * @param model
+ * @return
+ */
+float roughnessToLobeVariance(float roughness, MicrofacetModel model);
+
+/**
+ * Returns the roughness corresponding to a variance of the specular lobe, or the alpha of a microfacet model
+ * corresponding to a variance of the slopes of the microfacets.
+ * @brief lobeVarianceToRoughness
+ * @param lobeVariance
+ * @param model
+ * @return
+ */
+float lobeVarianceToRoughness(float lobeVariance, MicrofacetModel model);
+
+/**
+ * Returns the variance added to the lobe (see roughnessToLobeVariance) by the normals of a footprint,
+ * from the length of their average (Toksvig).
+ * @brief normalsLobeVariance
+ * @param length length of the average normal, in ]0;1].
+ * @param model
+ * @return
+ */
+float normalsLobeVariance(float length, MicrofacetModel model);
+
+/**
+ * Builds the complete mip chains of the maps. The 4 maps of a level are computed in a single parallel pass over its rows.
+ * The roughness is filtered as the alpha of the current microfacet model, if any (microfacetModel()).
+ * @brief buildMipChain
+ * @param diffuse CV_32FC3 or empty.
+ * @param specular CV_32FC3.
+ * @param normals CV_32FC3, BGR = ZYX.
+ * @param roughness CV_32FC3.
+ * @param binaryMask CV_8UC1.
+ * @param chain
+ */
+void buildMipChain(const cv::Mat &diffuse, const cv::Mat &specular, const cv::Mat &normals, const cv::Mat &roughness,
+                   const cv::Mat &binaryMask, MipChain &chain);
+
+/**
+ * Queues the levels 1 and above of the chains to the output writer (group pathToFolder) : diffuse_mipN.pfm, specular_mipN.pfm,
+ * normalMap_mipN.bmp and roughness_mipN.pfm in the textures folder (level 0 is saved with the maps).
+ * @brief saveMipChain
+ * @param chain
+ * @param pathToFolder
+ */
+void saveMipChain(const MipChain &chain, std::string pathToFolder);
+
+#endif // MIPCHAIN
@@ -0,0 +1,568 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file mosaic.cpp
+ * \brief Implementation of the reflectance maps of a sample larger than one camera frame.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the reflectance maps of a sample larger than one camera frame.
+ */
+
+#include "mosaic.h"
+#include "capturetile.h"
+#include "bufferpool.h"
+#include "taskgraph.h"
+#include "PFMReadWrite.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+//Relative weight of the pixels of a shot outside its mask : the background of a shot is only visible
+//where no other shot sees the sample
+#define MOSAIC_BACKGROUND_WEIGHT 0.001f
+
+/**
+ * Returns the folder of the layout file of a mosaic.
+ * @brief layoutFolder
+ * @param layoutFile
+ * @return
+ */
+static string layoutFolder(string layoutFile)
+{
+    size_t separator = layoutFile.find_last_of("/\\");
+
+    if(separator == string::npos)
+    {
+        return ".";
+    }
+
+    return layoutFile.substr(0, separator);
+}
+
+/**
+ * Reads the layout of a mosaic : one line "folder x y" per shot, with the position of the top left corner of the shot
+ * in pixels. The folders are relative to the folder of the layout file. Empty lines and lines starting with # are ignored.
+ * The positions are translated so that the mosaic starts at (0,0).
+ * @brief readMosaicLayout
+ * @param layoutFile
+ * @param mosaic
+ * @return false if the file could not be read, a line is not valid or the mask of a shot could not be loaded.
+ */
+bool readMosaicLayout(string layoutFile, Mosaic &mosaic)
+{
+    ifstream file(layoutFile.c_str());
+
+    if(!file)
+    {
+        cerr << "Cannot read the layout of the mosaic " << layoutFile << endl;
+        return false;
+    }
+
+    string folder = layoutFolder(layoutFile);
+    string line;
+    int lineNumber = 0;
+
+    mosaic.shots.clear();
+
+    while(getline(file, line))
+    {
+        lineNumber++;
+
+        istringstream stream(line);
+        string name;
+        MosaicShot shot;
+
+        if(!(stream >> name) || name[0] == '#')
+        {
+            continue;
+        }
+
+        if(!(stream >> shot.position.x >> shot.position.y))
+        {
+            cerr << "Invalid line " << lineNumber << " in the layout of the mosaic " << layoutFile << endl;
+            return false;
+        }
+
+        shot.pathToFolder = (name[0] == '/') ? name : folder + "/" + name;
+
+        if(!readCaptureSize(shot.pathToFolder, shot.size))
+        {
+            cerr << "Cannot read the size of the shot " << shot.pathToFolder << endl;
+            return false;
+        }
+
+        mosaic.shots.push_back(shot);
+    }
+
+    if(mosaic.shots.empty())
+    {
+        cerr << "No shot in the layout of the mosaic " << layoutFile << endl;
+        return false;
+    }
+
+    Point origin(INT_MAX, INT_MAX);
+
+    for(size_t s = 0 ; s<mosaic.shots.size() ; s++)
+    {
+        origin.x = min(origin.x, mosaic.shots[s].position.x);
+        origin.y = min(origin.y, mosaic.shots[s].position.y);
+    }
+
+    mosaic.size = Size(0, 0);
+
+    for(size_t s = 0 ; s<mosaic.shots.size() ; s++)
+    {
+        MosaicShot &shot = mosaic.shots[s];
+        shot.position.x -= origin.x;
+        shot.position.y -= origin.y;
+
+        mosaic.size.width = max(mosaic.size.width, shot.position.x + shot.size.width);
+        mosaic.size.height = max(mosaic.size.height, shot.position.y + shot.size.height);
+    }
+
+    return true;
+}
+
+/**
+ * Computes the blending weights of a shot : distance to the closest border of the shot, in pixels,
+ * scaled by MOSAIC_BACKGROUND_WEIGHT outside the mask (red channel below 0.9, as accumulateSurfaceNormals).
+ * @brief computeBlendingWeights
+ * @param mask linear mask (CV_32FC3).
+ * @param weights
+ */
+static void computeBlendingWeights(const Mat &mask, Mat &weights)
+{
+    createPooledImage(weights, mask.rows, mask.cols, CV_32FC1);
+
+    for(int i = 0 ; i<mask.rows ; i++)
+    {
+        const Vec3f *maskRow = mask.ptr<Vec3f>(i);
+        float *weightRow = weights.ptr<float>(i);
+        int distanceToRows = min(i+1, mask.rows-i);
+
+        for(int j = 0 ; j<mask.cols ; j++)
+        {
+            float distance = (float) min(distanceToRows, min(j+1, mask.cols-j));
+
+            weightRow[j] = (maskRow[j].val[2] > 0.9) ? distance : MOSAIC_BACKGROUND_WEIGHT*distance;
+        }
+    }
+}
+
+/**
+ * Writes the maps of a shot (not scaled) and its blending weights in a scratch file :
+ * the diffuse (with cross polarised data only), specular, normal and roughness maps and the weights one after the other, row by row.
+ * @brief writeScratchMaps
+ * @param maps
+ * @param weights
+ * @param filePath
+ * @return false if the file could not be written.
+ */
+static bool writeScratchMaps(const ReflectanceMaps &maps, const Mat &weights, string filePath)
+{
+    ofstream file(filePath.c_str(), ios::out | ios::trunc | ios::binary);
+
+    if(!file)
+    {
+        return false;
+    }
+
+    const Mat *planes[] = {&maps.diffuse, &maps.specular, &maps.normals, &maps.roughness, &weights};
+
+    for(int p = 0 ; p<5 ; p++)
+    {
+        for(int i = 0 ; i<planes[p]->rows ; i++)
+        {
+            file.write(planes[p]->ptr<char>(i), planes[p]->cols*planes[p]->elemSize());
+        }
+    }
+
+    return file.good();
+}
+
+/**
+ * Reads a region of the maps and of the blending weights of a shot from its scratch file.
+ * @brief readScratchMaps
+ * @param filePath
+ * @param shotSize
+ * @param isCrossData
+ * @param region region of the shot.
+ * @param maps
+ * @param weights
+ * @return false if the file could not be read.
+ */
+static bool readScratchMaps(string filePath, Size shotSize, bool isCrossData, Rect region, ReflectanceMaps &maps, Mat &weights)
+{
+    ifstream file(filePath.c_str(), ios::in | ios::binary);
+
+    if(!file)
+    {
+        return false;
+    }
+
+    Mat *planes[] = {&maps.diffuse, &maps.specular, &maps.normals, &maps.roughness, &weights};
+    int types[] = {CV_32FC3, CV_32FC3, CV_32FC3, CV_32FC3, CV_32FC1};
+    streamoff offset = 0;
+
+    if(!isCrossData)
+    {
+        maps.diffuse.release();
+    }
+
+    for(int p = isCrossData ? 0 : 1 ; p<5 ; p++)
+    {
+        planes[p]->create(region.height, region.width, types[p]);
+
+        streamoff pixelSize = planes[p]->elemSize();
+
+        for(int i = 0 ; i<region.height ; i++)
+        {
+            file.seekg(offset + ((streamoff) (region.y+i)*shotSize.width + region.x)*pixelSize);
+            file.read(planes[p]->ptr<char>(i), region.width*pixelSize);
+        }
+
+        offset += (streamoff) shotSize.width*shotSize.height*pixelSize;
+    }
+
+    return file.good();
+}
+
+/**
+ * Adds a map multiplied by the blending weights to the weighted sum of the maps of a tile of the mosaic.
+ * @brief addWeightedMap
+ * @param map
+ * @param weights
+ * @param sum region of the sum covered by the map.
+ */
+static void addWeightedMap(const Mat &map, const Mat &weights, Mat sum)
+{
+    for(int i = 0 ; i<map.rows ; i++)
+    {
+        const Vec3f *mapRow = map.ptr<Vec3f>(i);
+        const float *weightRow = weights.ptr<float>(i);
+        Vec3f *sumRow = sum.ptr<Vec3f>(i);
+
+        for(int j = 0 ; j<map.cols ; j++)
+        {
+            sumRow[j] += mapRow[j]*weightRow[j];
+        }
+    }
+}
+
+/**
+ * Divides the weighted sums of the maps of a tile of the mosaic by the sum of the weights and normalizes the normals.
+ * The pixels that no shot covers are set to 0 with a normal facing the camera.
+ * @brief normalizeMosaicTile
+ * @param maps
+ * @param weightSum
+ */
+static void normalizeMosaicTile(ReflectanceMaps &maps, const Mat &weightSum)
+{
+    for(int i = 0 ; i<weightSum.rows ; i++)
+    {
+        const float *weightRow = weightSum.ptr<float>(i);
+        Vec3f *specularRow = maps.specular.ptr<Vec3f>(i);
+        Vec3f *normalRow = maps.normals.ptr<Vec3f>(i);
+        Vec3f *roughnessRow = maps.roughness.ptr<Vec3f>(i);
+        Vec3f *diffuseRow = maps.diffuse.empty() ? NULL : maps.diffuse.ptr<Vec3f>(i);
+
+        for(int j = 0 ; j<weightSum.cols ; j++)
+        {
+            if(weightRow[j] <= 0.0f)
+            {
+                //BGR = ZYX
+                normalRow[j] = Vec3f(1.0f, 0.0f, 0.0f);
+                continue;
+            }
+
+            float inverseWeight = 1.0f/weightRow[j];
+
+            specularRow[j] *= inverseWeight;
+            roughnessRow[j] *= inverseWeight;
+
+            if(diffuseRow != NULL)
+            {
+                diffuseRow[j] *= inverseWeight;
+            }
+
+            float length = sqrt(normalRow[j].val[0]*normalRow[j].val[0] + normalRow[j].val[1]*normalRow[j].val[1]
+                                + normalRow[j].val[2]*normalRow[j].val[2]);
+
+            if(length > 0.0f)
+            {
+                normalRow[j] *= 1.0f/length;
+            }
+        }
+    }
+}
+
+/**
+ * Builds the maps of a tile of the mosaic : the regions of the shots that cover the tile are read from the scratch files,
+ * scaled with the global statistics (finalizeTileMaps) and blended.
+ * @brief blendMosaicTile
+ * @param mosaic
+ * @param scratchFiles
+ * @param isCrossData
+ * @param statistics
+ * @param region region of the mosaic.
+ * @param maps
+ * @return false if one of the scratch files could not be read.
+ */
+static bool blendMosaicTile(const Mosaic &mosaic, const vector<string> &scratchFiles, bool isCrossData,
+                            const CaptureStatistics &statistics, Rect region, ReflectanceMaps &maps)
+{
+    Mat weightSum;
+    Mat *sums[] = {&maps.diffuse, &maps.specular, &maps.normals, &maps.roughness, &weightSum};
+    int types[] = {CV_32FC3, CV_32FC3, CV_32FC3, CV_32FC3, CV_32FC1};
+
+    for(int p = isCrossData ? 0 : 1 ; p<5 ; p++)
+    {
+        createPooledImage(*sums[p], region.height, region.width, types[p]);
+        sums[p]->setTo(Scalar::all(0));
+    }
+
+    CaptureTile shot;
+    shot.isCrossData = isCrossData;
+    Mat weights;
+
+    for(size_t s = 0 ; s<mosaic.shots.size() ; s++)
+    {
+        const MosaicShot &mosaicShot = mosaic.shots[s];
+        Rect overlap = region & Rect(mosaicShot.position, mosaicShot.size);
+
+        if(overlap.width <= 0 || overlap.height <= 0)
+        {
+            continue;
+        }
+
+        Rect shotRegion(overlap.x-mosaicShot.position.x, overlap.y-mosaicShot.position.y, overlap.width, overlap.height);
+
+        if(!readScratchMaps(scratchFiles[s], mosaicShot.size, isCrossData, shotRegion, shot.maps, weights))
+        {
+            cerr << "Cannot read the scratch file " << scratchFiles[s] << endl;
+            return false;
+        }
+
+        finalizeTileMaps(shot, statistics);
+
+        Rect tileRegion(overlap.x-region.x, overlap.y-region.y, overlap.width, overlap.height);
+
+        if(isCrossData)
+        {
+            addWeightedMap(shot.maps.diffuse, weights, maps.diffuse(tileRegion));
+        }
+
+        addWeightedMap(shot.maps.specular, weights, maps.specular(tileRegion));
+        addWeightedMap(shot.maps.normals, weights, maps.normals(tileRegion));
+        addWeightedMap(shot.maps.roughness, weights, maps.roughness(tileRegion));
+
+        weightSum(tileRegion) += weights;
+    }
+
+    normalizeMosaicTile(maps, weightSum);
+
+    return true;
+}
+
+/**
+ * Writes the maps of a tile of the mosaic : diffuse_<row>_<column>.pfm (with cross polarised data only),
+ * specular_<row>_<column>.pfm, normalMap_<row>_<column>.bmp and roughness_<row>_<column>.pfm.
+ * @brief saveMosaicTile
+ * @param maps
+ * @param pathToTextures
+ * @param row
+ * @param column
+ * @return false if one of the files could not be written.
+ */
+static bool saveMosaicTile(const ReflectanceMaps &maps, string pathToTextures, int row, int column)
+{
+    ostringstream suffix;
+    suffix << "_" << row << "_" << column;
+
+    bool success = true;
+
+    if(!maps.diffuse.empty())
+    {
+        success = savePFM(maps.diffuse, pathToTextures + "/diffuse" + suffix.str() + ".pfm") && success;
+    }
+
+    success = savePFM(maps.specular, pathToTextures + "/specular" + suffix.str() + ".pfm") && success;
+    success = saveNormalMap(maps.normals, pathToTextures + "/normalMap" + suffix.str() + ".bmp") && success;
+    success = savePFM(maps.roughness, pathToTextures + "/roughness" + suffix.str() + ".pfm") && success;
+
+    return success;
+}
+
+/**
+ * Writes the size of the mosaic and the size of its tiles in mosaic.txt : width height tileSize.
+ * @brief saveMosaicDescription
+ * @param mosaic
+ * @param pathToTextures
+ * @return false if the file could not be written.
+ */
+static bool saveMosaicDescription(const Mosaic &mosaic, string pathToTextures)
+{
+    ofstream file((pathToTextures + "/mosaic.txt").c_str(), ios::out | ios::trunc);
+
+    file << mosaic.size.width << " " << mosaic.size.height << " " << MOSAIC_TILE_SIZE << endl;
+
+    return file.good();
+}
+
+/**
+ * Removes the scratch files of the shots.
+ * @brief removeScratchFiles
+ * @param scratchFiles
+ */
+static void removeScratchFiles(const vector<string> &scratchFiles)
+{
+    for(size_t s = 0 ; s<scratchFiles.size() ; s++)
+    {
+        remove(scratchFiles[s].c_str());
+    }
+}
+
+/**
+ * Computes the reflectance maps of a mosaic with the global statistics of its shots and writes them in the textures
+ * folder of the folder of the layout file, as tiles of MOSAIC_TILE_SIZE pixels : diffuse_<row>_<column>.pfm
+ * (with cross polarised data only), specular_<row>_<column>.pfm, normalMap_<row>_<column>.bmp and
+ * roughness_<row>_<column>.pfm, with mosaic.txt (width, height and size of the tiles).
+ * The overlaps are blended with weights that decrease towards the borders of the shots, the background of a shot
+ * is only used where no other shot sees the sample. The normals are those of the green channel.
+ * @brief computeMosaicMaps
+ * @param layoutFile
+ * @param isCrossData
+ * @return false if the layout is not valid, one of the files could not be loaded or one of the tiles could not be written.
+ */
+bool computeMosaicMaps(string layoutFile, bool isCrossData)
+{
+    Mosaic mosaic;
+
+    if(!readMosaicLayout(layoutFile, mosaic))
+    {
+        return false;
+    }
+
+    string pathToFolder = layoutFolder(layoutFile);
+    string pathToTextures = pathToFolder + "/textures";
+    CaptureStatistics statistics;
+    CaptureTile shot;
+
+    //First reduction over all the shots : maxima of the gradients
+    for(size_t s = 0 ; s<mosaic.shots.size() ; s++)
+    {
+        if(!loadCaptureTile(mosaic.shots[s].pathToFolder, isCrossData, Rect(), shot))
+        {
+            return false;
+        }
+
+        accumulateGradientMaxima(shot, statistics);
+    }
+
+    //Second reduction : the maps of each shot are computed with the global maxima and kept in a scratch file until
+    //the statistics of all the shots are known
+    vector<string> scratchFiles;
+    Mat weights;
+
+    for(size_t s = 0 ; s<mosaic.shots.size() ; s++)
+    {
+        if(!loadCaptureTile(mosaic.shots[s].pathToFolder, isCrossData, Rect(), shot))
+        {
+            removeScratchFiles(scratchFiles);
+            return false;
+        }
+
+        computeTileMaps(shot, statistics);
+
+        releaseTileGradients(shot);
+
+        accumulateMapStatistics(shot, statistics);
+
+        computeBlendingWeights(shot.mask, weights);
+
+        ostringstream scratchFile;
+        scratchFile << pathToTextures << "/mosaic_shot_" << s << ".tmp";
+        scratchFiles.push_back(scratchFile.str());
+
+        if(!writeScratchMaps(shot.maps, weights, scratchFiles.back()))
+        {
+            cerr << "Cannot write the scratch file " << scratchFiles.back() << endl;
+            removeScratchFiles(scratchFiles);
+            return false;
+        }
+    }
+
+    printPixelDiagnostics(statistics.diagnostics, pathToFolder);
+
+    //The shot and its maps are not needed anymore
+    shot = CaptureTile();
+    weights.release();
+
+    //The tiles of the mosaic are independent : one tile per task, written as soon as it is blended
+    vector<Rect> tiles = splitIntoTiles(mosaic.size, MOSAIC_TILE_SIZE, MOSAIC_TILE_SIZE);
+    vector<char> tileWritten(tiles.size(), 0);
+
+    runTasks((int) tiles.size(), [&](int t)
+    {
+        ReflectanceMaps maps;
+
+        if(blendMosaicTile(mosaic, scratchFiles, isCrossData, statistics, tiles[t], maps))
+        {
+            tileWritten[t] = saveMosaicTile(maps, pathToTextures, tiles[t].y/MOSAIC_TILE_SIZE, tiles[t].x/MOSAIC_TILE_SIZE) ? 1 : 0;
+        }
+    });
+
+    removeScratchFiles(scratchFiles);
+
+    bool success = saveMosaicDescription(mosaic, pathToTextures);
+
+    for(size_t t = 0 ; t<tiles.size() ; t++)
+    {
+        if(!tileWritten[t])
+        {
+            cerr << "Cannot write the tile " << tiles[t].y/MOSAIC_TILE_SIZE << "_" << tiles[t].x/MOSAIC_TILE_SIZE
+                 << " of the mosaic in " << pathToTextures << endl;
+            success = false;
+        }
+    }
+
+    return success;
+}
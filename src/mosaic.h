@@ -0,0 +1,113 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file mosaic.h
+ * \brief Implementation of the reflectance maps of a sample larger than one camera frame.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * A large sample is captured as a grid of overlapping captures (shots), each one a usual capture folder
+ * (par, cross, checker.txt, mask). The maps of the sample (the mosaic) are computed as one capture :
+ * the maxima of scaleTo01Range and the average surface normal are the global statistics of all the shots,
+ * so that the albedos and the normals of neighbouring shots match.
+ *
+ * The mosaic is never held in memory :
+ *  - the first pass loads the shots one at a time for the maxima of the gradients,
+ *  - the second pass computes the maps of each shot and writes them unscaled in a scratch file,
+ *  - the third pass builds the mosaic one output tile at a time : the regions of the shots that cover the tile
+ *    are read from the scratch files, scaled with the global statistics and blended in the overlaps.
+ * The memory is bounded by one shot and one output tile per thread whatever the size of the mosaic.
+ */
+
+#ifndef MOSAIC
+#define MOSAIC
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+
+//Size of the square tiles of the mosaic written in the textures folder
+#define MOSAIC_TILE_SIZE 1024
+
+/**
+ * One capture of the mosaic and its position.
+ * @brief The MosaicShot struct
+ */
+struct MosaicShot
+{
+    std::string pathToFolder;
+
+    //Top left corner of the shot in the mosaic, in pixels
+    cv::Point position;
+    cv::Size size;
+};
+
+/**
+ * Layout of the shots of a mosaic.
+ * @brief The Mosaic struct
+ */
+struct Mosaic
+{
+    std::vector<MosaicShot> shots;
+
+    //Bounding box of the shots, the top left shot is at (0,0)
+    cv::Size size;
+};
+
+/**
+ * Reads the layout of a mosaic : one line "folder x y" per shot, with the position of the top left corner of the shot
+ * in pixels. The folders are relative to the folder of the layout file. Empty lines and lines starting with # are ignored.
+ * The positions are translated so that the mosaic starts at (0,0).
+ * @brief readMosaicLayout
+ * @param layoutFile
+ * @param mosaic
+ * @return false if the file could not be read, a line is not valid or the mask of a shot could not be loaded.
+ */
+bool readMosaicLayout(std::string layoutFile, Mosaic &mosaic);
+
+/**
+ * Computes the reflectance maps of a mosaic with the global statistics of its shots and writes them in the textures
+ * folder of the folder of the layout file, as tiles of MOSAIC_TILE_SIZE pixels : diffuse_<row>_<column>.pfm
+ * (with cross polarised data only), specular_<row>_<column>.pfm, normalMap_<row>_<column>.bmp and
+ * roughness_<row>_<column>.pfm, with mosaic.txt (width, height and size of the tiles).
+ * The overlaps are blended with weights that decrease towards the borders of the shots, the background of a shot
+ * is only used where no other shot sees the sample. The normals are those of the green channel.
+ * @brief computeMosaicMaps
+ * @param layoutFile
+ * @param isCrossData
+ * @return false if the layout is not valid, one of the files could not be loaded or one of the tiles could not be written.
+ */
+bool computeMosaicMaps(std::string layoutFile, bool isCrossData);
+
+#endif // MOSAIC
@@ -0,0 +1,393 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file multishot.cpp
+ * \brief Implementation of the averaging of several shots of each gradient.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the averaging of several shots of each gradient.
+ */
+
+#include "multishot.h"
+#include "imageprocessing.h"
+#include "bufferpool.h"
+#include "reflectance.h"
+#include "calibration.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <sstream>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+static int currentNumberOfShots = 1;
+static bool isNoiseMapEnabled = false;
+
+/**
+ * Sets the number of shots of each gradient and of the ambient illumination (1 by default).
+ * @brief setNumberOfShots
+ * @param shots
+ */
+void setNumberOfShots(int shots)
+{
+    currentNumberOfShots = max(shots, 1);
+}
+
+/**
+ * Returns the number of shots of each gradient and of the ambient illumination.
+ * @brief numberOfShots
+ * @return
+ */
+int numberOfShots()
+{
+    return currentNumberOfShots;
+}
+
+/**
+ * Enables the computation of the noise map.
+ * @brief setNoiseMapEnabled
+ * @param enabled
+ */
+void setNoiseMapEnabled(bool enabled)
+{
+    isNoiseMapEnabled = enabled;
+}
+
+/**
+ * Returns true if the noise map is computed : enabled and at least 2 shots per image.
+ * @brief noiseMapEnabled
+ * @return
+ */
+bool noiseMapEnabled()
+{
+    return isNoiseMapEnabled && currentNumberOfShots > 1;
+}
+
+/**
+ * Returns the path of a shot of an image of a folder (par or cross).
+ * @brief shotFilePath
+ * @param pathToFolder
+ * @param subFolder
+ * @param firstImageNumber
+ * @param image index of the gradient, numberOfGradients() for the ambient illumination.
+ * @param shot
+ * @return
+ */
+string shotFilePath(string pathToFolder, string subFolder, unsigned int firstImageNumber, int image, int shot)
+{
+    ostringstream osstream;
+    osstream << pathToFolder << "/" << subFolder << "/";
+
+    if(image < numberOfGradients())
+    {
+        osstream << "IMG_" << firstImageNumber + image*currentNumberOfShots + shot << ".JPG";
+    }
+    else if(shot == 0)
+    {
+        osstream << "ambient.JPG";
+    }
+    else
+    {
+        osstream << "ambient_" << shot << ".JPG";
+    }
+
+    return osstream.str();
+}
+
+/**
+ * Welford update of the rows of the accumulators with a shot.
+ */
+class AccumulateShotBody : public ParallelLoopBody
+{
+public:
+    AccumulateShotBody(const Mat &shot8U, const float *table, int shot, Mat &mean, Mat *sumOfSquaredDeviations)
+        : m_shot8U(shot8U), m_table(table), m_shot(shot), m_mean(mean), m_sumOfSquaredDeviations(sumOfSquaredDeviations) {}
+
+    void operator()(const Range &rows) const
+    {
+        int width = m_shot8U.cols*m_shot8U.channels();
+        float inverseCount = 1.0/(m_shot+1);
+
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            const uchar *source = m_shot8U.ptr<uchar>(i);
+            float *mean = m_mean.ptr<float>(i);
+            float *sumOfSquares = m_sumOfSquaredDeviations ? m_sumOfSquaredDeviations->ptr<float>(i) : NULL;
+
+            if(m_shot == 0)
+            {
+                for(int j = 0 ; j<width ; j++)
+                {
+                    mean[j] = m_table[source[j]];
+                }
+
+                if(sumOfSquares)
+                {
+                    for(int j = 0 ; j<width ; j++)
+                    {
+                        sumOfSquares[j] = 0.0;
+                    }
+                }
+
+                continue;
+            }
+
+            for(int j = 0 ; j<width ; j++)
+            {
+                float value = m_table[source[j]];
+                float delta = value - mean[j];
+
+                mean[j] += delta*inverseCount;
+
+                if(sumOfSquares)
+                {
+                    sumOfSquares[j] += delta*(value - mean[j]);
+                }
+            }
+        }
+    }
+
+private:
+    const Mat &m_shot8U;
+    const float *m_table;
+    int m_shot;
+    Mat &m_mean;
+    Mat *m_sumOfSquaredDeviations;
+};
+
+/**
+ * Adds a shot (CV_8UC3) to the running mean (CV_32FC3, linear 0;1 range) and to the running sum of the squared deviations
+ * of an image (Welford), after the removal of the gamma. The first shot (shot = 0) initialises the accumulators.
+ * The sum of the squared deviations is not computed if sumOfSquaredDeviations is NULL.
+ * @brief accumulateShot
+ * @param shot8U
+ * @param gamma
+ * @param shot index of the shot.
+ * @param mean
+ * @param sumOfSquaredDeviations
+ */
+void accumulateShot(const Mat &shot8U, double gamma, int shot, Mat &mean, Mat *sumOfSquaredDeviations)
+{
+    if(shot == 0)
+    {
+        createPooledImage(mean, shot8U.rows, shot8U.cols, CV_32FC(shot8U.channels()));
+
+        if(sumOfSquaredDeviations)
+        {
+            createPooledImage(*sumOfSquaredDeviations, shot8U.rows, shot8U.cols, CV_32FC(shot8U.channels()));
+        }
+    }
+
+    parallel_for_(Range(0, shot8U.rows), AccumulateShotBody(shot8U, gammaLookupTable(gamma), shot, mean, sumOfSquaredDeviations));
+}
+
+/**
+ * Adds the variance of the shots (sum of the squared deviations divided by numberOfShots-1) to the noise map.
+ * @brief addShotVariance
+ * @param sumOfSquaredDeviations
+ * @param numberOfShots
+ * @param noise
+ */
+static void addShotVariance(const Mat &sumOfSquaredDeviations, int numberOfShots, Mat &noise)
+{
+    if(noise.empty())
+    {
+        createPooledImage(noise, sumOfSquaredDeviations.rows, sumOfSquaredDeviations.cols, sumOfSquaredDeviations.type());
+        noise.setTo(Scalar::all(0));
+    }
+
+    int width = sumOfSquaredDeviations.cols*sumOfSquaredDeviations.channels();
+    float inverseCount = 1.0/(numberOfShots-1);
+
+    for(int i = 0 ; i<noise.rows ; i++)
+    {
+        const float *sumOfSquares = sumOfSquaredDeviations.ptr<float>(i);
+        float *variance = noise.ptr<float>(i);
+
+        for(int j = 0 ; j<width ; j++)
+        {
+            variance[j] += sumOfSquares[j]*inverseCount;
+        }
+    }
+}
+
+/**
+ * Returns the 16 bits code of a linear value encoded with a gamma.
+ * @brief encodeValue
+ * @param value
+ * @param inverseGamma
+ * @return
+ */
+static inline ushort encodeValue(float value, float inverseGamma)
+{
+    value = min(max(value, 0.0f), 1.0f);
+
+    return (ushort) (pow(value, inverseGamma)*65535.0f + 0.5f);
+}
+
+/**
+ * Rounds a linear mean to the values of its 16 bits encoding, so that the averages kept as 16 bits images
+ * (encodeAveragedImage) give the same results as the averages kept in float.
+ * @brief roundAveragedImage
+ * @param mean
+ * @param gamma
+ */
+static void roundAveragedImage(Mat &mean, double gamma)
+{
+    const float *table = gammaLookupTable(gamma, 65536);
+
+    int width = mean.cols*mean.channels();
+    float inverseGamma = 1.0/gamma;
+
+    for(int i = 0 ; i<mean.rows ; i++)
+    {
+        float *value = mean.ptr<float>(i);
+
+        for(int j = 0 ; j<width ; j++)
+        {
+            value[j] = table[encodeValue(value[j], inverseGamma)];
+        }
+    }
+}
+
+/**
+ * Loads all the shots of an image of a folder (par or cross) and averages them in linear space.
+ * The shots are decoded one at a time in the same buffer, the shots of the ambient illumination are read through
+ * the cache of the decoded ambient images. The average of several shots is rounded to 16 bits (see encodeAveragedImage).
+ * If noise is not NULL, the variance of the shots is added to it (allocated and set to 0 if empty).
+ * @brief loadAveragedImage
+ * @param pathToFolder
+ * @param subFolder
+ * @param firstImageNumber
+ * @param image index of the gradient, numberOfGradients() for the ambient illumination.
+ * @param gamma gamma removed from the shots (1.0 for none).
+ * @param region only this region of the shots is kept if it is not empty.
+ * @param mean
+ * @param noise
+ * @return false if one of the shots could not be loaded.
+ */
+bool loadAveragedImage(string pathToFolder, string subFolder, unsigned int firstImageNumber, int image, double gamma,
+                       Rect region, Mat &mean, Mat *noise)
+{
+    //Decoded in a buffer of the pool, given back when shot8U goes out of scope
+    Mat shot8U;
+    Mat sumOfSquaredDeviations;
+
+    bool computeVariance = noise != NULL && currentNumberOfShots > 1;
+
+    for(int s = 0 ; s<currentNumberOfShots ; s++)
+    {
+        string filePath = shotFilePath(pathToFolder, subFolder, firstImageNumber, image, s);
+
+        //The ambient illumination is decoded once per session (see calibration.h)
+        bool isRead = image == numberOfGradients() ? readAmbientFile(filePath, shot8U) : readImageFile(filePath, shot8U);
+
+        if(!isRead)
+        {
+            cerr << "Could not load image : " << filePath << endl;
+            return false;
+        }
+
+        Mat shotRegion = region.area() > 0 ? shot8U(region) : shot8U;
+
+        if(s > 0 && (shotRegion.rows != mean.rows || shotRegion.cols != mean.cols))
+        {
+            cerr << "The shots do not have the same size : " << filePath << endl;
+            return false;
+        }
+
+        accumulateShot(shotRegion, gamma, s, mean, computeVariance ? &sumOfSquaredDeviations : NULL);
+    }
+
+    if(computeVariance)
+    {
+        addShotVariance(sumOfSquaredDeviations, currentNumberOfShots, *noise);
+    }
+
+    if(currentNumberOfShots > 1)
+    {
+        roundAveragedImage(mean, gamma);
+    }
+
+    return true;
+}
+
+/**
+ * Encodes a linear mean (CV_32FC3) as a 16 bits image (CV_16UC3) with a gamma, so that the averaged images
+ * of a capture can stay in memory with half the size of the float images (see linearizeImage).
+ * @brief encodeAveragedImage
+ * @param mean
+ * @param gamma
+ * @param image16U
+ */
+void encodeAveragedImage(const Mat &mean, double gamma, Mat &image16U)
+{
+    createPooledImage(image16U, mean.rows, mean.cols, CV_16UC(mean.channels()));
+
+    int width = mean.cols*mean.channels();
+    float inverseGamma = 1.0/gamma;
+
+    for(int i = 0 ; i<mean.rows ; i++)
+    {
+        const float *source = mean.ptr<float>(i);
+        ushort *destination = image16U.ptr<ushort>(i);
+
+        for(int j = 0 ; j<width ; j++)
+        {
+            destination[j] = encodeValue(source[j], inverseGamma);
+        }
+    }
+}
+
+/**
+ * Divides the sum of the variances of the gradients by their number.
+ * @brief finalizeNoiseMap
+ * @param noise
+ * @param numberOfImages
+ */
+void finalizeNoiseMap(Mat &noise, int numberOfImages)
+{
+    int width = noise.cols*noise.channels();
+    float inverseCount = 1.0/max(numberOfImages, 1);
+
+    for(int i = 0 ; i<noise.rows ; i++)
+    {
+        float *variance = noise.ptr<float>(i);
+
+        for(int j = 0 ; j<width ; j++)
+        {
+            variance[j] *= inverseCount;
+        }
+    }
+}
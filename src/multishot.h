@@ -0,0 +1,147 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file multishot.h
+ * \brief Implementation of the averaging of several shots of each gradient.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * In low light each gradient (and the ambient illumination) can be captured several times. The shots of an image are
+ * decoded one at a time and accumulated in a running mean and a running sum of squared deviations (Welford), in the same
+ * pass as the linearisation : the memory does not depend on the number of shots.
+ *
+ * With N shots per image the shots of the gradient k of a folder are IMG_XXXX.JPG with XXXX = firstImageNumber + k*N + s
+ * (s = 0 .. N-1) and the shots of the ambient illumination are ambient.JPG, ambient_1.JPG ... ambient_<N-1>.JPG.
+ *
+ * The noise map (noise.pfm, optional, at least 2 shots) is the average over the gradients of the variance of the shots
+ * of each pixel, in the linear 0;1 range of the camera (before the checkerchart scaling).
+ */
+
+#ifndef MULTISHOT
+#define MULTISHOT
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+
+/**
+ * Sets the number of shots of each gradient and of the ambient illumination (1 by default).
+ * @brief setNumberOfShots
+ * @param shots
+ */
+void setNumberOfShots(int shots);
+
+/**
+ * Returns the number of shots of each gradient and of the ambient illumination.
+ * @brief numberOfShots
+ * @return
+ */
+int numberOfShots();
+
+/**
+ * Enables the computation of the noise map.
+ * @brief setNoiseMapEnabled
+ * @param enabled
+ */
+void setNoiseMapEnabled(bool enabled);
+
+/**
+ * Returns true if the noise map is computed : enabled and at least 2 shots per image.
+ * @brief noiseMapEnabled
+ * @return
+ */
+bool noiseMapEnabled();
+
+/**
+ * Returns the path of a shot of an image of a folder (par or cross).
+ * @brief shotFilePath
+ * @param pathToFolder
+ * @param subFolder
+ * @param firstImageNumber
+ * @param image index of the gradient, numberOfGradients() for the ambient illumination.
+ * @param shot
+ * @return
+ */
+std::string shotFilePath(std::string pathToFolder, std::string subFolder, unsigned int firstImageNumber, int image, int shot);
+
+/**
+ * Adds a shot (CV_8UC3) to the running mean (CV_32FC3, linear 0;1 range) and to the running sum of the squared deviations
+ * of an image (Welford), after the removal of the gamma. The first shot (shot = 0) initialises the accumulators.
+ * The sum of the squared deviations is not computed if sumOfSquaredDeviations is NULL.
+ * @brief accumulateShot
+ * @param shot8U
+ * @param gamma
+ * @param shot index of the shot.
+ * @param mean
+ * @param sumOfSquaredDeviations
+ */
+void accumulateShot(const cv::Mat &shot8U, double gamma, int shot, cv::Mat &mean, cv::Mat *sumOfSquaredDeviations);
+
+/**
+ * Loads all the shots of an image of a folder (par or cross) and averages them in linear space.
+ * The average of several shots is rounded to 16 bits (see encodeAveragedImage).
+ * If noise is not NULL, the variance of the shots is added to it (allocated and set to 0 if empty).
+ * @brief loadAveragedImage
+ * @param pathToFolder
+ * @param subFolder
+ * @param firstImageNumber
+ * @param image index of the gradient, numberOfGradients() for the ambient illumination.
+ * @param gamma gamma removed from the shots (1.0 for none).
+ * @param region only this region of the shots is kept if it is not empty.
+ * @param mean
+ * @param noise
+ * @return false if one of the shots could not be loaded.
+ */
+bool loadAveragedImage(std::string pathToFolder, std::string subFolder, unsigned int firstImageNumber, int image, double gamma,
+                       cv::Rect region, cv::Mat &mean, cv::Mat *noise);
+
+/**
+ * Encodes a linear mean (CV_32FC3) as a 16 bits image (CV_16UC3) with a gamma, so that the averaged images
+ * of a capture can stay in memory with half the size of the float images (see linearizeImage).
+ * The means given by loadAveragedImage are encoded without loss.
+ * @brief encodeAveragedImage
+ * @param mean
+ * @param gamma
+ * @param image16U
+ */
+void encodeAveragedImage(const cv::Mat &mean, double gamma, cv::Mat &image16U);
+
+/**
+ * Divides the sum of the variances of the gradients by their number.
+ * @brief finalizeNoiseMap
+ * @param noise
+ * @param numberOfImages
+ */
+void finalizeNoiseMap(cv::Mat &noise, int numberOfImages);
+
+#endif // MULTISHOT
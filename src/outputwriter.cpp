@@ -0,0 +1,352 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file outputwriter.cpp
+ * \brief Implementation of the asynchronous writing of the output files.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the asynchronous writing of the output files.
+ */
+
+#include "outputwriter.h"
+#include "reflectance.h"
+#include "PFMReadWrite.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Files of a group that are not written yet and files that could not be written.
+ * @brief The OutputGroup struct
+ */
+struct OutputGroup
+{
+    int pendingFiles;
+    vector<string> failedFiles;
+    vector<OutputCallback> callbacks;
+};
+
+/**
+ * File waiting to be written.
+ * @brief The QueuedOutput struct
+ */
+struct QueuedOutput
+{
+    string group;
+    string filePath;
+    OutputTask task;
+};
+
+/**
+ * Queue of the files and threads that write them.
+ */
+class OutputWriter
+{
+public:
+    OutputWriter() : m_pendingFiles(0)
+    {
+        for(int t = 0 ; t<OUTPUT_WRITER_THREADS ; t++)
+        {
+            m_threads.push_back(thread(&OutputWriter::writeFiles, this));
+        }
+    }
+
+    void submit(string group, string filePath, OutputTask task)
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+
+            QueuedOutput output = {group, filePath, task};
+            m_queue.push_back(output);
+
+            OutputGroup &outputGroup = m_groups[group];
+            outputGroup.pendingFiles++;
+            m_pendingFiles++;
+        }
+
+        m_fileAvailable.notify_one();
+    }
+
+    bool wait(string group, vector<string> &failedFiles)
+    {
+        unique_lock<mutex> lock(m_mutex);
+
+        while(m_groups.count(group) > 0 && m_groups[group].pendingFiles > 0)
+        {
+            m_fileWritten.wait(lock);
+        }
+
+        failedFiles.clear();
+
+        if(m_groups.count(group) > 0)
+        {
+            failedFiles = m_groups[group].failedFiles;
+            m_groups.erase(group);
+        }
+
+        return failedFiles.empty();
+    }
+
+    void notify(string group, OutputCallback callback)
+    {
+        vector<string> failedFiles;
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+
+            if(m_groups.count(group) > 0 && m_groups[group].pendingFiles > 0)
+            {
+                m_groups[group].callbacks.push_back(callback);
+                return;
+            }
+
+            if(m_groups.count(group) > 0)
+            {
+                failedFiles = m_groups[group].failedFiles;
+                m_groups.erase(group);
+            }
+        }
+
+        callback(failedFiles);
+    }
+
+    bool flush(vector<string> &failedFiles)
+    {
+        unique_lock<mutex> lock(m_mutex);
+
+        while(m_pendingFiles > 0)
+        {
+            m_fileWritten.wait(lock);
+        }
+
+        failedFiles.clear();
+
+        for(map<string, OutputGroup>::iterator group = m_groups.begin() ; group != m_groups.end() ; group++)
+        {
+            failedFiles.insert(failedFiles.end(), group->second.failedFiles.begin(), group->second.failedFiles.end());
+        }
+
+        m_groups.clear();
+
+        return failedFiles.empty();
+    }
+
+private:
+    void writeFiles()
+    {
+        while(true)
+        {
+            QueuedOutput output;
+
+            {
+                unique_lock<mutex> lock(m_mutex);
+
+                while(m_queue.empty())
+                {
+                    m_fileAvailable.wait(lock);
+                }
+
+                output = m_queue.front();
+                m_queue.pop_front();
+            }
+
+            bool success = false;
+
+            try
+            {
+                success = output.task();
+            }
+            catch(...)
+            {
+                //OpenCV exceptions of the encoders
+                success = false;
+            }
+
+            vector<OutputCallback> callbacks;
+            vector<string> failedFiles;
+
+            {
+                lock_guard<mutex> lock(m_mutex);
+
+                OutputGroup &group = m_groups[output.group];
+
+                if(!success)
+                {
+                    group.failedFiles.push_back(output.filePath);
+                }
+
+                group.pendingFiles--;
+
+                //Last file of a group with callbacks : the group is done
+                if(group.pendingFiles == 0 && !group.callbacks.empty())
+                {
+                    callbacks.swap(group.callbacks);
+                    failedFiles = group.failedFiles;
+                    m_groups.erase(output.group);
+                }
+            }
+
+            for(unsigned int c = 0 ; c<callbacks.size() ; c++)
+            {
+                callbacks[c](failedFiles);
+            }
+
+            //The file counts as pending until its callbacks have returned (flushOutputs)
+            {
+                lock_guard<mutex> lock(m_mutex);
+                m_pendingFiles--;
+            }
+
+            m_fileWritten.notify_all();
+        }
+    }
+
+    mutex m_mutex;
+    condition_variable m_fileAvailable;
+    condition_variable m_fileWritten;
+
+    deque<QueuedOutput> m_queue;
+    map<string, OutputGroup> m_groups;
+    int m_pendingFiles;
+
+    vector<thread> m_threads;
+};
+
+/**
+ * Returns the output writer of the process. Its threads are started at the first call.
+ * @brief outputWriter
+ * @return
+ */
+static OutputWriter& outputWriter()
+{
+    //Never destroyed : the threads wait for files until the end of the process
+    static OutputWriter *writer = new OutputWriter();
+
+    return *writer;
+}
+
+/**
+ * Queues a file to the output writer.
+ * @brief writeOutputAsync
+ * @param group
+ * @param filePath
+ * @param task
+ */
+void writeOutputAsync(string group, string filePath, OutputTask task)
+{
+    outputWriter().submit(group, filePath, task);
+}
+
+/**
+ * Queues a PFM file to the output writer.
+ * @brief savePFMAsync
+ * @param group
+ * @param image
+ * @param filePath
+ */
+void savePFMAsync(string group, const Mat &image, string filePath)
+{
+    //The header of the image keeps its buffer alive until the file is written
+    Mat imageToSave = image;
+
+    writeOutputAsync(group, filePath, [imageToSave, filePath]() { return savePFM(imageToSave, filePath); });
+}
+
+/**
+ * Queues a normal map to the output writer (see saveNormalMap).
+ * @brief saveNormalMapAsync
+ * @param group
+ * @param normals
+ * @param filePath
+ */
+void saveNormalMapAsync(string group, const Mat &normals, string filePath)
+{
+    Mat normalsToSave = normals;
+
+    writeOutputAsync(group, filePath, [normalsToSave, filePath]() { return saveNormalMap(normalsToSave, filePath); });
+}
+
+/**
+ * Waits until all the files of a group have been written. The group is then forgotten.
+ * @brief waitForOutputs
+ * @param group
+ * @param failedFiles files that could not be written.
+ * @return false if a file could not be written.
+ */
+bool waitForOutputs(string group, vector<string> &failedFiles)
+{
+    return outputWriter().wait(group, failedFiles);
+}
+
+/**
+ * Calls callback once all the files of a group have been written (from a thread of the writer,
+ * or immediately if they already are). The group is then forgotten.
+ * @brief whenOutputsWritten
+ * @param group
+ * @param callback
+ */
+void whenOutputsWritten(string group, OutputCallback callback)
+{
+    outputWriter().notify(group, callback);
+}
+
+/**
+ * Waits until all the queued files have been written. All the groups are forgotten.
+ * @brief flushOutputs
+ * @param failedFiles files that could not be written.
+ * @return false if a file could not be written.
+ */
+bool flushOutputs(vector<string> &failedFiles)
+{
+    return outputWriter().flush(failedFiles);
+}
+
+/**
+ * Prints the files that could not be written.
+ * @brief reportFailedOutputs
+ * @param failedFiles
+ */
+void reportFailedOutputs(const vector<string> &failedFiles)
+{
+    for(unsigned int f = 0 ; f<failedFiles.size() ; f++)
+    {
+        cerr << "Could not write : " << failedFiles[f] << endl;
+    }
+}
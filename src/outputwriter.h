@@ -0,0 +1,130 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file outputwriter.h
+ * \brief Implementation of the asynchronous writing of the output files.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The output files are encoded and written by the threads of the output writer while the computation goes on.
+ * Each file belongs to a group (the folder of the capture) : the computation waits for the files of a group
+ * (waitForOutputs) or is called back once they are written (whenOutputsWritten), and gets the list of the files that
+ * could not be written.
+ *
+ * The images given to the writer must not be modified until they are written. The buffers of the pool are not reused
+ * while they are shared (see createPooledImage) : the next capture gets new buffers while the previous one is written.
+ */
+
+#ifndef OUTPUTWRITER
+#define OUTPUTWRITER
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+#include <functional>
+
+//Number of threads that encode and write the files
+#define OUTPUT_WRITER_THREADS 2
+
+/**
+ * Encodes and writes one file. Returns false if the file could not be written.
+ */
+typedef std::function<bool()> OutputTask;
+
+/**
+ * Called with the files of a group that could not be written, once all the files of the group have been written.
+ */
+typedef std::function<void(const std::vector<std::string>&)> OutputCallback;
+
+/**
+ * Queues a file to the output writer.
+ * @brief writeOutputAsync
+ * @param group
+ * @param filePath
+ * @param task
+ */
+void writeOutputAsync(std::string group, std::string filePath, OutputTask task);
+
+/**
+ * Queues a PFM file to the output writer.
+ * @brief savePFMAsync
+ * @param group
+ * @param image
+ * @param filePath
+ */
+void savePFMAsync(std::string group, const cv::Mat &image, std::string filePath);
+
+/**
+ * Queues a normal map to the output writer (see saveNormalMap).
+ * @brief saveNormalMapAsync
+ * @param group
+ * @param normals
+ * @param filePath
+ */
+void saveNormalMapAsync(std::string group, const cv::Mat &normals, std::string filePath);
+
+/**
+ * Waits until all the files of a group have been written. The group is then forgotten.
+ * @brief waitForOutputs
+ * @param group
+ * @param failedFiles files that could not be written.
+ * @return false if a file could not be written.
+ */
+bool waitForOutputs(std::string group, std::vector<std::string> &failedFiles);
+
+/**
+ * Calls callback once all the files of a group have been written (from a thread of the writer,
+ * or immediately if they already are). The group is then forgotten.
+ * @brief whenOutputsWritten
+ * @param group
+ * @param callback
+ */
+void whenOutputsWritten(std::string group, OutputCallback callback);
+
+/**
+ * Waits until all the queued files have been written. All the groups are forgotten.
+ * @brief flushOutputs
+ * @param failedFiles files that could not be written.
+ * @return false if a file could not be written.
+ */
+bool flushOutputs(std::vector<std::string> &failedFiles);
+
+/**
+ * Prints the files that could not be written.
+ * @brief reportFailedOutputs
+ * @param failedFiles
+ */
+void reportFailedOutputs(const std::vector<std::string> &failedFiles);
+
+#endif // OUTPUTWRITER
@@ -0,0 +1,1198 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file reflectancemapsmodule.cpp
+ * \brief Python bindings of the stages of the computation of the reflectance maps.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The images are shared with Python through the buffer protocol, without copies :
+ * - the images computed by the module are returned as reflectance_maps.Image objects that expose their memory
+ *   (numpy.asarray(image) is a view of the image, writable).
+ * - the functions accept any float32 buffer of shape (rows, cols, 3) in BGR order, as OpenCV (e.g a numpy array)
+ *   whose pixels are contiguous. The rows can be strided (e.g array[y0:y1, x0:x1]).
+ *   The in place functions (apply_checker_ratios, scale_to_01_range, align_normals) modify the buffer itself.
+ * The GIL is released during the loading and the computations so that several captures can be processed
+ * in parallel threads. See setup.py for the compilation.
+ */
+
+//Python.h must be included before the standard headers
+#include <Python.h>
+
+#include "../reflectance.h"
+#include "../capturetile.h"
+#include "../regionofinterest.h"
+#include "../calibration.h"
+#include "../kernelprecision.h"
+#include "../microfacet.h"
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+#include <exception>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Python object that owns an image computed by the module and exports its memory (buffer protocol).
+ * The Mat keeps the buffer alive (and out of the buffer pool) as long as the object or one of its views exists.
+ * @brief The ImageObject struct
+ */
+typedef struct
+{
+    PyObject_HEAD
+    Mat *image;
+    Py_ssize_t shape[3];
+    Py_ssize_t strides[3];
+} ImageObject;
+
+/**
+ * View of a Python buffer wrapped in a Mat without copy.
+ * The buffer is released when the view is destroyed, which must happen with the GIL held.
+ * @brief The BufferView struct
+ */
+struct BufferView
+{
+    BufferView()
+    {
+        view.obj = NULL;
+    }
+
+    ~BufferView()
+    {
+        if(view.obj != NULL)
+        {
+            PyBuffer_Release(&view);
+        }
+    }
+
+    Py_buffer view;
+    Mat image;
+};
+
+static PyTypeObject ImageType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+/**
+ * Returns a new reference to an Image object sharing the data of image (float, 1 or 3 channels),
+ * or None if the image is empty.
+ * @brief newImageObject
+ * @param image
+ * @return
+ */
+static PyObject* newImageObject(const Mat &image)
+{
+    if(image.empty())
+    {
+        Py_RETURN_NONE;
+    }
+
+    ImageObject *object = PyObject_New(ImageObject, &ImageType);
+
+    if(object == NULL)
+    {
+        return NULL;
+    }
+
+    object->image = new Mat(image);
+
+    object->shape[0] = image.rows;
+    object->shape[1] = image.cols;
+    object->shape[2] = image.channels();
+
+    object->strides[0] = image.step[0];
+    object->strides[1] = image.elemSize();
+    object->strides[2] = image.elemSize1();
+
+    return (PyObject*) object;
+}
+
+/**
+ * Deletes the Mat of an Image object : the buffer goes back to the buffer pool if it is not shared anymore.
+ * @brief imageDealloc
+ * @param object
+ */
+static void imageDealloc(PyObject *object)
+{
+    delete ((ImageObject*) object)->image;
+
+    Py_TYPE(object)->tp_free(object);
+}
+
+/**
+ * Buffer protocol : exports the memory of the image (float32, shape (rows, cols) or (rows, cols, channels)).
+ * @brief imageGetBuffer
+ * @param object
+ * @param view
+ * @param flags
+ * @return 0 or -1 with a BufferError if the consumer asks for a layout that the image does not have.
+ */
+static int imageGetBuffer(PyObject *object, Py_buffer *view, int flags)
+{
+    ImageObject *imageObject = (ImageObject*) object;
+    const Mat &image = *imageObject->image;
+
+    bool strided = (flags & PyBUF_STRIDES) == PyBUF_STRIDES;
+
+    if((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS || (!image.isContinuous() && (!strided || (flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS
+                                                                                       || (flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS)))
+    {
+        PyErr_SetString(PyExc_BufferError, "The image is not contiguous in the requested order");
+        view->obj = NULL;
+        return -1;
+    }
+
+    view->obj = object;
+    view->buf = image.data;
+    view->len = (Py_ssize_t) image.rows*image.cols*image.elemSize();
+    view->readonly = 0;
+    view->itemsize = image.elemSize1();
+    view->format = (flags & PyBUF_FORMAT) ? (char*) "f" : NULL;
+    view->ndim = image.channels() == 1 ? 2 : 3;
+    view->shape = (flags & PyBUF_ND) ? imageObject->shape : NULL;
+    view->strides = strided ? imageObject->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+
+    Py_INCREF(object);
+
+    return 0;
+}
+
+/**
+ * Returns the shape of the image as a tuple (rows, cols, channels).
+ * @brief imageShape
+ * @param object
+ * @return
+ */
+static PyObject* imageShape(PyObject *object, void*)
+{
+    ImageObject *imageObject = (ImageObject*) object;
+
+    return Py_BuildValue("(nnn)", imageObject->shape[0], imageObject->shape[1], imageObject->shape[2]);
+}
+
+static PyBufferProcs imageBufferProcs = {imageGetBuffer, NULL};
+
+static PyGetSetDef imageGetSet[] = {
+    {(char*) "shape", imageShape, NULL, (char*) "(rows, cols, channels)", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+/**
+ * Wraps a float32 buffer of shape (rows, cols, channels) in a Mat without copy.
+ * A buffer of shape (rows, cols) is accepted for one channel.
+ * @brief wrapBuffer
+ * @param object
+ * @param channels number of channels of the image, or 0 to accept 1 or 3 channels.
+ * @param writable set to true for the functions that modify the image in place.
+ * @param buffer
+ * @return false with a Python exception if the buffer cannot be wrapped.
+ */
+static bool wrapBuffer(PyObject *object, int channels, bool writable, BufferView &buffer)
+{
+    if(PyObject_GetBuffer(object, &buffer.view, PyBUF_RECORDS_RO | (writable ? PyBUF_WRITABLE : 0)) != 0)
+    {
+        return false;
+    }
+
+    const Py_buffer &view = buffer.view;
+    string format = view.format != NULL ? view.format : "B";
+
+    if(format != "f" && format != "=f" && format != "@f")
+    {
+        PyErr_SetString(PyExc_TypeError, "The images must be float32 arrays");
+        return false;
+    }
+
+    int imageChannels = view.ndim == 3 ? (int) view.shape[2] : 1;
+    bool validChannels = channels == 0 ? (imageChannels == 1 || imageChannels == 3) : imageChannels == channels;
+
+    if((view.ndim != 2 && view.ndim != 3) || !validChannels || view.shape[0] <= 0 || view.shape[1] <= 0)
+    {
+        PyErr_Format(PyExc_ValueError, "The images must have a shape (rows, cols, %d)", channels == 0 ? 3 : channels);
+        return false;
+    }
+
+    Py_ssize_t pixelSize = imageChannels*sizeof(float);
+
+    if((view.ndim == 3 && view.strides[2] != sizeof(float)) || view.strides[1] != pixelSize
+       || view.strides[0] < view.shape[1]*pixelSize || view.strides[0] % sizeof(float) != 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "The pixels of each row of the images must be contiguous");
+        return false;
+    }
+
+    buffer.image = Mat(view.shape[0], view.shape[1], CV_32FC(imageChannels), view.buf, view.strides[0]);
+
+    return true;
+}
+
+/**
+ * Wraps a sequence of numberOfGradients() float32 buffers of shape (rows, cols, 3).
+ * @brief wrapGradients
+ * @param sequence
+ * @param writable
+ * @param buffers
+ * @param images
+ * @return false with a Python exception if the gradients cannot be wrapped.
+ */
+static bool wrapGradients(PyObject *sequence, bool writable, BufferView buffers[], Mat images[])
+{
+    if(!PySequence_Check(sequence) || PySequence_Size(sequence) != numberOfGradients())
+    {
+        PyErr_Format(PyExc_ValueError, "The gradients must be a sequence of %d images", numberOfGradients());
+        return false;
+    }
+
+    for(int k = 0 ; k<numberOfGradients() ; k++)
+    {
+        PyObject *item = PySequence_GetItem(sequence, k);
+
+        if(item == NULL)
+        {
+            return false;
+        }
+
+        bool wrapped = wrapBuffer(item, 3, writable, buffers[k]);
+
+        Py_DECREF(item);
+
+        if(!wrapped)
+        {
+            return false;
+        }
+
+        if(buffers[k].image.rows != buffers[0].image.rows || buffers[k].image.cols != buffers[0].image.cols)
+        {
+            PyErr_SetString(PyExc_ValueError, "The gradients must have the same size");
+            return false;
+        }
+
+        images[k] = buffers[k].image;
+    }
+
+    return true;
+}
+
+/**
+ * Checks that two wrapped images have the same size.
+ * @brief checkSameSize
+ * @param image
+ * @param mask
+ * @return false with a Python exception otherwise.
+ */
+static bool checkSameSize(const Mat &image, const Mat &mask)
+{
+    if(image.rows != mask.rows || image.cols != mask.cols)
+    {
+        PyErr_SetString(PyExc_ValueError, "The image and the mask must have the same size");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Runs a computation without the GIL. The OpenCV exceptions are converted to RuntimeError.
+ * The buffers used by the computation must stay wrapped (and the Python objects alive) until it returns.
+ * @brief runWithoutGIL
+ * @param computation
+ * @return false with a Python exception if the computation threw an exception.
+ */
+template <typename Computation>
+static bool runWithoutGIL(Computation computation)
+{
+    string error;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    try
+    {
+        computation();
+    }
+    catch(const std::exception &exception)
+    {
+        error = exception.what();
+    }
+
+    Py_END_ALLOW_THREADS
+
+    if(!error.empty())
+    {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Returns a new list of Image objects.
+ * @brief newImageList
+ * @param images
+ * @param numberOfImages
+ * @return
+ */
+static PyObject* newImageList(const Mat images[], int numberOfImages)
+{
+    PyObject *list = PyList_New(numberOfImages);
+
+    for(int k = 0 ; list != NULL && k<numberOfImages ; k++)
+    {
+        PyObject *image = newImageObject(images[k]);
+
+        if(image == NULL)
+        {
+            Py_DECREF(list);
+            return NULL;
+        }
+
+        PyList_SET_ITEM(list, k, image);
+    }
+
+    return list;
+}
+
+/**
+ * load_gradients(path, sub_folder, first_image_number, region=None) -> list of Image
+ * Ingest : loads the gradients of a folder (par or cross), removes the gamma and the ambient illumination
+ * and averages the shots (set_number_of_shots).
+ * @brief loadGradients
+ * @param arguments
+ * @param keywordArguments
+ * @return
+ */
+static PyObject* loadGradients(PyObject*, PyObject *arguments, PyObject *keywordArguments)
+{
+    static const char *keywords[] = {"path", "sub_folder", "first_image_number", "region", NULL};
+
+    const char *path;
+    const char *subFolder;
+    unsigned int firstImageNumber;
+    Rect region;
+
+    if(!PyArg_ParseTupleAndKeywords(arguments, keywordArguments, "ssI|(iiii)", (char**) keywords, &path, &subFolder, &firstImageNumber,
+                                    &region.x, &region.y, &region.width, &region.height))
+    {
+        return NULL;
+    }
+
+    Mat images[MAXIMUM_NUMBER_OF_GRADIENTS];
+    bool loaded = false;
+
+    if(!runWithoutGIL([&]() { loaded = loadGradientImages(path, subFolder, firstImageNumber, images, region); }))
+    {
+        return NULL;
+    }
+
+    if(!loaded)
+    {
+        PyErr_Format(PyExc_IOError, "Could not load the gradients of %s/%s", path, subFolder);
+        return NULL;
+    }
+
+    return newImageList(images, numberOfGradients());
+}
+
+/**
+ * load_mask(path, region=None) -> Image
+ * Loads the linear mask of a capture (mask.JPG).
+ * @brief loadMask
+ * @param arguments
+ * @param keywordArguments
+ * @return
+ */
+static PyObject* loadMask(PyObject*, PyObject *arguments, PyObject *keywordArguments)
+{
+    static const char *keywords[] = {"path", "region", NULL};
+
+    const char *path;
+    Rect region;
+
+    if(!PyArg_ParseTupleAndKeywords(arguments, keywordArguments, "s|(iiii)", (char**) keywords, &path,
+                                    &region.x, &region.y, &region.width, &region.height))
+    {
+        return NULL;
+    }
+
+    Mat mask;
+    bool loaded = false;
+
+    if(!runWithoutGIL([&]() { loaded = loadLinearImage(string(path) + "/mask.JPG", mask, false, region); }))
+    {
+        return NULL;
+    }
+
+    if(!loaded)
+    {
+        PyErr_Format(PyExc_IOError, "Could not load the mask of %s", path);
+        return NULL;
+    }
+
+    return newImageObject(mask);
+}
+
+/**
+ * read_checker_ratios(path, cross=True) -> (ratio_par, ratio_cross)
+ * Reads the checkerchart ratios (BGR tuples). ratio_cross is None without cross polarised data.
+ * @brief readCheckerRatios
+ * @param arguments
+ * @param keywordArguments
+ * @return
+ */
+static PyObject* readCheckerRatios(PyObject*, PyObject *arguments, PyObject *keywordArguments)
+{
+    static const char *keywords[] = {"path", "cross", NULL};
+
+    const char *path;
+    int isCrossData = 1;
+
+    if(!PyArg_ParseTupleAndKeywords(arguments, keywordArguments, "s|p", (char**) keywords, &path, &isCrossData))
+    {
+        return NULL;
+    }
+
+    Vec3f ratioPar, ratioCross;
+
+    if(!readCheckerchartRatios(path, isCrossData, ratioPar, ratioCross))
+    {
+        PyErr_Format(PyExc_IOError, "Could not read the checkerchart values of %s", path);
+        return NULL;
+    }
+
+    if(!isCrossData)
+    {
+        return Py_BuildValue("((fff)O)", ratioPar[0], ratioPar[1], ratioPar[2], Py_None);
+    }
+
+    return Py_BuildValue("((fff)(fff))", ratioPar[0], ratioPar[1], ratioPar[2], ratioCross[0], ratioCross[1], ratioCross[2]);
+}
+
+/**
+ * apply_checker_ratios(gradients, ratio)
+ * Checker scaling : multiplies the gradients in place by the BGR ratio.
+ * @brief applyCheckerRatios
+ * @param arguments
+ * @return
+ */
+static PyObject* applyCheckerRatios(PyObject*, PyObject *arguments)
+{
+    PyObject *sequence;
+    Vec3f ratio;
+
+    if(!PyArg_ParseTuple(arguments, "O(fff)", &sequence, &ratio[0], &ratio[1], &ratio[2]))
+    {
+        return NULL;
+    }
+
+    BufferView buffers[MAXIMUM_NUMBER_OF_GRADIENTS];
+    Mat images[MAXIMUM_NUMBER_OF_GRADIENTS];
+
+    if(!wrapGradients(sequence, true, buffers, images)
+       || !runWithoutGIL([&]() { applyCheckerchartRatios(images, numberOfGradients(), ratio); }))
+    {
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * scale_to_01_range(image, mask) -> float
+ * Divides the image in place by its maximum inside the mask and returns the maximum.
+ * @brief scaleTo01RangeInPlace
+ * @param arguments
+ * @return
+ */
+static PyObject* scaleTo01RangeInPlace(PyObject*, PyObject *arguments)
+{
+    PyObject *imageObject, *maskObject;
+
+    if(!PyArg_ParseTuple(arguments, "OO", &imageObject, &maskObject))
+    {
+        return NULL;
+    }
+
+    BufferView image, mask;
+    float maximum = 0.0f;
+
+    if(!wrapBuffer(imageObject, 3, true, image) || !wrapBuffer(maskObject, 3, false, mask) || !checkSameSize(image.image, mask.image)
+       || !runWithoutGIL([&]() { maximum = maximumInMask(image.image, mask.image); divideByMaximum(image.image, maximum); }))
+    {
+        return NULL;
+    }
+
+    return PyFloat_FromDouble(maximum);
+}
+
+/**
+ * separate(parallel, cross=None) -> (diffuse, specular)
+ * Separates the diffuse and specular albedos of the order 0 gradients. diffuse is None without cross image.
+ * @brief separate
+ * @param arguments
+ * @param keywordArguments
+ * @return
+ */
+static PyObject* separate(PyObject*, PyObject *arguments, PyObject *keywordArguments)
+{
+    static const char *keywords[] = {"parallel", "cross", NULL};
+
+    PyObject *parallelObject;
+    PyObject *crossObject = Py_None;
+
+    if(!PyArg_ParseTupleAndKeywords(arguments, keywordArguments, "O|O", (char**) keywords, &parallelObject, &crossObject))
+    {
+        return NULL;
+    }
+
+    BufferView parallel, cross;
+
+    if(!wrapBuffer(parallelObject, 3, false, parallel)
+       || (crossObject != Py_None && (!wrapBuffer(crossObject, 3, false, cross) || !checkSameSize(parallel.image, cross.image))))
+    {
+        return NULL;
+    }
+
+    Mat diffuse, specular;
+
+    if(!runWithoutGIL([&]() { separateDiffuseSpecular(parallel.image, cross.image, diffuse, specular); }))
+    {
+        return NULL;
+    }
+
+    PyObject *diffuseObject = newImageObject(diffuse);
+    PyObject *specularObject = newImageObject(specular);
+
+    if(diffuseObject == NULL || specularObject == NULL)
+    {
+        Py_XDECREF(diffuseObject);
+        Py_XDECREF(specularObject);
+        return NULL;
+    }
+
+    return Py_BuildValue("(NN)", diffuseObject, specularObject);
+}
+
+/**
+ * normals(gradients) -> Image
+ * Specular normals (XYZ, not aligned) of the parallel polarised gradients.
+ * @brief normals
+ * @param arguments
+ * @return
+ */
+static PyObject* normals(PyObject*, PyObject *arguments)
+{
+    PyObject *sequence;
+
+    if(!PyArg_ParseTuple(arguments, "O", &sequence))
+    {
+        return NULL;
+    }
+
+    BufferView buffers[MAXIMUM_NUMBER_OF_GRADIENTS];
+    Mat images[MAXIMUM_NUMBER_OF_GRADIENTS];
+    Mat normalMap;
+
+    if(!wrapGradients(sequence, false, buffers, images) || !runWithoutGIL([&]() { computeSpecularNormals(images, NULL, normalMap); }))
+    {
+        return NULL;
+    }
+
+    return newImageObject(normalMap);
+}
+
+/**
+ * roughness(gradients) -> Image
+ * Roughness of the parallel polarised gradients.
+ * @brief roughness
+ * @param arguments
+ * @return
+ */
+static PyObject* roughness(PyObject*, PyObject *arguments)
+{
+    PyObject *sequence;
+
+    if(!PyArg_ParseTuple(arguments, "O", &sequence))
+    {
+        return NULL;
+    }
+
+    BufferView buffers[MAXIMUM_NUMBER_OF_GRADIENTS];
+    Mat images[MAXIMUM_NUMBER_OF_GRADIENTS];
+    Mat roughnessMap;
+
+    if(!wrapGradients(sequence, false, buffers, images) || !runWithoutGIL([&]() { computeRoughnessMap(images, roughnessMap); }))
+    {
+        return NULL;
+    }
+
+    return newImageObject(roughnessMap);
+}
+
+/**
+ * channel_maps(gradients) -> (blue_normals, green_normals, red_normals, roughness)
+ * Normals of each colour channel and roughness of the parallel polarised gradients in a single pass.
+ * @brief channelMaps
+ * @param arguments
+ * @return
+ */
+static PyObject* channelMaps(PyObject*, PyObject *arguments)
+{
+    PyObject *sequence;
+
+    if(!PyArg_ParseTuple(arguments, "O", &sequence))
+    {
+        return NULL;
+    }
+
+    BufferView buffers[MAXIMUM_NUMBER_OF_GRADIENTS];
+    Mat images[MAXIMUM_NUMBER_OF_GRADIENTS];
+    Mat maps[4];
+
+    if(!wrapGradients(sequence, false, buffers, images)
+       || !runWithoutGIL([&]() { computeChannelNormalsAndRoughness(images, maps[0], maps[1], maps[2], maps[3]); }))
+    {
+        return NULL;
+    }
+
+    PyObject *list = newImageList(maps, 4);
+
+    if(list == NULL)
+    {
+        return NULL;
+    }
+
+    PyObject *tuple = PyList_AsTuple(list);
+    Py_DECREF(list);
+
+    return tuple;
+}
+
+/**
+ * align_normals(normals, mask) -> (x, y, z)
+ * Rotates the normals in place so that their average inside the mask is (0,0,1) and returns the average normal.
+ * @brief alignNormals
+ * @param arguments
+ * @return
+ */
+static PyObject* alignNormals(PyObject*, PyObject *arguments)
+{
+    PyObject *normalsObject, *maskObject;
+
+    if(!PyArg_ParseTuple(arguments, "OO", &normalsObject, &maskObject))
+    {
+        return NULL;
+    }
+
+    BufferView normalMap, mask;
+    Mat averageNormal;
+
+    if(!wrapBuffer(normalsObject, 3, true, normalMap) || !wrapBuffer(maskObject, 3, false, mask) || !checkSameSize(normalMap.image, mask.image))
+    {
+        return NULL;
+    }
+
+    bool aligned = runWithoutGIL([&]()
+    {
+        double normalSum[3] = {0.0, 0.0, 0.0};
+        double numberOfNormals = 0.0;
+
+        accumulateSurfaceNormals(normalMap.image, mask.image, normalSum, numberOfNormals);
+
+        averageNormal = averageSurfaceNormal(normalSum, numberOfNormals);
+
+        rotateNormals(normalMap.image, averageNormal);
+    });
+
+    if(!aligned)
+    {
+        return NULL;
+    }
+
+    return Py_BuildValue("(fff)", averageNormal.at<float>(0,0), averageNormal.at<float>(1,0), averageNormal.at<float>(2,0));
+}
+
+/**
+ * load_pfm(file_path) -> Image
+ * @brief loadPFMImage
+ * @param arguments
+ * @return
+ */
+static PyObject* loadPFMImage(PyObject*, PyObject *arguments)
+{
+    const char *filePath;
+
+    if(!PyArg_ParseTuple(arguments, "s", &filePath))
+    {
+        return NULL;
+    }
+
+    Mat image;
+
+    if(!runWithoutGIL([&]() { image = loadPFM(filePath); }))
+    {
+        return NULL;
+    }
+
+    if(image.empty())
+    {
+        PyErr_Format(PyExc_IOError, "Could not load %s", filePath);
+        return NULL;
+    }
+
+    return newImageObject(image);
+}
+
+/**
+ * save_pfm(image, file_path)
+ * Saves a float32 buffer of shape (rows, cols, 3) or (rows, cols) as a PFM file.
+ * @brief savePFMImage
+ * @param arguments
+ * @return
+ */
+static PyObject* savePFMImage(PyObject*, PyObject *arguments)
+{
+    PyObject *imageObject;
+    const char *filePath;
+
+    if(!PyArg_ParseTuple(arguments, "Os", &imageObject, &filePath))
+    {
+        return NULL;
+    }
+
+    BufferView image;
+    bool saved = false;
+
+    if(!wrapBuffer(imageObject, 0, false, image) || !runWithoutGIL([&]() { saved = savePFM(image.image, filePath); }))
+    {
+        return NULL;
+    }
+
+    if(!saved)
+    {
+        PyErr_Format(PyExc_IOError, "Could not write %s", filePath);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * compute_capture(path, cross=True) -> dict
+ * Computes the maps of a whole capture as the program does (files written in the textures folder)
+ * and returns them : diffuse (None without cross data), specular, normals (aligned), roughness, height,
+ * red_normals and blue_normals (None unless set_per_channel_maps(True)), diffuse_normals (None unless
+ * set_diffuse_normals(True) with cross data) and noise (None unless computed).
+ * @brief computeCapture
+ * @param arguments
+ * @param keywordArguments
+ * @return
+ */
+static PyObject* computeCapture(PyObject*, PyObject *arguments, PyObject *keywordArguments)
+{
+    static const char *keywords[] = {"path", "cross", NULL};
+
+    const char *path;
+    int isCrossData = 1;
+
+    if(!PyArg_ParseTupleAndKeywords(arguments, keywordArguments, "s|p", (char**) keywords, &path, &isCrossData))
+    {
+        return NULL;
+    }
+
+    CaptureTile capture;
+    bool computed = false;
+    vector<string> failedFiles;
+
+    if(!runWithoutGIL([&]() { computed = computeCaptureMaps(path, isCrossData, capture) && waitForOutputs(path, failedFiles); }))
+    {
+        return NULL;
+    }
+
+    if(!computed)
+    {
+        reportFailedOutputs(failedFiles);
+        PyErr_Format(PyExc_IOError, "Could not compute the maps of %s", path);
+        return NULL;
+    }
+
+    const ReflectanceMaps &maps = capture.maps;
+
+    return Py_BuildValue("{sNsNsNsNsNsNsNsNsN}", "diffuse", newImageObject(maps.diffuse), "specular", newImageObject(maps.specular),
+                         "normals", newImageObject(maps.normals), "roughness", newImageObject(maps.roughness),
+                         "height", newImageObject(maps.height), "red_normals", newImageObject(maps.redNormals),
+                         "blue_normals", newImageObject(maps.blueNormals), "diffuse_normals", newImageObject(maps.diffuseNormals),
+                         "noise", newImageObject(maps.noise));
+}
+
+/**
+ * compute_region(path, region, cross=True) -> dict
+ * Computes the maps of a region (x, y, width, height) of a capture with the statistics of the last
+ * compute_capture (or run of the program) on it and returns them : diffuse (None without cross data), specular,
+ * normals (aligned), roughness, red_normals and blue_normals (None unless set_per_channel_maps(True))
+ * and diffuse_normals (None unless set_diffuse_normals(True) with cross data).
+ * The decoded images of the capture are kept for the next regions : only the region is converted and computed.
+ * @brief computeRegion
+ * @param arguments
+ * @param keywordArguments
+ * @return
+ */
+static PyObject* computeRegion(PyObject*, PyObject *arguments, PyObject *keywordArguments)
+{
+    static const char *keywords[] = {"path", "region", "cross", NULL};
+
+    const char *path;
+    Rect region;
+    int isCrossData = 1;
+
+    if(!PyArg_ParseTupleAndKeywords(arguments, keywordArguments, "s(iiii)|p", (char**) keywords, &path,
+                                    &region.x, &region.y, &region.width, &region.height, &isCrossData))
+    {
+        return NULL;
+    }
+
+    CaptureTile tile;
+    bool computed = false;
+
+    if(!runWithoutGIL([&]() { computed = computeRegionMaps(path, isCrossData, region, tile, true); }))
+    {
+        return NULL;
+    }
+
+    if(!computed)
+    {
+        PyErr_Format(PyExc_ValueError, "Could not compute the region of %s (compute the whole capture first)", path);
+        return NULL;
+    }
+
+    const ReflectanceMaps &maps = tile.maps;
+
+    return Py_BuildValue("{sNsNsNsNsNsNsN}", "diffuse", newImageObject(maps.diffuse), "specular", newImageObject(maps.specular),
+                         "normals", newImageObject(maps.normals), "roughness", newImageObject(maps.roughness),
+                         "red_normals", newImageObject(maps.redNormals), "blue_normals", newImageObject(maps.blueNormals),
+                         "diffuse_normals", newImageObject(maps.diffuseNormals));
+}
+
+/**
+ * set_number_of_shots(n)
+ * Number of shots of each gradient averaged by load_gradients and compute_capture (see multishot.h).
+ * The settings are global : they must be set before the computations start.
+ * @brief setShots
+ * @param arguments
+ * @return
+ */
+static PyObject* setShots(PyObject*, PyObject *arguments)
+{
+    int shots;
+
+    if(!PyArg_ParseTuple(arguments, "i", &shots))
+    {
+        return NULL;
+    }
+
+    if(shots <= 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "The number of shots must be positive");
+        return NULL;
+    }
+
+    setNumberOfShots(shots);
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * set_per_channel_maps(enabled)
+ * Computes the normals and the roughness of each colour channel in compute_capture.
+ * @brief setChannelMaps
+ * @param arguments
+ * @return
+ */
+static PyObject* setChannelMaps(PyObject*, PyObject *arguments)
+{
+    int enabled;
+
+    if(!PyArg_ParseTuple(arguments, "p", &enabled))
+    {
+        return NULL;
+    }
+
+    setPerChannelMaps(enabled);
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * set_diffuse_normals(enabled)
+ * Computes the diffuse normals of the cross polarised data in the same pass as the specular normals in compute_capture.
+ * @brief setDiffuseNormals
+ * @param arguments
+ * @return
+ */
+static PyObject* setDiffuseNormals(PyObject*, PyObject *arguments)
+{
+    int enabled;
+
+    if(!PyArg_ParseTuple(arguments, "p", &enabled))
+    {
+        return NULL;
+    }
+
+    setDiffuseNormalsEnabled(enabled);
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * set_precision(precision)
+ * Precision of the square roots and divisions of the normals and the roughness : "exact", "fast" or "approximate"
+ * (see kernelprecision.h for the maximum errors of each tier).
+ * @brief setPrecision
+ * @param arguments
+ * @return
+ */
+static PyObject* setPrecision(PyObject*, PyObject *arguments)
+{
+    const char *name;
+
+    if(!PyArg_ParseTuple(arguments, "s", &name))
+    {
+        return NULL;
+    }
+
+    KernelPrecision precision = EXACT_PRECISION;
+
+    if(!parseKernelPrecision(name, precision))
+    {
+        PyErr_Format(PyExc_ValueError, "Invalid precision %s (exact, fast or approximate)", name);
+        return NULL;
+    }
+
+    setKernelPrecision(precision);
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * set_microfacet_model(model, fresnel_albedo=False)
+ * Microfacet model of the roughness computed by compute_capture and compute_region : "none", "beckmann" or "ggx"
+ * (see microfacet.h). With fresnel_albedo the specular albedo is divided by the directional albedo of the model.
+ * @brief setMicrofacet
+ * @param arguments
+ * @param keywordArguments
+ * @return
+ */
+static PyObject* setMicrofacet(PyObject*, PyObject *arguments, PyObject *keywordArguments)
+{
+    static const char *keywords[] = {"model", "fresnel_albedo", NULL};
+
+    const char *name;
+    int fresnelAlbedo = 0;
+
+    if(!PyArg_ParseTupleAndKeywords(arguments, keywordArguments, "s|p", (char**) keywords, &name, &fresnelAlbedo))
+    {
+        return NULL;
+    }
+
+    MicrofacetModel model = NO_MICROFACET_MODEL;
+
+    if(!parseMicrofacetModel(name, model))
+    {
+        PyErr_Format(PyExc_ValueError, "Invalid microfacet model %s (none, beckmann or ggx)", name);
+        return NULL;
+    }
+
+    setMicrofacetModel(model);
+    setFresnelAlbedoEnabled(fresnelAlbedo);
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * set_flat_field(file_path)
+ * Applies the gains of a flat field calibration to the captures loaded by compute_capture and compute_region
+ * (see calibration.h). An empty path disables the correction.
+ * @brief setFlatField
+ * @param arguments
+ * @return
+ */
+static PyObject* setFlatField(PyObject*, PyObject *arguments)
+{
+    const char *calibrationFile;
+
+    if(!PyArg_ParseTuple(arguments, "s", &calibrationFile))
+    {
+        return NULL;
+    }
+
+    setFlatFieldFile(calibrationFile);
+
+    const FlatField *flatField = NULL;
+
+    if(!currentFlatField(flatField))
+    {
+        setFlatFieldFile("");
+        PyErr_Format(PyExc_IOError, "Could not load the flat field calibration %s", calibrationFile);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * set_illumination_patterns(file_path)
+ * Describes the illumination patterns of the captures (see illumination.h), for the rigs other than the LCD screen.
+ * An empty path restores the gradients of the LCD screen.
+ * @brief setIlluminationPatterns
+ * @param arguments
+ * @return
+ */
+static PyObject* setIlluminationPatterns(PyObject*, PyObject *arguments)
+{
+    const char *descriptionFile;
+
+    if(!PyArg_ParseTuple(arguments, "s", &descriptionFile))
+    {
+        return NULL;
+    }
+
+    if(!setIlluminationPatternsFile(descriptionFile))
+    {
+        PyErr_Format(PyExc_IOError, "Could not load the illumination patterns %s", descriptionFile);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * number_of_gradients() -> int
+ * Number of gradients of the captures : 7 for the LCD screen, the number of patterns of set_illumination_patterns otherwise.
+ * @brief gradientCount
+ * @return
+ */
+static PyObject* gradientCount(PyObject*, PyObject*)
+{
+    return PyLong_FromLong(numberOfGradients());
+}
+
+static PyMethodDef moduleMethods[] = {
+    {"load_gradients", (PyCFunction)(void(*)(void)) loadGradients, METH_VARARGS | METH_KEYWORDS,
+     "load_gradients(path, sub_folder, first_image_number, region=None) -> list of Image\n"
+     "Loads the linear gradients of a folder without the ambient illumination. region is (x, y, width, height)."},
+    {"load_mask", (PyCFunction)(void(*)(void)) loadMask, METH_VARARGS | METH_KEYWORDS,
+     "load_mask(path, region=None) -> Image\nLoads the linear mask of a capture."},
+    {"read_checker_ratios", (PyCFunction)(void(*)(void)) readCheckerRatios, METH_VARARGS | METH_KEYWORDS,
+     "read_checker_ratios(path, cross=True) -> (ratio_par, ratio_cross)\nBGR checkerchart ratios of a capture."},
+    {"apply_checker_ratios", applyCheckerRatios, METH_VARARGS,
+     "apply_checker_ratios(gradients, ratio)\nMultiplies the gradients in place by the BGR ratio."},
+    {"scale_to_01_range", scaleTo01RangeInPlace, METH_VARARGS,
+     "scale_to_01_range(image, mask) -> float\nDivides the image in place by its maximum inside the mask and returns the maximum."},
+    {"separate", (PyCFunction)(void(*)(void)) separate, METH_VARARGS | METH_KEYWORDS,
+     "separate(parallel, cross=None) -> (diffuse, specular)\nDiffuse and specular albedos of the order 0 gradients."},
+    {"normals", normals, METH_VARARGS,
+     "normals(gradients) -> Image\nSpecular normals (XYZ, not aligned) of the parallel polarised gradients."},
+    {"roughness", roughness, METH_VARARGS,
+     "roughness(gradients) -> Image\nRoughness of the parallel polarised gradients."},
+    {"channel_maps", channelMaps, METH_VARARGS,
+     "channel_maps(gradients) -> (blue_normals, green_normals, red_normals, roughness)\nMaps of each colour channel in a single pass."},
+    {"align_normals", alignNormals, METH_VARARGS,
+     "align_normals(normals, mask) -> (x, y, z)\nAligns the average normal inside the mask with (0,0,1) in place and returns it."},
+    {"load_pfm", loadPFMImage, METH_VARARGS, "load_pfm(file_path) -> Image"},
+    {"save_pfm", savePFMImage, METH_VARARGS, "save_pfm(image, file_path)\nSaves a float32 image with 1 or 3 channels (BGR)."},
+    {"compute_capture", (PyCFunction)(void(*)(void)) computeCapture, METH_VARARGS | METH_KEYWORDS,
+     "compute_capture(path, cross=True) -> dict\nComputes and saves the maps of a whole capture and returns them."},
+    {"compute_region", (PyCFunction)(void(*)(void)) computeRegion, METH_VARARGS | METH_KEYWORDS,
+     "compute_region(path, region, cross=True) -> dict\nComputes the maps of a region (x, y, width, height) with the statistics of the capture."},
+    {"set_number_of_shots", setShots, METH_VARARGS, "set_number_of_shots(n)\nNumber of shots averaged per gradient."},
+    {"set_per_channel_maps", setChannelMaps, METH_VARARGS,
+     "set_per_channel_maps(enabled)\nComputes the normals and the roughness of each colour channel in compute_capture."},
+    {"set_diffuse_normals", setDiffuseNormals, METH_VARARGS,
+     "set_diffuse_normals(enabled)\nComputes the diffuse normals of the cross polarised data in compute_capture."},
+    {"set_precision", setPrecision, METH_VARARGS,
+     "set_precision(precision)\nPrecision of the normals and roughness solvers : exact, fast or approximate."},
+    {"set_microfacet_model", (PyCFunction)(void(*)(void)) setMicrofacet, METH_VARARGS | METH_KEYWORDS,
+     "set_microfacet_model(model, fresnel_albedo=False)\nRoughness as the alpha of none, beckmann or ggx, optionally the Fresnel adjusted specular albedo."},
+    {"set_flat_field", setFlatField, METH_VARARGS,
+     "set_flat_field(file_path)\nApplies the gains of a flat field calibration in compute_capture and compute_region."},
+    {"set_illumination_patterns", setIlluminationPatterns, METH_VARARGS,
+     "set_illumination_patterns(file_path)\nDescription of the illumination patterns of the rig, an empty path for the LCD screen."},
+    {"number_of_gradients", gradientCount, METH_NOARGS,
+     "number_of_gradients() -> int\nNumber of gradients of the captures (sequences of the gradients)."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyModuleDef moduleDefinition = {
+    PyModuleDef_HEAD_INIT, "reflectance_maps",
+    "Stages of the computation of the reflectance maps. The images are shared with numpy without copies.",
+    -1, moduleMethods, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_reflectance_maps(void)
+{
+    ImageType.tp_name = "reflectance_maps.Image";
+    ImageType.tp_basicsize = sizeof(ImageObject);
+    ImageType.tp_dealloc = imageDealloc;
+    ImageType.tp_as_buffer = &imageBufferProcs;
+    ImageType.tp_getset = imageGetSet;
+    ImageType.tp_flags = Py_TPFLAGS_DEFAULT;
+    ImageType.tp_doc = "Image computed by the module. numpy.asarray(image) is a view of its memory (float32, BGR).";
+
+    if(PyType_Ready(&ImageType) < 0)
+    {
+        return NULL;
+    }
+
+    PyObject *module = PyModule_Create(&moduleDefinition);
+
+    if(module == NULL)
+    {
+        return NULL;
+    }
+
+    Py_INCREF(&ImageType);
+
+    if(PyModule_AddObject(module, "Image", (PyObject*) &ImageType) < 0
+       || PyModule_AddIntConstant(module, "NUMBER_OF_GRADIENT_ILLUMINATION", NUMBER_OF_GRADIENT_ILLUMINATION) < 0
+       || PyModule_AddIntConstant(module, "PARALLEL_FIRST_IMAGE_NUMBER", PARALLEL_FIRST_IMAGE_NUMBER) < 0
+       || PyModule_AddIntConstant(module, "CROSS_FIRST_IMAGE_NUMBER", CROSS_FIRST_IMAGE_NUMBER) < 0)
+    {
+        Py_DECREF(&ImageType);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    return module;
+}
@@ -0,0 +1,53 @@
+#
+#     Reflectance Maps
+#
+#     Python bindings of the stages of the computation (see reflectancemapsmodule.cpp).
+#     Compiles the sources of the program (except main.cpp) in the module, with the same libraries
+#     as reflectance_maps.pro (OpenCV 2.4 and Qt), found with pkg-config :
+#
+#         cd src/python
+#         python3 setup.py build_ext --inplace
+#
+
+import glob
+import os
+import subprocess
+import sys
+
+from setuptools import setup, Extension
+
+sourceFolder = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+
+
+def packageFlags(option, packages):
+    try:
+        return subprocess.check_output(['pkg-config', option] + packages).decode().split()
+    except (OSError, subprocess.CalledProcessError):
+        return []
+
+
+packages = ['opencv', 'Qt5Widgets', 'Qt5Gui', 'Qt5Core']
+
+sources = ['reflectancemapsmodule.cpp']
+sources += [path for path in sorted(glob.glob(os.path.join(sourceFolder, '*.cpp'))) if os.path.basename(path) != 'main.cpp']
+
+if os.name == 'nt':
+    sources = [path for path in sources if os.path.basename(path) not in ('distributed.cpp', 'daemon.cpp')]
+
+# The watch folder uses inotify (linux only, as in reflectance_maps.pro)
+if not sys.platform.startswith('linux'):
+    sources = [path for path in sources if os.path.basename(path) != 'watchfolder.cpp']
+
+compileFlags = ['-std=c++11', '-fPIC'] + packageFlags('--cflags', packages)
+
+linkFlags = packageFlags('--libs', packages)
+
+if not linkFlags:
+    linkFlags = ['-L/usr/local/lib', '-lopencv_core', '-lopencv_imgproc', '-lopencv_highgui', '-lopencv_calib3d',
+                 '-lopencv_features2d', '-lQt5Widgets', '-lQt5Gui', '-lQt5Core']
+
+setup(name='reflectance_maps',
+      version='1.0',
+      description='Reflectance maps from polarised gradient illumination',
+      ext_modules=[Extension('reflectance_maps', sources=sources, include_dirs=[sourceFolder, '/usr/local/include'],
+                             extra_compile_args=compileFlags + ['-pthread'], extra_link_args=linkFlags + ['-pthread'])])
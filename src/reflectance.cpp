@@ -38,509 +38,856 @@
  */
 
 #include "reflectance.h"
+#include "capturetile.h"
+#include "kernelprecision.h"
+#include "microfacet.h"
 
 using namespace std;
 using namespace cv;
 
+static bool computePerChannelMaps = false;
+static bool useInterleavedGradients = false;
+static bool computeDiffuseNormals = false;
+
 /**
- * Function to compute the reflectance maps given the path to the data folder and a bool that says if the
- * cross polarised data exists.
- * @brief computeMaps
- * @param pathToFolder
- * @param isCrossData
+ * Gradients stored in separate images (one CV_32FC3 image per gradient).
+ * With Channels = 1 the green channel of each pixel is read, with Channels = 3 its B, G and R channels.
+ * The specular normals and the roughness are computed from the parallel polarised gradients, with or without
+ * cross polarised data. The cross polarised gradients, if given, are read for the diffuse normals only.
  */
-void computeMaps(string pathToFolder, bool isCrossData)
+template<int Channels>
+class SeparateGradients
 {
+public:
+    static const int CHANNELS = Channels;
 
-    //Load the mask object
-    //Mask that represent the area where the calculations are done
-    Mat mask = imread(pathToFolder + "/mask.JPG", CV_LOAD_IMAGE_COLOR);
-
-    if(!mask.data)
-    {
-        cerr << "Could not load image : " << pathToFolder + "/mask.JPG" << endl;
-        exit(-1);
-    }
-    else
-    {
-        mask.convertTo(mask, CV_32FC3);
-        mask /= 255.0;
-    }
+    SeparateGradients(Mat parallelData[], Mat crossData[]) : m_parallelData(parallelData), m_crossData(crossData) {}
 
-    Mat parallelData[NUMBER_OF_GRADIENT_ILLUMINATION];
-    Mat crossData[NUMBER_OF_GRADIENT_ILLUMINATION];
+    int rows() const { return m_parallelData[0].rows; }
+    int cols() const { return m_parallelData[0].cols; }
 
-    ostringstream osstream;
-    unsigned int imageNumberPar = 2855;
-    unsigned int imageNumberCross = 2869;
-
-    /*--Load images parallelPolarised ---*/
-    for(int i = 0 ; i<NUMBER_OF_GRADIENT_ILLUMINATION ; i++)
+    /**
+     * Values of the gradients of one row. n is the index of the value in the row : pixel*Channels+channel.
+     */
+    class Row
     {
-        int imageNumber = imageNumberPar +i;
-
-        osstream <<  pathToFolder << "/par/IMG_" << imageNumber << ".JPG";
-        parallelData[i] = imread(osstream.str(), CV_LOAD_IMAGE_COLOR);
-
-        if(!parallelData[i].data)
+    public:
+        Row(const SeparateGradients &gradients, int i)
         {
-            cerr << "Could not load image : " << osstream.str() << endl;
-            exit(-1);
+            for(int k = 0 ; k<numberOfGradients() ; k++)
+            {
+                m_parallel[k] = gradients.m_parallelData[k].ptr<float>(i);
+                m_cross[k] = gradients.m_crossData ? gradients.m_crossData[k].ptr<float>(i) : NULL;
+            }
         }
-        else
+
+        float operator()(int k, int n) const
         {
-            parallelData[i].convertTo(parallelData[i], CV_32FC3);
-            parallelData[i] /= 255.0;
+            return m_parallel[k][Channels == 3 ? n : 3*n+1];
+        }
 
-            //Remove Gamma
-            removeGammaCorrection(parallelData[i], parallelData[i], 2.2);
+        /**
+         * Value of a cross polarised gradient (diffuse reflection only).
+         */
+        float diffuse(int k, int n) const
+        {
+            return m_cross[k][Channels == 3 ? n : 3*n+1];
         }
 
-        osstream.str("");
-    }
+    private:
+        const float *m_parallel[MAXIMUM_NUMBER_OF_GRADIENTS];
+        const float *m_cross[MAXIMUM_NUMBER_OF_GRADIENTS];
+    };
 
-    /*---Load the ambient illumination---*/
-    Mat ambientPar = imread(pathToFolder + "/par/ambient.JPG", CV_LOAD_IMAGE_COLOR);
+private:
+    Mat *m_parallelData;
+    Mat *m_crossData;
+};
 
-    if(!ambientPar.data)
-    {
-        cerr << "Could not load image : " << pathToFolder + "/par/ambient.JPG" << endl;
-        exit(-1);
-    }
-    else
-    {
-        ambientPar.convertTo(ambientPar, CV_32FC3);
-        ambientPar /= 255.0;
+/**
+ * Green channel of the gradients in the gradient-major layout (interleaveGradients) : one stream for all the gradients.
+ */
+class InterleavedGradients
+{
+public:
+    static const int CHANNELS = 1;
 
-        removeAmbientIllumination(parallelData, NUMBER_OF_GRADIENT_ILLUMINATION, ambientPar);
-    }
+    InterleavedGradients(const Mat &interleaved) : m_interleaved(interleaved) {}
 
-    /*---Load images cross polarised---*/
-    if(isCrossData)
+    int rows() const { return m_interleaved.rows; }
+    int cols() const { return m_interleaved.cols; }
+
+    /**
+     * Values of the gradients of one row. n is the index of the pixel in the row.
+     */
+    class Row
     {
-        for(int i = 0 ; i<NUMBER_OF_GRADIENT_ILLUMINATION ; i++)
+    public:
+        Row(const InterleavedGradients &gradients, int i) : m_values(gradients.m_interleaved.ptr<float>(i)) {}
+
+        float operator()(int k, int n) const
         {
-            int imageNumber = imageNumberCross +i;
+            return m_values[INTERLEAVED_GRADIENT_STRIDE*n+k];
+        }
 
-            osstream << pathToFolder << "/cross/IMG_" << imageNumber << ".JPG";
-            crossData[i] = imread(osstream.str(), CV_LOAD_IMAGE_COLOR);
+        /**
+         * The layout has no cross polarised gradients : the diffuse normals are never computed from it.
+         */
+        float diffuse(int, int) const
+        {
+            return 0.0f;
+        }
 
-            if(!crossData[i].data)
-            {
-                cerr << "Could not load image : " << osstream.str() << endl;
-                exit(-1);
-            }
-            else
-            {
-                crossData[i].convertTo(crossData[i], CV_32FC3);
-                crossData[i] /= 255.0;
+    private:
+        const float *m_values;
+    };
 
-                //Remove Gamma correction
-                removeGammaCorrection(crossData[i], crossData[i], 2.2);
-            }
+private:
+    const Mat &m_interleaved;
+};
 
+/**
+ * Copies the results of a row of the gradients to the maps that are computed (normals of each channel, BGR = ZYX,
+ * roughness and diffuse normals of the green channel).
+ * @brief storeSpecularRow
+ * @param i index of the row.
+ * @param width
+ * @param normalX
+ * @param normalY
+ * @param normalZ
+ * @param roughness
+ * @param diffuseX diffuse normals, not read if diffuseNormals is NULL.
+ * @param diffuseY
+ * @param diffuseZ
+ * @param normals
+ * @param roughnessMap
+ * @param diffuseNormals
+ */
+template<class Gradients>
+static void storeSpecularRow(int i, int width, const float normalX[], const float normalY[],
+                             const float normalZ[], const float roughness[], const float diffuseX[], const float diffuseY[],
+                             const float diffuseZ[], Mat *normals[], Mat *roughnessMap, Mat *diffuseNormals)
+{
+    const int channels = Gradients::CHANNELS;
 
-            osstream.str("");
-        }
+    if(normals[0])
+    {
+        for(int c = 0 ; c<channels ; c++)
+        {
+            Vec3f *normalRow = normals[c]->ptr<Vec3f>(i);
 
+            for(int j = 0 ; j<width ; j++)
+            {
+                normalRow[j] = Vec3f(normalZ[channels*j+c], normalY[channels*j+c], normalX[channels*j+c]);
+            }
+        }
+    }
 
-        /*---Remove the ambient illumination---*/
-        Mat ambientCross = imread(pathToFolder + "/cross/ambient.JPG", CV_LOAD_IMAGE_COLOR);
+    if(roughnessMap)
+    {
+        Vec3f *roughnessRow = roughnessMap->ptr<Vec3f>(i);
 
-        if(!ambientCross.data)
+        for(int j = 0 ; j<width ; j++)
         {
-            cerr << "Could not load image : " << pathToFolder + "/par/ambient.JPG" << endl;
-            exit(-1);
+            //The roughness of the green channel is copied to the 3 channels
+            roughnessRow[j] = channels == 3 ? Vec3f(roughness[3*j], roughness[3*j+1], roughness[3*j+2])
+                                            : Vec3f(roughness[j], roughness[j], roughness[j]);
         }
-        else
-        {
-            ambientCross.convertTo(ambientCross, CV_32FC3);
-            ambientCross /= 255.0;
+    }
+
+    if(diffuseNormals)
+    {
+        Vec3f *diffuseRow = diffuseNormals->ptr<Vec3f>(i);
+        int green = channels == 3 ? 1 : 0;
 
-            removeAmbientIllumination(crossData, NUMBER_OF_GRADIENT_ILLUMINATION, ambientCross);
+        for(int j = 0 ; j<width ; j++)
+        {
+            diffuseRow[j] = Vec3f(diffuseZ[channels*j+green], diffuseY[channels*j+green], diffuseX[channels*j+green]);
         }
+    }
+}
 
-        //Computations : diffuse, specular normals and roughness
-        /*--Scale values with checkerchart ---*/
-        checkerchartScaling(parallelData, crossData, mask, pathToFolder);
+/**
+ * Normalises the first moment of a diffuse lobe divided by the full illumination into a normal, with the functions
+ * of the precision (see kernelprecision.h). Without z moment, z is deduced from x and y (0 if x^2+y^2 is above 1 because of the noise).
+ * @brief storeDiffuseNormal
+ * @param x
+ * @param y
+ * @param z not read if hasZ is false.
+ * @param hasZ
+ * @param normalX
+ * @param normalY
+ * @param normalZ
+ */
+template<KernelPrecision Precision>
+static inline void storeDiffuseNormal(float x, float y, float z, bool hasZ, float &normalX, float &normalY, float &normalZ)
+{
+    float planarZ = squareRoot<Precision>(max(1.0f-x*x-y*y, 0.0f));
+    z = hasZ ? z : planarZ;
 
-        diffuseSpecularSeparation(parallelData, crossData, mask, pathToFolder);
+    normalizeVector<Precision>(x, y, z);
 
-        computeNormals(parallelData, mask, pathToFolder);
+    normalX = x;
+    normalY = y;
+    normalZ = z;
+}
 
-        computeRoughness(parallelData, pathToFolder);
+/**
+ * Computes the specular normals (not aligned) and the roughness of the rows of the gradients of the LCD screen,
+ * for any capture mode, number of channels and storage of the gradients (Gradients : SeparateGradients or InterleavedGradients).
+ * With DiffuseNormals, the diffuse normals of the cross polarised gradients are computed in the same loop (SeparateGradients only).
+ * The square roots and the divisions are those of the Precision (see kernelprecision.h).
+ * With a microfacet table, the roughness of a row is converted to the alpha of the model afterwards (see microfacet.h).
+ * The type of the gradients is known at compile time : the loop of the computations is inlined for each storage,
+ * has no branch and is vectorised by the compiler. The results of a row are written in rows of values (one per thread),
+ * then copied to the maps that are computed (storeSpecularRow).
+ */
+template<class Gradients, bool DiffuseNormals, KernelPrecision Precision>
+class SpecularMapsBody : public ParallelLoopBody
+{
+public:
+    SpecularMapsBody(const Gradients &gradients, Mat *normals[], Mat *roughness, Mat *diffuseNormals,
+                     const MicrofacetTable *microfacet)
+        : m_gradients(gradients), m_normals(normals), m_roughness(roughness), m_diffuseNormals(diffuseNormals),
+          m_microfacet(microfacet) {}
 
-    }
-    else
+    void operator()(const Range &rows) const
     {
+        const int channels = Gradients::CHANNELS;
+        int width = m_gradients.cols();
+        int numberOfValues = channels*width;
 
-        //Computations : specular normals and roughness
-        /*--Scale values with checkerchart ---*/
-        checkerchartScaling(parallelData,mask, pathToFolder);
+        //Results of a row, one value per channel of each pixel
+        vector<float> normalX(numberOfValues), normalY(numberOfValues), normalZ(numberOfValues), roughness(numberOfValues);
+        vector<float> variance(numberOfValues);
+        vector<float> diffuseX(DiffuseNormals ? numberOfValues : 0), diffuseY(diffuseX.size()), diffuseZ(diffuseX.size());
 
-        /*-Specular data-*/
-        Mat specular = parallelData[0].clone();
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            typename Gradients::Row gradients(m_gradients, i);
 
-        //Scale down to 01 range and save the result
-        scaleTo01Range(specular, mask);
+            for(int n = 0 ; n<numberOfValues ; n++)
+            {
+                //Reflection vector : the camera sees xGradient as -xGradient and conversely
+                float x = gradients(2, n)-gradients(1, n);
+                float y = gradients(3, n)-gradients(4, n);
+                float z = unitVectorZ<Precision>(x, y);
+
+                normalizeVector<Precision>(x, y, z);
+
+                //The normal is the half vector V+R. V = (0,0,1)
+                z += 1.0;
+
+                normalizeVector<Precision>(x, y, z);
+
+                normalX[n] = x;
+                normalY[n] = y;
+                normalZ[n] = z;
+
+                //sigma^2 = L2/L0-(L1/L0)^2 in the x and y directions, roughness = (sigma_x^4+sigma_y^4)^(1/4)/4
+                //A division by 0 gives 0 (as cv::divide)
+                float L0 = gradients(0, n);
+                float divisor = L0 != 0.0 ? L0 : 1.0;
+                float horizontalGradient = divide<Precision>(gradients(2, n)-gradients(1, n), divisor);
+                float verticalGradient = divide<Precision>(gradients(3, n)-gradients(4, n), divisor);
+                float sigmaSquaredX = divide<Precision>(gradients(5, n), divisor)-horizontalGradient*horizontalGradient;
+                float sigmaSquaredY = divide<Precision>(gradients(6, n), divisor)-verticalGradient*verticalGradient;
+                float value = fourthRoot<Precision>(sigmaSquaredX*sigmaSquaredX+sigmaSquaredY*sigmaSquaredY)/4.0;
 
-        savePFM(specular, pathToFolder + "/textures/specular.pfm");
+                roughness[n] = L0 != 0.0 ? value : 0.0;
+                variance[n] = sigmaSquaredX+sigmaSquaredY;
 
-        computeNormals(parallelData, mask, pathToFolder);
+                if(DiffuseNormals)
+                {
+                    //The diffuse lobe is centred on the normal : its first moment divided by the full illumination
+                    //gives the normal directly (Ma et al. 2007). A null full illumination gives (0,0,1)
+                    float D0 = gradients.diffuse(0, n);
+                    float diffuseDivisor = D0 != 0.0 ? D0 : 1.0;
+
+                    storeDiffuseNormal<Precision>(divide<Precision>(gradients.diffuse(2, n)-gradients.diffuse(1, n), diffuseDivisor),
+                                                  divide<Precision>(gradients.diffuse(3, n)-gradients.diffuse(4, n), diffuseDivisor),
+                                                  1.0f, false, diffuseX[n], diffuseY[n], diffuseZ[n]);
+                }
+            }
 
-        computeRoughness(parallelData, pathToFolder);
+            //Alphas of the microfacet model, in a separate loop so that the loop of the computations has no branch
+            if(m_microfacet)
+            {
+                convertMicrofacetRoughness(*m_microfacet, variance.data(), normalZ.data(), roughness.data(), numberOfValues);
+            }
 
+            storeSpecularRow<Gradients>(i, width, normalX.data(), normalY.data(), normalZ.data(), roughness.data(),
+                                        diffuseX.data(), diffuseY.data(), diffuseZ.data(), m_normals, m_roughness,
+                                        DiffuseNormals ? m_diffuseNormals : NULL);
+        }
     }
-}
+
+private:
+    Gradients m_gradients;
+    Mat **m_normals;
+    Mat *m_roughness;
+    Mat *m_diffuseNormals;
+    const MicrofacetTable *m_microfacet;
+};
 
 /**
- * Scale the value of parallel polarised data to the value of the checkerchart.
- * @brief checkerchartScaling
- * @param parallelData
- * @param mask
- * @param pathToFolder
+ * Computes the specular normals (not aligned) and the roughness of the rows of the gradients of described illumination
+ * patterns (see illumination.h). Each moment is the sum of at most Terms patterns weighted by the precomputed least squares
+ * solver (its non zero coefficients, completed by zero weights) : the number of terms is known at compile time, so the loop
+ * over the values of a row is unrolled and costs about as much as the hardcoded formulas of the LCD screen.
+ * The normals and the roughness are then computed from the moments as with the LCD screen.
  */
-void checkerchartScaling(Mat parallelData[], const Mat &mask, string pathToFolder)
+template<class Gradients, int Terms, bool DiffuseNormals, KernelPrecision Precision>
+class PatternMapsBody : public ParallelLoopBody
 {
-    /*--Read checkerchart values---*/
-    string RParPicture, GParPicture, BParPicture;
-    string checkerchartPar;
-    float ratioParR = 0.0, ratioParG = 0.0, ratioParB = 0.0;
-
-    ifstream checkerFile(pathToFolder + "/checker.txt", ios::in);
-
-    if(checkerFile)
+public:
+    PatternMapsBody(const Gradients &gradients, const IlluminationPatterns &patterns, Mat *normals[], Mat *roughness,
+                    Mat *diffuseNormals, const MicrofacetTable *microfacet)
+        : m_gradients(gradients), m_normals(normals), m_roughness(roughness), m_diffuseNormals(diffuseNormals),
+          m_microfacet(microfacet)
     {
-        //First line is parallel and second is cross polarised
-        checkerFile >> RParPicture >> GParPicture >> BParPicture >> checkerchartPar;
-
-        ratioParR = atof(checkerchartPar.c_str())/atof(RParPicture.c_str());
-        ratioParG = atof(checkerchartPar.c_str())/atof(GParPicture.c_str());
-        ratioParB = atof(checkerchartPar.c_str())/atof(BParPicture.c_str());
+        //Moments used by the maps, the order 0 moment is replaced by the full illumination
+        const IlluminationMoment moments[] = {MOMENT_X, MOMENT_Y, MOMENT_Z, MOMENT_XX, MOMENT_YY};
 
-        cout << "Parallel " << ratioParR << " - " << ratioParG << " - "<< ratioParB << endl;
+        for(int m = 0 ; m<5 ; m++)
+        {
+            int numberOfTerms = 0;
 
-        int width = parallelData[0].cols;
-        int height = parallelData[0].rows;
+            for(int t = 0 ; t<Terms ; t++)
+            {
+                m_termPatterns[m][t] = 0;
+                m_termWeights[m][t] = 0.0f;
+            }
 
-        /*--Scale parallel polarised values---*/
-        //White balancing with the checkerchart
-        for(int k = 0 ; k<NUMBER_OF_GRADIENT_ILLUMINATION ; k++)
-        {
-            for(int i = 0 ; i<height ; i++)
+            for(int k = 0 ; k<patterns.numberOfPatterns ; k++)
             {
-                for(int j = 0 ; j<width ; j++)
+                if(patterns.solver[moments[m]][k] != 0.0f && numberOfTerms < Terms)
                 {
-                    //OpenCV is in BGR
-                    parallelData[k].at<Vec3f>(i,j).val[0] *= ratioParB;
-                    parallelData[k].at<Vec3f>(i,j).val[1] *= ratioParG;
-                    parallelData[k].at<Vec3f>(i,j).val[2] *= ratioParR;
+                    m_termPatterns[m][numberOfTerms] = k;
+                    m_termWeights[m][numberOfTerms] = patterns.solver[moments[m]][k];
+                    numberOfTerms++;
                 }
             }
         }
 
-        //Scale down between 0 and 1 for the computation
-        for(int k = 0 ; k<NUMBER_OF_GRADIENT_ILLUMINATION ; k++)
-        {
-            //Scale down to 01 range and save the result
-            scaleTo01Range(parallelData[k], mask);
-        }
+        //Without Z gradients z is deduced from x and y as with the LCD screen
+        m_hasZ = patterns.isDetermined[MOMENT_Z];
     }
-    else
+
+    void operator()(const Range &rows) const
     {
-        cerr << "Could not the file image : " << pathToFolder << "/checker.txt" << endl;
-        exit(-1);
-    }
+        const int channels = Gradients::CHANNELS;
+        int width = m_gradients.cols();
+        int numberOfValues = channels*width;
 
-}
+        //Local copies of the terms : the compiler keeps them in registers instead of reading them again after each result
+        int termPatterns[5][Terms];
+        float termWeights[5][Terms];
+        bool hasZ = m_hasZ;
 
-/**
- * Scale the value of parallel and cross polarised data to the value of the checkerchart.
- * @brief checkerchartScaling
- * @param parallelData
- * @param crossData
- * @param mask
- * @param pathToFolder
- */
-void checkerchartScaling(Mat parallelData[], Mat crossData[], const Mat &mask, string pathToFolder)
-{
-    /*--Read checkerchart values---*/
-    string RParPicture, GParPicture, BParPicture;
-    string checkerchartPar;
-    float ratioParR = 0.0, ratioParG = 0.0, ratioParB = 0.0;
+        for(int m = 0 ; m<5 ; m++)
+        {
+            for(int t = 0 ; t<Terms ; t++)
+            {
+                termPatterns[m][t] = m_termPatterns[m][t];
+                termWeights[m][t] = m_termWeights[m][t];
+            }
+        }
 
-    string RCrossPicture, GCrossPicture, BCrossPicture;
-    string checkerchartCross;
-    float ratioCrossR = 0.0, ratioCrossG = 0.0, ratioCrossB = 0.0;
+        //Results of a row, one value per channel of each pixel
+        vector<float> normalX(numberOfValues), normalY(numberOfValues), normalZ(numberOfValues), roughness(numberOfValues);
+        vector<float> variance(numberOfValues);
+        vector<float> diffuseX(DiffuseNormals ? numberOfValues : 0), diffuseY(diffuseX.size()), diffuseZ(diffuseX.size());
 
-    ifstream checkerFile(pathToFolder + "/checker.txt", ios::in);
+        for(int i = rows.start ; i<rows.end ; i++)
+        {
+            typename Gradients::Row gradients(m_gradients, i);
 
-    //If the file has been correctly opened
-    if(checkerFile)
-    {
-        //First line is parallel and second is cross polarised
-        checkerFile >> RParPicture >> GParPicture >> BParPicture >> checkerchartPar;
+            for(int n = 0 ; n<numberOfValues ; n++)
+            {
+                float moment[5];
 
-        ratioParR = atof(checkerchartPar.c_str())/atof(RParPicture.c_str());
-        ratioParG = atof(checkerchartPar.c_str())/atof(GParPicture.c_str());
-        ratioParB = atof(checkerchartPar.c_str())/atof(BParPicture.c_str());
+                for(int m = 0 ; m<5 ; m++)
+                {
+                    moment[m] = 0.0f;
 
-        checkerFile >> RCrossPicture >> GCrossPicture >> BCrossPicture >> checkerchartCross;
+                    for(int t = 0 ; t<Terms ; t++)
+                    {
+                        moment[m] += termWeights[m][t]*gradients(termPatterns[m][t], n);
+                    }
+                }
 
-        ratioCrossR = atof(checkerchartCross.c_str())/atof(RCrossPicture.c_str());
-        ratioCrossG = atof(checkerchartCross.c_str())/atof(GCrossPicture.c_str());
-        ratioCrossB = atof(checkerchartCross.c_str())/atof(BCrossPicture.c_str());
+                //Reflection vector
+                float x = moment[0];
+                float y = moment[1];
+                float z = unitVectorZ<Precision>(x, y);
+                z = hasZ ? moment[2] : z;
 
-        cout << "Parallel " << ratioParR << " - " << ratioParG << " - "<< ratioParB << endl;
-        cout << "Cross " << ratioCrossR << " - " << ratioCrossG << " - "<< ratioCrossB << endl;
+                normalizeVector<Precision>(x, y, z);
 
-        int width = parallelData[0].cols;
-        int height = parallelData[0].rows;
+                //The normal is the half vector V+R. V = (0,0,1)
+                z += 1.0;
 
-        /*--Scale parallel polarised values---*/
-        //White balancing with the checkerchart
-        for(int k = 0 ; k<NUMBER_OF_GRADIENT_ILLUMINATION ; k++)
-        {
+                normalizeVector<Precision>(x, y, z);
 
-            for(int i = 0 ; i<height ; i++)
-            {
+                normalX[n] = x;
+                normalY[n] = y;
+                normalZ[n] = z;
 
-                for(int j = 0 ; j<width ; j++)
-                {
+                //Same roughness as the LCD screen, with the moments of the patterns
+                float L0 = gradients(0, n);
+                float divisor = L0 != 0.0 ? L0 : 1.0;
+                float horizontalGradient = divide<Precision>(moment[0], divisor);
+                float verticalGradient = divide<Precision>(moment[1], divisor);
+                float sigmaSquaredX = divide<Precision>(moment[3], divisor)-horizontalGradient*horizontalGradient;
+                float sigmaSquaredY = divide<Precision>(moment[4], divisor)-verticalGradient*verticalGradient;
+                float value = fourthRoot<Precision>(sigmaSquaredX*sigmaSquaredX+sigmaSquaredY*sigmaSquaredY)/4.0;
 
-                    //OpenCV is in BGR
-                    parallelData[k].at<Vec3f>(i,j).val[0] *= ratioParB;
-                    parallelData[k].at<Vec3f>(i,j).val[1] *= ratioParG;
-                    parallelData[k].at<Vec3f>(i,j).val[2] *= ratioParR;
+                roughness[n] = L0 != 0.0 ? value : 0.0;
+                variance[n] = sigmaSquaredX+sigmaSquaredY;
 
-                    crossData[k].at<Vec3f>(i,j).val[0] *= ratioCrossB;
-                    crossData[k].at<Vec3f>(i,j).val[1] *= ratioCrossG;
-                    crossData[k].at<Vec3f>(i,j).val[2] *= ratioCrossR;
+                if(DiffuseNormals)
+                {
+                    //First moments of the diffuse lobe, with the same terms
+                    float diffuseMoment[3];
+
+                    for(int m = 0 ; m<3 ; m++)
+                    {
+                        diffuseMoment[m] = 0.0f;
+
+                        for(int t = 0 ; t<Terms ; t++)
+                        {
+                            diffuseMoment[m] += termWeights[m][t]*gradients.diffuse(termPatterns[m][t], n);
+                        }
+                    }
+
+                    float D0 = gradients.diffuse(0, n);
+                    float diffuseDivisor = D0 != 0.0 ? D0 : 1.0;
+
+                    storeDiffuseNormal<Precision>(divide<Precision>(diffuseMoment[0], diffuseDivisor),
+                                                  divide<Precision>(diffuseMoment[1], diffuseDivisor),
+                                                  divide<Precision>(diffuseMoment[2], diffuseDivisor),
+                                                  hasZ, diffuseX[n], diffuseY[n], diffuseZ[n]);
                 }
             }
-         }
 
+            //Alphas of the microfacet model, in a separate loop so that the loop of the computations has no branch
+            if(m_microfacet)
+            {
+                convertMicrofacetRoughness(*m_microfacet, variance.data(), normalZ.data(), roughness.data(), numberOfValues);
+            }
+
+            storeSpecularRow<Gradients>(i, width, normalX.data(), normalY.data(), normalZ.data(), roughness.data(),
+                                        diffuseX.data(), diffuseY.data(), diffuseZ.data(), m_normals, m_roughness,
+                                        DiffuseNormals ? m_diffuseNormals : NULL);
+        }
+    }
+
+private:
+    Gradients m_gradients;
+    int m_termPatterns[5][Terms];
+    float m_termWeights[5][Terms];
+    bool m_hasZ;
+    Mat **m_normals;
+    Mat *m_roughness;
+    Mat *m_diffuseNormals;
+    const MicrofacetTable *m_microfacet;
+};
+
+/**
+ * Runs the body that computes the maps from the gradients : the solver of the described illumination patterns
+ * with the smallest number of terms that holds their moments, or the gradients of the LCD screen.
+ * The functions of the solvers are those of the Precision (see kernelprecision.h). The roughness is the alpha of the
+ * current microfacet model, if any (see microfacet.h).
+ * @brief runSpecularMaps
+ * @param gradients
+ * @param normals
+ * @param roughness
+ * @param diffuseNormals not NULL if DiffuseNormals.
+ */
+template<class Gradients, bool DiffuseNormals, KernelPrecision Precision>
+static void runSpecularMaps(const Gradients &gradients, Mat *normals[], Mat *roughness, Mat *diffuseNormals)
+{
+    const IlluminationPatterns *patterns = currentIlluminationPatterns();
+    const MicrofacetTable *microfacet = roughness ? currentMicrofacetTable() : NULL;
+    Range range(0, gradients.rows());
+
+    if(patterns)
+    {
+        //Smallest number of terms that holds the moments of the patterns
+        int maximumNumberOfTerms = 0;
+        const IlluminationMoment moments[] = {MOMENT_X, MOMENT_Y, MOMENT_Z, MOMENT_XX, MOMENT_YY};
 
-        //After applying the checkerchart some pixels values might be above 1
-        //Scale down between 0 and 1 for the computation
-        for(int k = 0 ; k<NUMBER_OF_GRADIENT_ILLUMINATION ; k++)
+        for(int m = 0 ; m<5 ; m++)
         {
-            //Scale down to 01 range and save the result
-            scaleTo01Range(crossData[k], mask);
-            scaleTo01Range(parallelData[k], mask);
+            int numberOfTerms = 0;
+
+            for(int k = 0 ; k<patterns->numberOfPatterns ; k++)
+            {
+                numberOfTerms += patterns->solver[moments[m]][k] != 0.0f ? 1 : 0;
+            }
+
+            maximumNumberOfTerms = max(maximumNumberOfTerms, numberOfTerms);
         }
 
+        if(maximumNumberOfTerms <= 2)
+        {
+            parallel_for_(range, PatternMapsBody<Gradients, 2, DiffuseNormals, Precision>(gradients, *patterns, normals, roughness,
+                                                                                         diffuseNormals, microfacet));
+        }
+        else if(maximumNumberOfTerms <= 4)
+        {
+            parallel_for_(range, PatternMapsBody<Gradients, 4, DiffuseNormals, Precision>(gradients, *patterns, normals, roughness,
+                                                                                         diffuseNormals, microfacet));
+        }
+        else
+        {
+            parallel_for_(range, PatternMapsBody<Gradients, MAXIMUM_NUMBER_OF_GRADIENTS, DiffuseNormals, Precision>(gradients, *patterns,
+                                                                                                                 normals, roughness,
+                                                                                                                 diffuseNormals, microfacet));
+        }
     }
     else
     {
-        cerr << "Could not the file image : " << pathToFolder << "/checker.txt" << endl;
-        exit(-1);
+        parallel_for_(range, SpecularMapsBody<Gradients, DiffuseNormals, Precision>(gradients, normals, roughness, diffuseNormals,
+                                                                                    microfacet));
     }
-
 }
 
 /**
- * Compute the diffuse and specular albedo given parallel and cross polarised data.
- * Also requires a mask on which data is computed.
- * @brief checkerchartScaling
- * @param parallelData
- * @param mask
- * @param pathToFolder
+ * Runs the body that computes the maps from the gradients with the functions of the current precision (kernelPrecision()).
+ * @brief runPrecisionMaps
+ * @param gradients
+ * @param normals
+ * @param roughness
+ * @param diffuseNormals not NULL if DiffuseNormals.
  */
-void diffuseSpecularSeparation(Mat parallelData[], Mat crossData[], const Mat &mask, string pathToFolder)
+template<class Gradients, bool DiffuseNormals>
+static void runPrecisionMaps(const Gradients &gradients, Mat *normals[], Mat *roughness, Mat *diffuseNormals)
 {
-    //Cross data contains diffuse only
-    //Parallel data contains diffuse+specular
-    Mat diffuse = crossData[0].clone();
-    Mat specular = parallelData[0].clone();
-
-    //Remove the diffuse component
-    specular -= diffuse;
+    switch(kernelPrecision())
+    {
+        case FAST_PRECISION :
+            runSpecularMaps<Gradients, DiffuseNormals, FAST_PRECISION>(gradients, normals, roughness, diffuseNormals);
+            break;
+        case APPROXIMATE_PRECISION :
+            runSpecularMaps<Gradients, DiffuseNormals, APPROXIMATE_PRECISION>(gradients, normals, roughness, diffuseNormals);
+            break;
+        default :
+            runSpecularMaps<Gradients, DiffuseNormals, EXACT_PRECISION>(gradients, normals, roughness, diffuseNormals);
+            break;
+    }
+}
 
-    setNegativePixelsTo0(specular);
+/**
+ * Computes the maps given (not NULL) from the gradients, in parallel. The maps are taken from the buffer pool.
+ * @brief computeSpecularMaps
+ * @param gradients
+ * @param normals normals of each channel of the gradients, NULL if the normals are not computed.
+ * @param roughness NULL if the roughness is not computed.
+ * @param diffuseNormals NULL if the diffuse normals are not computed, otherwise the gradients must hold the cross polarised data.
+ */
+template<class Gradients>
+static void computeSpecularMaps(const Gradients &gradients, Mat *normals[], Mat *roughness, Mat *diffuseNormals)
+{
+    for(int c = 0 ; c<Gradients::CHANNELS && normals[0] ; c++)
+    {
+        createPooledImage(*normals[c], gradients.rows(), gradients.cols(), CV_32FC3);
+    }
 
-    //Scale down to 01 range and save the result
-    scaleTo01Range(diffuse, mask);
-    scaleTo01Range(specular, mask);
+    if(roughness)
+    {
+        createPooledImage(*roughness, gradients.rows(), gradients.cols(), CV_32FC3);
+    }
 
-    savePFM(diffuse, pathToFolder + "/textures/diffuse.pfm");
-    savePFM(specular, pathToFolder + "/textures/specular.pfm");
+    if(diffuseNormals)
+    {
+        createPooledImage(*diffuseNormals, gradients.rows(), gradients.cols(), CV_32FC3);
+        runPrecisionMaps<Gradients, true>(gradients, normals, roughness, diffuseNormals);
+    }
+    else
+    {
+        runPrecisionMaps<Gradients, false>(gradients, normals, roughness, NULL);
+    }
 }
 
 /**
- * Compute the specular normals given parallel and cross data.
- * Also requires a mask on which data is computed.
- * The sample is assumed to be almost flat without big variations in the z component of the normal.
- * Therefore the measurements have been made without the zGradients.
- * @param parallelData
- * @param crossData
- * @param mask
+ * Function to compute the reflectance maps given the path to the data folder and a bool that says if the
+ * cross polarised data exists. Kept for the existing callers : the capture is computed by computeCaptureMaps
+ * (see capturetile.h) and the files are written before the function returns. Exits the program if the capture
+ * could not be computed or one of the files could not be written.
+ * @brief computeMaps
  * @param pathToFolder
+ * @param isCrossData
  */
-void computeNormals(Mat parallelData[], Mat crossData[], const Mat &mask, string pathToFolder)
+void computeMaps(string pathToFolder, bool isCrossData)
 {
-    Mat xGradient, minusXGradient;
-    Mat yGradient, minusYGradient;;
-    Mat normals = Mat(parallelData[1].rows, parallelData[1].cols, CV_32FC3);
+    CaptureTile capture;
 
-    //The specular normals are computed : remove the cross data from the parallel data.
-    //X direction
-    xGradient = parallelData[1].clone()-crossData[1].clone();
-    minusXGradient = parallelData[2].clone()-crossData[2].clone();
-
-    //The specular normals are computed : remove the cross data from the parallel data.
-    //Y direction
-    yGradient = parallelData[3].clone()-crossData[3].clone();
-    minusYGradient = parallelData[4].clone()-crossData[4].clone();
-
-    float x = 0.0, y = 0.0, z = 0.0;
-    float norm = 0.0;
+    if(!computeCaptureMaps(pathToFolder, isCrossData, capture))
+    {
+        exit(-1);
+    }
 
-    int width = parallelData[0].cols;
-    int height = parallelData[0].rows;
+    //Wait for the files written in the background
+    vector<string> failedFiles;
 
-    //Compute all the normals and normalize them
-    for(int i = 0 ; i<height ; i++)
+    if(!waitForOutputs(pathToFolder, failedFiles))
     {
-        for(int j = 0 ; j<width ; j++)
-        {
-            //RGB = xyz
-            //Calculations with green channel
-            //Reflection : the camera sees xGradient as -xGradient and conversely
+        reportFailedOutputs(failedFiles);
+        exit(-1);
+    }
+}
 
-            //x component of the normals : -xGradient - +xGradient
-            //y component of the normals : yGradient - -yGradient
-            x = minusXGradient.at<Vec3f>(i,j).val[1]-xGradient.at<Vec3f>(i,j).val[1];
-            y = yGradient.at<Vec3f>(i,j).val[1]-minusYGradient.at<Vec3f>(i,j).val[1];
-            z = sqrt(1.0-x*x-y*y);
-            norm = sqrt(x*x+y*y+z*z);
+/**
+ * Loads an 8 bits image and converts it to a CV_32FC3 image in the 0;1 range.
+ * If a non empty region is given, only this region of the image is kept.
+ * The buffer of image is reused if it already has the right size.
+ * @brief loadLinearImage
+ * @param filePath
+ * @param image
+ * @param removeGamma set to true to remove the gamma correction of the camera.
+ * @param region
+ * @return false if the image could not be loaded.
+ */
+bool loadLinearImage(string filePath, Mat &image, bool removeGamma, Rect region)
+{
+    //Decoded in a buffer of the pool, given back when image8U goes out of scope
+    Mat image8U;
 
-            //Normalise the reflection vector
-            x /= norm;
-            y /= norm;
-            z /= norm;
+    if(!readImageFile(filePath, image8U))
+    {
+        cerr << "Could not load image : " << filePath << endl;
+        return false;
+    }
 
-            //(x,y,z) is the reflection vector
-            //The normal is the hal vector V+R. V = (0,0,1)
-            z += 1.0;
+    if(region.area() > 0)
+    {
+        image8U = image8U(region);
+    }
 
-            //Normalise the normal
-            norm = sqrt(x*x+y*y+z*z);
+    //Convert to the 0;1 range and remove the gamma in one pass
+    linearizeImage(image8U, image, removeGamma ? 2.2 : 1.0);
 
-            x /= norm;
-            y /= norm;
-            z /= norm;
+    return true;
+}
 
-            normals.at<Vec3f>(i,j).val[2] = x;
-            normals.at<Vec3f>(i,j).val[1] = y;
-            normals.at<Vec3f>(i,j).val[0] = z;
+/**
+ * Loads the gradient illumination images and the ambient illumination of a folder (par or cross)
+ * and removes the ambient illumination from the gradients.
+ * The images are supposed to have a name : IMG_XXXX where XXXX is a number starting at firstImageNumber.
+ * With several shots per image (see multishot.h) the shots are averaged.
+ * @brief loadGradientImages
+ * @param pathToFolder
+ * @param subFolder
+ * @param firstImageNumber
+ * @param images array of numberOfGradients() images.
+ * @param region
+ * @param noise if not NULL, the variances of the shots of the gradients are added to it.
+ * @param saturatedPixels if not NULL, the saturated pixels of the gradients are added to it (see diagnostics.h).
+ * @return false if one of the images could not be loaded.
+ */
+bool loadGradientImages(string pathToFolder, string subFolder, unsigned int firstImageNumber, Mat images[], Rect region, Mat *noise,
+                        vector<int> *saturatedPixels)
+{
+    for(int i = 0 ; i<numberOfGradients() ; i++)
+    {
+        if(!loadAveragedImage(pathToFolder, subFolder, firstImageNumber, i, 2.2, region, images[i], noise))
+        {
+            return false;
+        }
 
+        if(saturatedPixels)
+        {
+            markSaturatedPixels(images[i], *saturatedPixels);
         }
     }
 
-    alignAverageSurfaceNormal(normals, mask);
+    /*---Load the ambient illumination---*/
+    Mat ambient;
 
-    //Color mapping
-    for(int i = 0 ; i<height ; i++)
+    if(!loadAveragedImage(pathToFolder, subFolder, firstImageNumber, numberOfGradients(), 1.0, region, ambient, NULL))
     {
-
-        for(int j = 0 ; j<width ; j++)
-        {
-            normals.at<Vec3f>(i,j).val[2] = (normals.at<Vec3f>(i,j).val[2]+1.0)/2.0;
-            normals.at<Vec3f>(i,j).val[1] = (normals.at<Vec3f>(i,j).val[1]+1.0)/2.0;
-            normals.at<Vec3f>(i,j).val[0] = (normals.at<Vec3f>(i,j).val[0]+1.0)/2.0;
-        }
+        return false;
     }
 
+    removeAmbientIllumination(images, numberOfGradients(), ambient);
 
-    normals *= 255.0;
-    normals.convertTo(normals, CV_8UC3);
-    imwrite(pathToFolder + "/textures/normalMap.bmp", normals);
+    return true;
 }
 
 /**
- * Compute the specular normals given parallel and cross data.
- * Also requires a mask on which data is computed.
- * @brief computeNormals
- * @param parallelData
- * @param crossData
- * @param mask
+ * Reads the checker.txt file and computes the ratios between the checkerchart reflectance and the measured values.
+ * The ratios are stored in BGR order, as the OpenCV images.
+ * @brief readCheckerchartRatios
  * @param pathToFolder
+ * @param isCrossData set to true to also read the second line (cross polarised values).
+ * @param ratioPar
+ * @param ratioCross
+ * @return false if the file could not be read.
  */
-void computeNormals(Mat parallelData[], const Mat &mask, string pathToFolder)
+bool readCheckerchartRatios(string pathToFolder, bool isCrossData, Vec3f &ratioPar, Vec3f &ratioCross)
 {
-    Mat xGradient, minusXGradient;
-    Mat yGradient, minusYGradient;;
-    Mat normals = Mat(parallelData[1].rows, parallelData[1].cols, CV_32FC3);
+    /*--Read checkerchart values---*/
+    string RParPicture, GParPicture, BParPicture;
+    string checkerchartPar;
 
-    xGradient = parallelData[1].clone();
-    minusXGradient = parallelData[2].clone();
+    string RCrossPicture, GCrossPicture, BCrossPicture;
+    string checkerchartCross;
 
-    yGradient = parallelData[3].clone();
-    minusYGradient = parallelData[4].clone();
+    ifstream checkerFile(pathToFolder + "/checker.txt", ios::in);
 
-    float x = 0.0, y = 0.0, z = 0.0;
-    float norm = 0.0;
+    //If the file has been correctly opened
+    if(!checkerFile)
+    {
+        cerr << "Could not the file image : " << pathToFolder << "/checker.txt" << endl;
+        return false;
+    }
 
-    int width = parallelData[0].cols;
-    int height = parallelData[0].rows;
+    //First line is parallel and second is cross polarised
+    checkerFile >> RParPicture >> GParPicture >> BParPicture >> checkerchartPar;
 
-    for(int i = 0 ; i<height ; i++)
+    ratioPar.val[0] = atof(checkerchartPar.c_str())/atof(BParPicture.c_str());
+    ratioPar.val[1] = atof(checkerchartPar.c_str())/atof(GParPicture.c_str());
+    ratioPar.val[2] = atof(checkerchartPar.c_str())/atof(RParPicture.c_str());
+
+    if(isCrossData)
     {
+        checkerFile >> RCrossPicture >> GCrossPicture >> BCrossPicture >> checkerchartCross;
 
-        for(int j = 0 ; j<width ; j++)
+        ratioCross.val[0] = atof(checkerchartCross.c_str())/atof(BCrossPicture.c_str());
+        ratioCross.val[1] = atof(checkerchartCross.c_str())/atof(GCrossPicture.c_str());
+        ratioCross.val[2] = atof(checkerchartCross.c_str())/atof(RCrossPicture.c_str());
+    }
+
+    return true;
+}
+
+/**
+ * White balancing with the checkerchart : multiplies each channel of the images by the corresponding ratio.
+ * @brief applyCheckerchartRatios
+ * @param images
+ * @param numberOfImages
+ * @param ratio BGR ratios returned by readCheckerchartRatios.
+ */
+void applyCheckerchartRatios(Mat images[], int numberOfImages, Vec3f ratio)
+{
+    for(int k = 0 ; k<numberOfImages ; k++)
+    {
+        int width = images[k].cols;
+        int height = images[k].rows;
+
+        for(int i = 0 ; i<height ; i++)
         {
+            for(int j = 0 ; j<width ; j++)
+            {
+                //OpenCV is in BGR
+                images[k].at<Vec3f>(i,j).val[0] *= ratio.val[0];
+                images[k].at<Vec3f>(i,j).val[1] *= ratio.val[1];
+                images[k].at<Vec3f>(i,j).val[2] *= ratio.val[2];
+            }
+        }
+    }
+}
 
-            //RGB = xyz
-            //Calculations with green channel
-            //Reflection : the camera sees xGradient as -xGradient and conversely
-            x = minusXGradient.at<Vec3f>(i,j).val[1]-xGradient.at<Vec3f>(i,j).val[1];
-            y = yGradient.at<Vec3f>(i,j).val[1]-minusYGradient.at<Vec3f>(i,j).val[1];
-            z = sqrt(1.0-x*x-y*y);
-            norm = sqrt(x*x+y*y+z*z);
+/**
+ * Separates the diffuse and specular albedos of the order 0 gradients (not scaled).
+ * Without cross polarised image (empty), the diffuse map is released and the specular map is the parallel image.
+ * @brief separateDiffuseSpecular
+ * @param parallelImage
+ * @param crossImage
+ * @param diffuse
+ * @param specular
+ */
+void separateDiffuseSpecular(const Mat &parallelImage, const Mat &crossImage, Mat &diffuse, Mat &specular)
+{
+    createPooledImage(specular, parallelImage.rows, parallelImage.cols, CV_32FC3);
 
-            //Normalise the reflection vector
-            x /= norm;
-            y /= norm;
-            z /= norm;
+    if(crossImage.empty())
+    {
+        diffuse.release();
+        parallelImage.copyTo(specular);
+        return;
+    }
 
-            //(x,y,z) is the reflection vector
-            //The normal is the hal vector V+R. V = (0,0,1)
-            z += 1.0;
+    createPooledImage(diffuse, parallelImage.rows, parallelImage.cols, CV_32FC3);
 
-            //Normalise the normal
-            norm = sqrt(x*x+y*y+z*z);
+    //Cross data contains diffuse only
+    //Parallel data contains diffuse+specular
+    crossImage.copyTo(diffuse);
+    subtract(parallelImage, crossImage, specular);
 
-            x /= norm;
-            y /= norm;
-            z /= norm;
+    //The clamped pixels are counted by flagInvalidPixels (see diagnostics.h)
+    setNegativePixelsTo0(specular);
+}
 
-            normals.at<Vec3f>(i,j).val[2] = x;
-            normals.at<Vec3f>(i,j).val[1] = y;
-            normals.at<Vec3f>(i,j).val[0] = z;
+/**
+ * Compute the specular normals of the green channel from the parallel polarised data, without any alignment.
+ * The specular normals are stored as BGR = ZYX in a CV_32FC3 image.
+ * @brief computeSpecularNormals
+ * @param parallelData
+ * @param crossData cross polarised data, read for the diffuse normals only (can be NULL).
+ * @param normals
+ * @param diffuseNormals if not NULL, diffuse normals of the green channel of crossData (not aligned, BGR = ZYX), computed in the same pass.
+ */
+void computeSpecularNormals(Mat parallelData[], Mat crossData[], Mat &normals, Mat *diffuseNormals)
+{
+    Mat *channelNormals[1] = {&normals};
 
-        }
-    }
+    computeSpecularMaps(SeparateGradients<1>(parallelData, crossData), channelNormals, NULL, diffuseNormals);
+}
+
+/**
+ * Computes the specular normals (without any alignment) and the roughness of the green channel in a single pass
+ * over the parallel polarised gradients. Same results as computeSpecularNormals and computeRoughnessMap.
+ * @brief computeSpecularNormalsAndRoughness
+ * @param parallelData
+ * @param crossData cross polarised data, read for the diffuse normals only (can be NULL).
+ * @param normals BGR = ZYX.
+ * @param roughness
+ * @param diffuseNormals if not NULL, diffuse normals of the green channel of crossData (not aligned, BGR = ZYX), computed in the same pass.
+ */
+void computeSpecularNormalsAndRoughness(Mat parallelData[], Mat crossData[], Mat &normals, Mat &roughness, Mat *diffuseNormals)
+{
+    Mat *channelNormals[1] = {&normals};
+
+    computeSpecularMaps(SeparateGradients<1>(parallelData, crossData), channelNormals, &roughness, diffuseNormals);
+}
+
+/**
+ * Maps the normals from [-1;1] to [0;255] and saves them as an 8 bits BMP image (no gamma).
+ * @brief saveNormalMap
+ * @param normals
+ * @param filePath
+ * @return false if the file could not be written.
+ */
+bool saveNormalMap(Mat normals, string filePath)
+{
+    int width = normals.cols;
+    int height = normals.rows;
+
+    //8 bits image taken from the buffer pool : the caller keeps its float normals
+    Mat normalMap;
+    createPooledImage(normalMap, height, width, CV_8UC3);
 
-    //Align the average surface normal with (0,0,1) (flat sample assumption)
-    alignAverageSurfaceNormal(normals, mask);
+    float value = 0.0;
 
     //Color mapping RGB = XYZ
     for(int i = 0 ; i<height ; i++)
     {
         for(int j = 0 ; j<width ; j++)
         {
-            normals.at<Vec3f>(i,j).val[2] = (normals.at<Vec3f>(i,j).val[2]+1.0)/2.0;
-            normals.at<Vec3f>(i,j).val[1] = (normals.at<Vec3f>(i,j).val[1]+1.0)/2.0;
-            normals.at<Vec3f>(i,j).val[0] = (normals.at<Vec3f>(i,j).val[0]+1.0)/2.0;
+            for(int c = 0 ; c<3 ; c++)
+            {
+                value = (normals.at<Vec3f>(i,j).val[c]+1.0)/2.0;
+                value *= 255.0;
+                normalMap.at<Vec3b>(i,j).val[c] = saturate_cast<uchar>(value);
+            }
         }
     }
 
-
-    normals *= 255.0;
-    normals.convertTo(normals, CV_8UC3);
     //Save as BMP : no gamma!
-    imwrite(pathToFolder + "/textures/normalMap.bmp", normals);
+    return imwrite(filePath, normalMap);
 }
 
 /**
@@ -561,21 +908,23 @@ void removeAmbientIllumination(Mat images[], int numberOfImages, const Mat &ambi
 }
 
 /**
- * Rotates the normals so that the average surface normal is (0,0,1)
- * @brief alignAverageSurfaceNormal
+ * Adds the XYZ components of the normals inside the mask to normalSum and counts them.
+ * NaN normals are skipped. Can be called on several tiles of the same image before calling averageSurfaceNormal.
+ * @brief accumulateSurfaceNormals
  * @param normals
  * @param mask
+ * @param normalSum
+ * @param numberOfNormals
+ * @return number of NaN normals skipped inside the mask.
  */
-void alignAverageSurfaceNormal(Mat &normals, const Mat &mask)
+long long accumulateSurfaceNormals(const Mat &normals, const Mat &mask, double normalSum[3], double &numberOfNormals)
 {
     int height = normals.rows;
     int width = normals.cols;
 
+    //Counted instead of logged : a bad capture can have millions of them
+    long long numberOfNanNormals = 0;
 
-    /*----Compute average surface normal---*/
-    //On the sample only !
-    Mat averageNormal = Mat::zeros(3,1, CV_32FC1);
-    double numberOfNormalsAccounted = 0.0;
     for(int i = 0 ; i<height ; i++)
     {
         for(int j = 0 ; j<width ; j++)
@@ -585,24 +934,52 @@ void alignAverageSurfaceNormal(Mat &normals, const Mat &mask)
             {
                 if(isnan(normals.at<Vec3f>(i,j).val[2]) || isnan(normals.at<Vec3f>(i,j).val[1]) || isnan(normals.at<Vec3f>(i,j).val[0]))
                 {
-                    cout << "Nan Skip : " << i << " " << j << endl;
+                    numberOfNanNormals++;
                 }
                 else
                 {
-                    averageNormal.at<float>(0,0) += normals.at<Vec3f>(i,j).val[2];
-                    averageNormal.at<float>(1,0) += normals.at<Vec3f>(i,j).val[1];
-                    averageNormal.at<float>(2,0) += normals.at<Vec3f>(i,j).val[0];
-                    numberOfNormalsAccounted += 1.0;
+                    normalSum[0] += normals.at<Vec3f>(i,j).val[2];
+                    normalSum[1] += normals.at<Vec3f>(i,j).val[1];
+                    normalSum[2] += normals.at<Vec3f>(i,j).val[0];
+                    numberOfNormals += 1.0;
                 }
             }
         }
     }
 
+    return numberOfNanNormals;
+}
+
+/**
+ * Returns the normalized average surface normal (3x1 CV_32FC1 vector, XYZ) given the sum of the normals.
+ * @brief averageSurfaceNormal
+ * @param normalSum
+ * @param numberOfNormals
+ * @return
+ */
+Mat averageSurfaceNormal(const double normalSum[3], double numberOfNormals)
+{
+    Mat averageNormal = Mat::zeros(3,1, CV_32FC1);
+
+    averageNormal.at<float>(0,0) = normalSum[0]/numberOfNormals;
+    averageNormal.at<float>(1,0) = normalSum[1]/numberOfNormals;
+    averageNormal.at<float>(2,0) = normalSum[2]/numberOfNormals;
 
-    averageNormal /= numberOfNormalsAccounted;
     normalizeVector(averageNormal);
 
-    cout << "Average surface normal : " << averageNormal << endl;
+    return averageNormal;
+}
+
+/**
+ * Rotates the normals so that averageNormal is aligned with (0,0,1)
+ * @brief rotateNormals
+ * @param normals
+ * @param averageNormal
+ */
+void rotateNormals(Mat &normals, const Mat &averageNormal)
+{
+    int height = normals.rows;
+    int width = normals.cols;
 
     /*----Compute the rotation matrix---*/
     //Align all the normals with normal with (0,0,1)
@@ -617,145 +994,213 @@ void alignAverageSurfaceNormal(Mat &normals, const Mat &mask)
 
     Mat rotationMatrix = makeRotationMatrix(axis, sin, cos);
 
+    //Read the rotation once : no matrix is allocated per pixel
+    float r[3][3];
+
+    for(int k = 0 ; k<3 ; k++)
+    {
+        for(int l = 0 ; l<3 ; l++)
+        {
+            r[k][l] = rotationMatrix.at<float>(k,l);
+        }
+    }
+
+    float x = 0.0, y = 0.0, z = 0.0;
+
     /*----Align all the normals---*/
     for(int i = 0 ; i<height ; i++)
     {
         for(int j = 0 ; j<width ; j++)
         {
-            Mat currentNormal = Mat::zeros(3,1, CV_32FC1);
-
-            currentNormal.at<float>(0,0) =  normals.at<Vec3f>(i,j).val[2];
-            currentNormal.at<float>(1,0) =  normals.at<Vec3f>(i,j).val[1];
-            currentNormal.at<float>(2,0) =  normals.at<Vec3f>(i,j).val[0];
+            Vec3f &normal = normals.at<Vec3f>(i,j);
 
-            currentNormal = rotationMatrix*currentNormal;
+            x = normal.val[2];
+            y = normal.val[1];
+            z = normal.val[0];
 
-            normals.at<Vec3f>(i,j).val[2] = currentNormal.at<float>(0,0) ;
-            normals.at<Vec3f>(i,j).val[1] = currentNormal.at<float>(1,0) ;
-            normals.at<Vec3f>(i,j).val[0] = currentNormal.at<float>(2,0) ;
+            normal.val[2] = r[0][0]*x+r[0][1]*y+r[0][2]*z;
+            normal.val[1] = r[1][0]*x+r[1][1]*y+r[1][2]*z;
+            normal.val[0] = r[2][0]*x+r[2][1]*y+r[2][2]*z;
         }
     }
 }
 
 /**
- * Calculates the roughness using both cross and parallel polarised data.
- * @brief computeRoughness
+ * Calculates the roughness map of the green channel from the parallel polarised data, without saving it.
+ * @brief computeRoughnessMap
  * @param parallelData
- * @param crossData
- * @param pathToFolder
+ * @param roughness
  */
-void computeRoughness(Mat parallelData[], Mat crossData[], string pathToFolder)
+void computeRoughnessMap(Mat parallelData[], Mat &roughness)
 {
-    Mat xGradient, minusXGradient;
-    Mat yGradient, minusYGradient;;
+    Mat *channelNormals[1] = {NULL};
 
-    //Remove the cross data from the parallel data for the L1 moments
-    xGradient = parallelData[1].clone()-crossData[1].clone();
-    minusXGradient = parallelData[2].clone()-crossData[2].clone();
+    computeSpecularMaps(SeparateGradients<1>(parallelData, NULL), channelNormals, &roughness, NULL);
+}
+
+/**
+ * Computes the maps of each colour channel (setPerChannelMaps) instead of the green channel only.
+ * @brief setPerChannelMaps
+ * @param enabled
+ */
+void setPerChannelMaps(bool enabled)
+{
+    computePerChannelMaps = enabled;
+}
 
-    yGradient = parallelData[3].clone()-crossData[3].clone();
-    minusYGradient = parallelData[4].clone()-crossData[4].clone();
+/**
+ * Returns true if the normals and the roughness are computed for each colour channel (false by default).
+ * @brief perChannelMaps
+ * @return
+ */
+bool perChannelMaps()
+{
+    return computePerChannelMaps;
+}
 
-    Mat horizontalGradient = minusXGradient-xGradient;
-    Mat verticalGradient = yGradient-minusYGradient;
+/**
+ * Computes the specular normals (without any alignment) and the roughness of the R, G and B channels
+ * with parallel data only, in a single pass over the gradients.
+ * The green channel gives the same results as computeSpecularNormals and computeRoughnessMap.
+ * @brief computeChannelNormalsAndRoughness
+ * @param parallelData
+ * @param blueNormals normals of each channel, BGR = ZYX.
+ * @param greenNormals
+ * @param redNormals
+ * @param roughness roughness of each channel (BGR).
+ * @param crossData cross polarised data, read for the diffuse normals only (can be NULL).
+ * @param diffuseNormals if not NULL, diffuse normals of the green channel of crossData (not aligned, BGR = ZYX), computed in the same pass.
+ */
+void computeChannelNormalsAndRoughness(Mat parallelData[], Mat &blueNormals, Mat &greenNormals, Mat &redNormals, Mat &roughness,
+                                       Mat crossData[], Mat *diffuseNormals)
+{
+    //In the order of the channels of the gradients
+    Mat *channelNormals[3] = {&blueNormals, &greenNormals, &redNormals};
 
-    //The general formula for the roughness is sigma^2 = L1^2/L0-L2/L0 with L1 and L2 the first and second order moments.
-    //Compute it in the x direction and the y direction
-    divide(horizontalGradient, parallelData[0]-crossData[0], horizontalGradient);
-    divide(verticalGradient, parallelData[0]-crossData[0], verticalGradient);
+    computeSpecularMaps(SeparateGradients<3>(parallelData, crossData), channelNormals, &roughness, diffuseNormals);
+}
 
-    Mat secondOrderGradientX = parallelData[5];
-    Mat secondOrderGradientY = parallelData[6];
+/**
+ * Computes the green channel normals and roughness from the gradient-major layout (interleaveGradients)
+ * instead of the 7 gradient images (false by default).
+ * @brief setInterleavedGradients
+ * @param enabled
+ */
+void setInterleavedGradients(bool enabled)
+{
+    useInterleavedGradients = enabled;
+}
 
-    divide(secondOrderGradientX, parallelData[0]-crossData[0], secondOrderGradientX);
-    divide(secondOrderGradientY, parallelData[0]-crossData[0], secondOrderGradientY);
+/**
+ * Returns true if the green channel normals and roughness are computed from the gradient-major layout.
+ * The layout is specific to the gradients of the LCD screen : it is not used with a description of the illumination patterns.
+ * @brief interleavedGradients
+ * @return
+ */
+bool interleavedGradients()
+{
+    return useInterleavedGradients && currentIlluminationPatterns() == NULL;
+}
 
-    secondOrderGradientX -= horizontalGradient.mul(horizontalGradient);
-    secondOrderGradientY -= verticalGradient.mul(verticalGradient);
+/**
+ * Computes the diffuse normals of the cross polarised gradients in the same pass as the specular normals (false by default).
+ * @brief setDiffuseNormalsEnabled
+ * @param enabled
+ */
+void setDiffuseNormalsEnabled(bool enabled)
+{
+    computeDiffuseNormals = enabled;
+}
 
-    //Calculate the final roughness is sigma^2 = sqrt(sigma_x^4+sigma_y^4)/4
-    Mat roughness = Mat::zeros(secondOrderGradientX.rows, secondOrderGradientX.cols, CV_32FC3);
+/**
+ * Returns true if the diffuse normals are computed with cross polarised data (false by default).
+ * @brief diffuseNormalsEnabled
+ * @return
+ */
+bool diffuseNormalsEnabled()
+{
+    return computeDiffuseNormals;
+}
 
-    int height = parallelData[0].rows;
-    int width = parallelData[0].cols;
+/**
+ * Packs the rows of the gradients in the gradient-major layout.
+ * Each row of the gradients is read once, the values of a pixel are written in the same cache line.
+ */
+class InterleaveGradientsBody : public ParallelLoopBody
+{
+public:
+    InterleaveGradientsBody(Mat parallelData[], const float maxima[], Mat &interleaved)
+        : m_parallelData(parallelData), m_maxima(maxima), m_interleaved(interleaved) {}
 
-    for(int i = 0 ; i<height ; i++)
+    void operator()(const Range &rows) const
     {
-        for(int j = 0 ; j<width ; j++)
+        int width = m_interleaved.cols;
+
+        for(int i = rows.start ; i<rows.end ; i++)
         {
-            roughness.at<Vec3f>(i,j).val[0] = sqrt(secondOrderGradientX.at<Vec3f>(i,j).val[1]*secondOrderGradientX.at<Vec3f>(i,j).val[1]
-                    +secondOrderGradientY.at<Vec3f>(i,j).val[1]*secondOrderGradientY.at<Vec3f>(i,j).val[1]);
+            float *values = m_interleaved.ptr<float>(i);
 
-            roughness.at<Vec3f>(i,j).val[1] = sqrt(secondOrderGradientX.at<Vec3f>(i,j).val[1]*secondOrderGradientX.at<Vec3f>(i,j).val[1]
-                    +secondOrderGradientY.at<Vec3f>(i,j).val[1]*secondOrderGradientY.at<Vec3f>(i,j).val[1]);
+            for(int k = 0 ; k<NUMBER_OF_GRADIENT_ILLUMINATION ; k++)
+            {
+                const Vec3f *gradient = m_parallelData[k].ptr<Vec3f>(i);
+
+                //Same division as divideByMaximum (no scaling without a positive maximum)
+                if(m_maxima[k] > 0.0)
+                {
+                    for(int j = 0 ; j<width ; j++)
+                    {
+                        values[INTERLEAVED_GRADIENT_STRIDE*j+k] = gradient[j].val[1]/m_maxima[k];
+                    }
+                }
+                else
+                {
+                    for(int j = 0 ; j<width ; j++)
+                    {
+                        values[INTERLEAVED_GRADIENT_STRIDE*j+k] = gradient[j].val[1];
+                    }
+                }
+            }
 
-            roughness.at<Vec3f>(i,j).val[2] = sqrt(secondOrderGradientX.at<Vec3f>(i,j).val[1]*secondOrderGradientX.at<Vec3f>(i,j).val[1]
-                    +secondOrderGradientY.at<Vec3f>(i,j).val[1]*secondOrderGradientY.at<Vec3f>(i,j).val[1]);
+            for(int j = 0 ; j<width ; j++)
+            {
+                values[INTERLEAVED_GRADIENT_STRIDE*j+NUMBER_OF_GRADIENT_ILLUMINATION] = 0.0;
+            }
         }
     }
 
-    roughness /= 4.0;
-
-    savePFM(roughness, pathToFolder + "/textures/roughness.pfm");
-
-}
+private:
+    Mat *m_parallelData;
+    const float *m_maxima;
+    Mat &m_interleaved;
+};
 
 /**
- * Calculates the roughness using only parallel polarised data.
- * @brief computeRoughness
+ * Packs the green channel of the 7 gradients of each pixel next to each other (gradient-major layout,
+ * INTERLEAVED_GRADIENT_STRIDE floats per pixel) and divides them by the maximum of their gradient as divideByMaximum.
+ * The solvers then read one contiguous stream instead of one stream per gradient. The gradients are not modified.
+ * @brief interleaveGradients
  * @param parallelData
- * @param pathToFolder
+ * @param maxima maximum of each gradient (scaleTo01Range).
+ * @param interleaved CV_32FC(INTERLEAVED_GRADIENT_STRIDE) image, taken from the buffer pool.
  */
-void computeRoughness(Mat parallelData[], string pathToFolder)
+void interleaveGradients(Mat parallelData[], const float maxima[], Mat &interleaved)
 {
-    Mat xGradient, minusXGradient;
-    Mat yGradient, minusYGradient;;
-
-    xGradient = parallelData[1].clone();
-    minusXGradient = parallelData[2].clone();
-
-    yGradient = parallelData[3].clone();
-    minusYGradient = parallelData[4].clone();
-
-    //The general formula for the roughness is sigma^2 = L1^2/L0-L2/L0 with L1 and L2 the first and second order moments.
-    //Compute it in the x direction and the y direction
-    Mat horizontalGradient = minusXGradient-xGradient;
-    Mat verticalGradient = yGradient-minusYGradient;
-
-    divide(horizontalGradient, parallelData[0], horizontalGradient);
-    divide(verticalGradient, parallelData[0], verticalGradient);
-
-    Mat secondOrderGradientX = parallelData[5];
-    Mat secondOrderGradientY = parallelData[6];
-
-    divide(secondOrderGradientX, parallelData[0], secondOrderGradientX);
-    divide(secondOrderGradientY, parallelData[0], secondOrderGradientY);
-
-    secondOrderGradientX -= horizontalGradient.mul(horizontalGradient);
-    secondOrderGradientY -= verticalGradient.mul(verticalGradient);
+    createPooledImage(interleaved, parallelData[0].rows, parallelData[0].cols, CV_32FC(INTERLEAVED_GRADIENT_STRIDE));
 
-    //Calculate the final roughness is sigma^2 = sqrt(sigma_x^4+sigma_y^4)/4
-    Mat roughness = Mat::zeros(secondOrderGradientX.rows, secondOrderGradientX.cols, CV_32FC3);
-
-    int height = parallelData[0].rows;
-    int width = parallelData[0].cols;
-
-    for(int i = 0 ; i<height ; i++)
-    {
-        for(int j = 0 ; j<width ; j++)
-        {
-            //sigma^4 = sqrt(sigmaSquaredX^2+sigmaSquaredY^2)
-            roughness.at<Vec3f>(i,j).val[0] = sqrt(sqrt(secondOrderGradientX.at<Vec3f>(i,j).val[1]*secondOrderGradientX.at<Vec3f>(i,j).val[1]
-                    +secondOrderGradientY.at<Vec3f>(i,j).val[1]*secondOrderGradientY.at<Vec3f>(i,j).val[1]));
-
-            roughness.at<Vec3f>(i,j).val[1] = sqrt(sqrt(secondOrderGradientX.at<Vec3f>(i,j).val[1]*secondOrderGradientX.at<Vec3f>(i,j).val[1]
-                    +secondOrderGradientY.at<Vec3f>(i,j).val[1]*secondOrderGradientY.at<Vec3f>(i,j).val[1]));
+    parallel_for_(Range(0, interleaved.rows), InterleaveGradientsBody(parallelData, maxima, interleaved));
+}
 
-            roughness.at<Vec3f>(i,j).val[2] = sqrt(sqrt(secondOrderGradientX.at<Vec3f>(i,j).val[1]*secondOrderGradientX.at<Vec3f>(i,j).val[1]
-                    +secondOrderGradientY.at<Vec3f>(i,j).val[1]*secondOrderGradientY.at<Vec3f>(i,j).val[1]));
-          }
-    }
+/**
+ * Computes the specular normals (without any alignment) and the roughness of the green channel from the
+ * gradient-major layout, in a single parallel pass. Same results as computeSpecularNormals and computeRoughnessMap.
+ * @brief computeInterleavedNormalsAndRoughness
+ * @param interleaved gradients packed by interleaveGradients.
+ * @param normals BGR = ZYX.
+ * @param roughness
+ */
+void computeInterleavedNormalsAndRoughness(const Mat &interleaved, Mat &normals, Mat &roughness)
+{
+    Mat *channelNormals[1] = {&normals};
 
-    roughness /= 4.0;
-    savePFM(roughness, pathToFolder + "/textures/roughness.pfm");
+    computeSpecularMaps(InterleavedGradients(interleaved), channelNormals, &roughness, NULL);
 }
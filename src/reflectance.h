@@ -41,11 +41,24 @@
 #define REFLECTANCE
 
 #define M_PI 3.14159265358979323846
+//Number of gradients of the LCD screen, see numberOfGradients() for the gradients of a capture
 #define NUMBER_OF_GRADIENT_ILLUMINATION 7
 
+//Values per pixel in the gradient-major layout : the green channel of the 7 gradients and one padding value (32 bytes)
+#define INTERLEAVED_GRADIENT_STRIDE 8
+
+//Number of the first picture (IMG_XXXX.JPG) in the par and cross folders
+#define PARALLEL_FIRST_IMAGE_NUMBER 2855
+#define CROSS_FIRST_IMAGE_NUMBER 2869
+
 #include "imageprocessing.h"
 #include "mathfunctions.h"
 #include "PFMReadWrite.h"
+#include "heightmap.h"
+#include "outputwriter.h"
+#include "multishot.h"
+#include "diagnostics.h"
+#include "illumination.h"
 
 /*---- OpenCV ----*/
 #include <opencv2/core/core.hpp>
@@ -55,6 +68,7 @@
 #include <cmath>
 #include <string>
 #include <sstream>
+#include <vector>
 #include <fstream>
 
 #include "mathfunctions.h"
@@ -62,67 +76,112 @@
 
 /**
  * Function to compute the reflectance maps given the path to the data folder and a bool that says if the
- * cross polarised data exists.
+ * cross polarised data exists. Kept for the existing callers : the capture is computed by computeCaptureMaps
+ * (see capturetile.h) and the files are written before the function returns. Exits the program if the capture
+ * could not be computed or one of the files could not be written.
  * @brief computeMaps
  * @param pathToFolder
  * @param isCrossData
  */
 void computeMaps(std::string pathToFolder, bool isCrossData);
 
+/**
+ * Loads an 8 bits image and converts it to a CV_32FC3 image in the 0;1 range.
+ * If a non empty region is given, only this region of the image is kept.
+ * The buffer of image is reused if it already has the right size.
+ * @brief loadLinearImage
+ * @param filePath
+ * @param image
+ * @param removeGamma set to true to remove the gamma correction of the camera.
+ * @param region
+ * @return false if the image could not be loaded.
+ */
+bool loadLinearImage(std::string filePath, cv::Mat &image, bool removeGamma, cv::Rect region = cv::Rect());
 
 /**
- * Scale the value of parallel polarised data to the value of the checkerchart.
- * @brief checkerchartScaling
- * @param parallelData
- * @param mask
+ * Loads the gradient illumination images and the ambient illumination of a folder (par or cross)
+ * and removes the ambient illumination from the gradients.
+ * The images are supposed to have a name : IMG_XXXX where XXXX is a number starting at firstImageNumber.
+ * With several shots per image (see multishot.h) the shots are averaged.
+ * @brief loadGradientImages
  * @param pathToFolder
+ * @param subFolder
+ * @param firstImageNumber
+ * @param images array of numberOfGradients() images.
+ * @param region
+ * @param noise if not NULL, the variances of the shots of the gradients are added to it.
+ * @param saturatedPixels if not NULL, the saturated pixels of the gradients are added to it (see diagnostics.h).
+ * @return false if one of the images could not be loaded.
  */
-void checkerchartScaling(cv::Mat parallelData[], const cv::Mat &mask, std::string pathToFolder);
+bool loadGradientImages(std::string pathToFolder, std::string subFolder, unsigned int firstImageNumber, cv::Mat images[],
+                        cv::Rect region = cv::Rect(), cv::Mat *noise = NULL, std::vector<int> *saturatedPixels = NULL);
 
 /**
- * Scale the value of parallel and cross polarised data to the value of the checkerchart.
- * @brief checkerchartScaling
- * @param parallelData
- * @param crossData
- * @param mask
+ * Reads the checker.txt file and computes the ratios between the checkerchart reflectance and the measured values.
+ * The ratios are stored in BGR order, as the OpenCV images.
+ * @brief readCheckerchartRatios
  * @param pathToFolder
+ * @param isCrossData set to true to also read the second line (cross polarised values).
+ * @param ratioPar
+ * @param ratioCross
+ * @return false if the file could not be read.
  */
-void checkerchartScaling(cv::Mat parallelData[], cv::Mat crossData[], const cv::Mat &mask, std::string pathToFolder);
+bool readCheckerchartRatios(std::string pathToFolder, bool isCrossData, cv::Vec3f &ratioPar, cv::Vec3f &ratioCross);
 
 /**
- * Compute the diffuse and specular albedo given parallel and cross polarised data.
- * Also requires a mask on which data is computed.
- * @brief checkerchartScaling
- * @param parallelData
- * @param mask
- * @param pathToFolder
+ * White balancing with the checkerchart : multiplies each channel of the images by the corresponding ratio.
+ * @brief applyCheckerchartRatios
+ * @param images
+ * @param numberOfImages
+ * @param ratio BGR ratios returned by readCheckerchartRatios.
+ */
+void applyCheckerchartRatios(cv::Mat images[], int numberOfImages, cv::Vec3f ratio);
+
+/**
+ * Separates the diffuse and specular albedos of the order 0 gradients (not scaled).
+ * The cross polarised image contains the diffuse only and the parallel polarised image diffuse+specular.
+ * Without cross polarised image (empty), the diffuse map is released and the specular map is the parallel image.
+ * The maps are taken from the buffer pool unless they already have the right size.
+ * @brief separateDiffuseSpecular
+ * @param parallelImage
+ * @param crossImage
+ * @param diffuse
+ * @param specular
  */
-void diffuseSpecularSeparation(cv::Mat parallelData[], cv::Mat crossData[], const cv::Mat &mask, std::string pathToFolder);
+void separateDiffuseSpecular(const cv::Mat &parallelImage, const cv::Mat &crossImage, cv::Mat &diffuse, cv::Mat &specular);
 
 /**
- * Compute the specular normals given parallel and cross data.
- * Also requires a mask on which data is computed.
- * The sample is assumed to be almost flat without big variations in the z component of the normal.
- * Therefore the measurements have been made without the zGradients.
+ * Compute the specular normals of the green channel from the parallel polarised data, without any alignment.
+ * The specular normals are stored as BGR = ZYX in a CV_32FC3 image.
+ * @brief computeSpecularNormals
  * @param parallelData
- * @param crossData
- * @param mask
- * @param pathToFolder
+ * @param crossData cross polarised data, read for the diffuse normals only (can be NULL).
+ * @param normals
+ * @param diffuseNormals if not NULL, diffuse normals of the green channel of crossData (not aligned, BGR = ZYX), computed in the same pass.
  */
-void computeNormals(cv::Mat parallelData[], cv::Mat crossData[], const cv::Mat &mask, std::string pathToFolder);
+void computeSpecularNormals(cv::Mat parallelData[], cv::Mat crossData[], cv::Mat &normals, cv::Mat *diffuseNormals = NULL);
 
 /**
- * Compute the specular normals given parallel and cross data.
- * Also requires a mask on which data is computed.
- * The sample is assumed to be almost flat without big variations in the z component of the normal.
- * Therefore the measurements have been made without the zGradients.
- * @brief computeNormals
+ * Computes the specular normals (without any alignment) and the roughness of the green channel in a single pass
+ * over the parallel polarised gradients. Same results as computeSpecularNormals and computeRoughnessMap.
+ * @brief computeSpecularNormalsAndRoughness
  * @param parallelData
- * @param crossData
- * @param mask
- * @param pathToFolder
+ * @param crossData cross polarised data, read for the diffuse normals only (can be NULL).
+ * @param normals BGR = ZYX.
+ * @param roughness
+ * @param diffuseNormals if not NULL, diffuse normals of the green channel of crossData (not aligned, BGR = ZYX), computed in the same pass.
  */
-void computeNormals(cv::Mat parallelData[], const cv::Mat &mask, std::string pathToFolder);
+void computeSpecularNormalsAndRoughness(cv::Mat parallelData[], cv::Mat crossData[], cv::Mat &normals, cv::Mat &roughness,
+                                        cv::Mat *diffuseNormals = NULL);
+
+/**
+ * Maps the normals from [-1;1] to [0;255] and saves them as an 8 bits BMP image (no gamma).
+ * @brief saveNormalMap
+ * @param normals
+ * @param filePath
+ * @return false if the file could not be written.
+ */
+bool saveNormalMap(cv::Mat normals, std::string filePath);
 
 /**
  * Remove ambient illumination from a set of images.
@@ -134,29 +193,124 @@ void computeNormals(cv::Mat parallelData[], const cv::Mat &mask, std::string pat
 void removeAmbientIllumination(cv::Mat images[], int numberOfImages, const cv::Mat &ambient);
 
 /**
- * Rotates the normals so that the average surface normal is (0,0,1)
- * @brief alignAverageSurfaceNormal
+ * Adds the XYZ components of the normals inside the mask to normalSum and counts them.
+ * NaN normals are skipped. Can be called on several tiles of the same image before calling averageSurfaceNormal.
+ * @brief accumulateSurfaceNormals
  * @param normals
  * @param mask
+ * @param normalSum
+ * @param numberOfNormals
+ * @return number of NaN normals skipped inside the mask.
  */
-void alignAverageSurfaceNormal(cv::Mat &normals, const cv::Mat &mask);
+long long accumulateSurfaceNormals(const cv::Mat &normals, const cv::Mat &mask, double normalSum[3], double &numberOfNormals);
 
 /**
- * Calculates the roughness using both cross and parallel polarised data.
- * @brief computeRoughness
+ * Returns the normalized average surface normal (3x1 CV_32FC1 vector, XYZ) given the sum of the normals.
+ * @brief averageSurfaceNormal
+ * @param normalSum
+ * @param numberOfNormals
+ * @return
+ */
+cv::Mat averageSurfaceNormal(const double normalSum[3], double numberOfNormals);
+
+/**
+ * Rotates the normals so that averageNormal is aligned with (0,0,1)
+ * @brief rotateNormals
+ * @param normals
+ * @param averageNormal
+ */
+void rotateNormals(cv::Mat &normals, const cv::Mat &averageNormal);
+
+/**
+ * Calculates the roughness map of the green channel from the parallel polarised data, without saving it.
+ * @brief computeRoughnessMap
  * @param parallelData
- * @param crossData
- * @param pathToFolder
+ * @param roughness
+ */
+void computeRoughnessMap(cv::Mat parallelData[], cv::Mat &roughness);
+
+/**
+ * Computes the maps of each colour channel (setPerChannelMaps) instead of the green channel only.
+ * @brief setPerChannelMaps
+ * @param enabled
  */
-void computeRoughness(cv::Mat parallelData[], cv::Mat crossData[], std::string pathToFolder);
+void setPerChannelMaps(bool enabled);
 
 /**
- * Calculates the roughness using only parallel polarised data.
- * @brief computeRoughness
+ * Returns true if the normals and the roughness are computed for each colour channel (false by default).
+ * @brief perChannelMaps
+ * @return
+ */
+bool perChannelMaps();
+
+/**
+ * Computes the specular normals (without any alignment) and the roughness of the R, G and B channels
+ * with parallel data only, in a single pass over the gradients.
+ * The green channel gives the same results as computeSpecularNormals and computeRoughnessMap.
+ * @brief computeChannelNormalsAndRoughness
  * @param parallelData
- * @param pathToFolder
+ * @param blueNormals normals of each channel, BGR = ZYX.
+ * @param greenNormals
+ * @param redNormals
+ * @param roughness roughness of each channel (BGR).
+ * @param crossData cross polarised data, read for the diffuse normals only (can be NULL).
+ * @param diffuseNormals if not NULL, diffuse normals of the green channel of crossData (not aligned, BGR = ZYX), computed in the same pass.
+ */
+void computeChannelNormalsAndRoughness(cv::Mat parallelData[], cv::Mat &blueNormals, cv::Mat &greenNormals, cv::Mat &redNormals, cv::Mat &roughness,
+                                       cv::Mat crossData[] = NULL, cv::Mat *diffuseNormals = NULL);
+
+/**
+ * Computes the green channel normals and roughness from the gradient-major layout (interleaveGradients)
+ * instead of the 7 gradient images (false by default).
+ * @brief setInterleavedGradients
+ * @param enabled
+ */
+void setInterleavedGradients(bool enabled);
+
+/**
+ * Returns true if the green channel normals and roughness are computed from the gradient-major layout.
+ * The layout is specific to the gradients of the LCD screen : it is not used with a description of the illumination patterns.
+ * @brief interleavedGradients
+ * @return
+ */
+bool interleavedGradients();
+
+/**
+ * Computes the diffuse normals of the cross polarised gradients in the same pass as the specular normals (false by default).
+ * The diffuse lobe is centred on the surface normal : the diffuse normals are smooth and complete the sharper specular normals.
+ * They are computed with cross polarised data only, for the green channel, and saved in diffuseNormalMap.bmp.
+ * @brief setDiffuseNormalsEnabled
+ * @param enabled
+ */
+void setDiffuseNormalsEnabled(bool enabled);
+
+/**
+ * Returns true if the diffuse normals are computed with cross polarised data (false by default).
+ * @brief diffuseNormalsEnabled
+ * @return
+ */
+bool diffuseNormalsEnabled();
+
+/**
+ * Packs the green channel of the 7 gradients of each pixel next to each other (gradient-major layout,
+ * INTERLEAVED_GRADIENT_STRIDE floats per pixel) and divides them by the maximum of their gradient as divideByMaximum.
+ * The solvers then read one contiguous stream instead of one stream per gradient. The gradients are not modified.
+ * @brief interleaveGradients
+ * @param parallelData
+ * @param maxima maximum of each gradient (scaleTo01Range).
+ * @param interleaved CV_32FC(INTERLEAVED_GRADIENT_STRIDE) image, taken from the buffer pool.
+ */
+void interleaveGradients(cv::Mat parallelData[], const float maxima[], cv::Mat &interleaved);
+
+/**
+ * Computes the specular normals (without any alignment) and the roughness of the green channel from the
+ * gradient-major layout, in a single parallel pass. Same results as computeSpecularNormals and computeRoughnessMap.
+ * @brief computeInterleavedNormalsAndRoughness
+ * @param interleaved gradients packed by interleaveGradients.
+ * @param normals BGR = ZYX.
+ * @param roughness
  */
-void computeRoughness(cv::Mat parallelData[], std::string pathToFolder);
+void computeInterleavedNormalsAndRoughness(const cv::Mat &interleaved, cv::Mat &normals, cv::Mat &roughness);
 
 #endif // REFLECTANCE
 
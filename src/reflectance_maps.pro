@@ -6,12 +6,32 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets printsupport
 TARGET = reflectance_maps
 TEMPLATE = app
 
+CONFIG += c++11
+
 
 SOURCES += main.cpp \
     PFMReadWrite.cpp \
     reflectance.cpp \
     imageprocessing.cpp \
-    mathfunctions.cpp
+    mathfunctions.cpp \
+    capturetile.cpp \
+    bufferpool.cpp \
+    memoryplanner.cpp \
+    synthetic.cpp \
+    heightmap.cpp \
+    mipchain.cpp \
+    blockcompression.cpp \
+    outputwriter.cpp \
+    multishot.cpp \
+    diagnostics.cpp \
+    regionofinterest.cpp \
+    calibration.cpp \
+    taskgraph.cpp \
+    mosaic.cpp \
+    illumination.cpp \
+    kernelprecision.cpp \
+    labelmask.cpp \
+    microfacet.cpp
 
 
 
@@ -20,7 +40,33 @@ HEADERS  += \
     PFMReadWrite.h \
     reflectance.h \
     imageprocessing.h \
-    mathfunctions.h
+    mathfunctions.h \
+    capturetile.h \
+    bufferpool.h \
+    memoryplanner.h \
+    synthetic.h \
+    heightmap.h \
+    mipchain.h \
+    blockcompression.h \
+    outputwriter.h \
+    multishot.h \
+    diagnostics.h \
+    regionofinterest.h \
+    calibration.h \
+    taskgraph.h \
+    mosaic.h \
+    illumination.h \
+    kernelprecision.h \
+    labelmask.h \
+    microfacet.h
+
+unix:SOURCES += distributed.cpp \
+    daemon.cpp
+unix:HEADERS += distributed.h \
+    daemon.h
+
+linux:SOURCES += watchfolder.cpp
+linux:HEADERS += watchfolder.h
 
 ##################### OpenCV   ##############################
 
@@ -0,0 +1,376 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file regionofinterest.cpp
+ * \brief Implementation of the recomputation of the maps of a region of a capture.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the recomputation of the maps of a region of a capture.
+ */
+
+#include "regionofinterest.h"
+#include "calibration.h"
+#include "microfacet.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+using namespace std;
+using namespace cv;
+
+//Identifies the statistics files written with the same layout of CaptureStatistics
+#define STATISTICS_FILE_MAGIC "RMSTATS4"
+
+/**
+ * Global statistics of a computed capture and the data they were computed with.
+ * @brief The CachedStatistics struct
+ */
+struct CachedStatistics
+{
+    char magic[8];
+    int width;
+    int height;
+    int isCrossData;
+    int shots;
+    int gradients;
+    //Settings that change the maxima of the albedos : flat field calibration (FNV-1a hash of flatFieldFile()),
+    //microfacet model and division by its directional albedo
+    unsigned long long flatFieldHash;
+    int microfacetModel;
+    int fresnelAlbedo;
+    CaptureStatistics statistics;
+};
+
+static mutex statisticsMutex;
+static map<string, CachedStatistics> cachedStatistics;
+
+//Decoded images of the last capture whose regions were computed
+static mutex framesMutex;
+static string framesFolder;
+static CaptureFrames regionFrames;
+
+/**
+ * Returns the path of the file of the statistics of a capture.
+ * @brief statisticsFilePath
+ * @param pathToFolder
+ * @return
+ */
+static string statisticsFilePath(string pathToFolder)
+{
+    return pathToFolder + "/textures/statistics.dat";
+}
+
+/**
+ * Returns the FNV-1a hash (64 bits) of a text, the same on every platform.
+ * @brief textHash
+ * @param text
+ * @return
+ */
+static unsigned long long textHash(string text)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for(size_t i = 0 ; i<text.size() ; i++)
+    {
+        hash ^= (unsigned char) text[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Returns 1 if the specular albedo is divided by the directional albedo of a microfacet model, 0 otherwise.
+ * @brief fresnelAlbedoSetting
+ * @return
+ */
+static int fresnelAlbedoSetting()
+{
+    return microfacetModel() != NO_MICROFACET_MODEL && fresnelAlbedoEnabled() ? 1 : 0;
+}
+
+/**
+ * Writes the cached statistics of a capture.
+ * @brief writeStatisticsFile
+ * @param cache
+ * @param filePath
+ * @return false if the file could not be written.
+ */
+static bool writeStatisticsFile(const CachedStatistics &cache, string filePath)
+{
+    ofstream file(filePath.c_str(), ios::out | ios::trunc | ios::binary);
+
+    if(!file)
+    {
+        return false;
+    }
+
+    file.write((const char*) &cache, sizeof(CachedStatistics));
+
+    return file.good();
+}
+
+/**
+ * Caches the global statistics of a capture once its second reduction is done : in memory and in
+ * textures/statistics.dat (written by the output writer, group pathToFolder).
+ * The decoded images of the capture kept for the regions are released.
+ * @brief storeCaptureStatistics
+ * @param pathToFolder
+ * @param isCrossData
+ * @param imageSize
+ * @param statistics
+ */
+void storeCaptureStatistics(string pathToFolder, bool isCrossData, Size imageSize, const CaptureStatistics &statistics)
+{
+    //The padding of the struct is written to the file as well
+    CachedStatistics cache;
+    memset((void*) &cache, 0, sizeof(CachedStatistics));
+    memcpy(cache.magic, STATISTICS_FILE_MAGIC, sizeof(cache.magic));
+    cache.width = imageSize.width;
+    cache.height = imageSize.height;
+    cache.isCrossData = isCrossData ? 1 : 0;
+    cache.shots = numberOfShots();
+    cache.gradients = numberOfGradients();
+    cache.flatFieldHash = textHash(flatFieldFile());
+    cache.microfacetModel = microfacetModel();
+    cache.fresnelAlbedo = fresnelAlbedoSetting();
+    cache.statistics = statistics;
+
+    {
+        lock_guard<mutex> lock(statisticsMutex);
+        cachedStatistics[pathToFolder] = cache;
+    }
+
+    //The images may have changed since they were decoded
+    {
+        lock_guard<mutex> lock(framesMutex);
+
+        if(framesFolder == pathToFolder)
+        {
+            framesFolder.clear();
+            regionFrames = CaptureFrames();
+        }
+    }
+
+    string filePath = statisticsFilePath(pathToFolder);
+
+    writeOutputAsync(pathToFolder, filePath, [cache, filePath]() { return writeStatisticsFile(cache, filePath); });
+}
+
+/**
+ * Returns the cached statistics of a capture, from memory or from textures/statistics.dat.
+ * @brief loadCaptureStatistics
+ * @param pathToFolder
+ * @param isCrossData
+ * @param imageSize
+ * @param statistics
+ * @return false if the capture has not been computed with the same data (cross polarised data, shots, gradients)
+ *         or the same settings (flat field calibration, microfacet model, Fresnel albedo).
+ */
+bool loadCaptureStatistics(string pathToFolder, bool isCrossData, Size &imageSize, CaptureStatistics &statistics)
+{
+    CachedStatistics cache;
+    bool found = false;
+
+    {
+        lock_guard<mutex> lock(statisticsMutex);
+        map<string, CachedStatistics>::iterator entry = cachedStatistics.find(pathToFolder);
+
+        if(entry != cachedStatistics.end())
+        {
+            cache = entry->second;
+            found = true;
+        }
+    }
+
+    if(!found)
+    {
+        ifstream file(statisticsFilePath(pathToFolder).c_str(), ios::in | ios::binary);
+
+        found = file.read((char*) &cache, sizeof(CachedStatistics)) && memcmp(cache.magic, STATISTICS_FILE_MAGIC, sizeof(cache.magic)) == 0;
+
+        if(found)
+        {
+            lock_guard<mutex> lock(statisticsMutex);
+            cachedStatistics[pathToFolder] = cache;
+        }
+    }
+
+    if(!found || cache.isCrossData != (isCrossData ? 1 : 0) || cache.shots != numberOfShots() || cache.gradients != numberOfGradients())
+    {
+        cerr << "The statistics of " << pathToFolder << " are not available : compute the whole capture first"
+             << (isCrossData ? "" : " (with --no-cross)") << endl;
+        return false;
+    }
+
+    if(cache.flatFieldHash != textHash(flatFieldFile()) || cache.microfacetModel != microfacetModel()
+       || cache.fresnelAlbedo != fresnelAlbedoSetting())
+    {
+        cerr << "The statistics of " << pathToFolder << " were computed with another flat field calibration or microfacet model :"
+             << " compute the whole capture again" << endl;
+        return false;
+    }
+
+    imageSize = Size(cache.width, cache.height);
+    statistics = cache.statistics;
+
+    return true;
+}
+
+/**
+ * Computes the maps of a region of a capture with the cached statistics of the capture : albedos in the 0;1 range
+ * of the capture, normals aligned with the average surface normal of the capture, roughness.
+ * @brief computeRegionMaps
+ * @param pathToFolder
+ * @param isCrossData
+ * @param region
+ * @param tile
+ * @param keepFrames set to true to decode the images of the capture once and keep them for the next regions,
+ *        false to decode the images and keep the region only.
+ * @return false if the statistics of the capture are not cached, the region is not inside the capture or
+ *         one of the files could not be loaded.
+ */
+bool computeRegionMaps(string pathToFolder, bool isCrossData, Rect region, CaptureTile &tile, bool keepFrames)
+{
+    Size imageSize;
+    CaptureStatistics statistics;
+
+    if(!loadCaptureStatistics(pathToFolder, isCrossData, imageSize, statistics))
+    {
+        return false;
+    }
+
+    if(region.width <= 0 || region.height <= 0 || (region & Rect(0, 0, imageSize.width, imageSize.height)) != region)
+    {
+        cerr << "The region " << region.x << "," << region.y << "," << region.width << "," << region.height
+             << " is not inside the capture (" << imageSize.width << "x" << imageSize.height << ")" << endl;
+        return false;
+    }
+
+    if(keepFrames)
+    {
+        lock_guard<mutex> lock(framesMutex);
+
+        if(framesFolder != pathToFolder || regionFrames.isCrossData != isCrossData)
+        {
+            framesFolder.clear();
+
+            if(!loadCaptureFrames(pathToFolder, isCrossData, regionFrames))
+            {
+                regionFrames = CaptureFrames();
+                return false;
+            }
+
+            framesFolder = pathToFolder;
+        }
+
+        linearizeCaptureTile(regionFrames, region, tile);
+    }
+    else if(!loadCaptureTile(pathToFolder, isCrossData, region, tile))
+    {
+        return false;
+    }
+
+    //Same computations as the tiles of the capture, with the statistics of the whole capture
+    computeTileMaps(tile, statistics);
+    releaseTileGradients(tile);
+    finalizeTileMaps(tile, statistics);
+
+    return true;
+}
+
+/**
+ * Queues the maps of a region to the output writer (group pathToFolder) : roi_diffuse.pfm (with cross polarised data only),
+ * roi_specular.pfm, roi_normalMap.bmp (and roi_normalMap_red.bmp, roi_normalMap_blue.bmp, roi_diffuseNormalMap.bmp
+ * if computed) and roi_roughness.pfm in the textures folder.
+ * @brief saveRegionMaps
+ * @param maps
+ * @param pathToFolder
+ */
+void saveRegionMaps(const ReflectanceMaps &maps, string pathToFolder)
+{
+    if(!maps.diffuse.empty())
+    {
+        savePFMAsync(pathToFolder, maps.diffuse, pathToFolder + "/textures/roi_diffuse.pfm");
+    }
+
+    savePFMAsync(pathToFolder, maps.specular, pathToFolder + "/textures/roi_specular.pfm");
+    saveNormalMapAsync(pathToFolder, maps.normals, pathToFolder + "/textures/roi_normalMap.bmp");
+
+    if(!maps.redNormals.empty())
+    {
+        saveNormalMapAsync(pathToFolder, maps.redNormals, pathToFolder + "/textures/roi_normalMap_red.bmp");
+        saveNormalMapAsync(pathToFolder, maps.blueNormals, pathToFolder + "/textures/roi_normalMap_blue.bmp");
+    }
+
+    if(!maps.diffuseNormals.empty())
+    {
+        saveNormalMapAsync(pathToFolder, maps.diffuseNormals, pathToFolder + "/textures/roi_diffuseNormalMap.bmp");
+    }
+
+    savePFMAsync(pathToFolder, maps.roughness, pathToFolder + "/textures/roi_roughness.pfm");
+}
+
+/**
+ * Parses a region given as x,y,width,height.
+ * @brief parseRegion
+ * @param text
+ * @param region
+ * @return false if the text is not a valid region.
+ */
+bool parseRegion(string text, Rect &region)
+{
+    istringstream stream(text);
+    char separator[3] = {0, 0, 0};
+
+    stream >> region.x >> separator[0] >> region.y >> separator[1] >> region.width >> separator[2] >> region.height;
+
+    return stream && separator[0] == ',' && separator[1] == ',' && separator[2] == ','
+           && region.x >= 0 && region.y >= 0 && region.width > 0 && region.height > 0;
+}
+
+/**
+ * Releases the decoded images kept for the regions.
+ * @brief releaseRegionFrames
+ */
+void releaseRegionFrames()
+{
+    lock_guard<mutex> lock(framesMutex);
+
+    framesFolder.clear();
+    regionFrames = CaptureFrames();
+}
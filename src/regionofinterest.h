@@ -0,0 +1,121 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file regionofinterest.h
+ * \brief Implementation of the recomputation of the maps of a region of a capture.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The maps of a region only depend on the pixels of the region and on the global statistics of the capture
+ * (maxima of scaleTo01Range and average surface normal, see CaptureStatistics). The statistics are cached when
+ * a whole capture is computed (in memory and in textures/statistics.dat) so that a region can be recomputed alone
+ * with the tile computation : the maps of the region are identical to the same region of the maps of the capture.
+ *
+ * The height map and the mip chains are global and are not computed for a region.
+ * For repeated requests (viewer, daemon, Python bindings) the decoded images of the last capture are kept in memory
+ * (CaptureFrames) : a request only converts the region to float and computes its maps.
+ */
+
+#ifndef REGIONOFINTEREST
+#define REGIONOFINTEREST
+
+#include "capturetile.h"
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+
+/**
+ * Caches the global statistics of a capture once its second reduction is done : in memory and in
+ * textures/statistics.dat (written by the output writer, group pathToFolder).
+ * The decoded images of the capture kept for the regions are released.
+ * @brief storeCaptureStatistics
+ * @param pathToFolder
+ * @param isCrossData
+ * @param imageSize
+ * @param statistics
+ */
+void storeCaptureStatistics(std::string pathToFolder, bool isCrossData, cv::Size imageSize, const CaptureStatistics &statistics);
+
+/**
+ * Returns the cached statistics of a capture, from memory or from textures/statistics.dat.
+ * @brief loadCaptureStatistics
+ * @param pathToFolder
+ * @param isCrossData
+ * @param imageSize
+ * @param statistics
+ * @return false if the capture has not been computed with the same data (cross polarised data, shots, gradients).
+ */
+bool loadCaptureStatistics(std::string pathToFolder, bool isCrossData, cv::Size &imageSize, CaptureStatistics &statistics);
+
+/**
+ * Computes the maps of a region of a capture with the cached statistics of the capture : albedos in the 0;1 range
+ * of the capture, normals aligned with the average surface normal of the capture, roughness.
+ * @brief computeRegionMaps
+ * @param pathToFolder
+ * @param isCrossData
+ * @param region
+ * @param tile
+ * @param keepFrames set to true to decode the images of the capture once and keep them for the next regions,
+ *        false to decode the images and keep the region only.
+ * @return false if the statistics of the capture are not cached, the region is not inside the capture or
+ *         one of the files could not be loaded.
+ */
+bool computeRegionMaps(std::string pathToFolder, bool isCrossData, cv::Rect region, CaptureTile &tile, bool keepFrames);
+
+/**
+ * Queues the maps of a region to the output writer (group pathToFolder) : roi_diffuse.pfm (with cross polarised data only),
+ * roi_specular.pfm, roi_normalMap.bmp (and roi_normalMap_red.bmp, roi_normalMap_blue.bmp, roi_diffuseNormalMap.bmp
+ * if computed) and roi_roughness.pfm in the textures folder.
+ * @brief saveRegionMaps
+ * @param maps
+ * @param pathToFolder
+ */
+void saveRegionMaps(const ReflectanceMaps &maps, std::string pathToFolder);
+
+/**
+ * Parses a region given as x,y,width,height.
+ * @brief parseRegion
+ * @param text
+ * @param region
+ * @return false if the text is not a valid region.
+ */
+bool parseRegion(std::string text, cv::Rect &region);
+
+/**
+ * Releases the decoded images kept for the regions.
+ * @brief releaseRegionFrames
+ */
+void releaseRegionFrames();
+
+#endif // REGIONOFINTEREST
@@ -0,0 +1,932 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file synthetic.cpp
+ * \brief Implementation of the synthetic captures used to measure and check the computation.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the synthetic captures used to measure and check the computation.
+ */
+
+#include "synthetic.h"
+#include "memoryplanner.h"
+#include "bufferpool.h"
+#include "kernelprecision.h"
+#include "taskgraph.h"
+
+/*---- OpenCV ----*/
+#include <opencv/highgui.h>
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+#define PI 3.14159265358979323846
+
+//Pixels of the sphere cap tilted more than SCORED_MAXIMUM_TILT degrees are not compared : near 45 degrees the reflection
+//vector is almost horizontal and its z component is very sensitive to the quantization of the images
+#define SCORED_MAXIMUM_TILT 40.0
+
+//Maximum tilt of the bumps in degrees
+#define BUMP_MAXIMUM_TILT 30.0
+
+//Roughness of the flat patches
+static const float PATCH_ROUGHNESS[3] = {0.08f, 0.12f, 0.16f};
+
+//8 bits value of each gradient where it is at its maximum (full on, +-X, +-Y, second order X and Y) : the brightness
+//of the patterns differs, so scaleTo01Range must divide each gradient by its own maximum. The maxima are encoded exactly
+static const int GRADIENT_WHITE_LEVELS[NUMBER_OF_GRADIENT_ILLUMINATION] = {250, 243, 237, 246, 231, 240, 234};
+
+/**
+ * Creates a directory. Does nothing if it already exists.
+ * @brief makeDirectory
+ * @param path
+ */
+static void makeDirectory(string path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+/**
+ * Sets the ground truth of a pixel of the object.
+ * @brief setScenePixel
+ * @param scene
+ * @param i
+ * @param j
+ * @param normal (x,y,z), normalised
+ * @param lobeVariance
+ */
+static void setScenePixel(SyntheticScene &scene, int i, int j, Vec3f normal, float lobeVariance)
+{
+    scene.normals.at<Vec3f>(i,j) = Vec3f(normal.val[2], normal.val[1], normal.val[0]);
+    scene.lobeVariance.at<float>(i,j) = lobeVariance;
+
+    //Roughness of the computation with sigma_x^2 = sigma_y^2 = s : sqrt(sqrt(2 s^2))/4
+    scene.roughness.at<float>(i,j) = sqrt(sqrt(2.0f*lobeVariance*lobeVariance))/4.0f;
+    scene.mask.at<uchar>(i,j) = 255;
+
+    if(normal.val[2] >= cos(SCORED_MAXIMUM_TILT*PI/180.0))
+    {
+        scene.scored.at<uchar>(i,j) = 255;
+    }
+}
+
+/**
+ * Renders the ground truth of a scene : a sphere cap (tilt up to 45 degrees) on the left,
+ * bumps on the top right and flat patches of increasing roughness on the bottom right.
+ * Four facets tilted by 45 degrees towards +-X and +-Y in the corners of the left half reflect the extremities of the screen.
+ * @brief renderSyntheticScene
+ * @param size
+ * @param scene
+ */
+void renderSyntheticScene(Size size, SyntheticScene &scene)
+{
+    int width = size.width;
+    int height = size.height;
+
+    scene.normals = Mat(height, width, CV_32FC3, Scalar(1.0, 0.0, 0.0));
+    scene.lobeVariance = Mat::zeros(height, width, CV_32FC1);
+    scene.roughness = Mat::zeros(height, width, CV_32FC1);
+    scene.mask = Mat::zeros(height, width, CV_8UC1);
+    scene.scored = Mat::zeros(height, width, CV_8UC1);
+
+    /*---Facets tilted by 45 degrees : the reflection of the view is (+-1,0,0) or (0,+-1,0), every gradient reaches its maximum---*/
+    int facetSize = max(2, width/32);
+    float tilt = sqrt(0.5);
+    Vec3f facetNormals[4] = {Vec3f(-tilt, 0.0, tilt), Vec3f(tilt, 0.0, tilt), Vec3f(0.0, -tilt, tilt), Vec3f(0.0, tilt, tilt)};
+    int facetTops[4] = {0, 0, height-facetSize, height-facetSize};
+    int facetLefts[4] = {0, width/2-facetSize, 0, width/2-facetSize};
+
+    for(int f = 0 ; f<4 ; f++)
+    {
+        for(int i = facetTops[f] ; i<facetTops[f]+facetSize ; i++)
+        {
+            for(int j = facetLefts[f] ; j<facetLefts[f]+facetSize ; j++)
+            {
+                setScenePixel(scene, i, j, facetNormals[f], 0.0);
+            }
+        }
+    }
+
+    /*---Sphere cap on the left half : the tilt reaches 45 degrees on its border---*/
+    float centerX = width/4;
+    float centerY = height/2;
+    float capRadius = 0.45*min(width/2, height);
+    float sphereRadius = capRadius*sqrt(2.0);
+
+    for(int i = 0 ; i<height ; i++)
+    {
+        for(int j = 0 ; j<width/2 ; j++)
+        {
+            float x = (j-centerX)/sphereRadius;
+            float y = (i-centerY)/sphereRadius;
+
+            if((j-centerX)*(j-centerX)+(i-centerY)*(i-centerY) <= capRadius*capRadius)
+            {
+                setScenePixel(scene, i, j, Vec3f(x, y, sqrt(1.0-x*x-y*y)), 0.0);
+            }
+        }
+    }
+
+    /*---2x2 gaussian bumps on the top right quarter---*/
+    float cellWidth = (width-width/2)/2.0;
+    float cellHeight = (height/2)/2.0;
+    float bumpWidth = min(cellWidth, cellHeight)/6.0;
+
+    //Maximum slope of a gaussian : amplitude/width*exp(-1/2)
+    float amplitude = tan(BUMP_MAXIMUM_TILT*PI/180.0)*bumpWidth*exp(0.5);
+
+    for(int i = 0 ; i<height/2 ; i++)
+    {
+        for(int j = width/2 ; j<width ; j++)
+        {
+            //Center of the cell of the pixel
+            float bumpX = width/2+(floor((j-width/2)/cellWidth)+0.5)*cellWidth;
+            float bumpY = (floor(i/cellHeight)+0.5)*cellHeight;
+
+            float dx = j-bumpX;
+            float dy = i-bumpY;
+            float bump = amplitude*exp(-(dx*dx+dy*dy)/(2.0*bumpWidth*bumpWidth));
+
+            //Normal of the height field : (-dh/dx, -dh/dy, 1)
+            float x = bump*dx/(bumpWidth*bumpWidth);
+            float y = bump*dy/(bumpWidth*bumpWidth);
+            float normalNorm = sqrt(x*x+y*y+1.0);
+
+            Vec3f normal(x/normalNorm, y/normalNorm, 1.0/normalNorm);
+
+            setScenePixel(scene, i, j, normal, 0.0);
+        }
+    }
+
+    /*---Flat patches of increasing roughness on the bottom right quarter---*/
+    int patchSize = min((width-width/2)/3, height-height/2)*3/4;
+
+    for(int k = 0 ; k<3 ; k++)
+    {
+        //s such that sqrt(sqrt(2 s^2))/4 = roughness
+        float roughness = PATCH_ROUGHNESS[k];
+        float lobeVariance = 16.0*roughness*roughness/sqrt(2.0);
+
+        int left = width/2+k*(width-width/2)/3+((width-width/2)/3-patchSize)/2;
+        int top = height/2+(height-height/2-patchSize)/2;
+
+        for(int i = top ; i<top+patchSize ; i++)
+        {
+            for(int j = left ; j<left+patchSize ; j++)
+            {
+                setScenePixel(scene, i, j, Vec3f(0.0, 0.0, 1.0), lobeVariance);
+            }
+        }
+    }
+}
+
+/**
+ * Stores a linear value in an 8 bits pixel with the gamma of the camera (2.2).
+ * @brief encodeWithGamma
+ * @param value
+ * @return
+ */
+static uchar encodeWithGamma(float value)
+{
+    return saturate_cast<uchar>(255.0*pow(max(value, 0.0f), 1.0f/2.2f));
+}
+
+/**
+ * Writes an 8 bits image losslessly (PNG content) : the computation decodes the images from their content, not their name.
+ * @brief writeLosslessImage
+ * @param image
+ * @param filePath
+ * @return false if the file could not be written.
+ */
+static bool writeLosslessImage(const Mat &image, string filePath)
+{
+    vector<uchar> content;
+
+    if(!imencode(".png", image, content))
+    {
+        return false;
+    }
+
+    ofstream file(filePath.c_str(), ios::out | ios::trunc | ios::binary);
+
+    if(!file)
+    {
+        cerr << "Could not write the file : " << filePath << endl;
+        return false;
+    }
+
+    file.write((const char*) &content[0], content.size());
+
+    return (bool) file;
+}
+
+/**
+ * Writes the capture of a scene : par (gradients and ambient), cross (black : no diffuse reflection),
+ * checker.txt (ratios of 1), mask.JPG and an empty textures folder.
+ * The images are stored losslessly (PNG content) under the .JPG names read by the computation.
+ * @brief writeSyntheticCapture
+ * @param scene
+ * @param pathToFolder
+ * @return false if a file could not be written.
+ */
+bool writeSyntheticCapture(const SyntheticScene &scene, string pathToFolder)
+{
+    int width = scene.mask.cols;
+    int height = scene.mask.rows;
+
+    makeDirectory(pathToFolder);
+    makeDirectory(pathToFolder + "/par");
+    makeDirectory(pathToFolder + "/cross");
+    makeDirectory(pathToFolder + "/textures");
+
+    vector<Mat> gradients(NUMBER_OF_GRADIENT_ILLUMINATION);
+
+    for(int k = 0 ; k<NUMBER_OF_GRADIENT_ILLUMINATION ; k++)
+    {
+        gradients[k] = Mat::zeros(height, width, CV_8UC3);
+    }
+
+    float values[NUMBER_OF_GRADIENT_ILLUMINATION];
+
+    for(int i = 0 ; i<height ; i++)
+    {
+        for(int j = 0 ; j<width ; j++)
+        {
+            if(scene.mask.at<uchar>(i,j) == 0)
+            {
+                continue;
+            }
+
+            Vec3f normal = scene.normals.at<Vec3f>(i,j);
+            float s = scene.lobeVariance.at<float>(i,j);
+
+            //Reflection of the view (0,0,1) about the normal (BGR = ZYX)
+            float Rx = 2.0*normal.val[0]*normal.val[2];
+            float Ry = 2.0*normal.val[0]*normal.val[1];
+
+            values[0] = 1.0;
+            values[1] = (1.0-Rx)/2.0;
+            values[2] = (1.0+Rx)/2.0;
+            values[3] = (1.0+Ry)/2.0;
+            values[4] = (1.0-Ry)/2.0;
+            values[5] = Rx*Rx+s;
+            values[6] = Ry*Ry+s;
+
+            for(int k = 0 ; k<NUMBER_OF_GRADIENT_ILLUMINATION ; k++)
+            {
+                //The values are at most 1 and reach 1 on the facets
+                float gain = pow(GRADIENT_WHITE_LEVELS[k]/255.0f, 2.2f);
+                uchar value = encodeWithGamma(gain*min(values[k], 1.0f));
+                gradients[k].at<Vec3b>(i,j) = Vec3b(value, value, value);
+            }
+        }
+    }
+
+    ostringstream osstream;
+    Mat black = Mat::zeros(height, width, CV_8UC3);
+
+    for(int k = 0 ; k<NUMBER_OF_GRADIENT_ILLUMINATION ; k++)
+    {
+        osstream << pathToFolder << "/par/IMG_" << PARALLEL_FIRST_IMAGE_NUMBER+k << ".JPG";
+        if(!writeLosslessImage(gradients[k], osstream.str()))
+        {
+            return false;
+        }
+        osstream.str("");
+
+        osstream << pathToFolder << "/cross/IMG_" << CROSS_FIRST_IMAGE_NUMBER+k << ".JPG";
+        if(!writeLosslessImage(black, osstream.str()))
+        {
+            return false;
+        }
+        osstream.str("");
+    }
+
+    Mat mask = Mat::zeros(height, width, CV_8UC3);
+
+    for(int i = 0 ; i<height ; i++)
+    {
+        for(int j = 0 ; j<width ; j++)
+        {
+            uchar value = scene.mask.at<uchar>(i,j);
+            mask.at<Vec3b>(i,j) = Vec3b(value, value, value);
+        }
+    }
+
+    if(!writeLosslessImage(black, pathToFolder + "/par/ambient.JPG") || !writeLosslessImage(black, pathToFolder + "/cross/ambient.JPG")
+       || !writeLosslessImage(mask, pathToFolder + "/mask.JPG"))
+    {
+        return false;
+    }
+
+    //The measured values of the checkerchart are its reflectance : no white balancing
+    ofstream checkerFile((pathToFolder + "/checker.txt").c_str(), ios::out | ios::trunc);
+    checkerFile << "1 1 1 1" << endl << "1 1 1 1" << endl;
+
+    return (bool) checkerFile;
+}
+
+/**
+ * Compares the maps computed for a synthetic capture with its ground truth.
+ * @brief compareWithGroundTruth
+ * @param scene
+ * @param maps
+ * @return
+ */
+SyntheticErrors compareWithGroundTruth(const SyntheticScene &scene, const ReflectanceMaps &maps)
+{
+    SyntheticErrors errors = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    double numberOfPixels = 0.0;
+    double numberOfRoughPixels = 0.0;
+
+    for(int i = 0 ; i<scene.scored.rows ; i++)
+    {
+        for(int j = 0 ; j<scene.scored.cols ; j++)
+        {
+            if(scene.scored.at<uchar>(i,j) == 0)
+            {
+                continue;
+            }
+
+            Vec3f normal = maps.normals.at<Vec3f>(i,j);
+            Vec3f expectedNormal = scene.normals.at<Vec3f>(i,j);
+
+            double cosine = normal.val[0]*expectedNormal.val[0]+normal.val[1]*expectedNormal.val[1]+normal.val[2]*expectedNormal.val[2];
+
+            //A NaN normal counts as the largest error
+            double normalError = cosine == cosine ? acos(min(1.0, max(-1.0, cosine)))*180.0/PI : 180.0;
+            double roughnessError = fabs(maps.roughness.at<Vec3f>(i,j).val[1]-scene.roughness.at<float>(i,j));
+            double albedoError = fabs(maps.specular.at<Vec3f>(i,j).val[1]-1.0);
+
+            if(roughnessError != roughnessError)
+            {
+                roughnessError = 1.0;
+            }
+
+            errors.meanNormalError += normalError;
+            errors.maximumNormalError = max(errors.maximumNormalError, normalError);
+
+            if(scene.lobeVariance.at<float>(i,j) > 0.0)
+            {
+                errors.meanRoughnessError += roughnessError;
+                errors.maximumRoughnessError = max(errors.maximumRoughnessError, roughnessError);
+                numberOfRoughPixels++;
+            }
+            else
+            {
+                errors.maximumSmoothRoughness = max(errors.maximumSmoothRoughness, roughnessError);
+            }
+
+            errors.maximumAlbedoError = max(errors.maximumAlbedoError, albedoError != albedoError ? 1.0 : albedoError);
+
+            numberOfPixels++;
+        }
+    }
+
+    if(numberOfPixels > 0.0)
+    {
+        errors.meanNormalError /= numberOfPixels;
+    }
+
+    if(numberOfRoughPixels > 0.0)
+    {
+        errors.meanRoughnessError /= numberOfRoughPixels;
+    }
+
+    return errors;
+}
+
+/**
+ * Returns true if the errors are within the tolerances.
+ * @brief isWithinTolerances
+ * @param errors
+ * @return
+ */
+bool isWithinTolerances(const SyntheticErrors &errors)
+{
+    return errors.meanNormalError <= NORMAL_MEAN_TOLERANCE && errors.maximumNormalError <= NORMAL_MAXIMUM_TOLERANCE
+        && errors.meanRoughnessError <= ROUGHNESS_MEAN_TOLERANCE && errors.maximumRoughnessError <= ROUGHNESS_MAXIMUM_TOLERANCE
+        && errors.maximumSmoothRoughness <= SMOOTH_ROUGHNESS_TOLERANCE
+        && errors.maximumAlbedoError <= ALBEDO_MAXIMUM_TOLERANCE;
+}
+
+/**
+ * Returns true if two counters of invalid pixels are identical.
+ * @brief sameDiagnostics
+ * @param first
+ * @param second
+ * @return
+ */
+static bool sameDiagnostics(const PixelDiagnostics &first, const PixelDiagnostics &second)
+{
+    return first.nanNormals == second.nanNormals && first.clampedPixels == second.clampedPixels
+           && first.zeroDivisions == second.zeroDivisions && first.saturatedPixels == second.saturatedPixels
+           && first.invalidPixels == second.invalidPixels;
+}
+
+/**
+ * Runs the harness : for each resolution (square images), each number of threads (threads of the parallel loops
+ * and of the task scheduler, at most one per core for the scheduler) and each number of concurrent captures,
+ * computes the maps, prints the throughput, the peak memory and the errors, and appends them to pathToFolder/results.csv.
+ * The invalid pixels of a resolution must be identical in every run : the stages of the task graph that read the same
+ * maps must not depend on the scheduling.
+ * @brief runSyntheticHarness
+ * @param pathToFolder folder in which the captures are written.
+ * @param resolutions
+ * @param threadCounts numbers of threads.
+ * @param captureCounts numbers of captures computed concurrently.
+ * @return false if a capture could not be written or computed, if an error is above the tolerances
+ *         or if the invalid pixels differ between the runs.
+ */
+bool runSyntheticHarness(string pathToFolder, vector<int> resolutions, vector<int> threadCounts, vector<int> captureCounts)
+{
+    makeDirectory(pathToFolder);
+
+    ofstream results((pathToFolder + "/results.csv").c_str(), ios::out | ios::app);
+    results << "width,height,threads,captures,seconds,megapixels_per_second,peak_rss_mb,mean_normal_error_deg,maximum_normal_error_deg,"
+            << "mean_roughness_error,maximum_roughness_error,maximum_smooth_roughness,maximum_albedo_error,passed" << endl;
+
+    int maximumCaptureCount = 1;
+
+    for(unsigned int c = 0 ; c<captureCounts.size() ; c++)
+    {
+        maximumCaptureCount = max(maximumCaptureCount, captureCounts[c]);
+    }
+
+    //Restored at the end of the sweep
+    int parallelThreads = getNumThreads();
+    int taskThreads = numberOfTaskThreads();
+
+    bool passed = true;
+
+    for(unsigned int r = 0 ; r<resolutions.size() ; r++)
+    {
+        Size size(resolutions[r], resolutions[r]);
+
+        SyntheticScene scene;
+        renderSyntheticScene(size, scene);
+
+        //One copy of the capture per concurrent computation : each one writes its own textures
+        vector<string> captureFolders;
+
+        for(int c = 0 ; c<maximumCaptureCount ; c++)
+        {
+            ostringstream osstream;
+            osstream << pathToFolder << "/" << size.width << "x" << size.height << "_" << c;
+            captureFolders.push_back(osstream.str());
+
+            if(!writeSyntheticCapture(scene, captureFolders[c]))
+            {
+                return false;
+            }
+        }
+
+        //Invalid pixels of the first run of the resolution
+        PixelDiagnostics referenceDiagnostics;
+        bool isReferenceDiagnostics = false;
+
+        //Every number of threads with every number of concurrent captures
+        for(unsigned int t = 0 ; t<threadCounts.size()*captureCounts.size() ; t++)
+        {
+            int numberOfThreads = max(1, threadCounts[t/captureCounts.size()]);
+            int numberOfCaptures = max(1, captureCounts[t % captureCounts.size()]);
+
+            setNumThreads(numberOfThreads);
+            setTaskThreadLimit(numberOfThreads);
+
+            vector<CaptureTile> captures(numberOfCaptures);
+            vector<char> success(numberOfCaptures, 0);
+            vector<thread> threads;
+
+            //Measure the memory of this run only
+            globalBufferPool().trim();
+            resetPeakResidentMemory();
+
+            chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+            for(int c = 0 ; c<numberOfCaptures ; c++)
+            {
+                threads.push_back(thread([&, c]() {
+                    vector<string> failedFiles;
+
+                    //The throughput includes the writing of the files
+                    success[c] = computeCaptureMaps(captureFolders[c], true, captures[c])
+                                 && waitForOutputs(captureFolders[c], failedFiles);
+
+                    reportFailedOutputs(failedFiles);
+                }));
+            }
+
+            for(int c = 0 ; c<numberOfCaptures ; c++)
+            {
+                threads[c].join();
+            }
+
+            double seconds = chrono::duration<double>(chrono::steady_clock::now()-startTime).count();
+            size_t peak = peakResidentMemory();
+
+            //Worst errors over the concurrent captures
+            SyntheticErrors errors = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+            for(int c = 0 ; c<numberOfCaptures ; c++)
+            {
+                if(!success[c])
+                {
+                    cerr << "Could not compute the capture " << captureFolders[c] << endl;
+
+                    setNumThreads(parallelThreads);
+                    setTaskThreadLimit(taskThreads);
+                    return false;
+                }
+
+                if(!isReferenceDiagnostics)
+                {
+                    referenceDiagnostics = captures[c].diagnostics;
+                    isReferenceDiagnostics = true;
+                }
+                else if(!sameDiagnostics(referenceDiagnostics, captures[c].diagnostics))
+                {
+                    cerr << "The invalid pixels of " << captureFolders[c] << " differ from the first run with "
+                         << numberOfThreads << " thread(s) and " << numberOfCaptures << " capture(s)" << endl;
+                    passed = false;
+                }
+
+                SyntheticErrors captureErrors = compareWithGroundTruth(scene, captures[c].maps);
+
+                errors.meanNormalError = max(errors.meanNormalError, captureErrors.meanNormalError);
+                errors.maximumNormalError = max(errors.maximumNormalError, captureErrors.maximumNormalError);
+                errors.meanRoughnessError = max(errors.meanRoughnessError, captureErrors.meanRoughnessError);
+                errors.maximumRoughnessError = max(errors.maximumRoughnessError, captureErrors.maximumRoughnessError);
+                errors.maximumSmoothRoughness = max(errors.maximumSmoothRoughness, captureErrors.maximumSmoothRoughness);
+                errors.maximumAlbedoError = max(errors.maximumAlbedoError, captureErrors.maximumAlbedoError);
+            }
+
+            bool withinTolerances = isWithinTolerances(errors);
+            passed = passed && withinTolerances;
+
+            double megapixelsPerSecond = numberOfCaptures*(double) size.area()/1.0e6/seconds;
+
+            cout << size.width << "x" << size.height << ", " << numberOfThreads << " thread(s), " << numberOfCaptures << " capture(s) : "
+                 << seconds << " s, " << megapixelsPerSecond << " MP/s, peak " << peak/(1024*1024) << " MB, normals "
+                 << errors.meanNormalError << " (max " << errors.maximumNormalError << ") degrees, roughness "
+                 << errors.meanRoughnessError << " (max " << errors.maximumRoughnessError << ", smooth surfaces "
+                 << errors.maximumSmoothRoughness << "), albedo max "
+                 << errors.maximumAlbedoError << (withinTolerances ? " : OK" : " : ABOVE TOLERANCES") << endl;
+
+            results << size.width << "," << size.height << "," << numberOfThreads << "," << numberOfCaptures << "," << seconds << "," << megapixelsPerSecond
+                    << "," << peak/(1024*1024) << "," << errors.meanNormalError << "," << errors.maximumNormalError << ","
+                    << errors.meanRoughnessError << "," << errors.maximumRoughnessError << "," << errors.maximumSmoothRoughness << ","
+                    << errors.maximumAlbedoError << ","
+                    << (withinTolerances ? 1 : 0) << endl;
+        }
+    }
+
+    setNumThreads(parallelThreads);
+    setTaskThreadLimit(taskThreads);
+
+    return passed;
+}
+
+/**
+ * Returns true if two images have the same size, type and bits (NaN included).
+ * @brief sameBits
+ * @param first
+ * @param second
+ * @return
+ */
+static bool sameBits(const Mat &first, const Mat &second)
+{
+    if(first.rows != second.rows || first.cols != second.cols || first.type() != second.type())
+    {
+        return false;
+    }
+
+    for(int i = 0 ; i<first.rows ; i++)
+    {
+        if(memcmp(first.ptr(i), second.ptr(i), first.cols*first.elemSize()) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Measures the computation of the maps of a synthetic capture (computeTileMaps, green channel) with the gradients
+ * in separate images and in the gradient-major layout (interleavedGradients) and checks that both give the same maps.
+ * For each resolution prints the best time of the repetitions of each layout and appends it to pathToFolder/layouts.csv.
+ * @brief benchmarkGradientLayouts
+ * @param pathToFolder folder in which the captures are written.
+ * @param resolutions
+ * @param repetitions
+ * @return false if a capture could not be written or loaded, or if the maps of the two layouts differ.
+ */
+bool benchmarkGradientLayouts(string pathToFolder, vector<int> resolutions, int repetitions)
+{
+    makeDirectory(pathToFolder);
+
+    ofstream results((pathToFolder + "/layouts.csv").c_str(), ios::out | ios::app);
+    results << "width,height,layout,milliseconds,megapixels_per_second" << endl;
+
+    bool wasInterleaved = interleavedGradients();
+    bool wasPerChannel = perChannelMaps();
+    bool passed = true;
+
+    //The layout only changes the green channel solvers
+    setPerChannelMaps(false);
+
+    for(unsigned int r = 0 ; r<resolutions.size() && passed ; r++)
+    {
+        Size size(resolutions[r], resolutions[r]);
+
+        SyntheticScene scene;
+        renderSyntheticScene(size, scene);
+
+        ostringstream osstream;
+        osstream << pathToFolder << "/" << size.width << "x" << size.height << "_layout";
+
+        CaptureTile capture;
+        CaptureStatistics statistics;
+
+        if(!writeSyntheticCapture(scene, osstream.str()) || !loadCaptureTile(osstream.str(), true, Rect(), capture))
+        {
+            passed = false;
+            break;
+        }
+
+        accumulateGradientMaxima(capture, statistics);
+
+        const char *layoutNames[2] = {"separate", "interleaved"};
+        ReflectanceMaps layoutMaps[2];
+        PixelDiagnostics layoutDiagnostics[2];
+        double bestMilliseconds[2] = {0.0, 0.0};
+
+        for(int layout = 0 ; layout<2 ; layout++)
+        {
+            setInterleavedGradients(layout == 1);
+
+            CaptureTile tile;
+            tile.isCrossData = capture.isCrossData;
+            tile.region = capture.region;
+            tile.mask = capture.mask;
+            tile.saturatedPixels = capture.saturatedPixels;
+
+            //The first run takes the buffers from the pool
+            for(int repetition = -1 ; repetition<repetitions ; repetition++)
+            {
+                //The gradients are scaled in place : each run starts from the loaded gradients
+                for(int k = 0 ; k<NUMBER_OF_GRADIENT_ILLUMINATION ; k++)
+                {
+                    capture.parallelData[k].copyTo(tile.parallelData[k]);
+                    capture.crossData[k].copyTo(tile.crossData[k]);
+                }
+
+                chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+                computeTileMaps(tile, statistics);
+
+                double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now()-startTime).count();
+
+                if(repetition == 0 || (repetition > 0 && milliseconds < bestMilliseconds[layout]))
+                {
+                    bestMilliseconds[layout] = milliseconds;
+                }
+            }
+
+            layoutMaps[layout] = tile.maps;
+            layoutDiagnostics[layout] = tile.diagnostics;
+
+            double megapixelsPerSecond = size.area()/1.0e6/(bestMilliseconds[layout]/1000.0);
+
+            cout << size.width << "x" << size.height << ", " << layoutNames[layout] << " gradients : "
+                 << bestMilliseconds[layout] << " ms, " << megapixelsPerSecond << " MP/s" << endl;
+
+            results << size.width << "," << size.height << "," << layoutNames[layout] << ","
+                    << bestMilliseconds[layout] << "," << megapixelsPerSecond << endl;
+        }
+
+        if(!sameBits(layoutMaps[0].normals, layoutMaps[1].normals) || !sameBits(layoutMaps[0].roughness, layoutMaps[1].roughness)
+           || !sameDiagnostics(layoutDiagnostics[0], layoutDiagnostics[1]))
+        {
+            cerr << "The maps of the two layouts differ at " << size.width << "x" << size.height << endl;
+            passed = false;
+        }
+        else
+        {
+            cout << size.width << "x" << size.height << ", speedup of the interleaved gradients : "
+                 << bestMilliseconds[0]/bestMilliseconds[1] << endl;
+        }
+    }
+
+    setInterleavedGradients(wasInterleaved);
+    setPerChannelMaps(wasPerChannel);
+
+    return passed;
+}
+
+/**
+ * Maximum angle in degrees between the normals of two maps and maximum difference of the roughness
+ * of their green channel, on the scored pixels. A NaN in one map only counts as the largest error.
+ * @brief compareKernelMaps
+ * @param scene
+ * @param exactMaps
+ * @param maps
+ * @param normalError
+ * @param roughnessError
+ */
+static void compareKernelMaps(const SyntheticScene &scene, const ReflectanceMaps &exactMaps, const ReflectanceMaps &maps,
+                              double &normalError, double &roughnessError)
+{
+    normalError = 0.0;
+    roughnessError = 0.0;
+
+    for(int i = 0 ; i<scene.scored.rows ; i++)
+    {
+        for(int j = 0 ; j<scene.scored.cols ; j++)
+        {
+            if(scene.scored.at<uchar>(i,j) == 0)
+            {
+                continue;
+            }
+
+            Vec3f exactNormal = exactMaps.normals.at<Vec3f>(i,j);
+            Vec3f normal = maps.normals.at<Vec3f>(i,j);
+
+            double cosine = normal.val[0]*exactNormal.val[0]+normal.val[1]*exactNormal.val[1]+normal.val[2]*exactNormal.val[2];
+            double squaredNorm = normal.val[0]*normal.val[0]+normal.val[1]*normal.val[1]+normal.val[2]*normal.val[2];
+            double exactSquaredNorm = exactNormal.val[0]*exactNormal.val[0]+exactNormal.val[1]*exactNormal.val[1]
+                                     +exactNormal.val[2]*exactNormal.val[2];
+            double norms = sqrt(squaredNorm*exactSquaredNorm);
+            double angle = acos(min(1.0, max(-1.0, cosine/norms)))*180.0/PI;
+
+            bool exactNan = exactNormal.val[0] != exactNormal.val[0];
+            bool nan = normal.val[0] != normal.val[0];
+
+            angle = exactNan != nan ? 180.0 : (exactNan ? 0.0 : angle);
+
+            double difference = fabs(maps.roughness.at<Vec3f>(i,j).val[1]-exactMaps.roughness.at<Vec3f>(i,j).val[1]);
+
+            normalError = max(normalError, angle);
+            roughnessError = max(roughnessError, difference != difference ? 1.0 : difference);
+        }
+    }
+}
+
+/**
+ * Measures the computation of the maps of a synthetic capture (computeTileMaps) with each precision of the solvers
+ * (see kernelprecision.h) and compares the normals and the roughness of the fast and approximate tiers with the exact tier.
+ * For each resolution prints the best time of the repetitions and the maximum errors of each tier
+ * and appends them to pathToFolder/precision.csv.
+ * @brief benchmarkKernelPrecision
+ * @param pathToFolder folder in which the captures are written.
+ * @param resolutions
+ * @param repetitions
+ * @return false if a capture could not be written or loaded, or if an error is above the tolerance of its tier.
+ */
+bool benchmarkKernelPrecision(string pathToFolder, vector<int> resolutions, int repetitions)
+{
+    makeDirectory(pathToFolder);
+
+    ofstream results((pathToFolder + "/precision.csv").c_str(), ios::out | ios::app);
+    results << "width,height,precision,milliseconds,megapixels_per_second,maximum_normal_error_degrees,maximum_roughness_error" << endl;
+
+    KernelPrecision previousPrecision = kernelPrecision();
+    bool passed = true;
+
+    const KernelPrecision precisions[3] = {EXACT_PRECISION, FAST_PRECISION, APPROXIMATE_PRECISION};
+    const double normalTolerances[3] = {0.0, FAST_PRECISION_NORMAL_TOLERANCE, APPROXIMATE_PRECISION_NORMAL_TOLERANCE};
+    const double roughnessTolerances[3] = {0.0, FAST_PRECISION_ROUGHNESS_TOLERANCE, APPROXIMATE_PRECISION_ROUGHNESS_TOLERANCE};
+
+    for(unsigned int r = 0 ; r<resolutions.size() && passed ; r++)
+    {
+        Size size(resolutions[r], resolutions[r]);
+
+        SyntheticScene scene;
+        renderSyntheticScene(size, scene);
+
+        ostringstream osstream;
+        osstream << pathToFolder << "/" << size.width << "x" << size.height << "_precision";
+
+        CaptureTile capture;
+        CaptureStatistics statistics;
+
+        if(!writeSyntheticCapture(scene, osstream.str()) || !loadCaptureTile(osstream.str(), true, Rect(), capture))
+        {
+            passed = false;
+            break;
+        }
+
+        accumulateGradientMaxima(capture, statistics);
+
+        ReflectanceMaps precisionMaps[3];
+        double bestMilliseconds[3] = {0.0, 0.0, 0.0};
+
+        for(int p = 0 ; p<3 ; p++)
+        {
+            setKernelPrecision(precisions[p]);
+
+            CaptureTile tile;
+            tile.isCrossData = capture.isCrossData;
+            tile.region = capture.region;
+            tile.mask = capture.mask;
+            tile.saturatedPixels = capture.saturatedPixels;
+
+            //The first run takes the buffers from the pool
+            for(int repetition = -1 ; repetition<repetitions ; repetition++)
+            {
+                //The gradients are scaled in place : each run starts from the loaded gradients
+                for(int k = 0 ; k<numberOfGradients() ; k++)
+                {
+                    capture.parallelData[k].copyTo(tile.parallelData[k]);
+                    capture.crossData[k].copyTo(tile.crossData[k]);
+                }
+
+                chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+                computeTileMaps(tile, statistics);
+
+                double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now()-startTime).count();
+
+                if(repetition == 0 || (repetition > 0 && milliseconds < bestMilliseconds[p]))
+                {
+                    bestMilliseconds[p] = milliseconds;
+                }
+            }
+
+            precisionMaps[p] = tile.maps;
+
+            double normalError = 0.0, roughnessError = 0.0;
+            compareKernelMaps(scene, precisionMaps[0], precisionMaps[p], normalError, roughnessError);
+
+            double megapixelsPerSecond = size.area()/1.0e6/(bestMilliseconds[p]/1000.0);
+
+            cout << size.width << "x" << size.height << ", " << kernelPrecisionName(precisions[p]) << " precision : "
+                 << bestMilliseconds[p] << " ms, " << megapixelsPerSecond << " MP/s, maximum errors against the exact precision : "
+                 << normalError << " degrees, roughness " << roughnessError << endl;
+
+            results << size.width << "," << size.height << "," << kernelPrecisionName(precisions[p]) << "," << bestMilliseconds[p] << ","
+                    << megapixelsPerSecond << "," << normalError << "," << roughnessError << endl;
+
+            if(normalError > normalTolerances[p] || roughnessError > roughnessTolerances[p])
+            {
+                cerr << "The " << kernelPrecisionName(precisions[p]) << " precision is above its tolerances at "
+                     << size.width << "x" << size.height << endl;
+                passed = false;
+            }
+        }
+    }
+
+    setKernelPrecision(previousPrecision);
+
+    return passed;
+}
@@ -0,0 +1,178 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file synthetic.h
+ * \brief Implementation of the synthetic captures used to measure and check the computation.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * A synthetic capture is rendered from a scene of known normals and roughness : a sphere cap, a field of bumps
+ * and flat patches of known roughness. The images are rendered with the moment model of the computation :
+ *   R = reflection of the view (0,0,1) about the normal, s = variance of the specular lobe
+ *   full on = 1, +-X gradients = (1-+Rx)/2, +-Y gradients = (1+-Ry)/2, second order gradients = Rx^2+s, Ry^2+s
+ * so that the expected output is exact up to the 8 bits quantization of the images.
+ * Each gradient is rendered with its own brightness, as the patterns of a screen : scaleTo01Range must divide it by its maximum.
+ * Four facets tilted by 45 degrees reflect the extremities of the screen, where every gradient reaches its maximum.
+ *
+ * The harness writes the captures in the layout read by computeCaptureMaps (par, cross, checker.txt, mask.JPG),
+ * runs the computation for several resolutions, numbers of threads and numbers of concurrent captures, records the throughput
+ * and the peak memory and checks the normals, roughness and specular albedo against the ground truth.
+ */
+
+#ifndef SYNTHETIC
+#define SYNTHETIC
+
+#include "capturetile.h"
+
+/*---- OpenCV ----*/
+#include <opencv2/core/core.hpp>
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+
+//Tolerances of the comparison with the ground truth, above the errors due to the 8 bits quantization
+#define NORMAL_MEAN_TOLERANCE 0.5           //degrees
+#define NORMAL_MAXIMUM_TOLERANCE 2.0        //degrees
+#define ROUGHNESS_MEAN_TOLERANCE 0.002      //rough patches
+#define ROUGHNESS_MAXIMUM_TOLERANCE 0.005   //rough patches
+//The roughness is a fourth root of the variance : the quantization noise gives up to 0.03 on smooth surfaces
+#define SMOOTH_ROUGHNESS_TOLERANCE 0.04
+#define ALBEDO_MAXIMUM_TOLERANCE 0.01
+
+/**
+ * Ground truth of a synthetic scene.
+ * @brief The SyntheticScene struct
+ */
+struct SyntheticScene
+{
+    cv::Mat normals;        //CV_32FC3, BGR = ZYX as the normals of the computation
+    cv::Mat lobeVariance;   //CV_32FC1, variance s of the specular lobe
+    cv::Mat roughness;      //CV_32FC1, expected roughness
+    cv::Mat mask;           //CV_8UC1, 255 inside the object
+    cv::Mat scored;         //CV_8UC1, 255 where the output is compared with the ground truth
+};
+
+/**
+ * Errors of the maps of a synthetic capture, computed on the scored pixels.
+ * @brief The SyntheticErrors struct
+ */
+struct SyntheticErrors
+{
+    double meanNormalError;         //degrees
+    double maximumNormalError;      //degrees
+    double meanRoughnessError;      //rough patches
+    double maximumRoughnessError;   //rough patches
+    double maximumSmoothRoughness;  //roughness found on the smooth surfaces
+    double maximumAlbedoError;      //specular albedo, expected to be 1
+};
+
+/**
+ * Renders the ground truth of a scene : a sphere cap (tilt up to 45 degrees) on the left,
+ * bumps on the top right and flat patches of increasing roughness on the bottom right.
+ * Four facets tilted by 45 degrees towards +-X and +-Y in the corners of the left half reflect the extremities of the screen.
+ * @brief renderSyntheticScene
+ * @param size
+ * @param scene
+ */
+void renderSyntheticScene(cv::Size size, SyntheticScene &scene);
+
+/**
+ * Writes the capture of a scene : par (gradients and ambient), cross (black : no diffuse reflection),
+ * checker.txt (ratios of 1), mask.JPG and an empty textures folder.
+ * The images are stored losslessly (PNG content) under the .JPG names read by the computation.
+ * @brief writeSyntheticCapture
+ * @param scene
+ * @param pathToFolder
+ * @return false if a file could not be written.
+ */
+bool writeSyntheticCapture(const SyntheticScene &scene, std::string pathToFolder);
+
+/**
+ * Compares the maps computed for a synthetic capture with its ground truth.
+ * @brief compareWithGroundTruth
+ * @param scene
+ * @param maps
+ * @return
+ */
+SyntheticErrors compareWithGroundTruth(const SyntheticScene &scene, const ReflectanceMaps &maps);
+
+/**
+ * Returns true if the errors are within the tolerances.
+ * @brief isWithinTolerances
+ * @param errors
+ * @return
+ */
+bool isWithinTolerances(const SyntheticErrors &errors);
+
+/**
+ * Runs the harness : for each resolution (square images), each number of threads (threads of the parallel loops
+ * and of the task scheduler, at most one per core for the scheduler) and each number of concurrent captures,
+ * computes the maps, prints the throughput, the peak memory and the errors, and appends them to pathToFolder/results.csv.
+ * The invalid pixels of a resolution must be identical in every run : the stages of the task graph that read the same
+ * maps must not depend on the scheduling.
+ * @brief runSyntheticHarness
+ * @param pathToFolder folder in which the captures are written.
+ * @param resolutions
+ * @param threadCounts numbers of threads.
+ * @param captureCounts numbers of captures computed concurrently.
+ * @return false if a capture could not be written or computed, if an error is above the tolerances
+ *         or if the invalid pixels differ between the runs.
+ */
+bool runSyntheticHarness(std::string pathToFolder, std::vector<int> resolutions, std::vector<int> threadCounts,
+                         std::vector<int> captureCounts);
+
+/**
+ * Measures the computation of the maps of a synthetic capture (computeTileMaps, green channel) with the gradients
+ * in separate images and in the gradient-major layout (interleavedGradients) and checks that both give the same maps.
+ * For each resolution prints the best time of the repetitions of each layout and appends it to pathToFolder/layouts.csv.
+ * @brief benchmarkGradientLayouts
+ * @param pathToFolder folder in which the captures are written.
+ * @param resolutions
+ * @param repetitions
+ * @return false if a capture could not be written or loaded, or if the maps of the two layouts differ.
+ */
+bool benchmarkGradientLayouts(std::string pathToFolder, std::vector<int> resolutions, int repetitions);
+
+/**
+ * Measures the computation of the maps of a synthetic capture (computeTileMaps) with each precision of the solvers
+ * (see kernelprecision.h) and compares the normals and the roughness of the fast and approximate tiers with the exact tier.
+ * For each resolution prints the best time of the repetitions and the maximum errors of each tier
+ * and appends them to pathToFolder/precision.csv.
+ * @brief benchmarkKernelPrecision
+ * @param pathToFolder folder in which the captures are written.
+ * @param resolutions
+ * @param repetitions
+ * @return false if a capture could not be written or loaded, or if an error is above the tolerance of its tier.
+ */
+bool benchmarkKernelPrecision(std::string pathToFolder, std::vector<int> resolutions, int repetitions);
+
+#endif // SYNTHETIC
@@ -0,0 +1,429 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file taskgraph.cpp
+ * \brief Implementation of the task graph of the computation and of its work stealing scheduler.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the task graph of the computation and of its work stealing scheduler.
+ */
+
+#include "taskgraph.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <exception>
+
+using namespace std;
+
+/**
+ * Tasks waited for together.
+ * @brief The TaskGroup struct
+ */
+struct TaskGroup
+{
+    TaskGroup() : pendingTasks(0), failed(false) {}
+
+    atomic<int> pendingTasks;
+    atomic<bool> failed;
+
+    mutex doneMutex;
+    condition_variable done;
+};
+
+/**
+ * Task queued to the scheduler.
+ * @brief The Task struct
+ */
+struct Task
+{
+    function<void()> run;
+    TaskGroup *group;
+};
+
+/**
+ * Queue of a thread of the scheduler.
+ * @brief The TaskQueue struct
+ */
+struct TaskQueue
+{
+    mutex queueMutex;
+    deque<Task> tasks;
+};
+
+//Queue of the current thread, -1 outside of the scheduler
+static thread_local int currentQueue = -1;
+
+/**
+ * Work stealing scheduler : one queue per thread, plus one for the tasks queued from outside of the scheduler.
+ */
+class TaskScheduler
+{
+public:
+    TaskScheduler(int numberOfThreads) : m_queuedTasks(0), m_threadLimit(numberOfThreads)
+    {
+        for(int q = 0 ; q<=numberOfThreads ; q++)
+        {
+            m_queues.push_back(new TaskQueue());
+        }
+
+        for(int t = 0 ; t<numberOfThreads ; t++)
+        {
+            m_threads.push_back(thread(&TaskScheduler::runThread, this, t));
+        }
+    }
+
+    void spawn(TaskGroup &group, function<void()> task)
+    {
+        group.pendingTasks++;
+
+        {
+            TaskQueue &queue = *m_queues[ownQueue()];
+            lock_guard<mutex> lock(queue.queueMutex);
+
+            Task queuedTask = {task, &group};
+            queue.tasks.push_back(queuedTask);
+        }
+
+        {
+            lock_guard<mutex> lock(m_sleepMutex);
+            m_queuedTasks++;
+        }
+
+        //The thread woken up must be allowed to run the task
+        if(m_threadLimit < (int) m_threads.size())
+        {
+            m_taskAvailable.notify_all();
+        }
+        else
+        {
+            m_taskAvailable.notify_one();
+        }
+    }
+
+    void wait(TaskGroup &group)
+    {
+        while(group.pendingTasks > 0)
+        {
+            //Runs the tasks of the group or other tasks instead of sleeping
+            if(!runTask())
+            {
+                unique_lock<mutex> lock(group.doneMutex);
+                group.done.wait_for(lock, chrono::milliseconds(1), [&group]() { return group.pendingTasks == 0; });
+            }
+        }
+
+        //The thread of the last task releases the mutex before the group can be destroyed
+        lock_guard<mutex> lock(group.doneMutex);
+    }
+
+    int numberOfThreads() const
+    {
+        return m_threadLimit;
+    }
+
+    void setThreadLimit(int threadLimit)
+    {
+        {
+            lock_guard<mutex> lock(m_sleepMutex);
+            m_threadLimit = min(max(threadLimit, 1), (int) m_threads.size());
+        }
+
+        m_taskAvailable.notify_all();
+    }
+
+private:
+    int ownQueue() const
+    {
+        return currentQueue >= 0 ? currentQueue : (int) m_queues.size()-1;
+    }
+
+    bool takeTask(Task &task)
+    {
+        int own = ownQueue();
+        int numberOfQueues = m_queues.size();
+
+        //Last task of its own queue first, then the oldest task of the other queues
+        for(int q = 0 ; q<numberOfQueues ; q++)
+        {
+            TaskQueue &queue = *m_queues[(own+q) % numberOfQueues];
+            lock_guard<mutex> lock(queue.queueMutex);
+
+            if(!queue.tasks.empty())
+            {
+                if(q == 0)
+                {
+                    task = queue.tasks.back();
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = queue.tasks.front();
+                    queue.tasks.pop_front();
+                }
+
+                m_queuedTasks--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool runTask()
+    {
+        Task task;
+
+        if(!takeTask(task))
+        {
+            return false;
+        }
+
+        try
+        {
+            task.run();
+        }
+        catch(const exception &error)
+        {
+            cerr << "Task failed : " << error.what() << endl;
+            task.group->failed = true;
+        }
+        catch(...)
+        {
+            task.group->failed = true;
+        }
+
+        TaskGroup &group = *task.group;
+        lock_guard<mutex> lock(group.doneMutex);
+
+        if(--group.pendingTasks == 0)
+        {
+            group.done.notify_all();
+        }
+
+        return true;
+    }
+
+    void runThread(int index)
+    {
+        currentQueue = index;
+
+        for(;;)
+        {
+            if(index < m_threadLimit && runTask())
+            {
+                continue;
+            }
+
+            //The threads above the limit sleep until it is raised
+            unique_lock<mutex> lock(m_sleepMutex);
+            m_taskAvailable.wait(lock, [this, index]() { return m_queuedTasks > 0 && index < m_threadLimit; });
+        }
+    }
+
+    vector<TaskQueue*> m_queues;
+    vector<thread> m_threads;
+
+    mutex m_sleepMutex;
+    condition_variable m_taskAvailable;
+    atomic<int> m_queuedTasks;
+
+    //Number of threads that run tasks (setTaskThreadLimit)
+    atomic<int> m_threadLimit;
+};
+
+/**
+ * Returns the scheduler of the process. Its threads are started at the first call.
+ * @brief taskScheduler
+ * @return
+ */
+static TaskScheduler& taskScheduler()
+{
+    //Never destroyed : the threads wait for tasks until the end of the process
+    static TaskScheduler *scheduler = new TaskScheduler(max((int) thread::hardware_concurrency(), 1));
+
+    return *scheduler;
+}
+
+/**
+ * Adds a stage to the graph. The stage runs once all its dependencies have succeeded.
+ * The dependencies are indices returned by previous calls : the graph has no cycle.
+ * @brief TaskGraph::addTask
+ * @param name name of the stage in the error messages.
+ * @param task returns false if the stage failed.
+ * @param dependencies
+ * @return index of the stage.
+ */
+int TaskGraph::addTask(string name, function<bool()> task, vector<int> dependencies)
+{
+    int index = m_nodes.size();
+
+    TaskNode node;
+    node.name = name;
+    node.task = task;
+
+    for(size_t d = 0 ; d<dependencies.size() ; d++)
+    {
+        if(dependencies[d] < 0 || dependencies[d] >= index)
+        {
+            cerr << "Invalid dependency of the task " << name << " : " << dependencies[d] << endl;
+            continue;
+        }
+
+        node.dependencies.push_back(dependencies[d]);
+        m_nodes[dependencies[d]].successors.push_back(index);
+    }
+
+    m_nodes.push_back(node);
+
+    return index;
+}
+
+/**
+ * Runs the graph and waits for the end of its stages. The stages that depend on a failed stage do not run.
+ * The calling thread runs tasks while it waits.
+ * @brief TaskGraph::run
+ * @return false if a stage failed.
+ */
+bool TaskGraph::run()
+{
+    TaskScheduler &scheduler = taskScheduler();
+    TaskGroup group;
+
+    //Number of dependencies of each stage that are not done yet
+    mutex graphMutex;
+    vector<int> remainingDependencies(m_nodes.size());
+    bool failed = false;
+
+    for(size_t n = 0 ; n<m_nodes.size() ; n++)
+    {
+        remainingDependencies[n] = m_nodes[n].dependencies.size();
+    }
+
+    function<void(int)> start = [&](int node)
+    {
+        scheduler.spawn(group, [&, node]()
+        {
+            bool success = m_nodes[node].task();
+            vector<int> readyNodes;
+
+            {
+                lock_guard<mutex> lock(graphMutex);
+
+                if(!success)
+                {
+                    cerr << "The task " << m_nodes[node].name << " failed" << endl;
+                    failed = true;
+                    return;
+                }
+
+                for(size_t s = 0 ; s<m_nodes[node].successors.size() ; s++)
+                {
+                    int successor = m_nodes[node].successors[s];
+
+                    if(--remainingDependencies[successor] == 0)
+                    {
+                        readyNodes.push_back(successor);
+                    }
+                }
+            }
+
+            //Queued on the queue of this thread : they read the data the stage has just written
+            for(size_t r = 0 ; r<readyNodes.size() ; r++)
+            {
+                start(readyNodes[r]);
+            }
+        });
+    };
+
+    for(size_t n = 0 ; n<m_nodes.size() ; n++)
+    {
+        if(m_nodes[n].dependencies.empty())
+        {
+            start(n);
+        }
+    }
+
+    scheduler.wait(group);
+
+    return !failed && !group.failed;
+}
+
+/**
+ * Runs task(0) ... task(numberOfTasks-1) on the scheduler of the process and waits for them.
+ * The calling thread runs tasks while it waits : it can be called from a task (nested tasks).
+ * @brief runTasks
+ * @param numberOfTasks
+ * @param task
+ * @return false if a task threw an exception.
+ */
+bool runTasks(int numberOfTasks, function<void(int)> task)
+{
+    TaskScheduler &scheduler = taskScheduler();
+    TaskGroup group;
+
+    for(int t = 0 ; t<numberOfTasks ; t++)
+    {
+        scheduler.spawn(group, [&task, t]() { task(t); });
+    }
+
+    scheduler.wait(group);
+
+    return !group.failed;
+}
+
+/**
+ * Returns the number of threads of the scheduler of the process that run tasks (one per core by default).
+ * @brief numberOfTaskThreads
+ * @return
+ */
+int numberOfTaskThreads()
+{
+    return taskScheduler().numberOfThreads();
+}
+
+/**
+ * Limits the number of threads of the scheduler that run tasks, between 1 and one per core.
+ * The other threads sleep until the limit is raised. The threads that wait for tasks still run tasks meanwhile.
+ * @brief setTaskThreadLimit
+ * @param numberOfThreads
+ */
+void setTaskThreadLimit(int numberOfThreads)
+{
+    taskScheduler().setThreadLimit(numberOfThreads);
+}
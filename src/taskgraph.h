@@ -0,0 +1,123 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file taskgraph.h
+ * \brief Implementation of the task graph of the computation and of its work stealing scheduler.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * The stages of a computation are the nodes of a TaskGraph : a stage starts as soon as the stages it depends on are done,
+ * so the independent stages (e.g. the loading of the parallel and cross polarised gradients, or the separation,
+ * the normals and the roughness once the gradients are scaled) run at the same time.
+ *
+ * The tasks are run by a scheduler shared by the process, with one thread per core. Each thread has its own queue :
+ * it runs the last task it queued first (the data of the task is still in its cache) and takes the oldest tasks
+ * of the other queues when its queue is empty (work stealing). A task can queue tasks itself (runTasks) : the stages
+ * split their work into tasks of the same scheduler, and the thread that waits for them runs tasks meanwhile.
+ * The images inside a task are still processed in parallel by OpenCV (parallel_for_).
+ */
+
+#ifndef TASKGRAPH
+#define TASKGRAPH
+
+/*---- Standard library ----*/
+#include <string>
+#include <vector>
+#include <functional>
+
+/**
+ * Node of a task graph.
+ * @brief The TaskNode struct
+ */
+struct TaskNode
+{
+    std::string name;
+    std::function<bool()> task;
+    std::vector<int> dependencies;
+    std::vector<int> successors;
+};
+
+/**
+ * Graph of the stages of a computation, run on the scheduler of the process.
+ * @brief The TaskGraph class
+ */
+class TaskGraph
+{
+public:
+    /**
+     * Adds a stage to the graph. The stage runs once all its dependencies have succeeded.
+     * The dependencies are indices returned by previous calls : the graph has no cycle.
+     * @brief addTask
+     * @param name name of the stage in the error messages.
+     * @param task returns false if the stage failed.
+     * @param dependencies
+     * @return index of the stage.
+     */
+    int addTask(std::string name, std::function<bool()> task, std::vector<int> dependencies = std::vector<int>());
+
+    /**
+     * Runs the graph and waits for the end of its stages. The stages that depend on a failed stage do not run.
+     * The calling thread runs tasks while it waits.
+     * @brief run
+     * @return false if a stage failed.
+     */
+    bool run();
+
+private:
+    std::vector<TaskNode> m_nodes;
+};
+
+/**
+ * Runs task(0) ... task(numberOfTasks-1) on the scheduler of the process and waits for them.
+ * The calling thread runs tasks while it waits : it can be called from a task (nested tasks).
+ * @brief runTasks
+ * @param numberOfTasks
+ * @param task
+ * @return false if a task threw an exception.
+ */
+bool runTasks(int numberOfTasks, std::function<void(int)> task);
+
+/**
+ * Returns the number of threads of the scheduler of the process that run tasks (one per core by default).
+ * @brief numberOfTaskThreads
+ * @return
+ */
+int numberOfTaskThreads();
+
+/**
+ * Limits the number of threads of the scheduler that run tasks, between 1 and one per core.
+ * The other threads sleep until the limit is raised. The threads that wait for tasks still run tasks meanwhile.
+ * @brief setTaskThreadLimit
+ * @param numberOfThreads
+ */
+void setTaskThreadLimit(int numberOfThreads);
+
+#endif // TASKGRAPH
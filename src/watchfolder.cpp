@@ -0,0 +1,561 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file watchfolder.cpp
+ * \brief Implementation of the watch folder mode.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * Implementation of the watch folder mode.
+ */
+
+#include "watchfolder.h"
+#include "capturetile.h"
+#include "multishot.h"
+#include "memoryplanner.h"
+#include "imageprocessing.h"
+
+/*---- Standard library ----*/
+#include <iostream>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/*---- POSIX ----*/
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+
+using namespace std;
+using namespace cv;
+
+//Events of the watched folders : files fully written, files and folders moved in, folders created
+#define WATCH_FOLDER_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+/**
+ * A capture folder whose files are landing.
+ */
+struct WatchedCapture
+{
+    string pathToFolder;
+
+    //Files of the capture (see shotFilePath) and files already landed
+    set<string> expectedFiles;
+    set<string> landedFiles;
+
+    //Size of the first decoded frame, (0,0) before
+    Size imageSize;
+
+    //Watches of the capture folder and of its par and cross folders
+    vector<int> watches;
+
+    chrono::steady_clock::time_point lastFileTime;
+    bool failed;
+};
+
+/**
+ * A complete capture waiting to be computed.
+ */
+struct WatchedJob
+{
+    string pathToFolder;
+    chrono::steady_clock::time_point lastFileTime;
+};
+
+/**
+ * State shared by the watcher and the computation thread.
+ */
+struct WatcherState
+{
+    mutex stateMutex;
+    condition_variable jobAvailable;
+
+    deque<WatchedJob> queue;
+    bool stopping;
+
+    bool isCrossData;
+    size_t memoryBudget;
+};
+
+/**
+ * Folders watched by the watcher.
+ */
+struct WatchedFolders
+{
+    int inotifyDescriptor;
+    bool isCrossData;
+
+    //Folder and capture of each watch
+    map<int, string> folders;
+    map<int, string> captureOfWatch;
+
+    map<string, WatchedCapture> captures;
+};
+
+/**
+ * Returns the number of milliseconds between two instants.
+ * @brief millisecondsSince
+ * @param start
+ * @return
+ */
+static double millisecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * Computation thread : computes the complete captures until the watcher stops and the queue is empty.
+ * The capture buffers are kept between the captures.
+ * @brief computeWatchedCaptures
+ * @param state
+ */
+static void computeWatchedCaptures(WatcherState *state)
+{
+    CaptureTile capture;
+
+    while(true)
+    {
+        WatchedJob job;
+
+        {
+            unique_lock<mutex> lock(state->stateMutex);
+
+            while(state->queue.empty() && !state->stopping)
+            {
+                state->jobAvailable.wait(lock);
+            }
+
+            if(state->queue.empty())
+            {
+                return;
+            }
+
+            job = state->queue.front();
+            state->queue.pop_front();
+        }
+
+        bool success = false;
+
+        if(state->memoryBudget > 0)
+        {
+            success = computeMapsWithinBudget(job.pathToFolder, state->isCrossData, state->memoryBudget);
+        }
+        else
+        {
+            success = computeCaptureMaps(job.pathToFolder, state->isCrossData, capture);
+        }
+
+        vector<string> failedFiles;
+        success = waitForOutputs(job.pathToFolder, failedFiles) && success;
+
+        if(!failedFiles.empty())
+        {
+            reportFailedOutputs(failedFiles);
+        }
+
+        //Frames that were not read (failed computation)
+        discardPrefetchedImages(job.pathToFolder);
+
+        cout << "Capture " << job.pathToFolder << (success ? " computed " : " failed ") << millisecondsSince(job.lastFileTime)
+             << " ms after its last file" << endl;
+    }
+}
+
+/**
+ * Returns the files of a capture : mask.JPG, checker.txt and the shots of the gradients and of the ambient illumination.
+ * @brief expectedCaptureFiles
+ * @param pathToFolder
+ * @param isCrossData
+ * @return
+ */
+static set<string> expectedCaptureFiles(string pathToFolder, bool isCrossData)
+{
+    set<string> files;
+    files.insert(pathToFolder + "/mask.JPG");
+    files.insert(pathToFolder + "/checker.txt");
+
+    for(int image = 0 ; image<=numberOfGradients() ; image++)
+    {
+        for(int shot = 0 ; shot<numberOfShots() ; shot++)
+        {
+            files.insert(shotFilePath(pathToFolder, "par", PARALLEL_FIRST_IMAGE_NUMBER, image, shot));
+
+            if(isCrossData)
+            {
+                files.insert(shotFilePath(pathToFolder, "cross", CROSS_FIRST_IMAGE_NUMBER, image, shot));
+            }
+        }
+    }
+
+    return files;
+}
+
+/**
+ * Records a file of a capture that is fully written. The images are decoded at once and their size is checked.
+ * @brief landCaptureFile
+ * @param capture
+ * @param filePath
+ */
+static void landCaptureFile(WatchedCapture &capture, string filePath)
+{
+    if(capture.expectedFiles.count(filePath) == 0)
+    {
+        cerr << "Unexpected file in the capture " << capture.pathToFolder << " : " << filePath << endl;
+        return;
+    }
+
+    capture.lastFileTime = chrono::steady_clock::now();
+
+    if(filePath.compare(filePath.size()-4, 4, ".JPG") == 0)
+    {
+        Size imageSize;
+
+        //Not landed : the file may be written again
+        if(!prefetchImageFile(filePath, imageSize))
+        {
+            cerr << "Could not decode " << filePath << endl;
+            return;
+        }
+
+        if(capture.imageSize.area() == 0)
+        {
+            capture.imageSize = imageSize;
+        }
+        else if(imageSize != capture.imageSize)
+        {
+            cerr << "The frame " << filePath << " is " << imageSize.width << "x" << imageSize.height << " instead of "
+                 << capture.imageSize.width << "x" << capture.imageSize.height << " : the capture is dropped" << endl;
+            capture.failed = true;
+            return;
+        }
+    }
+
+    capture.landedFiles.insert(filePath);
+}
+
+static void watchCaptureFolder(WatchedFolders &watched, WatchedCapture &capture, string folder);
+
+/**
+ * Handles a file or a folder that appears in a folder of a capture.
+ * @brief handleCaptureEntry
+ * @param watched
+ * @param capture
+ * @param folder
+ * @param name
+ * @param isDirectory
+ */
+static void handleCaptureEntry(WatchedFolders &watched, WatchedCapture &capture, string folder, string name, bool isDirectory)
+{
+    if(!isDirectory)
+    {
+        landCaptureFile(capture, folder + "/" + name);
+    }
+    else if(folder == capture.pathToFolder && (name == "par" || (name == "cross" && watched.isCrossData)))
+    {
+        watchCaptureFolder(watched, capture, folder + "/" + name);
+    }
+}
+
+/**
+ * Watches a folder of a capture and handles the entries already in it : they may have been created before the watch.
+ * @brief watchCaptureFolder
+ * @param watched
+ * @param capture
+ * @param folder
+ */
+static void watchCaptureFolder(WatchedFolders &watched, WatchedCapture &capture, string folder)
+{
+    int watch = inotify_add_watch(watched.inotifyDescriptor, folder.c_str(), WATCH_FOLDER_EVENTS);
+
+    if(watch < 0)
+    {
+        cerr << "Could not watch " << folder << endl;
+        capture.failed = true;
+        return;
+    }
+
+    watched.folders[watch] = folder;
+    watched.captureOfWatch[watch] = capture.pathToFolder;
+    capture.watches.push_back(watch);
+
+    DIR *directory = opendir(folder.c_str());
+
+    if(directory == NULL)
+    {
+        return;
+    }
+
+    vector<pair<string, bool> > entries;
+    struct dirent *entry = NULL;
+
+    while((entry = readdir(directory)) != NULL)
+    {
+        string name = entry->d_name;
+
+        if(name != "." && name != "..")
+        {
+            entries.push_back(make_pair(name, entry->d_type == DT_DIR));
+        }
+    }
+
+    closedir(directory);
+
+    for(unsigned int i = 0 ; i<entries.size() ; i++)
+    {
+        handleCaptureEntry(watched, capture, folder, entries[i].first, entries[i].second);
+    }
+}
+
+/**
+ * Stops watching a capture. Its prefetched images are released if it is not computed.
+ * @brief releaseCapture
+ * @param watched
+ * @param pathToFolder
+ * @param isComputed
+ */
+static void releaseCapture(WatchedFolders &watched, string pathToFolder, bool isComputed)
+{
+    WatchedCapture &capture = watched.captures[pathToFolder];
+
+    for(unsigned int w = 0 ; w<capture.watches.size() ; w++)
+    {
+        inotify_rm_watch(watched.inotifyDescriptor, capture.watches[w]);
+        watched.folders.erase(capture.watches[w]);
+        watched.captureOfWatch.erase(capture.watches[w]);
+    }
+
+    if(!isComputed)
+    {
+        discardPrefetchedImages(pathToFolder);
+    }
+
+    watched.captures.erase(pathToFolder);
+}
+
+/**
+ * Queues a capture once all its files have landed, drops it if one of its files is not valid.
+ * @brief updateCapture
+ * @param watched
+ * @param state
+ * @param pathToFolder
+ */
+static void updateCapture(WatchedFolders &watched, WatcherState &state, string pathToFolder)
+{
+    WatchedCapture &capture = watched.captures[pathToFolder];
+
+    if(capture.failed)
+    {
+        releaseCapture(watched, pathToFolder, false);
+    }
+    else if(capture.landedFiles.size() == capture.expectedFiles.size())
+    {
+        WatchedJob job;
+        job.pathToFolder = pathToFolder;
+        job.lastFileTime = capture.lastFileTime;
+
+        releaseCapture(watched, pathToFolder, true);
+
+        {
+            lock_guard<mutex> lock(state.stateMutex);
+            state.queue.push_back(job);
+        }
+
+        state.jobAvailable.notify_one();
+    }
+}
+
+/**
+ * Drops the captures that have not received a file for WATCH_CAPTURE_TIMEOUT seconds and lists their missing files.
+ * @brief dropStalledCaptures
+ * @param watched
+ */
+static void dropStalledCaptures(WatchedFolders &watched)
+{
+    vector<string> stalledCaptures;
+
+    for(map<string, WatchedCapture>::iterator capture = watched.captures.begin() ; capture != watched.captures.end() ; capture++)
+    {
+        if(millisecondsSince(capture->second.lastFileTime) > 1000.0*WATCH_CAPTURE_TIMEOUT)
+        {
+            stalledCaptures.push_back(capture->first);
+        }
+    }
+
+    for(unsigned int c = 0 ; c<stalledCaptures.size() ; c++)
+    {
+        const WatchedCapture &capture = watched.captures[stalledCaptures[c]];
+
+        cerr << "No file for " << WATCH_CAPTURE_TIMEOUT << " s in the capture " << capture.pathToFolder << ", dropped. Missing :";
+
+        for(set<string>::const_iterator file = capture.expectedFiles.begin() ; file != capture.expectedFiles.end() ; file++)
+        {
+            if(capture.landedFiles.count(*file) == 0)
+            {
+                cerr << " " << file->substr(capture.pathToFolder.size()+1);
+            }
+        }
+
+        cerr << endl;
+
+        releaseCapture(watched, stalledCaptures[c], false);
+    }
+}
+
+/**
+ * Watches a directory and computes the captures created in it as their frames land.
+ * @brief runWatchFolder
+ * @param watchDirectory
+ * @param isCrossData
+ * @param memoryBudget total memory of the process in bytes, 0 for no budget (see computeMapsWithinBudget).
+ * @return false if the directory could not be watched.
+ */
+bool runWatchFolder(string watchDirectory, bool isCrossData, size_t memoryBudget)
+{
+    WatchedFolders watched;
+    watched.isCrossData = isCrossData;
+    watched.inotifyDescriptor = inotify_init();
+
+    int rootWatch = watched.inotifyDescriptor < 0 ? -1 :
+                    inotify_add_watch(watched.inotifyDescriptor, watchDirectory.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_DELETE_SELF | IN_MOVE_SELF);
+
+    if(rootWatch < 0)
+    {
+        cerr << "Could not watch the directory : " << watchDirectory << endl;
+
+        if(watched.inotifyDescriptor >= 0)
+        {
+            close(watched.inotifyDescriptor);
+        }
+
+        return false;
+    }
+
+    //Build the lookup tables before the first capture
+    gammaLookupTable(1.0);
+    gammaLookupTable(2.2);
+
+    WatcherState state;
+    state.stopping = false;
+    state.isCrossData = isCrossData;
+    state.memoryBudget = memoryBudget;
+
+    thread computationThread(computeWatchedCaptures, &state);
+
+    cout << "Watching " << watchDirectory << " for captures" << endl;
+
+    bool stopping = false;
+
+    //Events are aligned as inotify_event
+    alignas(inotify_event) char events[64*1024];
+
+    while(!stopping)
+    {
+        pollfd watchPoll;
+        watchPoll.fd = watched.inotifyDescriptor;
+        watchPoll.events = POLLIN;
+
+        //Wake up every second to drop the stalled captures
+        if(poll(&watchPoll, 1, 1000) > 0)
+        {
+            ssize_t length = read(watched.inotifyDescriptor, events, sizeof(events));
+
+            for(ssize_t offset = 0 ; offset < length ; )
+            {
+                const inotify_event *event = (const inotify_event*) (events+offset);
+                offset += sizeof(inotify_event)+event->len;
+
+                string name = event->len > 0 ? string(event->name) : string();
+                bool isDirectory = (event->mask & IN_ISDIR) != 0;
+
+                if(event->wd == rootWatch)
+                {
+                    if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                    {
+                        stopping = true;
+                    }
+                    else if(isDirectory && watched.captures.count(watchDirectory + "/" + name) == 0)
+                    {
+                        string pathToFolder = watchDirectory + "/" + name;
+
+                        WatchedCapture &capture = watched.captures[pathToFolder];
+                        capture.pathToFolder = pathToFolder;
+                        capture.expectedFiles = expectedCaptureFiles(pathToFolder, isCrossData);
+                        capture.imageSize = Size(0, 0);
+                        capture.lastFileTime = chrono::steady_clock::now();
+                        capture.failed = false;
+
+                        watchCaptureFolder(watched, capture, pathToFolder);
+                        updateCapture(watched, state, pathToFolder);
+                    }
+
+                    continue;
+                }
+
+                //Files created but not written yet and watches already removed
+                if(watched.captureOfWatch.count(event->wd) == 0 || ((event->mask & IN_CREATE) && !isDirectory) || name.empty())
+                {
+                    continue;
+                }
+
+                string pathToFolder = watched.captureOfWatch[event->wd];
+
+                handleCaptureEntry(watched, watched.captures[pathToFolder], watched.folders[event->wd], name, isDirectory);
+                updateCapture(watched, state, pathToFolder);
+            }
+        }
+
+        dropStalledCaptures(watched);
+    }
+
+    //The incomplete captures are not computed
+    while(!watched.captures.empty())
+    {
+        releaseCapture(watched, watched.captures.begin()->first, false);
+    }
+
+    close(watched.inotifyDescriptor);
+
+    {
+        lock_guard<mutex> lock(state.stateMutex);
+        state.stopping = true;
+    }
+
+    state.jobAvailable.notify_all();
+    computationThread.join();
+
+    return true;
+}
@@ -0,0 +1,71 @@
+/*
+ *     Reflectance Maps
+ *
+ *     Authors:  Antoine TOISOUL LE CANN
+ *
+ *     Copyright © 2016 Antoine TOISOUL LE CANN
+ *              All rights reserved
+ *
+ *
+ * Reflectance Maps is free software: you can redistribute it and/or modify
+ *
+ * it under the terms of the GNU Lesser General Public License as published by
+ *
+ * the Free Software Foundation, either version 3 of the License, or
+ *
+ * (at your option) any later version.
+ *
+ * Reflectance Maps is distributed in the hope that it will be useful,
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file watchfolder.h
+ * \brief Implementation of the watch folder mode.
+ * \author Antoine Toisoul Le Cann
+ * \date October, 18th, 2026
+ *
+ * In watch folder mode the program watches a directory (inotify) in which the tethered camera creates the capture folders.
+ * Each new folder is expected to receive the frames of a capture (par, cross, mask.JPG and checker.txt, the names
+ * given by the number of shots, see shotFilePath). A frame is decoded as soon as it is fully written (closed or
+ * renamed into the folder) and its decoded image is kept until the capture is computed (see prefetchImageFile),
+ * so that the decoding overlaps the acquisition. The capture is computed by a separate thread as soon as its last
+ * file lands, while the frames of the next capture are decoded.
+ *
+ * The frames are validated when they land : unexpected names and frames whose size differs from the first frame
+ * of the capture are reported, the latter drop the capture. A capture that receives no file for WATCH_CAPTURE_TIMEOUT
+ * seconds is dropped and its missing files are listed.
+ * The folders that exist when the watcher starts are ignored. The watcher stops once the watched directory
+ * is removed or renamed, after the queued captures are computed.
+ */
+
+#ifndef WATCHFOLDER
+#define WATCHFOLDER
+
+/*---- Standard library ----*/
+#include <string>
+#include <cstddef>
+
+//Seconds without a new file after which an incomplete capture is dropped
+#define WATCH_CAPTURE_TIMEOUT 300
+
+/**
+ * Watches a directory and computes the captures created in it as their frames land.
+ * @brief runWatchFolder
+ * @param watchDirectory
+ * @param isCrossData
+ * @param memoryBudget total memory of the process in bytes, 0 for no budget (see computeMapsWithinBudget).
+ * @return false if the directory could not be watched.
+ */
+bool runWatchFolder(std::string watchDirectory, bool isCrossData, size_t memoryBudget);
+
+#endif // WATCHFOLDER